@@ -0,0 +1,69 @@
+#!/bin/sh
+# Time bdinfo on synthetic Blu-rays of increasing size and print one JSON
+# object per measurement, e.g.
+#   {"playlists":100,"operation":"info","runs":5,"min":0.0123,"median":0.0131}
+# Only the time is measured, check.sh compares the outputs of the same
+# operations with and without the native parser and the title cache.
+#
+# Usage: bench.sh BDINFO GEN-BDMV
+#
+# Environment:
+#   BENCH_SIZES      numbers of playlists (default "10 100 1000 5000")
+#   BENCH_RUNS       runs per measurement (default 5)
+#   BENCH_GEN_FLAGS  additional options of GEN-BDMV, e.g. "-a 3 -k 40"
+#   BENCH_FLAGS      additional options of BDINFO, e.g. "--no-native"
+
+set -eu
+
+if [ $# -ne 2 ]; then
+	echo "Usage: $0 BDINFO GEN-BDMV" >&2
+	exit 1
+fi
+bdinfo=$1
+gen=$2
+sizes=${BENCH_SIZES:-10 100 1000 5000}
+runs=${BENCH_RUNS:-5}
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/bdinfo-bench.XXXXXX")
+trap 'rm -rf "$tmp"' EXIT INT TERM
+
+now() {
+	date +%s%N
+}
+
+# measure SIZE OPERATION BDINFO-ARGS...
+measure() {
+	size=$1
+	op=$2
+	shift 2
+	times=
+	i=0
+	while [ "$i" -lt "$runs" ]; do
+		start=$(now)
+		# shellcheck disable=SC2086
+		if ! "$bdinfo" --no-cache ${BENCH_FLAGS:-} "$@" > /dev/null; then
+			echo "$0: $bdinfo $* failed" >&2
+			exit 1
+		fi
+		end=$(now)
+		times="$times $((end - start))"
+		i=$((i + 1))
+	done
+	printf '%s\n' $times | sort -n | awk -v size="$size" -v op="$op" '
+		{ t[NR] = $1 }
+		END {
+			printf "{\"playlists\":%d,\"operation\":\"%s\",\"runs\":%d,\"min\":%.6f,\"median\":%.6f}\n",
+				size, op, NR, t[1] / 1e9, t[int((NR + 1) / 2)] / 1e9
+		}'
+}
+
+for size in $sizes; do
+	disc="$tmp/$size"
+	# shellcheck disable=SC2086
+	"$gen" -p "$size" ${BENCH_GEN_FLAGS:-} "$disc"
+	measure "$size" list     "$disc"
+	measure "$size" info     -i "$disc"
+	measure "$size" chapters -c -p 1 "$disc"
+	measure "$size" ffmpeg   -f "$disc" "$tmp/%p.mkv"
+	rm -rf "$disc"
+done
@@ -0,0 +1,81 @@
+#!/bin/sh
+# Check bdinfo on synthetic Blu-rays of several shapes: the natively parsed
+# titles of every playlist have to equal the titles read by libbluray, and the
+# operations timed by bench.sh have to print the same with the native parser
+# and the title cache, cold and warm, as with libbluray alone.
+#
+# Usage: check.sh BDINFO GEN-BDMV
+#
+# Environment:
+#   CHECK_FLAGS  additional options of BDINFO
+
+set -eu
+
+if [ $# -ne 2 ]; then
+	echo "Usage: $0 BDINFO GEN-BDMV" >&2
+	exit 1
+fi
+bdinfo=$1
+gen=$2
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/bdinfo-check.XXXXXX")
+trap 'rm -rf "$tmp"' EXIT INT TERM
+# the title cache of the user is neither read nor written
+XDG_CACHE_HOME="$tmp/cache"
+export XDG_CACHE_HOME
+
+failed=0
+
+# run OUTPUT BDINFO-ARGS...
+run() {
+	out=$1
+	shift
+	# shellcheck disable=SC2086
+	"$bdinfo" ${CHECK_FLAGS:-} "$@" > "$out"
+}
+
+# compare NAME OPERATION BDINFO-ARGS...
+compare() {
+	name=$1
+	op=$2
+	shift 2
+	rm -rf "$XDG_CACHE_HOME"
+	if ! run "$tmp/reference" --no-native --no-cache "$@" \
+			|| ! run "$tmp/cold" "$@" || ! run "$tmp/warm" "$@"; then
+		echo "FAIL $name $op"
+		failed=1
+	elif ! cmp -s "$tmp/reference" "$tmp/cold" || ! cmp -s "$tmp/reference" "$tmp/warm"; then
+		echo "FAIL $name $op: output differs from --no-native --no-cache"
+		failed=1
+	else
+		echo "ok   $name $op"
+	fi
+}
+
+# check NAME GEN-BDMV-ARGS...
+check() {
+	name=$1
+	shift
+	disc="$tmp/$name"
+	"$gen" "$@" "$disc"
+	if run /dev/null --check-native -a -t 0 -i "$disc"; then
+		echo "ok   $name check-native"
+	else
+		echo "FAIL $name check-native"
+		failed=1
+	fi
+	compare "$name" list     "$disc"
+	compare "$name" info     -i "$disc"
+	compare "$name" chapters -c -p 1 "$disc"
+	compare "$name" ffmpeg   -f "$disc" "$tmp/%p.mkv"
+	rm -rf "$disc"
+}
+
+check default
+check shared   -p 20 -u 7
+check angles   -p 5 -a 3
+check streams  -p 5 -A 8 -s 8 -k 1
+check long     -p 3 -c 200 -d 3
+check many     -p 999 -c 1 -k 2
+
+exit "$failed"
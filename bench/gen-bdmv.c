@@ -0,0 +1,654 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Write a synthetic Blu-ray directory with index.bdmv, MovieObject.bdmv, and
+ * configurable numbers of playlists, clips, chapters, angles, and streams.
+ * The M2TS files are sparse, so even large corpora only cost inodes.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/util.h"
+
+/** index.bdmv cannot hold more titles */
+#define MAX_TITLES 999
+#define MAX_CLIPS  100000
+
+struct corpus {
+	const char   *root;
+	unsigned long playlists;
+	unsigned long clips;     /**< play items per playlist */
+	unsigned long numclips;  /**< distinct clips shared by all playlists */
+	unsigned long chapters;
+	unsigned long angles;
+	unsigned long audio;
+	unsigned long subtitles;
+	unsigned long duration;  /**< of every play item in seconds */
+	unsigned long size;      /**< of every M2TS file in bytes */
+};
+
+struct writer {
+	struct buffer buf;
+	int           err;
+};
+
+static const char *const languages[] = {"eng", "ger", "fre", "spa", "ita", "jpn", "chi", "kor"};
+#define NUMLANGUAGES (sizeof(languages) / sizeof(*languages))
+
+static void put(struct writer *w, const void *data, size_t n)
+{
+	if(!w->err && buffer_append(&w->buf, data, n) < 0)
+		w->err = -1;
+}
+
+static void put_be(struct writer *w, uint32_t x, size_t n)
+{
+	uint8_t b[4];
+	for(size_t i = 0; i < n; i++)
+		b[i] = x >> 8 * (n - 1 - i);
+	put(w, b, n);
+}
+
+static void put8(struct writer *w, uint8_t x)   { put_be(w, x, 1); }
+static void put16(struct writer *w, uint16_t x) { put_be(w, x, 2); }
+static void put32(struct writer *w, uint32_t x) { put_be(w, x, 4); }
+
+static void put_zero(struct writer *w, size_t n)
+{
+	while(n-- > 0)
+		put8(w, 0);
+}
+
+/**
+ * Overwrite the 16 bit value at *pos* with *x*.
+ */
+static void patch16(struct writer *w, size_t pos, uint16_t x)
+{
+	if(w->err)
+		return;
+	w->buf.data[pos]     = x >> 8;
+	w->buf.data[pos + 1] = x;
+}
+
+/**
+ * Overwrite the 32 bit value at *pos* with *x*.
+ */
+static void patch32(struct writer *w, size_t pos, uint32_t x)
+{
+	if(w->err)
+		return;
+	for(size_t i = 0; i < 4; i++)
+		w->buf.data[pos + i] = x >> 8 * (3 - i);
+}
+
+/**
+ * Start a block with a 32 bit length field. Returns the position to pass to
+ * end_block.
+ */
+static size_t begin_block(struct writer *w)
+{
+	size_t pos = w->buf.size;
+	put32(w, 0);
+	return pos;
+}
+
+static void end_block(struct writer *w, size_t pos)
+{
+	patch32(w, pos, w->buf.size - pos - 4);
+}
+
+/**
+ * Write the content of *w* to the file *name* below *root* and reset *w*.
+ */
+static int write_file(struct writer *w, const char *root, const char *name)
+{
+	char path[PATH_MAX];
+	if(w->err)
+		return -1;
+	if(snprintf(path, sizeof(path), "%s/BDMV/%s", root, name) >= (int)sizeof(path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+		return -1;
+	int err = 0;
+	for(size_t off = 0; off < w->buf.size;)
+	{
+		ssize_t n = write(fd, w->buf.data + off, w->buf.size - off);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			err = -1;
+			break;
+		}
+		off += n;
+	}
+	int errnum = errno;
+	if(close(fd) < 0 && !err)
+		return -1;
+	errno = errnum;
+	w->buf.size = 0;
+	return err;
+}
+
+static uint32_t clip_duration(const struct corpus *c)
+{
+	return c->duration * 45000;
+}
+
+/**
+ * Clip of play item *item* or of its angle *angle* in *playlist*.
+ */
+static unsigned long clip_of(const struct corpus *c, unsigned long playlist,
+		unsigned long item, unsigned long angle)
+{
+	return ((playlist * c->clips + item) * c->angles + angle) % c->numclips;
+}
+
+static void put_index(struct writer *w, const struct corpus *c)
+{
+	put(w, "INDX0200", 8);
+	put32(w, 78); // indexes start
+	put32(w, 0);  // extension data start
+	put_zero(w, 24);
+
+	// AppInfoBDMV
+	put32(w, 34);
+	put_zero(w, 34);
+
+	size_t len = begin_block(w);
+	// first playback and top menu run movie object 0
+	for(int i = 0; i < 2; i++)
+	{
+		put32(w, 1u << 30); // HDMV object
+		put32(w, 0);        // movie playback, movie object 0
+		put32(w, 0);
+	}
+	unsigned long numtitles = c->playlists < MAX_TITLES ? c->playlists : MAX_TITLES;
+	put16(w, numtitles);
+	for(unsigned long i = 0; i < numtitles; i++)
+	{
+		put32(w, 1u << 30); // HDMV object, access type 0
+		put32(w, i);        // movie playback of movie object i
+		put32(w, 0);
+	}
+	end_block(w, len);
+}
+
+static void put_movie_objects(struct writer *w, const struct corpus *c)
+{
+	put(w, "MOBJ0200", 8);
+	put32(w, 0); // extension data start
+	put_zero(w, 28);
+
+	size_t len = begin_block(w);
+	put32(w, 0);
+	unsigned long numobjects = c->playlists < MAX_TITLES ? c->playlists : MAX_TITLES;
+	put16(w, numobjects);
+	for(unsigned long i = 0; i < numobjects; i++)
+	{
+		put16(w, 0x8000); // resume intention
+		put16(w, 1);      // number of commands
+		put32(w, 0x22800000); // PlayPL with immediate operand
+		put32(w, i);
+		put32(w, 0);
+	}
+	end_block(w, len);
+}
+
+static void put_stream_entry(struct writer *w, uint16_t pid)
+{
+	put8(w, 9);
+	put8(w, 1); // stream of the play item's clip
+	put16(w, pid);
+	put_zero(w, 6);
+}
+
+static void put_stream_attributes(struct writer *w, uint8_t coding_type, uint8_t format,
+		const char *lang)
+{
+	put8(w, 5);
+	put8(w, coding_type);
+	if(format)
+		put8(w, format);
+	if(lang)
+		put(w, lang, 3);
+	put_zero(w, format && lang ? 0 : lang ? 1 : 3);
+}
+
+static void put_stn(struct writer *w, const struct corpus *c)
+{
+	size_t start = w->buf.size;
+	put16(w, 0);
+	put16(w, 0);
+	put8(w, 1);
+	put8(w, c->audio);
+	put8(w, c->subtitles);
+	put_zero(w, 4 + 5);
+
+	put_stream_entry(w, 0x1011);
+	put_stream_attributes(w, 0x1b, 0x61, NULL); // H.264 1080p 23.976
+	for(unsigned long i = 0; i < c->audio; i++)
+	{
+		put_stream_entry(w, 0x1100 + i);
+		put_stream_attributes(w, i % 2 ? 0x81 : 0x83, 0x31, languages[i % NUMLANGUAGES]);
+	}
+	for(unsigned long i = 0; i < c->subtitles; i++)
+	{
+		put_stream_entry(w, 0x1200 + i);
+		put_stream_attributes(w, 0x90, 0, languages[i % NUMLANGUAGES]);
+	}
+	patch16(w, start, w->buf.size - start - 2);
+}
+
+static void put_play_item(struct writer *w, const struct corpus *c, unsigned long playlist,
+		unsigned long item)
+{
+	char name[24];
+	size_t start = w->buf.size;
+	put16(w, 0);
+	snprintf(name, sizeof(name), "%05lu", clip_of(c, playlist, item, 0));
+	put(w, name, 5);
+	put(w, "M2TS", 4);
+	put16(w, (c->angles > 1 ? 1 << 4 : 0) | (item > 0 ? 5 : 1));
+	put8(w, 0); // STC id
+	put32(w, 0);
+	put32(w, clip_duration(c));
+	put_zero(w, 8); // UO_mask_table
+	put8(w, 0);
+	put8(w, 0);     // still mode
+	put16(w, 0);
+	if(c->angles > 1)
+	{
+		put8(w, c->angles);
+		put8(w, 1); // seamless angle change
+		for(unsigned long i = 1; i < c->angles; i++)
+		{
+			snprintf(name, sizeof(name), "%05lu", clip_of(c, playlist, item, i));
+			put(w, name, 5);
+			put(w, "M2TS", 4);
+			put8(w, 0);
+		}
+	}
+	put_stn(w, c);
+	patch16(w, start, w->buf.size - start - 2);
+}
+
+static void put_playlist(struct writer *w, const struct corpus *c, unsigned long playlist)
+{
+	put(w, "MPLS0200", 8);
+	put32(w, 0); // playlist start
+	put32(w, 0); // mark start
+	put32(w, 0); // extension data start
+	put_zero(w, 20);
+
+	// AppInfoPlayList
+	put32(w, 14);
+	put8(w, 0);
+	put8(w, 1); // sequential playback
+	put16(w, 0);
+	put_zero(w, 8);
+	put16(w, 0x4000); // random access shuffle prohibited
+
+	patch32(w, 8, w->buf.size);
+	size_t len = begin_block(w);
+	put16(w, 0);
+	put16(w, c->clips);
+	put16(w, 0); // sub paths
+	for(unsigned long i = 0; i < c->clips; i++)
+		put_play_item(w, c, playlist, i);
+	end_block(w, len);
+
+	// chapters are spread evenly over the play items
+	patch32(w, 12, w->buf.size);
+	len = begin_block(w);
+	put16(w, c->chapters);
+	uint64_t total = (uint64_t)clip_duration(c) * c->clips;
+	for(unsigned long i = 0; i < c->chapters; i++)
+	{
+		uint64_t t = total * i / c->chapters;
+		put8(w, 0);
+		put8(w, 1); // entry mark
+		put16(w, t / clip_duration(c));
+		put32(w, t % clip_duration(c));
+		put16(w, 0xffff);
+		put32(w, 0);
+	}
+	end_block(w, len);
+}
+
+static void put_clip_info(struct writer *w, const struct corpus *c)
+{
+	uint32_t numpackets = c->size / 192;
+	put(w, "HDMV0200", 8);
+	put32(w, 0); // sequence info start
+	put32(w, 0); // program info start
+	put32(w, 0); // CPI start
+	put32(w, 0); // clip mark start
+	put32(w, 0); // extension data start
+	put_zero(w, 12);
+
+	// ClipInfo
+	size_t len = begin_block(w);
+	put16(w, 0);
+	put8(w, 1); // clip stream type
+	put8(w, 1); // movie application
+	put32(w, 0);
+	put32(w, 48000000 / 8); // TS recording rate
+	put32(w, numpackets);
+	put_zero(w, 128);
+	put16(w, 30); // TS_type_info_block
+	put8(w, 0x80);
+	put(w, "HDMV", 4);
+	put_zero(w, 25);
+	end_block(w, len);
+
+	// SequenceInfo with a single STC sequence covering the clip
+	patch32(w, 8, w->buf.size);
+	len = begin_block(w);
+	put8(w, 0);
+	put8(w, 1);  // ATC sequences
+	put32(w, 0);
+	put8(w, 1);  // STC sequences
+	put8(w, 0);
+	put16(w, 0x1001); // PCR PID
+	put32(w, 0);
+	put32(w, 0);
+	put32(w, clip_duration(c));
+	end_block(w, len);
+
+	// ProgramInfo
+	patch32(w, 12, w->buf.size);
+	len = begin_block(w);
+	put8(w, 0);
+	put8(w, 1);
+	put32(w, 0);
+	put16(w, 0x0100);
+	put8(w, 1 + c->audio + c->subtitles);
+	put8(w, 0);
+	put16(w, 0x1011);
+	put8(w, 5);
+	put8(w, 0x1b);
+	put8(w, 0x61);
+	put8(w, 0x30); // 16:9
+	put_zero(w, 2);
+	for(unsigned long i = 0; i < c->audio; i++)
+	{
+		put16(w, 0x1100 + i);
+		put8(w, 5);
+		put8(w, i % 2 ? 0x81 : 0x83);
+		put8(w, 0x31);
+		put(w, languages[i % NUMLANGUAGES], 3);
+	}
+	for(unsigned long i = 0; i < c->subtitles; i++)
+	{
+		put16(w, 0x1200 + i);
+		put8(w, 5);
+		put8(w, 0x90);
+		put(w, languages[i % NUMLANGUAGES], 3);
+		put8(w, 0);
+	}
+	end_block(w, len);
+
+	// CPI with one entry point per second of the video stream
+	patch32(w, 16, w->buf.size);
+	len = begin_block(w);
+	put16(w, 1); // EP_map
+	uint32_t numfine = c->duration > 0 ? c->duration : 1;
+	put8(w, 0);
+	put8(w, 1);
+	put16(w, 0x1011);
+	size_t counts = w->buf.size;
+	put16(w, 0);
+	put32(w, 0);
+	put32(w, 14); // EP_map_for_one_stream start
+	size_t stream = w->buf.size;
+	put32(w, 0);  // EP_fine_table start
+	uint32_t numcoarse = 0;
+	uint32_t prev      = UINT32_MAX;
+	for(uint32_t i = 0; i < numfine; i++)
+	{
+		// PTS in 90 kHz ticks
+		uint64_t pts = (uint64_t)i * 90000;
+		uint32_t spn = (uint64_t)numpackets * i / numfine;
+		uint32_t key = pts >> 19 << 15 | spn >> 17;
+		if(key == prev)
+			continue;
+		prev = key;
+		put32(w, i << 14 | (pts >> 19 & 0x3fff));
+		put32(w, spn & ~0x1ffffu);
+		numcoarse++;
+	}
+	patch32(w, stream, w->buf.size - stream);
+	for(uint32_t i = 0; i < numfine; i++)
+	{
+		uint64_t pts = (uint64_t)i * 90000;
+		uint32_t spn = (uint64_t)numpackets * i / numfine;
+		put32(w, (pts >> 9 & 0x7ff) << 17 | (spn & 0x1ffff));
+	}
+	patch16(w, counts, 1 << 2 | numcoarse >> 14); // EP_stream_type 1
+	patch32(w, counts + 2, numcoarse << 18 | numfine);
+	end_block(w, len);
+
+	// ClipMark
+	patch32(w, 20, w->buf.size);
+	put32(w, 0);
+}
+
+/**
+ * Create an empty M2TS file of *size* bytes without allocating its blocks.
+ */
+static int create_sparse(const char *root, const char *name, off_t size)
+{
+	char path[PATH_MAX];
+	if(snprintf(path, sizeof(path), "%s/BDMV/%s", root, name) >= (int)sizeof(path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+		return -1;
+	int err = ftruncate(fd, size);
+	int errnum = errno;
+	if(close(fd) < 0 && !err)
+		return -1;
+	errno = errnum;
+	return err;
+}
+
+static int make_dirs(const char *root)
+{
+	static const char *const dirs[] = {"", "/BDMV", "/BDMV/PLAYLIST", "/BDMV/CLIPINF",
+			"/BDMV/STREAM"};
+	char path[PATH_MAX];
+	for(size_t i = 0; i < sizeof(dirs) / sizeof(*dirs); i++)
+	{
+		if(snprintf(path, sizeof(path), "%s%s", root, dirs[i]) >= (int)sizeof(path))
+		{
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		if(mkdir(path, 0755) < 0 && errno != EEXIST)
+			return -1;
+	}
+	return 0;
+}
+
+static int generate(const struct corpus *c)
+{
+	struct writer w = {{NULL, 0, 0}, 0};
+	char name[48];
+	int err = -1;
+	if(make_dirs(c->root) < 0)
+		goto error;
+
+	put_index(&w, c);
+	if(write_file(&w, c->root, "index.bdmv") < 0)
+		goto error;
+	put_movie_objects(&w, c);
+	if(write_file(&w, c->root, "MovieObject.bdmv") < 0)
+		goto error;
+
+	for(unsigned long i = 0; i < c->playlists; i++)
+	{
+		put_playlist(&w, c, i);
+		snprintf(name, sizeof(name), "PLAYLIST/%05lu.mpls", i);
+		if(write_file(&w, c->root, name) < 0)
+			goto error;
+	}
+
+	// every clip has the same content, so the clip information is built once
+	put_clip_info(&w, c);
+	if(w.err)
+		goto error;
+	size_t clpi_size = w.buf.size;
+	for(unsigned long i = 0; i < c->numclips; i++)
+	{
+		w.buf.size = clpi_size;
+		snprintf(name, sizeof(name), "CLIPINF/%05lu.clpi", i);
+		if(write_file(&w, c->root, name) < 0)
+			goto error;
+		snprintf(name, sizeof(name), "STREAM/%05lu.m2ts", i);
+		if(create_sparse(c->root, name, c->size) < 0)
+			goto error;
+	}
+	err = 0;
+
+error:
+	{
+		int errnum = errno;
+		free(w.buf.data);
+		errno = errnum;
+	}
+	return err;
+}
+
+static int parse_count(unsigned long *dst, const char *arg, unsigned long min, unsigned long max)
+{
+	char *end;
+	errno = 0;
+	unsigned long x = strtoul(arg, &end, 10);
+	if(errno || end == arg || *end || x < min || x > max)
+		return -1;
+	*dst = x;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct corpus c = {
+		.root      = NULL,
+		.playlists = 10,
+		.clips     = 3,
+		.numclips  = 0,
+		.chapters  = 16,
+		.angles    = 1,
+		.audio     = 2,
+		.subtitles = 2,
+		.duration  = 600,
+		.size      = 6144
+	};
+
+	static const struct option long_options[] = {
+		{"playlists", required_argument, NULL, 'p'},
+		{"clips",     required_argument, NULL, 'c'},
+		{"distinct",  required_argument, NULL, 'u'},
+		{"chapters",  required_argument, NULL, 'k'},
+		{"angles",    required_argument, NULL, 'a'},
+		{"audio",     required_argument, NULL, 'A'},
+		{"subtitles", required_argument, NULL, 's'},
+		{"duration",  required_argument, NULL, 'd'},
+		{"size",      required_argument, NULL, 'z'},
+		{"help",      no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	for(int opt; (opt = getopt_long(argc, argv, "p:c:u:k:a:A:s:d:z:h", long_options,
+			NULL)) != -1;)
+	{
+		int err = 0;
+		switch(opt)
+		{
+		case 'p': err = parse_count(&c.playlists, optarg, 1, 99999);         break;
+		case 'c': err = parse_count(&c.clips,     optarg, 1, 999);           break;
+		case 'u': err = parse_count(&c.numclips,  optarg, 1, MAX_CLIPS);     break;
+		case 'k': err = parse_count(&c.chapters,  optarg, 0, 999);           break;
+		case 'a': err = parse_count(&c.angles,    optarg, 1, 9);             break;
+		case 'A': err = parse_count(&c.audio,     optarg, 0, 32);            break;
+		case 's': err = parse_count(&c.subtitles, optarg, 0, 32);            break;
+		case 'd': err = parse_count(&c.duration,  optarg, 1, 47000);         break;
+		case 'z': err = parse_count(&c.size,      optarg, 0, ULONG_MAX / 2); break;
+		case 'h':
+			printf("Usage: %s [OPTION]... DIRECTORY\n"
+					"Write a synthetic Blu-ray to DIRECTORY.\n"
+					"\n"
+					"  -p, --playlists=N   number of playlists (default 10)\n"
+					"  -c, --clips=N       play items per playlist (default 3)\n"
+					"  -u, --distinct=N    number of distinct clips, which are shared by the\n"
+					"                      playlists (default one per play item and angle)\n"
+					"  -k, --chapters=N    chapters per playlist (default 16)\n"
+					"  -a, --angles=N      angles per play item (default 1)\n"
+					"  -A, --audio=N       audio streams per play item (default 2)\n"
+					"  -s, --subtitles=N   subtitle streams per play item (default 2)\n"
+					"  -d, --duration=N    seconds per play item (default 600)\n"
+					"  -z, --size=BYTES    size of the sparse M2TS files (default 6144)\n",
+					argv[0]);
+			return 0;
+		default:
+			return 1;
+		}
+		if(err)
+		{
+			fprintf(stderr, "%s: Invalid argument %s\n", argv[0], optarg);
+			return 1;
+		}
+	}
+	if(optind + 1 != argc)
+	{
+		fprintf(stderr, "Usage: %s [OPTION]... DIRECTORY\n", argv[0]);
+		return 1;
+	}
+	c.root = argv[optind];
+	if(c.numclips == 0)
+	{
+		unsigned long long n = (unsigned long long)c.playlists * c.clips * c.angles;
+		c.numclips = n < MAX_CLIPS ? n : MAX_CLIPS;
+	}
+
+	if(generate(&c) < 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", argv[0], c.root, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
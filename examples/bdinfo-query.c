@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Query several Blu-rays at once with libbdinfo, one thread each, and print
+ * the selected titles, their streams, and the calls that remux them. Only the
+ * API of libbdinfo.h is used.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/libbdinfo.h"
+
+struct job {
+	pthread_t                  thread;
+	const char                *src;
+	const struct bdinfo_query *query;
+	struct bdinfo_result      *result;
+	int                        status;
+	int                        errnum;
+};
+
+static void *run_query(void *data)
+{
+	struct job *job = data;
+	job->status = bdinfo_query(job->src, job->query, &job->result);
+	job->errnum = errno;
+	return NULL;
+}
+
+static int print_title(FILE *f, const char *src, const struct bdinfo_title *title)
+{
+	fprintf(f, "%s %05"PRIu32".mpls %"PRIu64" ticks\n", src, title->info->playlist,
+			title->info->duration);
+	for(size_t i = 0; i < title->numstreams; i++)
+	{
+		const struct bdinfo_stream *stream = title->streams + i;
+		fprintf(f, "  stream 0x%04"PRIx16" %s%s%s\n", stream->info->pid,
+				stream->language[0] ? stream->language : "und",
+				stream->flac ? " flac" : "", stream->late ? " late" : "");
+	}
+	if(title->argv)
+	{
+		fputs("  call", f);
+		for(char **arg = title->argv; *arg; arg++)
+			fprintf(f, " %s", *arg);
+		fputc('\n', f);
+	}
+	return ferror(f) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct bdinfo_query query = {
+		.min_duration = 0,
+		.use_cache    = 1
+	};
+	const char *usage = "Usage: %s [-l LANGUAGES] [-m] [-o OUTPUT] [-t THREADS] BLURAY...\n";
+	int opt;
+	while((opt = getopt(argc, argv, "l:mo:t:")) != -1)
+		switch(opt)
+		{
+		case 'l':
+			query.languages = optarg;
+			break;
+		case 'm':
+			query.main_feature = 1;
+			break;
+		case 'o':
+			query.output = optarg;
+			break;
+		case 't':
+			query.numthreads = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, usage, argv[0]);
+			return 2;
+		}
+	if(optind >= argc)
+	{
+		fprintf(stderr, usage, argv[0]);
+		return 2;
+	}
+
+	size_t numjobs = argc - optind;
+	struct job *jobs = calloc(numjobs, sizeof(*jobs));
+	if(!jobs)
+	{
+		perror(argv[0]);
+		return 1;
+	}
+	size_t started = 0;
+	for(; started < numjobs; started++)
+	{
+		jobs[started].src   = argv[optind + started];
+		jobs[started].query = &query;
+		if((errno = pthread_create(&jobs[started].thread, NULL, run_query, jobs + started)))
+		{
+			perror(argv[0]);
+			break;
+		}
+	}
+
+	int status = started < numjobs;
+	for(size_t i = 0; i < started; i++)
+	{
+		struct job *job = jobs + i;
+		pthread_join(job->thread, NULL);
+		if(job->status < 0)
+		{
+			fprintf(stderr, "%s: %s: %s\n", argv[0], job->src, job->status == -2
+					? "libbluray failed" : strerror(job->errnum));
+			status = 1;
+			continue;
+		}
+		if(job->result->numties > 0)
+			fprintf(stderr, "%s: %s: main feature ties with %zu other titles\n", argv[0],
+					job->src, job->result->numties);
+		for(size_t j = 0; j < job->result->numtitles; j++)
+			if(print_title(stdout, job->src, job->result->titles + j) < 0)
+				status = 1;
+		bdinfo_free(job->result);
+	}
+	free(jobs);
+	return status;
+}
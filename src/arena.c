@@ -0,0 +1,140 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE 4096
+
+/**
+ * Alignment of every allocation, enough for any type.
+ */
+union arena_align {
+	long double ld;
+	void       *p;
+	uint64_t    u;
+};
+#define ARENA_ALIGN sizeof(union arena_align)
+
+/**
+ * A block of *size* bytes of which the first *used* are allocated. The blocks
+ * of an arena are linked from the newest to the oldest.
+ */
+struct arena_block {
+	struct arena_block *next;
+	size_t              size;
+	size_t              used;
+	union arena_align   data[];
+};
+
+static size_t align_up(size_t n)
+{
+	return (n + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+void arena_init(struct arena *arena)
+{
+	arena->blocks = NULL;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	size = align_up(size > 0 ? size : 1);
+	struct arena_block *block = arena->blocks;
+	if(!block || block->size - block->used < size)
+	{
+		size_t blocksize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+		if(!(block = malloc(sizeof(*block) + blocksize)))
+			return NULL;
+		block->next   = arena->blocks;
+		block->size   = blocksize;
+		block->used   = 0;
+		arena->blocks = block;
+	}
+	void *ptr = (char *)block->data + block->used;
+	block->used += size;
+	return ptr;
+}
+
+void *arena_grow(struct arena *arena, void *ptr, size_t size, size_t newsize)
+{
+	struct arena_block *block = arena->blocks;
+	size_t oldsize = align_up(size > 0 ? size : 1);
+	// the last allocation of the newest block can be extended
+	if(ptr && block && (char *)ptr + oldsize == (char *)block->data + block->used
+			&& block->size - block->used + oldsize >= align_up(newsize))
+	{
+		block->used += align_up(newsize) - oldsize;
+		return ptr;
+	}
+	void *grown = arena_alloc(arena, newsize);
+	if(grown && size > 0)
+		memcpy(grown, ptr, size < newsize ? size : newsize);
+	return grown;
+}
+
+void *arena_memdup(struct arena *arena, const void *src, size_t size)
+{
+	void *dst = arena_alloc(arena, size);
+	if(dst)
+		memcpy(dst, src, size);
+	return dst;
+}
+
+char *arena_strdup(struct arena *arena, const char *s)
+{
+	return arena_memdup(arena, s, strlen(s) + 1);
+}
+
+char *arena_vprintf(struct arena *arena, const char *fmt, va_list ap)
+{
+	va_list ap2;
+	va_copy(ap2, ap);
+	int n = vsnprintf(NULL, 0, fmt, ap2);
+	va_end(ap2);
+	if(n < 0)
+		return NULL;
+	char *s = arena_alloc(arena, n + 1);
+	if(s)
+		vsnprintf(s, n + 1, fmt, ap);
+	return s;
+}
+
+char *arena_printf(struct arena *arena, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	char *s = arena_vprintf(arena, fmt, ap);
+	va_end(ap);
+	return s;
+}
+
+void arena_free(struct arena *arena)
+{
+	while(arena->blocks)
+	{
+		struct arena_block *next = arena->blocks->next;
+		free(arena->blocks);
+		arena->blocks = next;
+	}
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <stdarg.h>
+#include <stddef.h>
+
+struct arena_block;
+
+/**
+ * Memory of one request that is freed at once. Allocations are carved from
+ * blocks that are only returned by arena_free.
+ */
+struct arena {
+	struct arena_block *blocks;
+};
+
+void arena_init(struct arena *arena);
+
+/**
+ * Allocate *size* bytes from *arena*, aligned for any type. Returns NULL with
+ * errno set if no block could be allocated.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * Resize the *size* bytes at *ptr*, allocated from *arena*, to *newsize*
+ * bytes. The last allocation grows in place if its block has room, others are
+ * copied. *ptr* may be NULL if *size* is 0.
+ */
+void *arena_grow(struct arena *arena, void *ptr, size_t size, size_t newsize);
+
+/**
+ * Copy *size* bytes from *src* into *arena*.
+ */
+void *arena_memdup(struct arena *arena, const void *src, size_t size);
+
+char *arena_strdup(struct arena *arena, const char *s);
+
+/**
+ * Format a string into *arena* like vsprintf.
+ */
+char *arena_vprintf(struct arena *arena, const char *fmt, va_list ap);
+
+char *arena_printf(struct arena *arena, const char *fmt, ...);
+
+/**
+ * Free all memory allocated from *arena*, which can be used again afterwards.
+ */
+void arena_free(struct arena *arena);
+
+#endif
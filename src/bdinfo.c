@@ -22,688 +22,2093 @@ along with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <libbluray/bluray.h>
 
+#include "arena.h"
+#include "bdmv.h"
+#include "cache.h"
+#include "calls.h"
+#include "checkpoint.h"
+#include "copy.h"
+#include "demux.h"
+#include "feed.h"
 #include "iso-639-2.h"
+#include "jobs.h"
+#include "output.h"
+#include "plan.h"
+#include "progress.h"
+#include "remux.h"
+#include "scan.h"
+#include "score.h"
+#include "segment.h"
+#include "serve.h"
+#include "source.h"
+#include "stats.h"
+#include "title.h"
+#include "ts.h"
 #include "util.h"
 
-#define ANGLE_WILDCARD ((uint8_t)-1)
-
-
-struct enum_map {
-	int value;
-	const char *name;
-};
-
-static const char *enum_map_search(const struct enum_map *map, int value)
-{
-	for(; map->name != NULL; map++)
-		if(map->value == value)
-			return map->name;
-	return NULL;
-}
-
-static const char *get_stream_type(uint8_t type)
+/**
+ * Select the streams of *plan* that have one of the *numpids* *pids*, or any
+ * PID if there are none, and can be written as elementary streams by
+ * demux_title.
+ *
+ * Returns the number of streams stored in *\*streams*, which has to be freed,
+ * or -1 and sets errno.
+ */
+static ssize_t select_demux_streams(const struct remux_plan *plan, const uint16_t *pids,
+		size_t numpids, struct remux_stream **streams)
 {
-	static const struct enum_map types[] = {
-		{BLURAY_STREAM_TYPE_VIDEO_MPEG1,             "MPEG-1"},
-		{BLURAY_STREAM_TYPE_VIDEO_MPEG2,             "MPEG-2"},
-		{BLURAY_STREAM_TYPE_VIDEO_H264,              "H.264/MPEG-4 AVC"},
-		{BLURAY_STREAM_TYPE_VIDEO_VC1,               "VC-1/SMPTE 421M"},
-		{BLURAY_STREAM_TYPE_AUDIO_MPEG1,             "MPEG-1"},
-		{BLURAY_STREAM_TYPE_AUDIO_MPEG2,             "MPEG-2"},
-		{BLURAY_STREAM_TYPE_AUDIO_LPCM,              "PCM"},
-		{BLURAY_STREAM_TYPE_AUDIO_AC3,               "AC3"},
-		{BLURAY_STREAM_TYPE_AUDIO_DTS,               "DTS"},
-		{BLURAY_STREAM_TYPE_AUDIO_TRUHD,             "TrueHD"},
-		{BLURAY_STREAM_TYPE_AUDIO_AC3PLUS,           "AC3+"},
-		{BLURAY_STREAM_TYPE_AUDIO_AC3PLUS_SECONDARY, "AC3+"},
-		{BLURAY_STREAM_TYPE_AUDIO_DTSHD,             "DTS-HD"},
-		{BLURAY_STREAM_TYPE_AUDIO_DTSHD_SECONDARY,   "DTS-HD"},
-		{BLURAY_STREAM_TYPE_AUDIO_DTSHD_MASTER,      "DTS-HD MA"},
-		{BLURAY_STREAM_TYPE_SUB_PG,                  "HDMV/PGS"},
-		{BLURAY_STREAM_TYPE_SUB_IG,                  "HDMV/IGS"},
-		{BLURAY_STREAM_TYPE_SUB_TEXT,                "HDMV/TEXT"},
-		{0, NULL}
-	};
-	return enum_map_search(types, type);
+	if(!(*streams = malloc((plan->numstreams > 0 ? plan->numstreams : 1) * sizeof(**streams))))
+		return -1;
+	size_t n = 0;
+	for(size_t i = 0; i < plan->numstreams; i++)
+	{
+		const BLURAY_STREAM_INFO *info = plan->streams[i].info;
+		int wanted = numpids == 0;
+		for(size_t j = 0; j < numpids && !wanted; j++)
+			wanted = info->pid == pids[j];
+		if(wanted && demux_extension(info))
+			(*streams)[n++] = plan->streams[i];
+	}
+	return n;
 }
 
-static const char *get_video_format(uint8_t format)
+/**
+ * Render the output of *print* for *data* into an anonymous file, so ffmpeg
+ * can read it as a seekable input without a helper process. The file is a
+ * memfd called *name* or, if that is unavailable, an unlinked file in $TMPDIR.
+ * Returns its file descriptor, which is inherited across exec, or -1 and sets
+ * errno.
+ */
+static int open_rendered(const char *name, int (*print)(FILE *f, const void *data),
+		const void *data)
 {
-	static const struct enum_map formats[] = {
-		{BLURAY_VIDEO_FORMAT_480I,  "480i"},
-		{BLURAY_VIDEO_FORMAT_576I,  "576i"},
-		{BLURAY_VIDEO_FORMAT_480P,  "480p"},
-		{BLURAY_VIDEO_FORMAT_1080I, "1080i"},
-		{BLURAY_VIDEO_FORMAT_720P,  "720p"},
-		{BLURAY_VIDEO_FORMAT_1080P, "1080p"},
-		{BLURAY_VIDEO_FORMAT_576P,  "576p"},
-		{0, NULL}
-	};
-	return enum_map_search(formats, format);
-}
+	int fd = memfd_create(name, 0);
+	if(fd < 0)
+	{
+		if(errno != ENOSYS && errno != EINVAL)
+			return -1;
+		const char *tmpdir = getenv("TMPDIR");
+		char path[PATH_MAX];
+		if(snprintf(path, sizeof(path), "%s/bdinfo-XXXXXX", tmpdir && *tmpdir ? tmpdir : "/tmp")
+				>= (int)sizeof(path))
+		{
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		if((fd = mkstemp(path)) < 0)
+			return -1;
+		unlink(path);
+	}
 
-static const char *get_video_rate(uint8_t rate)
-{
-	static const struct enum_map rates[] = {
-		{BLURAY_VIDEO_RATE_24000_1001, "23.976 fps"},
-		{BLURAY_VIDEO_RATE_24,         "24 fps"},
-		{BLURAY_VIDEO_RATE_25,         "25 fps"},
-		{BLURAY_VIDEO_RATE_30000_1001, "29.97 fps"},
-		{BLURAY_VIDEO_RATE_50,         "50 fps"},
-		{BLURAY_VIDEO_RATE_60000_1001, "59.94 fps"},
-		{0, NULL}
-	};
-	return enum_map_search(rates, rate);
-}
+	int dupfd = dup(fd);
+	FILE *f = dupfd < 0 ? NULL : fdopen(dupfd, "w");
+	if(!f)
+	{
+		if(dupfd >= 0)
+			close(dupfd);
+		goto error;
+	}
+	int err = print(f, data);
+	if(fclose(f) == EOF || err < 0 || lseek(fd, 0, SEEK_SET) < 0)
+		goto error;
+	return fd;
 
-static const char *get_aspect_ratio(uint8_t ratio)
-{
-	static const struct enum_map ratios[] = {
-		{BLURAY_ASPECT_RATIO_4_3,  "4:3"},
-		{BLURAY_ASPECT_RATIO_16_9, "16:9"},
-		{0, NULL}
-	};
-	return enum_map_search(ratios, ratio);
+error:
+	{
+		int errnum = errno;
+		close(fd);
+		errno = errnum;
+	}
+	return -1;
 }
 
-static const char *get_audio_format(uint8_t format)
+static int render_ff_chapters(FILE *f, const void *title)
 {
-	static const struct enum_map formats[] = {
-		{BLURAY_AUDIO_FORMAT_MONO,       "Mono"},
-		{BLURAY_AUDIO_FORMAT_STEREO,     "Stereo"},
-		{BLURAY_AUDIO_FORMAT_MULTI_CHAN, "Multi channel"},
-		{BLURAY_AUDIO_FORMAT_COMBO,      "Combo"},
-		{0, NULL}
-	};
-	return enum_map_search(formats, format);
+	return print_ff_chapters(f, title);
 }
 
-static const char *get_audio_rate(uint8_t rate)
+/**
+ * Render the FFMETADATA chapters of *title* with open_rendered.
+ */
+static int open_ff_chapters(const BLURAY_TITLE_INFO *title)
 {
-	static const struct enum_map rates[] = {
-		{BLURAY_AUDIO_RATE_48,        "48 kHz"},
-		{BLURAY_AUDIO_RATE_96,        "96 kHz"},
-		{BLURAY_AUDIO_RATE_96_COMBO,  "96 kHz"},
-		{BLURAY_AUDIO_RATE_192,       "192 kHz"},
-		{BLURAY_AUDIO_RATE_192_COMBO, "192 kHz"},
-		{0, NULL}
-	};
-	return enum_map_search(rates, rate);
+	return open_rendered("bdinfo-chapters", render_ff_chapters, title);
 }
 
-struct playlist_selector {
-	uint32_t playlist;
-	uint8_t  angle;
-};
-
-#define FATALPUTC(c) \
-		do \
-		{ \
-			if(fputc(c, stdout) == EOF) \
-				return -1; \
-		} \
-		while(0)
-#define FATALPUTS(s) \
-		do \
-		{ \
-			if(fputs(s, stdout) == EOF) \
-				return -1; \
-		} \
-		while(0)
-#define FATALPRINTF(...) \
-		do \
-		{ \
-			if(printf(__VA_ARGS__) < 0) \
-				return -1; \
-		} \
-		while(0)
-
-static int print_stream_extended(const BLURAY_STREAM_INFO *stream)
+/**
+ * Print to *f* the ffmpeg calls, or the mkvmerge calls if *mkvmerge* is set,
+ * that extract the streams of unknown language and of *langs* of *titles* from
+ * *src* to the output template *dst*, chosen from their clips by *layout*.
+ * Chapters are passed to each ffmpeg call as a here-document.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+static int print_remux_calls(FILE *f, BLURAY_TITLE_INFO **titles, size_t numtitles,
+		const struct iso639_set *langs,  const char *src, const char *dst,
+		int transcode, int skip_ig, enum plan_layout layout, int mkvmerge)
 {
-	FATALPRINTF("          - pid:          0x%04"PRIx16"\n", stream->pid);
-	if(stream->lang[0])
-		FATALPRINTF("            language:     %s\n", iso6392_to_bcode((const char *)stream->lang));
-	const char *s;
-	if((s = get_stream_type(stream->coding_type)))
-		FATALPRINTF("            codec:        %s\n", s);
+	for(size_t i = 0; i < numtitles; i++)
+	{
+		BLURAY_TITLE_INFO *title = titles[i];
+		struct remux_plan plan;
+		if(plan_title(&plan, title, langs, transcode, skip_ig, layout) < 0)
+			return -1;
+		struct arena arena;
+		arena_init(&arena);
+		char *output = format_output(dst, title);
+		char **argv = !output ? NULL : mkvmerge
+				? generate_mkvmerge_argv(&arena, &plan, src, output)
+				: generate_ffargv(&arena, &plan, src, -1, output, 0, -1, NULL);
+		free(output);
+		plan_free(&plan);
+		int err = !argv || print_argv(f, argv) < 0;
+		arena_free(&arena);
+		if(err)
+			return -1;
+		if(title->chapter_count > 0 && !mkvmerge)
+			if(fputs(" << EOF\n", f) == EOF
+					|| print_ff_chapters(f, title) < 0
+					|| fputs("EOF", f) == EOF)
+				return -1;
+		if(fputc('\n', f) == EOF)
+			return -1;
+	}
 	return 0;
 }
 
-static int print_video_stream_extended(const BLURAY_STREAM_INFO *stream)
+/**
+ * Print the remux plans of *titles* as by print_remux_calls to *out*.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+static int output_remux_plans(struct output *out, BLURAY_TITLE_INFO **titles, size_t numtitles,
+		const struct iso639_set *langs, const char *src, const char *dst,
+		int transcode, int skip_ig, enum plan_layout layout)
 {
-	if(print_stream_extended(stream) < 0)
-		return -1;
-	const char *s;
-	if((s = get_aspect_ratio(stream->aspect)))
-		FATALPRINTF("            aspect_ratio: %s\n", s);
-	if((s = get_video_format(stream->format)))
-		FATALPRINTF("            resolution:   %s\n", s);
-	if((s = get_video_rate(stream->rate)))
-		FATALPRINTF("            rate:         %s\n", s);
-	return 0;
+	for(size_t i = 0; i < numtitles; i++)
+	{
+		struct remux_plan plan;
+		if(plan_title(&plan, titles[i], langs, transcode, skip_ig, layout) < 0)
+			return -1;
+		char *output = format_output(dst, titles[i]);
+		int err = output ? output_plan(out, &plan, src, output) : -1;
+		free(output);
+		plan_free(&plan);
+		if(err < 0)
+			return -1;
+	}
+	return output_finish(out);
 }
 
-static int print_audio_stream_extended(const BLURAY_STREAM_INFO *stream)
+static void print_diff_streams(FILE *f, const char *verb, const BLURAY_STREAM_INFO **streams,
+		size_t n)
 {
-	if(print_stream_extended(stream) < 0)
-		return -1;
-	const char *s;
-	if((s = get_audio_format(stream->format)) != NULL)
-		FATALPRINTF("            channels:     %s\n", s);
-	if((s = get_audio_rate(stream->rate)) != NULL)
-		FATALPRINTF("            rate:         %s\n", s);
-	return 0;
+	fputs(verb, f);
+	for(size_t i = 0; i < n; i++)
+		fprintf(f, "%s 0x%04"PRIx16" (%s)", i == 0 ? "" : ",", streams[i]->pid,
+				streams[i]->lang[0] ? (const char *)streams[i]->lang : "und");
 }
 
 /**
- * Print stream information for the arrays of streams passed as var-args.
+ * Report every clip of *titles* whose streams differ from those of the first
+ * clip of its title to stderr, skipping interactive graphic streams if
+ * *skip_ig* is set.
  *
- * The var-args are array-pointers followed by a size_t for the number of
- * streams in the array. The var-args are terminated by a NULL array-pointer.
- *
- * *print* is a function that prints stream information. If it is null a
- * comma-separated list of languages of the streams is returned.
+ * Returns the number of titles with such clips or -1 with errno set.
  */
-static int print_streams(int (*print)(const BLURAY_STREAM_INFO *), ...)
+static ssize_t report_clip_layouts(BLURAY_TITLE_INFO *const *titles, size_t numtitles,
+		int skip_ig, const char *argv0)
 {
-	va_list ap;
-	va_start(ap, print);
-	int err = 0;
-	const BLURAY_STREAM_INFO *streams;
-	while((streams = va_arg(ap, void *)))
+	ssize_t n = 0;
+	for(size_t i = 0; i < numtitles; i++)
 	{
-		size_t numstreams = va_arg(ap, size_t);
-		for(size_t i = 0; i < numstreams; i++)
+		const BLURAY_TITLE_INFO *title = titles[i];
+		int differs = 0;
+		for(uint32_t j = 1; j < title->clip_count; j++)
 		{
-			if(!print)
+			struct clip_diff diff;
+			if(plan_diff_clip(title->clips + j, title->clips, skip_ig, &diff) < 0)
+				return -1;
+			if(diff.numadded > 0 || diff.nummissing > 0)
 			{
-				if(printf("%s%s", i == 0 ? "" : ", ", streams[i].lang[0]
-						? iso6392_to_bcode((const char *)streams[i].lang) : "und") < 0)
-					goto err;
+				fprintf(stderr, "%s: %05"PRIu32".mpls: clip %s.m2ts", argv0,
+						title->playlist, title->clips[j].clip_id);
+				if(diff.numadded > 0)
+					print_diff_streams(stderr, " adds", diff.added, diff.numadded);
+				if(diff.nummissing > 0)
+					print_diff_streams(stderr, diff.numadded > 0 ? " and lacks" : " lacks",
+							diff.missing, diff.nummissing);
+				fputc('\n', stderr);
+				differs = 1;
 			}
-			else if(print(streams + i) < 0)
-				goto err;
+			plan_free_diff(&diff);
 		}
-		continue;
-	err:
-		err = -1;
-		break;
+		n += differs;
 	}
-	va_end(ap);
-	if(!err && !print && fputs("]\n", stdout) == EOF)
-		err = -1;
-	return err;
+	return n;
 }
 
 /**
- * Print information for all streams in *clip*. (video_streams,
- * sec_video_streams, audio_streams, sec_audio_streams, pg_streams, and
- * ig_streams)
+ * Parse playlist argument of the format PLAYLIST[:ANGLE]. The playlist number
+ * is returned in *\*pl* and the angle in *\*an*. *\*an* might be -1 if no angle
+ * was given.
  */
-static int print_all_streams(const BLURAY_CLIP_INFO *clip, int extended)
+static int parse_playlist_arg(uint32_t *pl, uint8_t *an, const char *arg)
 {
-	int (*print_video)(const BLURAY_STREAM_INFO *) = extended ? print_video_stream_extended : NULL;
-	int (*print_audio)(const BLURAY_STREAM_INFO *) = extended ? print_audio_stream_extended : NULL;
-	int (*print_subs )(const BLURAY_STREAM_INFO *) = extended ? print_stream_extended       : NULL;
-	int (*print_other)(const BLURAY_STREAM_INFO *) = extended ? print_stream_extended       : NULL;
-	if(clip->video_stream_count == 0 && clip->sec_video_stream_count == 0)
-		print_video = NULL;
-	if(clip->audio_stream_count == 0 && clip->sec_audio_stream_count == 0)
-		print_audio = NULL;
-	if(clip->pg_stream_count == 0)
-		print_subs = NULL;
-	if(clip->ig_stream_count == 0)
-		print_other = NULL;
-
-	FATALPRINTF("    streams:\n        video:%s", print_video ? "\n" : "     [");
-	if(print_streams(print_video, clip->video_streams, clip->video_stream_count,
-			clip->sec_video_streams, clip->sec_video_stream_count, NULL) < 0)
-		return -1;
+	unsigned long l;
+	char *end;
 
-	FATALPRINTF("        audio:%s", extended ? "\n" : "     [");
-	if(print_streams(print_audio, clip->audio_streams, clip->audio_stream_count,
-			clip->sec_audio_streams, clip->sec_audio_stream_count, NULL) < 0)
+	errno = 0;
+	l = strtoul(arg, &end, 0);
+	if(l > UINT32_MAX)
+		l = ULONG_MAX, errno = ERANGE;
+	if(l == ULONG_MAX && errno == ERANGE)
 		return -1;
+	*pl = l;
+	*an = ANGLE_WILDCARD;
 
-	FATALPRINTF("        subtitles:%s", extended ? "\n" : " [");
-	if(print_streams(print_subs, clip->pg_streams, clip->pg_stream_count, NULL) < 0)
+	if(!*end)
+		return 0;
+	else if(*end != ':')
 		return -1;
 
-	FATALPRINTF("        other:%s", extended ? "\n" : "     [");
-	if(print_streams(print_other, clip->ig_streams, clip->ig_stream_count, NULL) < 0)
+	l = strtoul(end + 1, &end, 0);
+	if(l > UINT8_MAX)
+		l = ULONG_MAX, errno = ERANGE;
+	if(l == ULONG_MAX && errno == ERANGE)
 		return -1;
+	*an = l;
 
-	return 0;
+	return *end ? -1 : 0;
 }
 
-static int print_clip(const BLURAY_CLIP_INFO *clip, int extended)
+static void report_unknown_language(const char *lang, size_t len, void *data)
 {
-	FATALPRINTF("  - name: %s%s.m2ts\n", extended ? "    " : "", clip->clip_id);
-	if(extended)
-	{
-		char timebuf[22];
-		FATALPRINTF("    start:    %s\n", ticks2time(timebuf, clip->start_time));
-		FATALPRINTF("    duration: %s\n", ticks2time(timebuf, clip->out_time - clip->in_time));
-		FATALPRINTF("    skip:     %s\n", ticks2time(timebuf, clip->in_time));
-	}
-	if(print_all_streams(clip, extended) < 0)
-		return -1;
+	fprintf(stderr, "%s: Unknown ISO 639-2 language requested: %.*s\n",
+			(const char *)data, (int)len, lang);
+}
 
+/**
+ * Add the known languages of the comma-separated list *arg* to the set
+ * *\*langs*, which is allocated for the first one, with iso639_set_parse.
+ * Unknown languages are reported with *argv0* and skipped.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+static int parse_languages(const char *arg, struct iso639_set **langs, const char *argv0)
+{
+	struct iso639_set *set = *langs ? *langs : calloc(1, sizeof(*set));
+	if(!set)
+		return -1;
+	if(iso639_set_parse(set, arg, report_unknown_language, (void *)argv0) > 0)
+		*langs = set;
+	else if(set != *langs)
+		free(set);
 	return 0;
 }
 
-static int print_clips(const BLURAY_CLIP_INFO *clips, size_t numclips, int extended)
+/**
+ * Parse the comma-separated list *arg* of PIDs and languages of --demux. PIDs
+ * are appended to *\*pids* and languages as by parse_languages.
+ *
+ * Returns 0, -1 with errno set, or -2 if a PID is invalid.
+ */
+static int parse_demux_selection(const char *arg, uint16_t **pids, size_t *numpids,
+		struct iso639_set **langs, const char *argv0)
 {
-	if(numclips == 0)
-		FATALPUTS("clips:    []\n");
-	else
+	char *languages = malloc(strlen(arg) + 1);
+	if(!languages)
+		return -1;
+	languages[0] = '\0';
+	int err = 0;
+	for(const char *item, *next = arg; (item = iter_comma_list(&next, ','));)
 	{
-		if(numclips == 1)
-			FATALPUTS("clips:\n");
-		else
-			FATALPRINTF("clips:    # %zu\n", numclips);
-
-		for(size_t i = 0; i < numclips; i++)
-			if(print_clip(clips + i, extended) < 0)
-				return -1;
+		if(*item < '0' || *item > '9')
+		{
+			strncat(strcat(languages, ","), item, next - item);
+			continue;
+		}
+		char *end;
+		errno = 0;
+		unsigned long pid = strtoul(item, &end, 0);
+		if(pid > 0x1fff || errno == ERANGE || end != next)
+		{
+			fprintf(stderr, "%s: Invalid PID %.*s\n", argv0, (int)(next - item), item);
+			err = -2;
+			goto out;
+		}
+		uint16_t *grown = array_reserve(*pids, *numpids, 1, sizeof(**pids));
+		if(!grown)
+		{
+			err = -1;
+			goto out;
+		}
+		*pids = grown;
+		(*pids)[(*numpids)++] = pid;
 	}
-	return 0;
+	if(languages[0])
+		err = parse_languages(languages, langs, argv0);
+out:
+	free(languages);
+	return err;
 }
 
-static int print_title(const BLURAY_TITLE_INFO *title, int extended)
+/**
+ * Store the angles of *title* selected by the cleaned *playlists* as a bit
+ * mask in *\*angles*, all if its playlist is selected without an angle or not
+ * at all.
+ *
+ * Returns 0 or the lowest selected angle the title does not have + 1.
+ */
+static int select_angles(const BLURAY_TITLE_INFO *title,
+		const struct playlist_selector *playlists, size_t numplaylists, uint16_t *angles)
 {
-	char timebuf[22];
-	FATALPRINTF("---\n"
-			"playlist: %05"PRIu32".mpls\n"
-			"angles:   %"PRIu8"\n"
-			"duration: %s\n"
-			"chapters: %"PRIu32"\n",
-			title->playlist, title->angle_count,
-			ticks2time(timebuf, title->duration), title->chapter_count);
-	return print_clips(title->clips, title->clip_count, extended);
+	unsigned count = title->angle_count < 16 ? title->angle_count : 16;
+	*angles = 0;
+	for(size_t i = 0; i < numplaylists; i++)
+		if(playlists[i].playlist == title->playlist && playlists[i].angle != ANGLE_WILDCARD)
+		{
+			if(playlists[i].angle >= count)
+				return playlists[i].angle + 1;
+			*angles |= 1 << playlists[i].angle;
+		}
+	if(*angles == 0)
+		*angles = (1 << count) - 1;
+	return 0;
 }
 
 /**
- * Print *title* chapters as XML, consumable by mkvmerge.
+ * Print *titles* to *out* and, if *extended* is set, the playlists in *folds*
+ * that were folded into them and their *scores*, if given, followed by the
+ * *runners_up* of the main feature. If *input* is given it is included in
+ * every title.
+ *
+ * Returns 0 or -1 with errno set.
  */
-static int print_xml_chapters(const BLURAY_TITLE_INFO *title)
+static int print_titles(struct output *out, BLURAY_TITLE_INFO **titles, size_t numtitles,
+		const struct title_fold *folds, size_t numfolds, const struct title_score *scores,
+		size_t numties, const struct playlist_score *runners_up, size_t numrunnersup,
+		const struct title_scan *scans, const char *input, int extended)
 {
-	static const char head[] =
-			"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-			"<Chapters>\n"
-			"\t<EditionEntry>\n"
-			"\t\t<EditionFlagHidden>0</EditionFlagHidden>\n"
-			"\t\t<EditionFlagDefault>0</EditionFlagDefault>\n";
-	static const char tail[] =
-			"\t</EditionEntry>\n"
-			"</Chapters>\n";
-
-	const BLURAY_TITLE_CHAPTER *chapters = title->chapters;
-	FATALPUTS(head);
-	for(uint32_t i = 0; i < title->chapter_count; i++)
-	{
-		char timebuf[22];
-		FATALPRINTF("\t\t<ChapterAtom>\n"
-				"\t\t\t<ChapterTimeStart>%s</ChapterTimeStart>\n"
-				"\t\t\t<ChapterFlagHidden>0</ChapterFlagHidden>\n"
-				"\t\t\t<ChapterFlagEnabled>1</ChapterFlagEnabled>\n"
-				"\t\t</ChapterAtom>\n",
-				ticks2time(timebuf, chapters[i].start));
-	}
-	FATALPUTS(tail);
-	return 0;
+	uint32_t *duplicates = malloc(numfolds * sizeof(*duplicates) + 1);
+	if(!duplicates)
+		return -1;
+	int err = 0;
+	for(size_t i = 0, j = 0; i < numtitles && !err; i++)
+	{
+		struct title_extra extra = {
+			.duplicates    = duplicates,
+			.numduplicates = 0,
+			.score         = scores ? scores + i : NULL,
+			.numties       = numties,
+			.runners_up    = runners_up,
+			.numrunnersup  = numrunnersup,
+			.scan          = scans ? scans + i : NULL
+		};
+		// both are sorted by playlist
+		for(; j < numfolds && folds[j].into <= titles[i]->playlist; j++)
+			if(folds[j].into == titles[i]->playlist)
+				duplicates[extra.numduplicates++] = folds[j].playlist;
+		err = output_title(out, titles[i], input, extended ? &extra : NULL, extended);
+	}
+	free(duplicates);
+	return err;
 }
 
 /**
- * Print *title*'s as FFMETADATA1, consumable by ffmpeg.
+ * Test if *path* is the root directory of a Blu-ray.
  */
-static int print_ff_chapters(const BLURAY_TITLE_INFO *title)
+static int is_bluray_root(const char *path)
 {
-	const BLURAY_TITLE_CHAPTER *chapters = title->chapters;
-	FATALPUTS(";FFMETADATA1\n");
-	for(uint32_t i = 0; i < title->chapter_count; i++)
-		FATALPRINTF("[CHAPTER]\n"
-				"TIMEBASE=1/90000\n"
-				"START=%"PRIu64"\n"
-				"END=%"PRIu64"\n",
-				chapters[i].start,
-				chapters[i].start + chapters[i].duration);
-	return 0;
+	static const char index[] = "/BDMV/index.bdmv";
+	char *buf = malloc(strlen(path) + sizeof(index));
+	if(!buf)
+		return 0;
+	int found = access(strcat(strcpy(buf, path), index), F_OK) == 0;
+	free(buf);
+	return found;
 }
 
-#undef FATALPUTC
-#undef FATALPUTS
-#undef FATALPRINTF
+struct batch_inputs {
+	char  **inputs;
+	size_t  numinputs;
+	size_t  numbad;
+};
 
 /**
- * *s* are immediately following nul-terminated strings. An array of pointers to
- * these strings is created and terminated by a NULL pointer.
+ * Add *path* to *in* if it is a Blu-ray root directory or image. Other
+ * directories are searched recursively for Blu-ray root directories and *.iso
+ * files. If *explicit* is not set, symbolic links to directories are not
+ * followed and only files ending in .iso are added.
+ *
+ * Inaccessible paths are reported and counted in *in->numbad*.
  *
- * The returned array may be used as *argv* in a call to execvpe.
+ * Returns 0 on success or -1 on error with errno set.
  */
-static char **argv_from_strs(char *s, size_t n)
+static int find_inputs(struct batch_inputs *in, const char *path, int explicit,
+		const char *argv0)
 {
-	char **argv = NULL;
-	int    argc = 0;
-	while(n > 0)
-	{
-		if(!(argv = array_reserve(argv, argc, 1, sizeof(*argv)))) // FIXME realloc: NULL
-			return NULL;
-		argv[argc++] = s;
-		char *s2 = memchr(s, '\0', n);
-		if(s2)
-			s2++, n -= s2 - s, s = s2;
-		else
-			n = 0;
+	struct stat st;
+	if((explicit ? stat : lstat)(path, &st) < 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", argv0, path, strerror(errno));
+		in->numbad++;
+		return 0;
 	}
-	if(!(argv = array_reserve(argv, argc, 1, sizeof(*argv)))) // FIXME realloc: NULL
-		return NULL;
-	argv[argc] = NULL;
-	return argv;
+	if(S_ISLNK(st.st_mode) && stat(path, &st) < 0)
+		return 0;
+
+	int add;
+	if(S_ISDIR(st.st_mode))
+		add = is_bluray_root(path);
+	else
+	{
+		size_t n = strlen(path);
+		add = explicit || (S_ISREG(st.st_mode) && n > 4
+				&& strcasecmp(path + n - 4, ".iso") == 0);
+	}
+	if(add)
+	{
+		char **grown = array_reserve(in->inputs, in->numinputs, 1, sizeof(*in->inputs));
+		if(!grown)
+			return -1;
+		in->inputs = grown;
+		if(!(in->inputs[in->numinputs] = strdup(path)))
+			return -1;
+		in->numinputs++;
+		return 0;
+	}
+	else if(!S_ISDIR(st.st_mode) || (!explicit && S_ISLNK(st.st_mode)))
+		return 0;
+
+	struct dirent **entries;
+	int n = scandir(path, &entries, NULL, alphasort);
+	if(n < 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", argv0, path, strerror(errno));
+		in->numbad++;
+		return 0;
+	}
+	int err = 0;
+	for(int i = 0; i < n; i++)
+	{
+		const char *name = entries[i]->d_name;
+		if(!err && name[0] != '.')
+		{
+			char *sub = malloc(strlen(path) + strlen(name) + 2);
+			if(!sub)
+				err = -1;
+			else
+			{
+				sprintf(sub, "%s/%s", path, name);
+				err = find_inputs(in, sub, 0, argv0);
+				free(sub);
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return err;
 }
 
-struct strs_builder {
-	char  *buf;
-	size_t len;
-	size_t end;
+struct batch_result {
+	BLURAY_TITLE_INFO    **titles;
+	size_t                 numtitles;
+	struct title_fold     *folds;
+	size_t                 numfolds;
+	struct title_score     score;
+	size_t                 numties;
+	struct playlist_score *runners_up;
+	size_t                 numrunnersup;
+	int                    err;
+	int                    errnum;
+	int                    done;
+};
+
+struct batch_scan {
+	char                          **inputs;
+	size_t                          numinputs;
+	int                             filter_flags;
+	uint32_t                        min_duration;
+	const struct playlist_selector *playlists;
+	size_t                          numplaylists;
+	int                             use_cache;
+	int                             refresh_cache;
+	int                             native;
+	int                             main_feature;
+	struct batch_result            *results;
+	size_t                          next;
+	pthread_mutex_t                 lock;
+	pthread_cond_t                  cond;
 };
 
 /**
- * Append a format string and its arguments to the string builder.
+ * Worker thread of a batch scan. Every worker opens its own BLURAY handle for
+ * each input it claims and publishes the titles found in *scan->results*.
  */
-static char *strs_pushf(struct strs_builder *b, const char *fmt, ...)
+static void *batch_worker(void *data)
 {
-	va_list ap;
-	va_start(ap, fmt);
-	int n;
+	struct batch_scan *scan = data;
 	while(1)
 	{
-		va_list ap2;
-		va_copy(ap2, ap);
-		n = vsnprintf(b->buf + b->end, b->len - b->end, fmt, ap2);
-		va_end(ap2);
-		if(n < 0)
-			return NULL;
-		else if((size_t)n >= b->len - b->end)
-		{
-			if(!(b->buf = array_reserve(b->buf, b->end, n + 1, 1))) // FIXME realloc: NULL
-				return NULL;
-			b->len = b->end + n + 1;
-		}
-		else
+		pthread_mutex_lock(&scan->lock);
+		size_t i = scan->next;
+		if(i < scan->numinputs)
+			scan->next++;
+		pthread_mutex_unlock(&scan->lock);
+		if(i >= scan->numinputs)
 			break;
+
+		struct batch_result r = {
+			.titles       = NULL,
+			.numtitles    = 0,
+			.folds        = NULL,
+			.numfolds     = 0,
+			.runners_up   = NULL,
+			.numrunnersup = 0,
+			.err          = -2,
+			.errnum       = 0,
+			.done         = 1
+		};
+		struct title_source source;
+		// the inputs are already scanned in parallel
+		source_open(&source, scan->inputs[i], scan->use_cache, scan->refresh_cache,
+				scan->native ? 1 : 0, NULL);
+		r.err = get_titles(&source, scan->filter_flags, scan->min_duration,
+				scan->playlists, scan->numplaylists, &r.titles, &r.numtitles,
+				&r.folds, &r.numfolds);
+		if(r.err == 0 && scan->main_feature
+				&& select_main_feature(r.titles, &r.numtitles, 1, &r.score, &r.numties,
+						&r.runners_up, &r.numrunnersup) < 0)
+			r.err = -1;
+		r.errnum = errno;
+		source_close(&source);
+
+		pthread_mutex_lock(&scan->lock);
+		scan->results[i] = r;
+		pthread_cond_broadcast(&scan->cond);
+		pthread_mutex_unlock(&scan->lock);
 	}
-	va_end(ap);
-	char *arg = b->buf + b->end;
-	b->end += n + 1;
-	return arg;
+	return NULL;
 }
 
 /**
- * Generate argv for ffmpeg that remuxes *title* from *src* to *dst*.
- *
- * Only streams of unknown language and of languages in *langs* are mapped.
+ * Scan the inputs of *scan* with up to *numworkers* threads and print their
+ * titles to *out* in input order as soon as they are available. Inputs that
+ * cannot be scanned are reported on stderr.
  *
- * LPCM audio streams are converted to FLAC, if *transcode* is given, DTS-HD MA
- * and Dolby True HD audio streams are also converted to FLAC.
- *
- * Stream languages is set and, if *chapterfd* is given, chapter data is read
- * from this file descriptor.
+ * Returns the number of failed inputs or -1 if printing failed.
  */
-static char **generate_ffargv(const BLURAY_TITLE_INFO *title, char (*langs)[4],
-		size_t numlangs, const char *src, const char *dst, int chapterfd,
-		int transcode, int skip_ig)
+static int batch_print(struct batch_scan *scan, size_t numworkers, struct output *out,
+		int extended, const char *argv0)
 {
-	struct strs_builder b = {
-		.buf = NULL,
-		.len = 0,
-		.end = 0
-	};
-	if(!strs_pushf(&b, "ffmpeg")
-			|| !strs_pushf(&b, "-playlist") || !strs_pushf(&b, "%"PRIu32,   title->playlist)
-//			|| !strs_pushf(&b, "-angle")    || !strs_pushf(&b, "%"PRIu8,    title->angle)
-			|| !strs_pushf(&b, "-i")        || !strs_pushf(&b, "bluray:%s", src))
+	if(numworkers > scan->numinputs)
+		numworkers = scan->numinputs;
+
+	int failed = 0;
+	int err    = 0;
+	pthread_t *workers = calloc(numworkers, sizeof(*workers));
+	if(!(scan->results = calloc(scan->numinputs, sizeof(*scan->results))) || !workers)
+		goto error;
+
+	size_t numstarted = 0;
+	for(; numstarted < numworkers; numstarted++)
+		if((errno = pthread_create(workers + numstarted, NULL, batch_worker, scan)))
+			break;
+	if(numstarted == 0 && scan->numinputs > 0)
 		goto error;
-	if(title->chapter_count > 0)
+
+	size_t i = 0;
+	for(; i < scan->numinputs; i++)
 	{
-		const char *fmt = chapterfd == STDIN_FILENO ? "-" : "/dev/fd/%u";
-		if(!strs_pushf(&b, "-i") || !strs_pushf(&b, fmt, chapterfd))
-			goto error;
+		struct batch_result *r = scan->results + i;
+		pthread_mutex_lock(&scan->lock);
+		while(!r->done)
+			pthread_cond_wait(&scan->cond, &scan->lock);
+		pthread_mutex_unlock(&scan->lock);
+
+		const char *input = scan->inputs[i];
+		if(r->err == -1)
+			fprintf(stderr, "%s: %s: %s\n", argv0, input, strerror(r->errnum));
+		else if(r->err < 0)
+			fprintf(stderr, "%s: Error in %s\n", argv0, input);
+		else if(r->numtitles == 0)
+			fprintf(stderr, "%s: No title selected in %s\n", argv0, input);
+		else
+		{
+			err = print_titles(out, r->titles, r->numtitles, r->folds, r->numfolds,
+					scan->main_feature ? &r->score : NULL, r->numties, r->runners_up,
+					r->numrunnersup, NULL, input, extended);
+			free_titles(r->titles, r->numtitles);
+			free(r->folds);
+			free(r->runners_up);
+			// the results from this one on are freed again if printing failed
+			r->titles       = NULL;
+			r->numtitles    = 0;
+			r->folds        = NULL;
+			r->numfolds     = 0;
+			r->runners_up   = NULL;
+			r->numrunnersup = 0;
+			if(err)
+				break;
+			continue;
+		}
+		failed++;
 	}
 
-	const BLURAY_STREAM_INFO *allstreams[] = {
-		title->clips[0].video_streams,
-		title->clips[0].sec_video_streams,
-		title->clips[0].audio_streams,
-		title->clips[0].sec_audio_streams,
-		title->clips[0].pg_streams,
-		title->clips[0].ig_streams
-	};
-	size_t numallstreams[] = {
-		title->clips[0].video_stream_count,
-		title->clips[0].sec_video_stream_count,
-		title->clips[0].audio_stream_count,
-		title->clips[0].sec_audio_stream_count,
-		title->clips[0].pg_stream_count,
-		skip_ig ? 0 : title->clips[0].ig_stream_count
-	};
-#define ITER_STREAMS(body) \
-		for(size_t _i = 0, streamnum = 0; _i < 6; _i++) \
-			for(size_t _j = 0; _j < numallstreams[_i]; _j++) { \
-				const BLURAY_STREAM_INFO *stream = allstreams[_i] + _j; \
-				const char *lang = stream->lang[0] ? iso6392_to_bcode((const char *)stream->lang) : NULL; \
-				if(langs && stream->lang[0] && !bisect_contains(langs, lang ? lang : "", numlangs, sizeof(*langs), (compar_fn)strcmp)) \
-					continue; \
-				body \
-				streamnum++; \
-			}
+	if(err)
+	{
+		// stop the workers from claiming more inputs
+		int errnum = errno;
+		pthread_mutex_lock(&scan->lock);
+		scan->next = scan->numinputs;
+		pthread_mutex_unlock(&scan->lock);
+		errno = errnum;
+	}
+	for(size_t j = 0; j < numstarted; j++)
+		pthread_join(workers[j], NULL);
+	for(; i < scan->numinputs; i++)
+	{
+		free_titles(scan->results[i].titles, scan->results[i].numtitles);
+		free(scan->results[i].folds);
+		free(scan->results[i].runners_up);
+	}
 
-	ITER_STREAMS(
-		if(!strs_pushf(&b, "-map") || !strs_pushf(&b, "0:i:0x%04"PRIx16, stream->pid))
-			goto error;
-	)
+	if(!err && output_finish(out) < 0)
+		err = -1;
 
-	if(!strs_pushf(&b, "-c") || !strs_pushf(&b, "copy"))
-		goto error;
-	int flac = 0;
-	ITER_STREAMS(
-		if(stream->coding_type == BLURAY_STREAM_TYPE_AUDIO_LPCM || (transcode
-				&& (stream->coding_type == BLURAY_STREAM_TYPE_AUDIO_TRUHD
-						|| stream->coding_type == BLURAY_STREAM_TYPE_AUDIO_DTSHD_MASTER)))
+	if(0)
+	{
+	error:
+		err = -1;
+	}
+	free(workers);
+	free(scan->results);
+	scan->results = NULL;
+	return err ? err : failed;
+}
+
+/**
+ * Compare the natively parsed *titles* with the titles libbluray returns for
+ * the same selection of *src* and report differences on stderr.
+ *
+ * Returns the number of differing titles, -1 on error with errno set or -2 if
+ * libbluray failed.
+ */
+static int check_native(const char *src, int filter_flags, uint32_t min_duration,
+		const struct playlist_selector *playlists, size_t numplaylists,
+		BLURAY_TITLE_INFO **titles, size_t numtitles, const char *argv0)
+{
+	struct title_source source;
+	BLURAY_TITLE_INFO **expected;
+	size_t numexpected;
+	source_open(&source, src, 0, 0, 0, NULL);
+	int err = get_titles(&source, filter_flags, min_duration, playlists, numplaylists,
+			&expected, &numexpected, NULL, NULL);
+	source_close(&source);
+	if(err < 0)
+		return err;
+
+	// both lists are sorted by playlist
+	int numdiffs = 0;
+	for(size_t i = 0, j = 0; i < numtitles || j < numexpected;)
+	{
+		const char *diff;
+		uint32_t playlist;
+		if(j >= numexpected || (i < numtitles && titles[i]->playlist < expected[j]->playlist))
 		{
-			if(!strs_pushf(&b, "-c:%zu", streamnum) || !strs_pushf(&b, "flac"))
-				goto error;
-			flac = 1;
+			diff = "not found by libbluray";
+			playlist = titles[i++]->playlist;
 		}
-	)
-	if(flac)
-		if(!strs_pushf(&b, "-compression_level") || !strs_pushf(&b, "12"))
-			goto error;
+		else if(i >= numtitles || expected[j]->playlist < titles[i]->playlist)
+		{
+			diff = "only found by libbluray";
+			playlist = expected[j++]->playlist;
+		}
+		else
+		{
+			diff = "differs from libbluray";
+			playlist = titles[i]->playlist;
+			if(title_equal(titles[i++], expected[j++]))
+				continue;
+		}
+		fprintf(stderr, "%s: %05"PRIu32".mpls: %s\n", argv0, playlist, diff);
+		numdiffs++;
+	}
+	free_titles(expected, numexpected);
+	return numdiffs;
+}
 
-	ITER_STREAMS(
-		if(lang)
-			if(!strs_pushf(&b, "-metadata:s:%zu", streamnum) || !strs_pushf(&b, "language=%s", lang))
-				goto error;
-	)
+/** milliseconds between checks of the remux progress */
+#define PROGRESS_TICK 1000
+/** ticks between progress reports if stderr is not a terminal */
+#define PROGRESS_LOG_TICKS 10
+/** seconds until a stalled child that ignores SIGTERM is killed */
+#define STALL_KILL_GRACE 10
 
-	if(title->chapter_count > 0)
-		if(!strs_pushf(&b, "-map_chapters") || !strs_pushf(&b, "1"))
-			goto error;
+/**
+ * Supervision state of a remux child. *stalled* is 0, STALL_WARNED after the
+ * stall was reported, STALL_TERMINATED after SIGTERM, or STALL_KILLED after
+ * SIGKILL was sent.
+ */
+struct remux_progress {
+	struct progress progress;
+	enum {
+		STALL_WARNED = 1,
+		STALL_TERMINATED,
+		STALL_KILLED
+	} stalled;
+};
 
-	if(!strs_pushf(&b, "%s", dst))
-		goto error;
+/**
+ * What a child of a remux does with the title with index *title*.
+ */
+enum remux_task_kind {
+	/** remux the whole title */
+	TASK_TITLE,
+	/** remux the *part*-th segment of the title */
+	TASK_SEGMENT,
+	/** join the segments remuxed by the prerequisites */
+	TASK_JOIN,
+	/** split the streams of the title, see generate_demux_ffargv */
+	TASK_DEMUX,
+	/** encode the stream with the number *part* split by the prerequisite */
+	TASK_ENCODE,
+	/** merge the streams split and encoded by the prerequisites */
+	TASK_MUX
+};
 
-	char **argv = argv_from_strs(b.buf, b.end);
-	if(!argv)
-		goto error;
-	return argv;
+/**
+ * A child of a remux writing *output*. It is run once its *numparts*
+ * prerequisites, the tasks starting at *firstpart*, succeeded. A *resumed*
+ * task was completed by an earlier run and is not run again.
+ */
+struct remux_task {
+	enum remux_task_kind  kind;
+	size_t                title;
+	char                 *output;
+	const struct segment *segment;
+	size_t                part;
+	size_t                firstpart;
+	size_t                numparts;
+	int                   resumed;
+};
 
-#undef ITER_STREAMS
+/**
+ * The built-in engines that can handle a title instead of ffmpeg.
+ */
+enum builtin_engine {
+	BUILTIN_NONE,
+	/** remux_title */
+	BUILTIN_REMUX,
+	/** demux_title */
+	BUILTIN_DEMUX,
+	/** remux_angles */
+	BUILTIN_ANGLES
+};
 
-error:
-	// TODO errno
-	free(b.buf);
-	return NULL;
+struct remux_jobs {
+	BLURAY_TITLE_INFO     **titles;
+	char                  **outputs;
+	size_t                  numtitles;
+	/** the remux_plan of each title */
+	const struct remux_plan *plans;
+	const char             *src;
+	/** the builtin_engine of each title */
+	const char             *builtin;
+	/** the angles of each title remuxed by BUILTIN_ANGLES as bit masks */
+	const uint16_t         *angles;
+	/** PIDs demultiplexed by BUILTIN_DEMUX, all if there are none */
+	const uint16_t         *pids;
+	size_t                  numpids;
+	/** segments of each title, NULL if it is not segmented */
+	struct segment        **segments;
+	/**
+	 * checkpoints of each title if segments are resumed, their *path* is NULL
+	 * if the title is not segmented
+	 */
+	struct checkpoint      *checkpoints;
+	/**
+	 * size and number of the blocks read ahead if titles are fed to ffmpeg by
+	 * feed_title, *feed_size* is 0 if ffmpeg reads them itself
+	 */
+	size_t                  feed_size;
+	size_t                  feed_depth;
+	struct remux_task      *tasks;
+	size_t                  numtasks;
+	const char             *argv0;
+	/** of all tasks, *numjobs* starting at task *first* are run */
+	const struct job       *jobs;
+	size_t                  first;
+	size_t                  numjobs;
+	/** NULL if the children are not supervised */
+	struct remux_progress  *progress;
+	/** seconds without progress until a child is stalled, 0 to never */
+	unsigned long           stall_timeout;
+	int                     kill_stalled;
+	int                     report;
+	/** whether the progress is shown as a status line on a terminal */
+	int                     tty;
+	int                     status_shown;
+	unsigned long           ticks;
+};
+
+/**
+ * Name the *i*-th task of *r* in *buf* by its playlist followed by *suffix*
+ * and, for segments and encoded streams, their number.
+ */
+static const char *task_name(const struct remux_jobs *r, size_t i, const char *suffix,
+		char buf[32])
+{
+	const struct remux_task *task = r->tasks + i;
+	uint32_t playlist = r->titles[task->title]->playlist;
+	if(task->kind == TASK_SEGMENT)
+		snprintf(buf, 32, "%05"PRIu32"%s#%zu", playlist, suffix, task->part);
+	else if(task->kind == TASK_ENCODE)
+		snprintf(buf, 32, "%05"PRIu32"%s:a%zu", playlist, suffix, task->part);
+	else
+		snprintf(buf, 32, "%05"PRIu32"%s", playlist, suffix);
+	return buf;
 }
 
-static int print_argv(char **argv)
+static const char *task_engine(const struct remux_jobs *r, size_t i)
 {
-	for(char **arg = argv; *arg;)
+	switch(r->builtin[r->tasks[i].title])
 	{
-		if(fputs(shell_escape(*arg), stdout) == EOF)
-			return -1;
-		if(*++arg && fputc(' ', stdout) == EOF)
-			return -1;
+	case BUILTIN_REMUX:
+		return "remux";
+	case BUILTIN_DEMUX:
+		return "demux";
+	case BUILTIN_ANGLES:
+		return "angles";
+	default:
+		return "ffmpeg";
 	}
-	return 0;
 }
 
-int fork_ffmpeg(const BLURAY_TITLE_INFO *title, int fds[2], const char *argv0)
+/**
+ * Append a task of *kind* for the title with index *title* to *r*, which takes
+ * ownership of *output*. Its prerequisites are the *numparts* tasks starting at
+ * *firstpart*. Returns the task or NULL with errno set, in which case *output*
+ * is freed.
+ */
+static struct remux_task *add_remux_task(struct remux_jobs *r, enum remux_task_kind kind,
+		size_t title, char *output, size_t firstpart, size_t numparts)
 {
-	if(title->chapter_count == 0)
-		return 0;
+	struct remux_task *grown = output ? array_reserve(r->tasks, r->numtasks, 1, sizeof(*r->tasks)) : NULL;
+	if(!grown)
+	{
+		free(output);
+		return NULL;
+	}
+	r->tasks = grown;
+	struct remux_task *task = r->tasks + r->numtasks++;
+	*task = (struct remux_task){
+		.kind      = kind,
+		.title     = title,
+		.output    = output,
+		.segment   = NULL,
+		.part      = 0,
+		.firstpart = firstpart,
+		.numparts  = numparts,
+		.resumed   = 0
+	};
+	return task;
+}
 
-	pid_t child = fork();
-	if(child < 0)
+/**
+ * Load the checkpoints of the *i*-th title of *r*, whose *numsegments* segments
+ * were just added as the last tasks, and mark the segments recorded by an
+ * earlier run resumed. The outputs of other segments are removed, as they may
+ * be left incomplete by an interrupted run.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+static int resume_segments(struct remux_jobs *r, size_t i, size_t numsegments)
+{
+	struct checkpoint *c = r->checkpoints + i;
+	if(checkpoint_open(c, r->plans + i, r->src, r->outputs[i], r->segments[i], numsegments) < 0)
 		return -1;
-	else if(child == 0)
+	struct remux_task *tasks = r->tasks + r->numtasks - numsegments;
+	for(size_t j = 0; j < numsegments; j++)
+		if(!(tasks[j].resumed = c->done[j]) && unlink(tasks[j].output) < 0 && errno != ENOENT)
+			return -1;
+	return 0;
+}
+
+/**
+ * Plan the tasks of every title of *r*. Unless *every* is 0, titles remuxed
+ * with ffmpeg are split at every *every*-th chapter, each segment is remuxed
+ * by its own task, and the segments are joined by a later task. If *split* is
+ * set, the streams converted to FLAC of titles remuxed with ffmpeg are instead
+ * encoded each by its own task after all streams were split by one task, and
+ * merged again by a final task.
+ *
+ * If *resume* is set, the segments of every title are recorded in its
+ * checkpoints, and segments an earlier run recorded are not remuxed again.
+ *
+ * Tasks are ordered by phases, every task follows its prerequisites.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+static int plan_remux_tasks(struct remux_jobs *r, uint32_t every, int split, int resume)
+{
+	// task of each title the tasks of the following phase depend on
+	size_t *prev = malloc(r->numtitles * sizeof(*prev) + 1);
+	size_t *numprev = calloc(r->numtitles + 1, sizeof(*numprev));
+	if(!prev || !numprev || !(r->segments = calloc(r->numtitles, sizeof(*r->segments))))
+		goto error;
+	if(resume && !(r->checkpoints = calloc(r->numtitles, sizeof(*r->checkpoints))))
+		goto error;
+
+	for(size_t i = 0; i < r->numtitles; i++)
+	{
+		const BLURAY_TITLE_INFO *title = r->titles[i];
+		if(every > 0 && !r->builtin[i])
+		{
+			ssize_t n = segment_title(title, every, r->segments + i);
+			if(n < 0)
+				goto error;
+			// a single segment is remuxed like the whole title
+			if(n > 1)
+			{
+				prev[i]    = r->numtasks;
+				numprev[i] = n;
+				for(ssize_t j = 0; j < n; j++)
+				{
+					struct remux_task *task = add_remux_task(r, TASK_SEGMENT, i,
+							segment_output(r->outputs[i], j), 0, 0);
+					if(!task)
+						goto error;
+					task->segment = r->segments[i] + j;
+					task->part    = j;
+				}
+				if(resume && resume_segments(r, i, n) < 0)
+					goto error;
+				continue;
+			}
+			free(r->segments[i]);
+			r->segments[i] = NULL;
+		}
+		// titles without streams to encode are remuxed in one piece
+		if(split && !r->builtin[i] && r->plans[i].numflac > 0)
+		{
+			prev[i]    = r->numtasks;
+			numprev[i] = 1;
+			if(!add_remux_task(r, TASK_DEMUX, i, split_output(r->outputs[i], -1, 0), 0, 0))
+				goto error;
+			continue;
+		}
+		if(!add_remux_task(r, TASK_TITLE, i, strdup(r->outputs[i]), 0, 0))
+			goto error;
+	}
+
+	// encode the streams of split titles
+	for(size_t i = 0; i < r->numtitles; i++)
+		if(numprev[i] > 0 && !r->segments[i])
+		{
+			const struct remux_plan *plan = r->plans + i;
+			size_t demux = prev[i];
+			prev[i]    = r->numtasks;
+			numprev[i] = 0;
+			for(size_t j = 0; j < plan->numstreams; j++)
+				if(plan->tracks[j].codec == PLAN_FLAC)
+				{
+					struct remux_task *task = add_remux_task(r, TASK_ENCODE, i,
+							split_output(r->outputs[i], j, 1), demux, 1);
+					if(!task)
+						goto error;
+					task->part = j;
+					numprev[i]++;
+				}
+		}
+
+	// join segments and merge split streams
+	for(size_t i = 0; i < r->numtitles; i++)
+		if(numprev[i] > 0)
+			if(!add_remux_task(r, r->segments[i] ? TASK_JOIN : TASK_MUX, i,
+					strdup(r->outputs[i]), prev[i], numprev[i]))
+				goto error;
+
+	free(prev);
+	free(numprev);
+	return 0;
+
+error:
+	{
+		int errnum = errno;
+		free(prev);
+		free(numprev);
+		errno = errnum;
+	}
+	return -1;
+}
+
+/**
+ * Remove the intermediate files of every task of *r* that joined or merged them
+ * successfully, according to *jobs*.
+ */
+static void remove_remux_parts(const struct remux_jobs *r, const struct job *jobs)
+{
+	for(size_t i = 0; i < r->numtasks; i++)
+	{
+		const struct remux_task *task = r->tasks + i;
+		if((task->kind != TASK_JOIN && task->kind != TASK_MUX) || !job_succeeded(jobs + i))
+			continue;
+		for(size_t j = task->firstpart; j < task->firstpart + task->numparts; j++)
+		{
+			const struct remux_task *part = r->tasks + j;
+			unlink(part->output);
+			if(part->kind != TASK_ENCODE)
+				continue;
+			char *name = split_output(r->outputs[task->title], part->part, 0);
+			if(name)
+				unlink(name);
+			free(name);
+		}
+		// the copied streams of a split title
+		if(task->kind == TASK_MUX && task->numparts > 0)
+			unlink(r->tasks[r->tasks[task->firstpart].firstpart].output);
+		// nothing is left to resume
+		if(task->kind == TASK_JOIN && r->checkpoints)
+			unlink(r->checkpoints[task->title].path);
+	}
+}
+
+static void free_remux_tasks(struct remux_jobs *r)
+{
+	for(size_t i = 0; i < r->numtasks; i++)
+		free(r->tasks[i].output);
+	free(r->tasks);
+	if(r->segments)
+		for(size_t i = 0; i < r->numtitles; i++)
+			free(r->segments[i]);
+	free(r->segments);
+	if(r->checkpoints)
+		for(size_t i = 0; i < r->numtitles; i++)
+			checkpoint_free(r->checkpoints + i);
+	free(r->checkpoints);
+}
+
+/**
+ * Test if all streams of *plan* can be remuxed by the built-in engine, which
+ * needs the codec configuration of every stream near the start of the title.
+ */
+static int builtin_supported(const struct remux_plan *plan)
+{
+	if(plan->numlate > 0)
 		return 0;
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(!remux_stream_supported(plan->streams[i].info))
+			return 0;
+	return 1;
+}
 
-	int status;
+/**
+ * Name the output of *angle* of a title remuxed to *dst* with remux_angles,
+ * inserting *.angleN* before the extension if *dst* ends in *.mkv*.
+ */
+static char *angle_output(const char *dst, unsigned angle)
+{
+	static const char ext[] = ".mkv";
+	size_t len = strlen(dst);
+	if(len >= sizeof(ext) - 1 && strcmp(dst + len - (sizeof(ext) - 1), ext) == 0)
+		len -= sizeof(ext) - 1;
+	char *name;
+	return asprintf(&name, "%.*s.angle%u.mkv", (int)len, dst, angle) < 0 ? NULL : name;
+}
+
+/**
+ * Read the selected angles of the title of the *i*-th task of *r* and remux
+ * *streams* of all of them at once with remux_angles.
+ *
+ * Returns like remux_angles.
+ */
+static int remux_title_angles(const struct remux_jobs *r, size_t i,
+		const struct remux_stream *streams, size_t numstreams, int progressfd)
+{
+	const struct remux_task *task = r->tasks + i;
+	uint16_t angles = r->angles[task->title];
+	BLURAY_TITLE_INFO *titles[16];
+	char              *dsts[16];
+	size_t n = 0;
+	int err = -1;
+	for(unsigned angle = 0; angle < 16; angle++)
+		if(angles & 1 << angle)
+		{
+			if(!(dsts[n] = angle_output(task->output, angle)))
+				goto cleanup;
+			if((err = bdmv_get_playlist(r->src, r->titles[task->title]->playlist, angle,
+					titles + n)) < 0)
+			{
+				free(dsts[n]);
+				goto cleanup;
+			}
+			n++;
+		}
+	err = remux_angles(r->src, titles, n, streams, numstreams, dsts, progressfd);
+
+cleanup:
+	{
+		int errnum = errno;
+		for(size_t j = 0; j < n; j++)
+		{
+			free(titles[j]);
+			free(dsts[j]);
+		}
+		errno = errnum;
+	}
+	return err;
+}
 
-	if(dup2(fds[1], STDOUT_FILENO) < 0)
+/**
+ * Remux or demultiplex the *i*-th task of the remux jobs *r* with its built-in
+ * engine and report its progress to *progressfd*, unless it is -1. Returns the
+ * exit status of the child, which fails if streams were dropped.
+ */
+static int remux_builtin(const struct remux_jobs *r, size_t i, int progressfd)
+{
+	const BLURAY_TITLE_INFO *title = r->titles[r->tasks[i].title];
+	const struct remux_plan *plan  = r->plans + r->tasks[i].title;
+	enum builtin_engine engine = r->builtin[r->tasks[i].title];
+	int dropped;
+	if(engine == BUILTIN_DEMUX)
+	{
+		struct remux_stream *streams;
+		ssize_t numstreams = select_demux_streams(plan, r->pids, r->numpids, &streams);
+		if(numstreams < 0)
+		{
+			perror(r->argv0);
+			return 1;
+		}
+		dropped = demux_title(r->src, title, streams, numstreams, r->tasks[i].output, progressfd);
+		free(streams);
+	}
+	else if(engine == BUILTIN_ANGLES)
+		dropped = remux_title_angles(r, i, plan->streams, plan->numstreams, progressfd);
+	else
+		dropped = remux_title(r->src, title, plan->streams, plan->numstreams,
+				r->tasks[i].output, progressfd);
+	switch(dropped)
+	{
+	case -1:
+		perror(r->argv0);
+		return 1;
+	case -2:
+		fprintf(stderr, "%s: Error in %s\n", r->argv0, r->src);
+		return 1;
+	case 0:
+		break;
+	default:
+		// an output missing selected streams is not a successful remux
+		fprintf(stderr, "%s: %05"PRIu32".mpls: dropped %d streams without codec"
+				" configuration, remux it with --engine=ffmpeg\n", r->argv0,
+				title->playlist, dropped);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * The concat list of the segments of a title.
+ */
+struct concat_list {
+	char                **outputs;
+	const struct segment *segments;
+	size_t                numsegments;
+};
+
+static int render_concat_list(FILE *f, const void *data)
+{
+	const struct concat_list *list = data;
+	return segment_print_list(f, list->outputs, list->segments, list->numsegments);
+}
+
+/**
+ * Generate the ffmpeg argv of the *i*-th task of *r*, which writes its
+ * progress to *progressfd* and, if it reads the title and *feedfd* is not -1,
+ * reads the title fed to *feedfd*. Chapters and concat lists are passed in
+ * anonymous files, the argv is allocated from *arena*.
+ */
+static char **remux_task_ffargv(struct arena *arena, const struct remux_jobs *r, size_t i,
+		int progressfd, int feedfd)
+{
+	const struct remux_task *task  = r->tasks + i;
+	const BLURAY_TITLE_INFO *title = r->titles[task->title];
+	const struct remux_plan *plan  = r->plans + task->title;
+	const char              *dst   = r->outputs[task->title];
+	switch(task->kind)
+	{
+	case TASK_DEMUX:
+		return generate_demux_ffargv(arena, plan, r->src, feedfd, dst, progressfd);
+	case TASK_ENCODE:
+		return generate_encode_ffargv(arena, dst, task->part, progressfd);
+	default:
+		break;
+	}
+
+	int chapterfd = 0;
+	if(title->chapter_count > 0 && task->kind != TASK_SEGMENT
+			&& (chapterfd = open_ff_chapters(title)) < 0)
+		return NULL;
+	if(task->kind == TASK_MUX)
+		return generate_mux_ffargv(arena, plan, dst, chapterfd, progressfd);
+	if(task->kind != TASK_JOIN)
+		return generate_ffargv(arena, plan, r->src, feedfd, task->output, chapterfd,
+				progressfd, task->segment);
+
+	struct concat_list list = {
+		.outputs     = malloc(task->numparts * sizeof(*list.outputs)),
+		.segments    = r->segments[task->title],
+		.numsegments = task->numparts
+	};
+	if(!list.outputs)
+		return NULL;
+	for(size_t j = 0; j < task->numparts; j++)
+		list.outputs[j] = r->tasks[task->firstpart + j].output;
+	int listfd = open_rendered("bdinfo-concat", render_concat_list, &list);
+	free(list.outputs);
+	if(listfd < 0)
+		return NULL;
+	return generate_concat_ffargv(arena, plan, listfd, chapterfd, progressfd, task->output);
+}
+
+/**
+ * Test if the *i*-th task of *r* reads its title from the Blu-ray.
+ */
+static int task_reads_title(const struct remux_jobs *r, size_t i)
+{
+	enum remux_task_kind kind = r->tasks[i].kind;
+	return kind == TASK_TITLE || kind == TASK_SEGMENT || kind == TASK_DEMUX;
+}
+
+/**
+ * Run ffmpeg for the *i*-th task of *r*, which reads its title, and feed it the
+ * title through a pipe with feed_title. Progress is reported to *progressfd*,
+ * unless it is -1. Returns the exit status of the child.
+ */
+static int remux_fed(const struct remux_jobs *r, size_t i, int progressfd)
+{
+	const struct remux_task *task = r->tasks + i;
+	int feed[2];
+	if(pipe2(feed, O_CLOEXEC) < 0)
+		goto error;
+	struct arena arena;
+	arena_init(&arena);
+	char **ffargv = remux_task_ffargv(&arena, r, i, progressfd, feed[0]);
+	if(!ffargv)
+	{
+		arena_free(&arena);
+		goto error;
+	}
+	pid_t ffmpeg = fork();
+	if(ffmpeg == 0)
+	{
+		// ffmpeg does not outlive its feeder, e.g. if it was killed as stalled
+		if(prctl(PR_SET_PDEATHSIG, SIGKILL) == 0 && fcntl(feed[0], F_SETFD, 0) == 0)
+			execvp("ffmpeg", ffargv);
+		perror(r->argv0);
+		_exit(127);
+	}
+	arena_free(&arena);
+	close(feed[0]);
+	if(ffmpeg < 0)
 		goto error;
-	close(fds[0]);
-	close(fds[1]);
 
-	if(print_ff_chapters(title) < 0 || fflush(stdout) == EOF)
+	// ffmpeg closing the pipe ends the feed, whether it failed tells its status
+	signal(SIGPIPE, SIG_IGN);
+	int err = feed_title(r->src, r->titles[task->title],
+			task->segment ? task->segment->chapter : 0, feed[1], r->feed_size,
+			r->feed_depth, progressfd);
+	int errnum = errno;
+	close(feed[1]);
+	if(err < 0)
+		kill(ffmpeg, SIGTERM);
+	int status;
+	while(waitpid(ffmpeg, &status, 0) < 0)
+		if(errno != EINTR)
+			goto error;
+	switch(err)
+	{
+	case -1:
+		errno = errnum;
 		goto error;
+	case -2:
+		fprintf(stderr, "%s: Error in %s\n", r->argv0, r->src);
+		return 1;
+	}
+	if(WIFSIGNALED(status))
+	{
+		signal(WTERMSIG(status), SIG_DFL);
+		raise(WTERMSIG(status));
+		// the signal is blocked or ignored
+		return 128 + WTERMSIG(status);
+	}
+	return WEXITSTATUS(status);
 
-	while(waitpid(child, &status, 0) < 0 || !(WIFEXITED(status) || WIFSIGNALED(status))) {}
-	if(WIFEXITED(status))
-		_exit(WEXITSTATUS(status));
-	raise(WTERMSIG(status));
-	_exit(1);
+error:
+	perror(r->argv0);
+	return 1;
+}
 
+/**
+ * Run the *i*-th task of *r* with ffmpeg in place of this child, feeding it the
+ * title if *r* asks for it. Progress is reported to *progressfd*, unless it is
+ * -1. Returns the exit status of the child if ffmpeg could not be executed or
+ * is run by remux_fed.
+ */
+static int exec_remux_task(const struct remux_jobs *r, size_t i, int progressfd)
+{
+	// ffmpeg inherits the write end of the progress pipe
+	if(progressfd >= 0 && fcntl(progressfd, F_SETFD, 0) < 0)
+		goto error;
+	if(r->feed_size > 0 && task_reads_title(r, i))
+		return remux_fed(r, i, progressfd);
+
+	// the arena is released by exec
+	struct arena arena;
+	arena_init(&arena);
+	char **ffargv = remux_task_ffargv(&arena, r, i, progressfd, -1);
+	if(!ffargv)
+		goto error;
+
+	execvp("ffmpeg", ffargv);
 error:
-	perror(argv0);
-	kill(child, SIGTERM);
-	while(waitpid(child, &status, 0) < 0 || !(WIFEXITED(status) || WIFSIGNALED(status))) {}
-	_exit(1);
+	perror(r->argv0);
+	return 127;
 }
 
 /**
- * Parse playlist argument of the format PLAYLIST[:ANGLE]. The playlist number
- * is returned in *\*pl* and the angle in *\*an*. *\*an* might be -1 if no angle
- * was given.
+ * Remux the *i*-th task of *r*, a segment, with exec_remux_task in a child and
+ * record it in the checkpoints of its title once it succeeded. Progress is
+ * reported to *progressfd*, unless it is -1. Returns the exit status of the
+ * child.
  */
-static int parse_playlist_arg(uint32_t *pl, uint8_t *an, const char *arg)
+static int remux_checkpointed(const struct remux_jobs *r, size_t i, int progressfd)
 {
-	unsigned long l;
-	char *end;
+	const struct remux_task *task = r->tasks + i;
+	pid_t parent = getpid();
+	pid_t child  = fork();
+	if(child == 0)
+	{
+		// the remux does not outlive this process, e.g. if it was killed as stalled
+		if(prctl(PR_SET_PDEATHSIG, SIGKILL) < 0)
+		{
+			perror(r->argv0);
+			_exit(127);
+		}
+		// this process may have died before the signal was requested
+		if(getppid() != parent)
+			_exit(127);
+		_exit(exec_remux_task(r, i, progressfd));
+	}
+	if(child < 0)
+		goto error;
+	int status;
+	while(waitpid(child, &status, 0) < 0)
+		if(errno != EINTR)
+			goto error;
+	if(WIFSIGNALED(status))
+	{
+		signal(WTERMSIG(status), SIG_DFL);
+		raise(WTERMSIG(status));
+		// the signal is blocked or ignored
+		return 128 + WTERMSIG(status);
+	}
+	if(WEXITSTATUS(status) != 0)
+		return WEXITSTATUS(status);
+	if(checkpoint_record(r->checkpoints + task->title, task->part, task->segment,
+			task->output) < 0)
+		goto error;
+	return 0;
 
-	errno = 0;
-	l = strtoul(arg, &end, 0);
-	if(l > UINT32_MAX)
-		l = ULONG_MAX, errno = ERANGE;
-	if(l == ULONG_MAX && errno == ERANGE)
-		return -1;
-	*pl = l;
-	*an = ANGLE_WILDCARD;
+error:
+	perror(r->argv0);
+	return 1;
+}
 
-	if(!*end)
+/**
+ * Fork a child that runs the *i*-th of the running tasks of the remux jobs
+ * *data* with ffmpeg or the built-in engine. If the children are supervised,
+ * *\*fd* is set to a pipe the child reports its progress to. Tasks whose
+ * prerequisites failed are not started and fail with ECANCELED, resumed tasks
+ * succeed without a child.
+ */
+static pid_t spawn_remux(size_t i, int *fd, void *data)
+{
+	const struct remux_jobs *r = data;
+	i += r->first;
+	const struct remux_task *task = r->tasks + i;
+	for(size_t j = task->firstpart; j < task->firstpart + task->numparts; j++)
+		if(!job_succeeded(r->jobs + j))
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+	if(task->resumed)
 		return 0;
-	else if(*end != ':')
-		return -1;
+	int progress[2] = {-1, -1};
+	if(r->progress)
+	{
+		if(pipe2(progress, O_CLOEXEC) < 0)
+			return -1;
+		progress_init(&r->progress[i].progress, task->segment
+				? task->segment->duration : r->titles[task->title]->duration);
+		r->progress[i].stalled = 0;
+	}
+	pid_t child = fork();
+	if(child != 0)
+	{
+		if(progress[1] >= 0)
+			close(progress[1]);
+		if(child < 0 && progress[0] >= 0)
+		{
+			int errnum = errno;
+			close(progress[0]);
+			errno = errnum;
+		}
+		else
+			*fd = progress[0];
+		return child;
+	}
+	if(progress[0] >= 0)
+		close(progress[0]);
+	if(r->builtin[task->title])
+		_exit(remux_builtin(r, i, progress[1]));
+	if(r->checkpoints && task->kind == TASK_SEGMENT)
+		_exit(remux_checkpointed(r, i, progress[1]));
+	_exit(exec_remux_task(r, i, progress[1]));
+}
 
-	l = strtoul(arg, &end, 0);
-	if(l > UINT8_MAX)
-		l = ULONG_MAX, errno = ERANGE;
-	if(l == ULONG_MAX && errno == ERANGE)
-		return -1;
-	*an = l;
+static int read_remux_progress(size_t i, int fd, void *data)
+{
+	struct remux_jobs *r = data;
+	return progress_read(&r->progress[r->first + i].progress, fd) != 0;
+}
 
-	return *end ? -1 : 0;
+/**
+ * Clear the status line of the remux jobs *r*, if it is shown.
+ */
+static void clear_remux_status(struct remux_jobs *r)
+{
+	if(r->status_shown)
+		fputs("\r\033[K", stderr);
+	r->status_shown = 0;
 }
 
 /**
- * Compare playlist-angle tuples.
+ * Report that the *i*-th task of *r* has not progressed for *seconds* and, if
+ * *action* is given, that it was sent a signal.
  */
-static int cmp_playlist_selectors(const void *a_, const void *b_)
+static void report_stall(struct remux_jobs *r, size_t i, double seconds, const char *action)
 {
-	const struct playlist_selector *a = a_;
-	const struct playlist_selector *b = b_;
-	int c = (a->playlist > b->playlist) - (a->playlist < b->playlist);
-	if(c == 0)
-	{
-		if(a->angle == ANGLE_WILDCARD)
-			c = -1;
-		else if(b->angle == ANGLE_WILDCARD)
-			c = 1;
-		else
-			c = (a->angle > b->angle) - (a->angle < b->angle);
+	char name[32];
+	task_name(r, i, ".mpls", name);
+	if(r->tty)
+	{
+		clear_remux_status(r);
+		fprintf(stderr, "%s: %s: %s made no progress for %.0f s%s%s\n",
+				r->argv0, name, task_engine(r, i), seconds,
+				action ? ", " : "", action ? action : "");
 	}
-	return c;
+	else
+		fprintf(stderr, "{\"event\":\"%s\",\"playlist\":\"%s\","
+				"\"engine\":\"%s\",\"seconds\":%.0f}\n", action ? action : "stalled",
+				name, task_engine(r, i), seconds);
 }
 
 /**
- * Remove duplicate or wildcard angles.
+ * Check the running remux jobs of *data* for stalls and report their progress.
  */
-static void clean_playlist_selectors(struct playlist_selector *playlists, size_t *numplaylists)
+static void tick_remux_jobs(void *data)
 {
-	if(*numplaylists == 0)
+	struct remux_jobs *r = data;
+	size_t end = r->first + r->numjobs;
+	r->ticks++;
+	for(size_t i = r->first; i < end; i++)
+	{
+		struct remux_progress *p = r->progress + i;
+		if(!r->jobs[i].running || r->stall_timeout == 0)
+			continue;
+		double stalled = progress_stalled(&p->progress);
+		if(stalled < r->stall_timeout)
+			p->stalled = 0;
+		else if(!p->stalled && !r->kill_stalled)
+		{
+			p->stalled = STALL_WARNED;
+			report_stall(r, i, stalled, NULL);
+		}
+		else if(r->kill_stalled && p->stalled < STALL_TERMINATED)
+		{
+			p->stalled = STALL_TERMINATED;
+			kill(r->jobs[i].pid, SIGTERM);
+			report_stall(r, i, stalled, "terminated");
+		}
+		else if(p->stalled == STALL_TERMINATED && stalled >= r->stall_timeout + STALL_KILL_GRACE)
+		{
+			p->stalled = STALL_KILLED;
+			kill(r->jobs[i].pid, SIGKILL);
+			report_stall(r, i, stalled, "killed");
+		}
+	}
+
+	if(!r->report)
 		return;
-	qsort(playlists, *numplaylists, sizeof(*playlists), cmp_playlist_selectors);
-	size_t off = 0;
-	int wildcard = playlists[0].angle == ANGLE_WILDCARD;
-	for(size_t src = 1; src < *numplaylists; src++)
+	char name[32];
+	if(r->tty)
 	{
-		if(playlists[src].playlist == playlists[src - 1].playlist)
+		// the status line is cut to the width of the terminal
+		char *line = NULL;
+		size_t size = 0;
+		FILE *f = open_memstream(&line, &size);
+		if(!f)
+			return;
+		for(size_t i = r->first; i < end; i++)
+			if(r->jobs[i].running)
+			{
+				fprintf(f, "%s%s: ", ftell(f) > 0 ? " | " : "", task_name(r, i, "", name));
+				progress_print(&r->progress[i].progress, f, 1);
+			}
+		if(fclose(f) == 0)
 		{
-			if(wildcard || playlists[src].angle == playlists[src - 1].angle)
+			struct winsize ws;
+			if(ioctl(STDERR_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && size >= ws.ws_col)
+				size = ws.ws_col - 1;
+			fprintf(stderr, "\r\033[K%.*s", (int)size, line);
+			r->status_shown = 1;
+		}
+		free(line);
+	}
+	else if(r->ticks % PROGRESS_LOG_TICKS == 0)
+		for(size_t i = r->first; i < end; i++)
+			if(r->jobs[i].running)
 			{
-				off++;
+				fprintf(stderr, "{\"event\":\"progress\",\"playlist\":\"%s\","
+						"\"engine\":\"%s\",", task_name(r, i, ".mpls", name),
+						task_engine(r, i));
+				progress_print(&r->progress[i].progress, stderr, 0);
+				fputs("}\n", stderr);
+			}
+	fflush(stderr);
+}
+
+/**
+ * Run the tasks of *r* in phases with at most *maxjobs* at once and store their
+ * results in *jobs*. A phase runs all following tasks whose prerequisites ran
+ * in earlier phases. If *supervise* is set, their progress is watched.
+ *
+ * Returns the number of failed tasks or -1 with errno set.
+ */
+static int run_remux_tasks(struct remux_jobs *r, struct job *jobs, size_t maxjobs,
+		int supervise)
+{
+	static const struct job_watch watch = {
+		.input    = read_remux_progress,
+		.tick     = tick_remux_jobs,
+		.interval = PROGRESS_TICK
+	};
+	r->jobs = jobs;
+	int failed = 0;
+	for(r->first = 0; r->first < r->numtasks; r->first += r->numjobs)
+	{
+		size_t end = r->first;
+		while(end < r->numtasks && r->tasks[end].firstpart + r->tasks[end].numparts <= r->first)
+			end++;
+		r->numjobs = end - r->first;
+		fflush(NULL);
+		int n = run_jobs(jobs + r->first, r->numjobs, maxjobs, spawn_remux,
+				supervise ? &watch : NULL, r);
+		clear_remux_status(r);
+		if(n < 0)
+			return -1;
+		failed += n;
+	}
+	return failed;
+}
+
+/**
+ * Test if the *j*-th clip of the *i*-th of *titles* was already played by an
+ * earlier clip.
+ */
+static int clip_seen(BLURAY_TITLE_INFO **titles, size_t i, uint32_t j)
+{
+	const char *clip_id = titles[i]->clips[j].clip_id;
+	for(size_t k = 0; k <= i; k++)
+		for(uint32_t l = 0; l < (k < i ? titles[k]->clip_count : j); l++)
+			if(strcmp(titles[k]->clips[l].clip_id, clip_id) == 0)
+				return 1;
+	return 0;
+}
+
+/**
+ * Copy the M2TS files of the clips of *titles* from the Blu-ray directory *src*
+ * to the directory *dir* with copy_file and report how each was copied to
+ * stderr. Whole clips are written to DIR/CLIP.m2ts, once even if several titles
+ * play them. If *trim* is set, only the source packets each clip of a title
+ * plays are copied to DIR/PLAYLIST.NNN.CLIP.m2ts instead.
+ *
+ * Returns the number of clips that could not be copied or -1 with errno set.
+ */
+static int extract_clips(BLURAY_TITLE_INFO **titles, size_t numtitles, const char *src,
+		const char *dir, int trim, const char *argv0)
+{
+	static const char *const methods[] = {
+		[COPY_CLONED]     = "cloned",
+		[COPY_IN_KERNEL]  = "copied in kernel",
+		[COPY_READ_WRITE] = "copied"
+	};
+	if(mkdir(dir, 0777) < 0 && errno != EEXIST)
+		return -1;
+	int failed = 0;
+	for(size_t i = 0; i < numtitles; i++)
+		for(uint32_t j = 0; j < titles[i]->clip_count; j++)
+		{
+			const BLURAY_CLIP_INFO *clip = titles[i]->clips + j;
+			if(!trim && clip_seen(titles, i, j))
 				continue;
+			off_t offset = 0;
+			off_t length = -1;
+			if(trim)
+			{
+				uint32_t start, end;
+				switch(bdmv_clip_packets(src, clip->clip_id, clip->in_time, clip->out_time,
+						&start, &end))
+				{
+				case -1:
+					return -1;
+				case -2:
+					fprintf(stderr, "%s: %s.clpi: Cannot find the packets of %05"PRIu32".mpls\n",
+							argv0, clip->clip_id, titles[i]->playlist);
+					failed++;
+					continue;
+				}
+				offset = (off_t)start * TS_PACKET_SIZE;
+				length = (off_t)(end - start) * TS_PACKET_SIZE;
+			}
+
+			char *in, *out;
+			int n = trim
+					? asprintf(&out, "%s/%05"PRIu32".%03"PRIu32".%s.m2ts", dir,
+							titles[i]->playlist, j, clip->clip_id)
+					: asprintf(&out, "%s/%s.m2ts", dir, clip->clip_id);
+			if(n < 0)
+				return -1;
+			if(asprintf(&in, "%s/BDMV/STREAM/%s.m2ts", src, clip->clip_id) < 0)
+			{
+				free(out);
+				return -1;
+			}
+			int method = copy_file(in, out, offset, length);
+			if(method < 0)
+			{
+				fprintf(stderr, "%s: %s: %s\n", argv0, out, strerror(errno));
+				failed++;
+			}
+			else
+				fprintf(stderr, "%s: %s: %s\n", argv0, out, methods[method]);
+			free(in);
+			free(out);
+		}
+	return failed;
+}
+
+/**
+ * Scan the clips of *titles* in the Blu-ray directory *src* with up to
+ * *numthreads* threads into the new array *\*scans* and report the clips that
+ * could not be read to stderr.
+ *
+ * Returns the number of clips that could not be read or -1 with errno set.
+ */
+static int scan_clips(BLURAY_TITLE_INFO **titles, size_t numtitles, const char *src,
+		size_t numthreads, struct title_scan **scans, const char *argv0)
+{
+	if(!(*scans = calloc(numtitles + 1, sizeof(**scans))))
+		return -1;
+	if(scan_titles(src, titles, numtitles, numthreads, *scans) < 0)
+	{
+		free(*scans);
+		*scans = NULL;
+		return -1;
+	}
+	int failed = 0;
+	for(size_t i = 0; i < numtitles; i++)
+		for(uint32_t j = 0; j < titles[i]->clip_count; j++)
+			if((*scans)[i].clips[j].err)
+			{
+				fprintf(stderr, "%s: %s/BDMV/STREAM/%s.m2ts: %s\n", argv0, src,
+						titles[i]->clips[j].clip_id, strerror((*scans)[i].clips[j].err));
+				failed++;
 			}
+	return failed;
+}
+
+/**
+ * Print the outcome of every remux task of *r* to stderr.
+ */
+static void print_remux_summary(const struct remux_jobs *r, const struct job *jobs)
+{
+	for(size_t i = 0; i < r->numtasks; i++)
+	{
+		const struct job *job = jobs + i;
+		const char *engine = task_engine(r, i);
+		char name[32];
+		fprintf(stderr, "%s: %s: ", r->argv0, task_name(r, i, ".mpls", name));
+		if(job->pid < 0 && job->error == ECANCELED)
+			fputs("skipped\n", stderr);
+		else if(job->pid == 0)
+			fputs("resumed\n", stderr);
+		else if(job->pid < 0)
+			fprintf(stderr, "could not start %s: %s\n", engine, strerror(job->error));
+		else if(WIFSIGNALED(job->status))
+			fprintf(stderr, "%s killed by signal %d (%s)\n", engine,
+					WTERMSIG(job->status), strsignal(WTERMSIG(job->status)));
+		else if(WEXITSTATUS(job->status) != 0)
+			fprintf(stderr, "%s exited with status %d\n", engine, WEXITSTATUS(job->status));
+		else if(r->tasks[i].kind == TASK_JOIN)
+			fputs("joined\n", stderr);
+		else if(r->tasks[i].kind == TASK_MUX)
+			fputs("merged\n", stderr);
+		else if(r->progress && r->progress[i].progress.read_us > 0)
+		{
+			const struct progress *p = &r->progress[i].progress;
+			fprintf(stderr, "done, read %.1f MB at %.1f MB/s\n", p->read_size / 1e6,
+					(double)p->read_size / p->read_us);
 		}
 		else
-			wildcard = playlists[src].angle == ANGLE_WILDCARD;
-		if(off > 0)
-			playlists[src - off] = playlists[src];
+			fputs("done\n", stderr);
+	}
+}
+
+/**
+ * Settings of all requests answered by --serve. Titles that are listed are
+ * parsed natively with *numthreads* threads if *native* is set.
+ */
+struct serve_config {
+	int         use_cache;
+	int         refresh_cache;
+	int         native;
+	size_t      numthreads;
+	const char *argv0;
+};
+
+/**
+ * A Blu-ray kept open by --serve. If *has_id* is set, *id* is the identity of
+ * the Blu-ray when it was opened, which is compared on every request to notice
+ * a changed disc. Devices have no identity.
+ */
+struct served_bd {
+	struct title_source source;
+	uint64_t            id;
+	int                 has_id;
+};
+
+/**
+ * Open the Blu-ray at *path* for --serve. libbluray is only opened once a
+ * title has to be read with it, fetched titles are kept in the title cache,
+ * which is only kept in memory if the Blu-ray cannot be cached.
+ */
+static int served_bd_open(struct served_bd *bd, const char *path, const struct serve_config *config,
+		int refresh_cache)
+{
+	bd->has_id = cache_disc_id(path, &bd->id) == 0;
+	source_open(&bd->source, path, config->use_cache, refresh_cache, 0, NULL);
+	if(!bd->source.cache && !(bd->source.cache = cache_new()))
+		return -1;
+	return 0;
+}
+
+static void *open_served_bd(const char *path, void *data)
+{
+	const struct serve_config *config = data;
+	struct served_bd *bd = malloc(sizeof(*bd));
+	if(!bd)
+		return NULL;
+	// libbluray does not tell why it failed, so a missing INPUT is caught here
+	struct stat st;
+	if(stat(path, &st) < 0 || served_bd_open(bd, path, config, config->refresh_cache) < 0)
+	{
+		int errnum = errno;
+		free(bd);
+		errno = errnum;
+		return NULL;
+	}
+	return bd;
+}
+
+static void close_served_bd(void *state, void *data)
+{
+	(void)data;
+	struct served_bd *bd = state;
+	source_close(&bd->source);
+	free(bd);
+}
+
+static void serve_error(int fd, const char *fmt, ...)
+{
+	char msg[1024];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+	dprintf(fd, "error: %s\n", msg);
+}
+
+/**
+ * Answer a request of --serve. *args* are the command, `list`, `info`,
+ * `chapters`, or `ffmpeg[=LANGUAGES]`, followed by options, the INPUT, and,
+ * for ffmpeg, the OUTPUT. The answer is a line `ok` followed by what the
+ * command line prints, or a line `error: MESSAGE`.
+ */
+static void serve_request(struct server *server, int fd, char **args, size_t numargs, void *data)
+{
+	const struct serve_config *config = data;
+
+	struct playlist_selector *playlists = NULL;
+	struct iso639_set        *langs     = NULL;
+	BLURAY_TITLE_INFO       **titles    = NULL;
+	struct title_fold        *folds     = NULL;
+	struct output            *out       = NULL;
+	struct playlist_score    *runners_up = NULL;
+	struct title_score        score;
+	size_t numplaylists = 0;
+	size_t numtitles    = 0;
+	size_t numfolds     = 0;
+	size_t numties      = 0;
+	size_t numrunnersup = 0;
+
+	uint32_t min_duration = -1;
+	int      filter_flags = TITLES_RELEVANT;
+	int      format       = OUTPUT_YAML;
+	int      main_feature = 0;
+	int      transcode    = 0;
+	int      skip_ig      = 0;
+	int      layout       = PLAN_FIRST_CLIP;
+	int      operation;
+
+	const char *cmd = args[0];
+	if(strcmp(cmd, "list") == 0)
+		operation = 'l';
+	else if(strcmp(cmd, "info") == 0)
+		operation = 'i';
+	else if(strcmp(cmd, "chapters") == 0)
+		operation = 'c';
+	else if(strncmp(cmd, "ffmpeg", 6) == 0 && (cmd[6] == '\0' || cmd[6] == '='))
+	{
+		operation = 'f';
+		if(cmd[6] == '=' && parse_languages(cmd + 7, &langs, config->argv0) < 0)
+			goto error_errno;
+	}
+	else
+	{
+		serve_error(fd, "Invalid request %s", cmd);
+		goto cleanup;
+	}
+
+	size_t i = 1;
+	for(; i < numargs && strncmp(args[i], "--", 2) == 0; i++)
+	{
+		const char *opt = args[i] + 2;
+		const char *arg = strchr(opt, '=');
+		arg = arg ? arg + 1 : "";
+		char *end;
+		uint32_t playlist;
+		uint8_t  angle;
+		if(strncmp(opt, "time=", 5) == 0)
+		{
+			errno = 0;
+			unsigned long long l = strtoull(arg, &end, 0);
+			if(l > UINT32_MAX || errno == ERANGE || end == arg || *end)
+			{
+				serve_error(fd, "Invalid duration %s", arg);
+				goto cleanup;
+			}
+			if(l < min_duration)
+				min_duration = l;
+		}
+		else if(strncmp(opt, "playlist=", 9) == 0)
+		{
+			if(parse_playlist_arg(&playlist, &angle, arg) == -1)
+			{
+				serve_error(fd, "Invalid playlist %s", arg);
+				goto cleanup;
+			}
+			struct playlist_selector *grown = array_reserve(playlists, numplaylists, 1,
+					sizeof(*playlists));
+			if(!grown)
+				goto error_errno;
+			playlists = grown;
+			playlists[numplaylists].playlist = playlist;
+			playlists[numplaylists++].angle  = angle;
+		}
+		else if(strncmp(opt, "format=", 7) == 0)
+		{
+			if((format = output_parse_format(arg)) < 0)
+			{
+				serve_error(fd, "Invalid output format %s", arg);
+				goto cleanup;
+			}
+		}
+		else if(strncmp(opt, "layout=", 7) == 0)
+		{
+			if((layout = plan_parse_layout(arg)) < 0)
+			{
+				serve_error(fd, "Invalid layout %s", arg);
+				goto cleanup;
+			}
+		}
+		else if(strcmp(opt, "all") == 0)
+			filter_flags = 0;
+		else if(strcmp(opt, "main-feature") == 0)
+			main_feature = 1;
+		else if(strcmp(opt, "lossless") == 0)
+			transcode = 1;
+		else if(strcmp(opt, "skip-igs") == 0)
+			skip_ig = 1;
+		else
+		{
+			serve_error(fd, "Invalid option %s", args[i]);
+			goto cleanup;
+		}
+	}
+	if(numargs - i != (operation == 'f' ? 2 : 1))
+	{
+		serve_error(fd, "%s requires INPUT%s", cmd, operation == 'f' ? " and OUTPUT" : "");
+		goto cleanup;
+	}
+	const char *input = args[i];
+	const char *dst   = args[i + 1];
+	if(main_feature)
+	{
+		if(min_duration != (uint32_t)-1 || numplaylists > 0)
+		{
+			serve_error(fd, "--main-feature cannot be combined with --time or --playlist");
+			goto cleanup;
+		}
+		min_duration = 0;
+	}
+	if(numplaylists > 0)
+		clean_playlist_selectors(playlists, &numplaylists);
+	else if(min_duration == (uint32_t)-1)
+		min_duration = 0;
+
+	struct served_bd *bd = serve_acquire(server, input);
+	if(!bd)
+	{
+		serve_error(fd, "%s: %s", input, strerror(errno));
+		goto cleanup;
+	}
+	uint64_t id;
+	if(bd->has_id && cache_disc_id(bd->source.src, &id) == 0 && id != bd->id)
+	{
+		// the disc was changed, its cache entry is still valid for the old one
+		const char *path = bd->source.src;
+		source_close(&bd->source);
+		if(served_bd_open(bd, path, config, 0) < 0)
+		{
+			serve_release(server, bd);
+			goto error_errno;
+		}
+	}
+	// only titles that are listed are parsed natively, as on the command line
+	bd->source.numthreads = (operation == 'l' || operation == 'i') && config->native
+			? config->numthreads : 0;
+	int status = get_titles(&bd->source, filter_flags, min_duration, playlists, numplaylists,
+			&titles, &numtitles, &folds, &numfolds);
+	if(status == 0 && main_feature
+			&& select_main_feature(titles, &numtitles, config->numthreads, &score, &numties,
+					&runners_up, &numrunnersup) < 0)
+		status = -1;
+	int errnum = errno;
+	// the cache is only an optimization, failing to write it is fine
+	cache_save(bd->source.cache);
+	serve_release(server, bd);
+	errno = errnum;
+	switch(status)
+	{
+	case -1:
+		goto error_errno;
+	case -2:
+		serve_error(fd, "Error in %s", input);
+		goto cleanup;
+	}
+	if(numtitles == 0)
+	{
+		serve_error(fd, "No title selected");
+		goto cleanup;
+	}
+	if(operation == 'c' && numtitles > 1)
+	{
+		serve_error(fd, "chapters requires a single title (%zu selected)", numtitles);
+		goto cleanup;
+	}
+	if(operation == 'f' && numtitles > 1 && !output_template_has_playlist(dst))
+	{
+		serve_error(fd, "OUTPUT must contain %%p if multiple titles are selected"
+				" (%zu selected)", numtitles);
+		goto cleanup;
+	}
+
+	// titles are copies, so the Blu-ray is not held while the client reads
+	if(dprintf(fd, "ok\n") < 0)
+		goto cleanup;
+	if(operation == 'l' || operation == 'i')
+	{
+		// failing to write means the client went away, which is not reported
+		if((out = output_new(fd, format)) && print_titles(out, titles, numtitles, folds,
+				numfolds, main_feature ? &score : NULL, numties, runners_up, numrunnersup, NULL,
+				NULL, operation == 'i') == 0)
+			output_finish(out);
+	}
+	else
+	{
+		int dupfd = dup(fd);
+		FILE *f = dupfd < 0 ? NULL : fdopen(dupfd, "w");
+		if(!f && dupfd >= 0)
+			close(dupfd);
+		if(f)
+		{
+			if(operation == 'c')
+				print_xml_chapters(f, titles[0]);
+			else
+				print_remux_calls(f, titles, numtitles, langs, input, dst,
+						transcode, skip_ig, layout, 0);
+			fclose(f);
+		}
 	}
-	*numplaylists -= off;
-}
-
-/**
- * Compare playlist-angle tuple with playlist number.
- */
-static int cmp_title_playlist(const void *a_, const void *b_)
-{
-	const BLURAY_TITLE_INFO *a = *(const void    **)a_;
-	uint32_t                 b = *(const uint32_t *)b_;
-	return (a->playlist > b) - (a->playlist < b);
-}
 
-/**
- * Compare playlist-angle tuple with BLURAY_TITLE_INFO.
- */
-static int cmp_title_infos(const void *a, const void *b_)
-{
-	const BLURAY_TITLE_INFO *b = *(const void **)b_;
-	return cmp_title_playlist(a, &b->playlist);
+	if(0)
+	{
+	error_errno:
+		serve_error(fd, "%s", strerror(errno));
+	}
+cleanup:
+	output_free(out);
+	free_titles(titles, numtitles);
+	free(folds);
+	free(runners_up);
+	free(langs);
+	free(playlists);
 }
 
 int main(int argc, char **argv)
@@ -713,22 +2118,103 @@ int main(int argc, char **argv)
 	uint32_t min_duration = -1;
 	int      filter_flags = TITLES_RELEVANT;
 	int      operation    = 'l';
+	int      format       = OUTPUT_YAML;
+	/** the output_format remux plans are printed in, -1 to print calls */
+	int      plan_format  = -1;
+	int      plan_given   = 0;
+	int      layout       = PLAN_FIRST_CLIP;
 	enum {
-		FLAG_TRANSCODE = 1,
-		FLAG_SKIP_IG   = 2
+		FLAG_TRANSCODE     = 1,
+		FLAG_SKIP_IG       = 2,
+		FLAG_NO_CACHE      = 4,
+		FLAG_REFRESH_CACHE = 8,
+		FLAG_NO_NATIVE     = 16,
+		FLAG_CHECK_NATIVE  = 32,
+		FLAG_BUILTIN       = 64,
+		FLAG_MAIN_FEATURE  = 128,
+		FLAG_KILL_STALLED  = 256,
+		FLAG_NO_PROGRESS   = 512,
+		FLAG_SPLIT_AUDIO   = 1024,
+		FLAG_TRIM_CLIPS    = 2048,
+		FLAG_SCAN          = 4096,
+		FLAG_ANGLES        = 8192,
+		FLAG_MKVMERGE      = 16384,
+		FLAG_RESUME        = 32768
 	} flags = 0;
+	uint16_t *demux_pids    = NULL;
+	size_t    numdemux_pids = 0;
+	unsigned long stall_timeout = 300;
+	unsigned long idle_timeout  = 300;
+	uint32_t      segment_every = 0;
+	size_t        feed_size     = 0;
+	size_t        feed_depth    = 8;
+	const char   *serve_socket  = NULL;
+	const char   *clips_dir     = NULL;
 
 	struct playlist_selector *playlists = NULL;
-	char                    (*langs)[4] = NULL;
+	struct iso639_set        *langs     = NULL;
 	size_t numplaylists = 0;
-	size_t numlangs     = 0;
 
-	BLURAY             *bd     = NULL;
-	BLURAY_TITLE_INFO **titles = NULL;
-	char              **ffargv = NULL;
+	struct title_source source  = {NULL, NULL, NULL, 0, NULL};
+	BLURAY_TITLE_INFO **titles  = NULL;
+	char              **outputs = NULL;
+	struct job         *jobs    = NULL;
+	char               *builtin = NULL;
+	uint16_t           *angles  = NULL;
+	struct remux_plan  *plans   = NULL;
+	struct remux_progress *progress = NULL;
+	struct remux_jobs   remux   = {.tasks = NULL, .numtasks = 0, .segments = NULL};
+	struct output      *out     = NULL;
+	struct title_fold  *folds   = NULL;
+	struct title_score  score;
+	struct playlist_score *runners_up = NULL;
+	struct title_scan  *scans   = NULL;
 	size_t numtitles = 0;
+	size_t numfolds  = 0;
+	size_t numties   = 0;
+	size_t numrunnersup = 0;
+	size_t maxjobs   = 0;
+	int    batch     = 0;
+
+	// the run is always timed, but only reported with --stats
+	struct stats  runstats;
+	struct stats *stats      = NULL;
+	const char   *stats_file = NULL;
+	stats_init(&runstats);
+
+	struct batch_inputs inputs = {
+		.inputs    = NULL,
+		.numinputs = 0,
+		.numbad    = 0
+	};
 
-	static const char optstring[] = "t:p:aicf::x::Lshv";
+	enum {
+		OPT_NO_CACHE = 0x100,
+		OPT_REFRESH_CACHE,
+		OPT_NO_NATIVE,
+		OPT_CHECK_NATIVE,
+		OPT_ENGINE,
+		OPT_FORMAT,
+		OPT_MAIN_FEATURE,
+		OPT_STATS,
+		OPT_NO_PROGRESS,
+		OPT_STALL_TIMEOUT,
+		OPT_KILL_STALLED,
+		OPT_SERVE,
+		OPT_IDLE_TIMEOUT,
+		OPT_SEGMENT,
+		OPT_RESUME,
+		OPT_SPLIT_AUDIO,
+		OPT_FEED,
+		OPT_EXTRACT_CLIPS,
+		OPT_TRIM_CLIPS,
+		OPT_DEMUX,
+		OPT_SCAN,
+		OPT_ANGLES,
+		OPT_PLAN,
+		OPT_LAYOUT
+	};
+	static const char optstring[] = "t:p:aicf::x::LsBj:hv";
 	static const struct option long_options[] = {
 		{"time",        required_argument, NULL, 't'},
 		{"playlist",    required_argument, NULL, 'p'},
@@ -740,6 +2226,32 @@ int main(int argc, char **argv)
 		{"remux",       optional_argument, NULL, 'x'},
 		{"lossless",    no_argument,       NULL, 'L'},
 		{"skip-igs",    no_argument,       NULL, 's'},
+		{"batch",       no_argument,       NULL, 'B'},
+		{"jobs",        required_argument, NULL, 'j'},
+		{"no-cache",    no_argument,       NULL, OPT_NO_CACHE},
+		{"refresh-cache", no_argument,     NULL, OPT_REFRESH_CACHE},
+		{"no-native",   no_argument,       NULL, OPT_NO_NATIVE},
+		{"check-native", no_argument,      NULL, OPT_CHECK_NATIVE},
+		{"engine",      required_argument, NULL, OPT_ENGINE},
+		{"format",      required_argument, NULL, OPT_FORMAT},
+		{"main-feature", no_argument,      NULL, OPT_MAIN_FEATURE},
+		{"stats",       optional_argument, NULL, OPT_STATS},
+		{"no-progress", no_argument,       NULL, OPT_NO_PROGRESS},
+		{"stall-timeout", required_argument, NULL, OPT_STALL_TIMEOUT},
+		{"kill-stalled", no_argument,      NULL, OPT_KILL_STALLED},
+		{"serve",       required_argument, NULL, OPT_SERVE},
+		{"idle-timeout", required_argument, NULL, OPT_IDLE_TIMEOUT},
+		{"segment",     optional_argument, NULL, OPT_SEGMENT},
+		{"resume",      no_argument,       NULL, OPT_RESUME},
+		{"split-audio", no_argument,       NULL, OPT_SPLIT_AUDIO},
+		{"feed",        optional_argument, NULL, OPT_FEED},
+		{"extract-clips", required_argument, NULL, OPT_EXTRACT_CLIPS},
+		{"trim-clips",  no_argument,       NULL, OPT_TRIM_CLIPS},
+		{"demux",       required_argument, NULL, OPT_DEMUX},
+		{"scan",        no_argument,       NULL, OPT_SCAN},
+		{"angles",      no_argument,       NULL, OPT_ANGLES},
+		{"plan",        required_argument, NULL, OPT_PLAN},
+		{"layout",      required_argument, NULL, OPT_LAYOUT},
 		{"help",        no_argument,       NULL, 'h'},
 		{"version",     no_argument,       NULL, 'v'},
 		{NULL, 0, NULL, 0}
@@ -755,6 +2267,8 @@ int main(int argc, char **argv)
 			uint8_t  angle;
 		case 'h':
 			if(printf("Usage: %s [OPTION]... INPUT [OUTPUT]\n"
+					"  or:  %s --batch [OPTION]... INPUT...\n"
+					"  or:  %s --serve=SOCKET [OPTION]...\n"
 					"Get " BLURAY_SPELLING " info and extract tracks with ffmpeg.\n"
 					"\n"
 					"  -t, --time=DURATION        select all titles at least DURATION seconds long\n"
@@ -763,16 +2277,66 @@ int main(int argc, char **argv)
 					"                             ANGLE\n"
 					"  -a, --all                  do not omit duplicate titles\n"
 					"  -i, --info                 print more detailed information\n"
+					"      --scan                 with -i, read the clips and print the size and\n"
+					"                             the average and peak bitrate of every stream\n"
 					"  -c, --chapters             print XML chapters\n"
 					"  -f, --ffmpeg[=LANGUAGES]   print ffmpeg call to extract all or only streams of\n"
 					"                             given or undefined languages\n"
+					"      --plan=BACKEND         with -f, print mkvmerge calls or the remux plans as\n"
+					"                             yaml, json, or ndjson instead of ffmpeg calls\n"
 					"  -x, --remux[=LANGUAGES]    extract all or only streams of given or undefined\n"
 					"                             languages with ffmpeg\n"
+					"      --angles               remux all or the selected angles of titles at\n"
+					"                             once, reading shared clips only once\n"
+					"      --demux=PID|LANGUAGE[,...]\n"
+					"                             write the given or all streams of given or\n"
+					"                             undefined languages as raw elementary streams\n"
+					"      --extract-clips=DIR    copy the M2TS clips of the selected titles to DIR\n"
+					"      --trim-clips           copy only the parts of the clips the titles play\n"
 					"  -L, --lossless             transcode lossless audio tracks to FLAC\n"
 					"  -s, --skip-igs             skip interactive graphic streams on extraction\n"
+					"      --layout=LAYOUT        extract the streams of the first (default), any\n"
+					"                             (union), or every (intersection) clip of titles\n",
+					argv[0], argv[0], argv[0]) < 0
+					|| printf(
+					"  -B, --batch                list the titles of all INPUTs, directories are\n"
+					"                             searched for " BLURAY_SPELLING "s and *.iso images\n"
+					"  -j, --jobs=N               run up to N ffmpeg processes or batch workers at\n"
+					"                             once\n"
+					"      --no-cache             neither read nor write the title cache\n"
+					"      --refresh-cache        ignore and rewrite cached titles\n"
+					"      --no-native            always read titles with libbluray\n"
+					"      --check-native         compare the natively parsed titles with libbluray's\n"
+					"      --main-feature         select the title most likely to be the main\n"
+					"                             feature, -i prints the scores of all titles\n"
+					"      --format=FORMAT        list titles as yaml (default), json, or ndjson\n"
+					"      --stats[=FILE]         report the time spent in each phase and the\n"
+					"                             resource usage to stderr or as JSON to FILE\n"
+					"      --no-progress          do not report the progress of remux children\n"
+					"      --stall-timeout=SECONDS\n"
+					"                             warn about remux children without progress for\n"
+					"                             SECONDS (default 300, 0 disables)\n"
+					"      --kill-stalled         terminate stalled remux children\n"
+					"      --serve=SOCKET         answer list, info, chapters, and ffmpeg requests\n"
+					"                             on the UNIX socket SOCKET and keep " BLURAY_SPELLING "s\n"
+					"                             and their titles open between requests\n"
+					"      --idle-timeout=SECONDS close " BLURAY_SPELLING "s served without requests for\n"
+					"                             SECONDS (default 300)\n"
+					"      --engine=ENGINE        remux with ffmpeg (default) or the builtin\n"
+					"                             Matroska writer\n"
+					"      --segment[=N]          remux every N chapters (default 1) of a title\n"
+					"                             with its own ffmpeg process and join them\n"
+					"      --resume               record remuxed segments in OUTPUT.resume and\n"
+					"                             skip them when remuxing again (implies --segment)\n"
+					"      --split-audio          encode every audio track converted to FLAC with\n"
+					"                             its own ffmpeg process\n"
+					"      --feed[=SIZE[,DEPTH]]  read titles for ffmpeg with up to DEPTH (default\n"
+					"                             8) reads of SIZE KiB (default 1536) ahead\n"
 					"  -h, --help                 display this help and exit\n"
-					"  -v, --version              output version information and exit\n",
-					argv[0]) < 0)
+					"  -v, --version              output version information and exit\n"
+					"\n"
+					"In OUTPUT %%p is replaced with the playlist number, which is required if\n"
+					"multiple titles are selected, and %%%% with a literal %%.\n") < 0)
 				goto error_errno;
 			return 0;
 		case 'v':
@@ -805,14 +2369,183 @@ int main(int argc, char **argv)
 				goto error;
 			}
 
-			if(!(playlists = array_reserve(playlists, numplaylists, 1, sizeof(*playlists)))) // FIXME realloc: NULL
+			struct playlist_selector *grown = array_reserve(playlists, numplaylists, 1,
+					sizeof(*playlists));
+			if(!grown)
 				goto error_errno;
+			playlists = grown;
 			playlists[numplaylists].playlist = playlist;
 			playlists[numplaylists++].angle  = angle;
 			break;
 		case 'a':
 			filter_flags = 0;
 			break;
+		case 'B':
+			batch = 1;
+			break;
+		case OPT_NO_CACHE:
+			flags |= FLAG_NO_CACHE;
+			break;
+		case OPT_REFRESH_CACHE:
+			flags |= FLAG_REFRESH_CACHE;
+			break;
+		case OPT_NO_NATIVE:
+			flags |= FLAG_NO_NATIVE;
+			break;
+		case OPT_CHECK_NATIVE:
+			flags |= FLAG_CHECK_NATIVE;
+			break;
+		case OPT_ENGINE:
+			if(strcmp(optarg, "builtin") == 0)
+				flags |= FLAG_BUILTIN;
+			else if(strcmp(optarg, "ffmpeg") == 0)
+				flags &= ~FLAG_BUILTIN;
+			else
+			{
+				fprintf(stderr, "%s: Invalid engine %s\n", argv[0], optarg);
+				goto error;
+			}
+			break;
+		case OPT_NO_PROGRESS:
+			flags |= FLAG_NO_PROGRESS;
+			break;
+		case OPT_STALL_TIMEOUT:
+			errno = 0;
+			l = strtoull(optarg, &end, 10);
+			if(l > UINT32_MAX || errno == ERANGE || end == optarg || *end)
+			{
+				fprintf(stderr, "%s: Invalid stall timeout %s\n", argv[0], optarg);
+				goto error;
+			}
+			stall_timeout = l;
+			break;
+		case OPT_KILL_STALLED:
+			flags |= FLAG_KILL_STALLED;
+			break;
+		case OPT_SERVE:
+			serve_socket = optarg;
+			break;
+		case OPT_IDLE_TIMEOUT:
+			errno = 0;
+			l = strtoull(optarg, &end, 10);
+			if(l > UINT32_MAX || errno == ERANGE || end == optarg || *end)
+			{
+				fprintf(stderr, "%s: Invalid idle timeout %s\n", argv[0], optarg);
+				goto error;
+			}
+			idle_timeout = l;
+			break;
+		case OPT_SEGMENT:
+			segment_every = 1;
+			if(!optarg)
+				break;
+			errno = 0;
+			l = strtoull(optarg, &end, 10);
+			if(l == 0 || l > UINT32_MAX || errno == ERANGE || end == optarg || *end)
+			{
+				fprintf(stderr, "%s: Invalid number of chapters %s\n", argv[0], optarg);
+				goto error;
+			}
+			segment_every = l;
+			break;
+		case OPT_RESUME:
+			flags |= FLAG_RESUME;
+			break;
+		case OPT_SPLIT_AUDIO:
+			flags |= FLAG_SPLIT_AUDIO;
+			break;
+		case OPT_EXTRACT_CLIPS:
+			clips_dir = optarg;
+			operation = c;
+			break;
+		case OPT_TRIM_CLIPS:
+			flags |= FLAG_TRIM_CLIPS;
+			break;
+		case OPT_SCAN:
+			flags |= FLAG_SCAN;
+			break;
+		case OPT_ANGLES:
+			flags |= FLAG_ANGLES;
+			break;
+		case OPT_PLAN:
+			flags &= ~FLAG_MKVMERGE;
+			plan_format = -1;
+			if(strcmp(optarg, "mkvmerge") == 0)
+				flags |= FLAG_MKVMERGE;
+			else if(strcmp(optarg, "ffmpeg") != 0 && (plan_format = output_parse_format(optarg)) < 0)
+			{
+				fprintf(stderr, "%s: Invalid plan backend %s\n", argv[0], optarg);
+				goto error;
+			}
+			plan_given = 1;
+			break;
+		case OPT_LAYOUT:
+			if((layout = plan_parse_layout(optarg)) < 0)
+			{
+				fprintf(stderr, "%s: Invalid layout %s\n", argv[0], optarg);
+				goto error;
+			}
+			break;
+		case OPT_DEMUX:
+			switch(parse_demux_selection(optarg, &demux_pids, &numdemux_pids, &langs,
+					argv[0]))
+			{
+			case -1:
+				goto error_errno;
+			case -2:
+				goto error;
+			}
+			operation = c;
+			break;
+		case OPT_FEED:
+			feed_size = 1536 << 10;
+			if(!optarg)
+				break;
+			errno = 0;
+			l = strtoull(optarg, &end, 10);
+			// reads are made of whole aligned units
+			if(l == 0 || l > SIZE_MAX >> 10 || (l << 10) < FEED_UNIT_SIZE || errno == ERANGE
+					|| end == optarg || (*end && *end != ','))
+			{
+				fprintf(stderr, "%s: Invalid read size %s\n", argv[0], optarg);
+				goto error;
+			}
+			feed_size = l << 10;
+			if(!*end)
+				break;
+			const char *depth = end + 1;
+			l = strtoull(depth, &end, 10);
+			if(l == 0 || l > SIZE_MAX / feed_size || errno == ERANGE || end == depth || *end)
+			{
+				fprintf(stderr, "%s: Invalid read-ahead depth %s\n", argv[0], depth);
+				goto error;
+			}
+			feed_depth = l;
+			break;
+		case OPT_STATS:
+			stats      = &runstats;
+			stats_file = optarg;
+			break;
+		case OPT_MAIN_FEATURE:
+			flags |= FLAG_MAIN_FEATURE;
+			break;
+		case OPT_FORMAT:
+			if((format = output_parse_format(optarg)) < 0)
+			{
+				fprintf(stderr, "%s: Invalid output format %s\n", argv[0], optarg);
+				goto error;
+			}
+			break;
+		case 'j':
+			errno = 0;
+			l = strtoull(optarg, &end, 0);
+			if(l == 0 || l > SIZE_MAX || errno == ERANGE || *end)
+			{
+				fprintf(stderr, "%s: Invalid number of jobs %s\n", argv[0], optarg);
+				goto error;
+			}
+			maxjobs = l;
+			break;
 		case 'L':
 			flags |= FLAG_TRANSCODE;
 			break;
@@ -821,39 +2554,173 @@ int main(int argc, char **argv)
 			break;
 		case 'f':
 		case 'x':
-			if(optarg)
-			{
-				for(const char *lang, *next = optarg; (lang = iter_comma_list(&next, ','));)
-				{
-					// null-terminate lang
-					char buf[4];
-					if(next - lang == 3 && *next)
-					{
-						strncpy(buf, lang, 3);
-						buf[3] = '\0';
-						lang = buf;
-					}
-
-					if(!iso6392_is_known(lang))
-					{
-						fprintf(stderr, "%s: Unknown ISO 639-2 language requested:"
-								" %s\n", argv[0], lang);
-						continue;
-					}
-
-					lang = iso6392_to_bcode(lang);
-					if(!(langs = array_reserve(langs, numlangs, 1, sizeof(*langs)))) // FIXME realloc: NULL
-						goto error_errno;
-					strcpy(langs[numlangs++], lang);
-				}
-				qsort(langs, numlangs, sizeof(*langs), (compar_fn)strcmp);
-			}
+			if(optarg && parse_languages(optarg, &langs, argv[0]) < 0)
+				goto error_errno;
 		case 'i':
 		case 'c':
 			operation = c;
 			break;
 		}
 
+	if(serve_socket)
+	{
+		if(batch || optind < argc)
+		{
+			fprintf(stderr, "%s: --serve takes neither INPUT nor --batch\n", argv[0]);
+			goto error;
+		}
+		struct serve_config config = {
+			.use_cache     = !(flags & FLAG_NO_CACHE),
+			.refresh_cache = flags & FLAG_REFRESH_CACHE,
+			.native        = !(flags & FLAG_NO_NATIVE),
+			.numthreads    = maxjobs > 0 ? maxjobs : num_cpus(),
+			.argv0         = argv[0]
+		};
+		static const struct serve_ops ops = {
+			.open   = open_served_bd,
+			.close  = close_served_bd,
+			.handle = serve_request
+		};
+		if(serve(serve_socket, &ops, idle_timeout, &config) < 0)
+		{
+			fprintf(stderr, "%s: %s: %s\n", argv[0], serve_socket, strerror(errno));
+			goto error;
+		}
+		goto cleanup;
+	}
+
+	if(flags & FLAG_MAIN_FEATURE)
+	{
+		if(min_duration != (uint32_t)-1 || numplaylists > 0)
+		{
+			fprintf(stderr, "%s: --main-feature cannot be combined with --time or"
+					" --playlist\n", argv[0]);
+			goto error;
+		}
+		min_duration = 0;
+	}
+
+	if((segment_every > 0 || (flags & (FLAG_SPLIT_AUDIO | FLAG_RESUME)) || feed_size > 0)
+			&& operation != 'x')
+	{
+		fprintf(stderr, "%s: --%s requires --remux\n", argv[0], segment_every > 0
+				? "segment" : flags & FLAG_SPLIT_AUDIO ? "split-audio"
+				: flags & FLAG_RESUME ? "resume" : "feed");
+		goto error;
+	}
+	if((flags & FLAG_TRIM_CLIPS) && operation != OPT_EXTRACT_CLIPS)
+	{
+		fprintf(stderr, "%s: --trim-clips requires --extract-clips\n", argv[0]);
+		goto error;
+	}
+	if((flags & FLAG_ANGLES) && operation != 'x')
+	{
+		fprintf(stderr, "%s: --angles requires --remux\n", argv[0]);
+		goto error;
+	}
+	if(layout != PLAN_FIRST_CLIP && operation != 'f' && operation != 'x' && operation != OPT_DEMUX)
+	{
+		fprintf(stderr, "%s: --layout requires --ffmpeg, --remux, or --demux\n", argv[0]);
+		goto error;
+	}
+	if(plan_given && operation != 'f')
+	{
+		fprintf(stderr, "%s: --plan requires --ffmpeg\n", argv[0]);
+		goto error;
+	}
+	if((flags & FLAG_MKVMERGE) && (flags & FLAG_TRANSCODE))
+	{
+		fprintf(stderr, "%s: --lossless requires ffmpeg\n", argv[0]);
+		goto error;
+	}
+	if((flags & FLAG_SCAN) && (operation != 'i' || batch))
+	{
+		fprintf(stderr, "%s: --scan requires --info of a single INPUT\n", argv[0]);
+		goto error;
+	}
+	if((segment_every > 0 || (flags & FLAG_RESUME)) && (flags & FLAG_SPLIT_AUDIO))
+	{
+		fprintf(stderr, "%s: --%s cannot be combined with --split-audio\n", argv[0],
+				segment_every > 0 ? "segment" : "resume");
+		goto error;
+	}
+	// angles are remuxed in one pass by the builtin engine, which does none of these
+	if((flags & FLAG_ANGLES) && (segment_every > 0 || (flags & (FLAG_SPLIT_AUDIO | FLAG_RESUME))
+			|| feed_size > 0))
+	{
+		fprintf(stderr, "%s: --angles cannot be combined with --%s\n", argv[0],
+				segment_every > 0 ? "segment" : flags & FLAG_SPLIT_AUDIO ? "split-audio"
+				: flags & FLAG_RESUME ? "resume" : "feed");
+		goto error;
+	}
+	// options only the ffmpeg engine supports
+	const char *ffmpeg_option = flags & FLAG_TRANSCODE ? "lossless"
+			: segment_every > 0 ? "segment" : flags & FLAG_SPLIT_AUDIO ? "split-audio"
+			: flags & FLAG_RESUME ? "resume" : feed_size > 0 ? "feed" : NULL;
+	// segments are the checkpoints of a resumed remux
+	if((flags & FLAG_RESUME) && segment_every == 0)
+		segment_every = 1;
+
+	// only titles that are listed are parsed natively
+	int native = (operation == 'l' || operation == 'i') && !(flags & FLAG_NO_NATIVE);
+	if((flags & FLAG_CHECK_NATIVE) && (!native || batch))
+	{
+		fprintf(stderr, "%s: --check-native requires listing the titles of a single"
+				" INPUT natively\n", argv[0]);
+		goto error;
+	}
+
+	if(batch)
+	{
+		if(operation != 'l' && operation != 'i')
+		{
+			fprintf(stderr, "%s: --batch only supports listing titles\n", argv[0]);
+			goto error;
+		}
+		if(optind >= argc)
+		{
+			fprintf(stderr, "%s: No "BLURAY_SPELLING" given\n", argv[0]);
+			return 2;
+		}
+		for(; optind < argc; optind++)
+			if(find_inputs(&inputs, argv[optind], 1, argv[0]) < 0)
+				goto error_errno;
+
+		if(numplaylists > 0)
+			clean_playlist_selectors(playlists, &numplaylists);
+		else if(min_duration == (uint32_t)-1)
+			min_duration = 0;
+
+		struct batch_scan scan = {
+			.inputs        = inputs.inputs,
+			.numinputs     = inputs.numinputs,
+			.filter_flags  = filter_flags,
+			.min_duration  = min_duration,
+			.playlists     = playlists,
+			.numplaylists  = numplaylists,
+			.use_cache     = !(flags & FLAG_NO_CACHE),
+			.refresh_cache = flags & FLAG_REFRESH_CACHE,
+			.native        = native,
+			.main_feature  = flags & FLAG_MAIN_FEATURE,
+			.results       = NULL,
+			.next          = 0,
+			.lock          = PTHREAD_MUTEX_INITIALIZER,
+			.cond          = PTHREAD_COND_INITIALIZER
+		};
+		if(maxjobs == 0)
+			maxjobs = num_cpus();
+		if(!(out = output_new(STDOUT_FILENO, format)))
+			goto error_errno;
+		stats_switch(stats, STATS_TITLES);
+		int failed = batch_print(&scan, maxjobs, out, operation == 'i', argv[0]);
+		stats_switch(stats, STATS_OTHER);
+		if(failed < 0)
+			goto error_errno;
+		if(failed > 0 || inputs.numbad > 0)
+			goto error;
+		goto cleanup;
+	}
+
 	const char *src = argv[optind++];
 	if(!src)
 	{
@@ -861,8 +2728,17 @@ int main(int argc, char **argv)
 		return 2;
 	}
 
+	if((operation == OPT_EXTRACT_CLIPS || (flags & (FLAG_SCAN | FLAG_ANGLES | FLAG_MKVMERGE)))
+			&& !is_bluray_root(src))
+	{
+		fprintf(stderr, "%s: --%s requires a "BLURAY_SPELLING" directory\n", argv[0],
+				flags & FLAG_SCAN ? "scan" : flags & FLAG_ANGLES ? "angles"
+				: flags & FLAG_MKVMERGE ? "plan=mkvmerge" : "extract-clips");
+		goto error;
+	}
+
 	const char *dst = argv[optind];
-	if(operation == 'f' || operation == 'x')
+	if(operation == 'f' || operation == 'x' || operation == OPT_DEMUX)
 		optind++;
 	if(optind > argc)
 	{
@@ -880,49 +2756,24 @@ int main(int argc, char **argv)
 	else if(min_duration == (uint32_t)-1)
 		min_duration = 0;
 
-	// open bluray
-	bd = bd_open(src, NULL);
-	if(!bd)
-		goto error_libbluray;
-
-	// get BLURAY_TITLE_INFOs by duration
-	if(min_duration != (uint32_t)-1)
-	{
-		uint32_t n = bd_get_titles(bd, filter_flags, min_duration);
-		if(!(titles = array_reserve(titles, numtitles, n, sizeof(*titles)))) // FIXME realloc: NULL
-			goto error_errno;
-		for(uint32_t i = 0; i < n; i++)
-		{
-			BLURAY_TITLE_INFO *title = bd_get_title_info(bd, i, 0);
-			if(!title)
-				goto error_libbluray;
-			titles[numtitles++] = title;
-		}
-	}
-	qsort(titles, numtitles, sizeof(*titles), cmp_title_infos);
-
-	// get BLURAY_TITLE_INFOs by playlist selectors
-	for(size_t i = 0; i < numplaylists; i++)
+	// checked titles must not come from the cache
+	source_open(&source, src, !(flags & (FLAG_NO_CACHE | FLAG_CHECK_NATIVE)),
+			flags & FLAG_REFRESH_CACHE, native ? (maxjobs > 0 ? maxjobs : num_cpus()) : 0,
+			stats);
+	stats_switch(stats, STATS_SELECT);
+	int status = get_titles(&source, filter_flags, min_duration, playlists, numplaylists,
+			&titles, &numtitles, &folds, &numfolds);
+	if(status == 0 && (flags & FLAG_MAIN_FEATURE) && select_main_feature(titles, &numtitles,
+			maxjobs > 0 ? maxjobs : num_cpus(), &score, &numties, &runners_up,
+			&numrunnersup) < 0)
+		status = -1;
+	stats_switch(stats, STATS_OTHER);
+	switch(status)
 	{
-		uint32_t playlist = playlists[i].playlist;
-
-		// skip playlist if already selected by time
-		size_t j = bisect_left(titles, &playlist, numtitles, sizeof(*titles), cmp_title_playlist);
-		if(j < numtitles && titles[j]->playlist == playlist)
-			continue;
-
-		BLURAY_TITLE_INFO *title = bd_get_playlist_info(bd, playlist, 0);
-		if(!title)
-			goto error_libbluray;
-
-		if(!(titles = array_reserve(titles, numtitles, 1, sizeof(*titles)))) // FIXME realloc: NULL
-		{
-			int errnum = errno;
-			bd_free_title_info(title);
-			errno = errnum;
-			goto error_errno;
-		}
-		titles[numtitles++] = title;
+	case -1:
+		goto error_errno;
+	case -2:
+		goto error_libbluray;
 	}
 
 	if(numtitles == 0)
@@ -930,16 +2781,51 @@ int main(int argc, char **argv)
 		fprintf(stderr, "%s: No title selected\n", argv[0]);
 		goto error;
 	}
+	// the lowest playlist is kept, but the choice is not backed by the scores
+	if(numties > 0)
+		fprintf(stderr, "%s: %zu titles tie as main feature, selected %05"PRIu32".mpls,"
+				" see --info\n", argv[0], numties + 1, titles[0]->playlist);
 
 	if(operation == 'l' || operation == 'i')
 	{
-		for(size_t i = 0; i < numtitles; i++)
-			if(print_title(titles[i], operation == 'i') < 0)
+		if(flags & FLAG_SCAN)
+		{
+			stats_switch(stats, STATS_SCAN);
+			int failed = scan_clips(titles, numtitles, src, maxjobs > 0 ? maxjobs : num_cpus(),
+					&scans, argv[0]);
+			stats_switch(stats, STATS_OTHER);
+			if(failed < 0)
 				goto error_errno;
-		if(fputs("...\n", stdout) == EOF)
+			if(failed > 0)
+				ok = 0;
+		}
+		if(!(out = output_new(STDOUT_FILENO, format)))
 			goto error_errno;
+		stats_switch(stats, STATS_OUTPUT);
+		if(print_titles(out, titles, numtitles, folds, numfolds,
+				flags & FLAG_MAIN_FEATURE ? &score : NULL, numties, runners_up, numrunnersup,
+				scans, NULL, operation == 'i') < 0
+				|| output_finish(out) < 0)
+			goto error_errno;
+		stats_switch(stats, STATS_OTHER);
+
+		if(flags & FLAG_CHECK_NATIVE)
+		{
+			switch(check_native(src, filter_flags, min_duration, playlists, numplaylists,
+					titles, numtitles, argv[0]))
+			{
+			case -1:
+				goto error_errno;
+			case -2:
+				goto error_libbluray;
+			case 0:
+				break;
+			default:
+				goto error;
+			}
+		}
 	}
-	else
+	else if(operation == 'c')
 	{
 		if(numtitles > 1)
 		{
@@ -956,55 +2842,200 @@ int main(int argc, char **argv)
 			goto error;
 		}
 
-		BLURAY_TITLE_INFO *title = titles[0];
-		if(operation == 'c')
+		stats_switch(stats, STATS_OUTPUT);
+		if(print_xml_chapters(stdout, titles[0]) == -1)
+			goto error_errno;
+		stats_switch(stats, STATS_OTHER);
+	}
+	else if(operation == OPT_EXTRACT_CLIPS)
+	{
+		stats_switch(stats, STATS_EXTRACT);
+		int failed = extract_clips(titles, numtitles, src, clips_dir,
+				flags & FLAG_TRIM_CLIPS, argv[0]);
+		stats_switch(stats, STATS_OTHER);
+		if(failed < 0)
+		{
+			fprintf(stderr, "%s: %s: %s\n", argv[0], clips_dir, strerror(errno));
+			goto error;
+		}
+		if(failed > 0)
+			goto error;
+	}
+	else
+	{
+		if(numtitles > 1 && !output_template_has_playlist(dst))
+		{
+			fprintf(stderr, "%s: OUTPUT must contain %%p if multiple titles are"
+					" selected (%zu selected)\n", argv[0], numtitles);
+			goto error;
+		}
+
+		// clips with other streams are reported before anything is remuxed
+		ssize_t differing = report_clip_layouts(titles, numtitles, flags & FLAG_SKIP_IG, argv[0]);
+		if(differing < 0)
+			goto error_errno;
+		if(differing > 0 && layout == PLAN_FIRST_CLIP)
+			fprintf(stderr, "%s: streams added by later clips are left out, see --layout\n",
+					argv[0]);
+		else if(differing > 0 && layout == PLAN_UNION)
+			fprintf(stderr, "%s: streams added by later clips are only written if ffmpeg finds"
+					" them at the start of the title, see --layout\n", argv[0]);
+
+		if(operation == 'f' && plan_format >= 0)
+		{
+			if(!(out = output_new(STDOUT_FILENO, plan_format)))
+				goto error_errno;
+			stats_switch(stats, STATS_OUTPUT);
+			if(output_remux_plans(out, titles, numtitles, langs, src, dst,
+					flags & FLAG_TRANSCODE, flags & FLAG_SKIP_IG, layout) < 0)
+				goto error_errno;
+			stats_switch(stats, STATS_OTHER);
+		}
+		else if(operation == 'f')
 		{
-			if(print_xml_chapters(title) == -1)
+			stats_switch(stats, STATS_OUTPUT);
+			if(print_remux_calls(stdout, titles, numtitles, langs, src, dst,
+					flags & FLAG_TRANSCODE, flags & FLAG_SKIP_IG, layout,
+					flags & FLAG_MKVMERGE) < 0)
 				goto error_errno;
+			stats_switch(stats, STATS_OTHER);
 		}
 		else
 		{
-			int fds[2] = {0, -1};
-			if(operation == 'x' && title->chapter_count > 0 && pipe2(fds, O_CLOEXEC) < 0)
+			if(!(outputs = calloc(numtitles, sizeof(*outputs))))
+				goto error_errno;
+			for(size_t i = 0; i < numtitles; i++)
+				if(!(outputs[i] = format_output(dst, titles[i])))
+					goto error_errno;
+			if(!(plans = calloc(numtitles, sizeof(*plans))))
 				goto error_errno;
+			for(size_t i = 0; i < numtitles; i++)
+				if(plan_title(plans + i, titles[i], langs, flags & FLAG_TRANSCODE,
+						flags & FLAG_SKIP_IG, layout) < 0)
+					goto error_errno;
 
-			ffargv = generate_ffargv(title, langs, numlangs, src, dst, fds[0],
-					flags & FLAG_TRANSCODE, flags & FLAG_SKIP_IG);
-			if(!ffargv)
-			{
-				if(operation == 'x')
+			// titles with streams the built-in engine cannot handle fall back to ffmpeg
+			if(!(builtin = calloc(numtitles, 1)))
+				goto error_errno;
+			if(operation == OPT_DEMUX)
+				for(size_t i = 0; i < numtitles; i++)
+				{
+					struct remux_stream *streams;
+					ssize_t n = select_demux_streams(plans + i, demux_pids, numdemux_pids,
+							&streams);
+					if(n < 0)
+						goto error_errno;
+					free(streams);
+					if(n == 0)
+					{
+						fprintf(stderr, "%s: %05"PRIu32".mpls: no selected stream can be"
+								" written as elementary stream\n", argv[0], titles[i]->playlist);
+						goto error;
+					}
+					builtin[i] = BUILTIN_DEMUX;
+				}
+			else if((flags & FLAG_BUILTIN) && ffmpeg_option)
+				fprintf(stderr, "%s: --%s requires ffmpeg, remuxing with ffmpeg\n", argv[0],
+						ffmpeg_option);
+			else if(flags & FLAG_BUILTIN)
+				for(size_t i = 0; i < numtitles; i++)
 				{
-					int errbak = errno;
-					close(fds[0]);
-					close(fds[1]);
-					errno = errbak;
+					if(builtin_supported(plans + i))
+						builtin[i] = BUILTIN_REMUX;
+					else
+						fprintf(stderr, "%s: %05"PRIu32".mpls: %s, remuxing with ffmpeg\n",
+								argv[0], titles[i]->playlist, plans[i].numlate > 0
+								? "streams missing from the first clip" : "unsupported streams");
 				}
-				goto error_errno;
-			}
 
-			if(operation == 'f')
+			// every angle of a title is remuxed by the same child
+			if(flags & FLAG_ANGLES)
 			{
-				if(print_argv(ffargv) < 0)
-					goto error_errno;
-				if(title->chapter_count > 0)
-					if(fputs(" << EOF\n", stdout) == EOF
-							|| print_ff_chapters(title) < 0
-							|| fputs("EOF", stdout) == EOF)
-						goto error_errno;
-				if(fputc('\n', stdout) == EOF)
+				if(!(angles = calloc(numtitles + 1, sizeof(*angles))))
 					goto error_errno;
+				for(size_t i = 0; i < numtitles; i++)
+				{
+					int missing = select_angles(titles[i], playlists, numplaylists, angles + i);
+					if(missing > 0)
+					{
+						fprintf(stderr, "%s: %05"PRIu32".mpls has no angle %d\n", argv[0],
+								titles[i]->playlist, missing - 1);
+						goto error;
+					}
+					if(titles[i]->angle_count <= 1)
+						continue;
+					if(!builtin_supported(plans + i) || (flags & FLAG_TRANSCODE))
+					{
+						fprintf(stderr, "%s: %05"PRIu32".mpls: --angles cannot remux the selected"
+								" streams without ffmpeg\n", argv[0], titles[i]->playlist);
+						goto error;
+					}
+					builtin[i] = BUILTIN_ANGLES;
+				}
 			}
-			else
-			{
-				if(title->chapter_count > 0 && fork_ffmpeg(title, fds, argv[0]) < 0)
-					goto error_errno;
 
-				execvp("ffmpeg", ffargv);
-				int errbak = errno;
-				close(fds[0]);
-				errno = errbak;
+			remux = (struct remux_jobs){
+				.titles        = titles,
+				.outputs       = outputs,
+				.numtitles     = numtitles,
+				.plans         = plans,
+				.src           = src,
+				.builtin       = builtin,
+				.angles        = angles,
+				.pids          = demux_pids,
+				.numpids       = numdemux_pids,
+				.segments      = NULL,
+				.checkpoints   = NULL,
+				.feed_size     = feed_size,
+				.feed_depth    = feed_depth,
+				.tasks         = NULL,
+				.numtasks      = 0,
+				.argv0         = argv[0],
+				.jobs          = NULL,
+				.first         = 0,
+				.numjobs       = 0,
+				.progress      = NULL,
+				.stall_timeout = stall_timeout,
+				.kill_stalled  = flags & FLAG_KILL_STALLED,
+				.report        = !(flags & FLAG_NO_PROGRESS),
+				.tty           = isatty(STDERR_FILENO),
+				.status_shown  = 0,
+				.ticks         = 0
+			};
+			if(plan_remux_tasks(&remux, segment_every, flags & FLAG_SPLIT_AUDIO,
+					flags & FLAG_RESUME) < 0)
 				goto error_errno;
-			}
+			if(remux.checkpoints)
+				for(size_t i = 0; i < numtitles; i++)
+					if(remux.checkpoints[i].numdone > 0)
+						fprintf(stderr, "%s: %05"PRIu32".mpls: resuming with %zu of %zu"
+								" segments done\n", argv[0], titles[i]->playlist,
+								remux.checkpoints[i].numdone, remux.checkpoints[i].numsegments);
+			if(!(jobs = calloc(remux.numtasks, sizeof(*jobs))))
+				goto error_errno;
+			// the children are supervised unless there is nothing to watch for
+			int supervise = stall_timeout > 0 || !(flags & FLAG_NO_PROGRESS);
+			if(supervise && !(progress = calloc(remux.numtasks, sizeof(*progress))))
+				goto error_errno;
+			remux.progress = progress;
+
+			stats_switch(stats, STATS_REMUX);
+			int failed = run_remux_tasks(&remux, jobs, maxjobs, supervise);
+			if(failed >= 0)
+				remove_remux_parts(&remux, jobs);
+			stats_switch(stats, STATS_OTHER);
+			if(failed < 0)
+				goto error_errno;
+			// resumed tasks ran no child
+			for(size_t i = 0; i < remux.numtasks; i++)
+				if(jobs[i].pid != 0 && stats_add_child(stats,
+						titles[remux.tasks[i].title]->playlist, task_engine(&remux, i),
+						jobs + i) < 0)
+					goto error_errno;
+			if(remux.numtasks > 1)
+				print_remux_summary(&remux, jobs);
+			if(failed > 0)
+				goto error;
 		}
 	}
 
@@ -1018,15 +3049,49 @@ int main(int argc, char **argv)
 	error:
 		ok = 0;
 	}
-	for(size_t i = 0; i < numtitles; i++)
-		bd_free_title_info(titles[i]);
-	free(titles);
-	if(ffargv)
-		free(ffargv[0]);
-	free(ffargv);
+cleanup:
+	if(scans)
+		for(size_t i = 0; i < numtitles; i++)
+			scan_free(scans + i);
+	free(scans);
+	free_titles(titles, numtitles);
+	for(size_t i = 0; i < inputs.numinputs; i++)
+		free(inputs.inputs[i]);
+	free(inputs.inputs);
+	if(outputs)
+		for(size_t i = 0; i < numtitles; i++)
+			free(outputs[i]);
+	free(outputs);
+	free_remux_tasks(&remux);
+	if(plans)
+		for(size_t i = 0; i < numtitles; i++)
+			plan_free(plans + i);
+	free(plans);
+	free(jobs);
+	free(progress);
+	free(builtin);
+	free(angles);
+	free(folds);
+	free(runners_up);
+	output_free(out);
 	free(langs);
-	if(bd)
-		bd_close(bd);
+	free(demux_pids);
+	source_close(&source);
+
+	if(stats)
+	{
+		FILE *f = stats_file ? fopen(stats_file, "w") : stderr;
+		int failed = !f || stats_print(stats, f, stats_file != NULL, argv[0]) < 0;
+		if(f && f != stderr && fclose(f) == EOF)
+			failed = 1;
+		if(failed)
+		{
+			fprintf(stderr, "%s: %s: %s\n", argv[0], stats_file ? stats_file : "stats",
+					strerror(errno));
+			ok = 0;
+		}
+		stats_free(stats);
+	}
 
 	return !ok;
 }
@@ -0,0 +1,1118 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bdmv.h"
+#include "title.h"
+#include "util.h"
+
+/*
+ * The titles are built the same way libbluray builds them in nav_title_open
+ * and _fill_title_info, so that they can be used interchangeably. All times in
+ * MPLS and CLPI files are in 45 kHz ticks, BLURAY_* structs use 90 kHz ticks.
+ */
+
+#define MAX_ANGLES 9
+
+/**
+ * Big-endian reader over a mapped file. Reading past the end sets *err* to 1
+ * and returns zeros, failed allocations set it to -1.
+ */
+struct reader {
+	const uint8_t *buf;
+	size_t         size;
+	size_t         pos;
+	int            err;
+};
+
+static void reader_overrun(struct reader *r)
+{
+	if(!r->err)
+		r->err = 1;
+	r->pos = r->size;
+}
+
+static uint32_t read_be(struct reader *r, size_t n)
+{
+	if(r->size - r->pos < n)
+	{
+		reader_overrun(r);
+		return 0;
+	}
+	uint32_t v = 0;
+	for(size_t i = 0; i < n; i++)
+		v = v << 8 | r->buf[r->pos++];
+	return v;
+}
+
+static uint8_t read8(struct reader *r)
+{
+	return read_be(r, 1);
+}
+
+static uint16_t read16(struct reader *r)
+{
+	return read_be(r, 2);
+}
+
+static uint32_t read32(struct reader *r)
+{
+	return read_be(r, 4);
+}
+
+static void reader_seek(struct reader *r, size_t pos)
+{
+	if(pos > r->size)
+		reader_overrun(r);
+	else
+		r->pos = pos;
+}
+
+static void reader_skip(struct reader *r, size_t n)
+{
+	reader_seek(r, r->size - r->pos < n ? r->size + 1 : r->pos + n);
+}
+
+static void read_string(struct reader *r, char *dst, size_t n)
+{
+	if(r->size - r->pos < n)
+	{
+		reader_overrun(r);
+		memset(dst, 0, n + 1);
+		return;
+	}
+	memcpy(dst, r->buf + r->pos, n);
+	dst[n] = '\0';
+	r->pos += n;
+}
+
+static int map_file(const char *path, struct reader *r)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return -1;
+	struct stat st;
+	void *buf = MAP_FAILED;
+	if(fstat(fd, &st) == 0)
+	{
+		if(st.st_size > 0)
+			buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		else
+			errno = EINVAL;
+	}
+	int errnum = errno;
+	close(fd);
+	if(buf == MAP_FAILED)
+	{
+		errno = errnum;
+		return -1;
+	}
+	r->buf  = buf;
+	r->size = st.st_size;
+	r->pos  = 0;
+	r->err  = 0;
+	return 0;
+}
+
+static void unmap_file(struct reader *r)
+{
+	munmap((void *)r->buf, r->size);
+}
+
+/**
+ * Map and parse the file *name* in the directory *dir* of the BDMV
+ * directory of *root*, falling back to the copy in BDMV/BACKUP if it cannot be parsed.
+ *
+ * Returns 0 on success, -1 on error with errno set or -2 if neither copy could
+ * be parsed.
+ */
+static int parse_bdmv_file(const char *root, const char *dir, const char *name,
+		int (*parse)(struct reader *r, void *data), void *data)
+{
+	int err = -2;
+	for(int backup = 0; backup < 2; backup++)
+	{
+		char *path;
+		if(asprintf(&path, "%s/BDMV/%s%s/%s", root, backup ? "BACKUP/" : "", dir, name) < 0)
+			return -1;
+		struct reader r;
+		int mapped = map_file(path, &r);
+		free(path);
+		if(mapped < 0)
+		{
+			if(errno == ENOMEM)
+				return -1;
+			continue;
+		}
+		err = parse(&r, data);
+		unmap_file(&r);
+		if(err != -2)
+			return err;
+	}
+	return err;
+}
+
+struct ep_point {
+	uint32_t pts;
+	uint32_t spn;
+};
+
+struct stream_aspect {
+	uint16_t pid;
+	uint8_t  aspect;
+};
+
+/**
+ * The parts of a clip information file needed for a title.
+ */
+struct clpi {
+	char                  clip_id[6];
+	int                   err;
+	uint32_t              num_source_packets;
+	struct stream_aspect *aspects;
+	size_t                numaspects;
+	struct ep_point      *eps;
+	size_t                numeps;
+};
+
+static int is_video_coding_type(uint8_t coding_type)
+{
+	switch(coding_type)
+	{
+	case 0x01: // MPEG-1
+	case 0x02: // MPEG-2
+	case 0x1b: // H.264
+	case 0x20: // MVC
+	case 0x24: // HEVC
+	case 0xea: // VC-1
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void parse_clpi_programs(struct reader *r, struct clpi *clpi)
+{
+	read32(r); // length
+	read8(r);  // reserved
+	uint8_t numprograms = read8(r);
+	for(uint8_t i = 0; i < numprograms && !r->err; i++)
+	{
+		read32(r); // SPN_program_sequence_start
+		read16(r); // program_map_PID
+		uint8_t numstreams = read8(r);
+		read8(r);  // num_groups
+		for(uint8_t j = 0; j < numstreams && !r->err; j++)
+		{
+			uint16_t pid = read16(r);
+			uint8_t  len = read8(r);
+			size_t   end = r->pos + len;
+			uint8_t coding_type = read8(r);
+			if(is_video_coding_type(coding_type))
+			{
+				read8(r); // format and rate
+				uint8_t aspect = read8(r) >> 4;
+				struct stream_aspect *grown = array_reserve(clpi->aspects, clpi->numaspects, 1,
+						sizeof(*clpi->aspects));
+				if(!grown)
+				{
+					r->err = -1;
+					return;
+				}
+				clpi->aspects = grown;
+				clpi->aspects[clpi->numaspects].pid    = pid;
+				clpi->aspects[clpi->numaspects].aspect = aspect;
+				clpi->numaspects++;
+			}
+			reader_seek(r, end);
+		}
+	}
+}
+
+static void parse_clpi_ep_map(struct reader *r, struct clpi *clpi)
+{
+	if(read32(r) == 0) // length
+		return;
+	read16(r); // reserved and CPI_type
+	size_t ep_map_pos = r->pos;
+	read8(r);  // reserved
+	uint8_t numpids = read8(r);
+	if(numpids < 1)
+		return;
+
+	// only the entry points of the first stream are used
+	read16(r); // PID
+	uint32_t x = read16(r);
+	uint32_t y = read32(r);
+	uint32_t numcoarse = (x & 0x3) << 14 | y >> 18;
+	uint32_t numfine   = y & 0x3ffff;
+	size_t   start     = ep_map_pos + read32(r);
+	if(r->err || numcoarse == 0 || numfine == 0)
+		return;
+
+	reader_seek(r, start);
+	size_t fine_start = start + read32(r);
+	uint32_t *coarse = malloc(numcoarse * 2 * sizeof(*coarse) + 1);
+	if(!coarse || !(clpi->eps = malloc(numfine * sizeof(*clpi->eps))))
+	{
+		free(coarse);
+		r->err = -1;
+		return;
+	}
+	for(uint32_t i = 0; i < numcoarse; i++)
+	{
+		coarse[2 * i]     = read32(r); // ref_to_EP_fine_id and PTS_EP_coarse
+		coarse[2 * i + 1] = read32(r); // SPN_EP_coarse
+	}
+	reader_seek(r, fine_start);
+	for(uint32_t i = 0, c = 0; i < numfine && !r->err; i++)
+	{
+		while(c + 1 < numcoarse && coarse[2 * (c + 1)] >> 14 <= i)
+			c++;
+		uint32_t fine = read32(r);
+		uint32_t coarse_pts = (coarse[2 * c] & 0x3ffe) << 18;
+		clpi->eps[i].pts = coarse_pts + ((fine >> 17 & 0x7ff) << 8);
+		clpi->eps[i].spn = (coarse[2 * c + 1] & ~0x1ffffu) + (fine & 0x1ffff);
+	}
+	free(coarse);
+	clpi->numeps = numfine;
+}
+
+static int parse_clpi(struct reader *r, void *data)
+{
+	struct clpi *clpi = data;
+	free(clpi->aspects);
+	free(clpi->eps);
+	clpi->aspects    = NULL;
+	clpi->numaspects = 0;
+	clpi->eps        = NULL;
+	clpi->numeps     = 0;
+
+	if(r->size < 60 || memcmp(r->buf, "HDMV", 4) != 0)
+		return -2;
+	reader_seek(r, 12);
+	uint32_t program_start = read32(r);
+	uint32_t cpi_start     = read32(r);
+	reader_seek(r, 56);
+	clpi->num_source_packets = read32(r);
+
+	reader_seek(r, program_start);
+	parse_clpi_programs(r, clpi);
+	if(r->err == 0 && cpi_start > 0)
+	{
+		reader_seek(r, cpi_start);
+		parse_clpi_ep_map(r, clpi);
+	}
+	return r->err < 0 ? -1 : r->err ? -2 : 0;
+}
+
+static void free_clpi(struct clpi *clpi)
+{
+	free(clpi->aspects);
+	free(clpi->eps);
+}
+
+/**
+ * Look up the source packet number of the entry point at or before
+ * *timestamp* if *before* is set, or of the first entry point after it
+ * otherwise.
+ */
+static uint32_t clpi_lookup_spn(const struct clpi *clpi, uint32_t timestamp, int before)
+{
+	if(!clpi || clpi->numeps == 0)
+		return before || !clpi ? 0 : clpi->num_source_packets;
+	size_t lo = 0;
+	size_t hi = clpi->numeps;
+	while(lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if(clpi->eps[mid].pts > timestamp)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if(before)
+		return lo > 0 ? clpi->eps[lo - 1].spn : 0;
+	return lo < clpi->numeps ? clpi->eps[lo].spn : clpi->num_source_packets;
+}
+
+static uint8_t clpi_lookup_aspect(const struct clpi *clpi, uint16_t pid)
+{
+	if(clpi)
+		for(size_t i = 0; i < clpi->numaspects; i++)
+			if(clpi->aspects[i].pid == pid)
+				return clpi->aspects[i].aspect;
+	return 0;
+}
+
+struct mpls_item {
+	char                clip_ids[MAX_ANGLES][6];
+	uint8_t             angle_count;
+	uint32_t            in_time;
+	uint32_t            out_time;
+	uint8_t             still_mode;
+	uint16_t            still_time;
+	/** counts of video, audio, pg, ig, sec_audio, and sec_video streams */
+	uint8_t             counts[6];
+	/** the streams in the order of *counts* */
+	BLURAY_STREAM_INFO *streams;
+	/** stream_type of the first stream of each kind, see fill_streams */
+	uint8_t             first_types[6];
+};
+
+struct mpls_mark {
+	uint8_t  type;
+	uint16_t item;
+	uint32_t time;
+	uint16_t pid;
+	uint32_t duration;
+};
+
+struct mpls {
+	uint32_t          playlist;
+	int               err;
+	uint8_t           mvc_base_view_r_flag;
+	uint16_t          numsubpaths;
+	uint16_t          numitems;
+	struct mpls_item *items;
+	uint16_t          nummarks;
+	struct mpls_mark *marks;
+};
+
+static void free_mpls(struct mpls *pl)
+{
+	if(pl->items)
+		for(uint16_t i = 0; i < pl->numitems; i++)
+			free(pl->items[i].streams);
+	free(pl->items);
+	free(pl->marks);
+	pl->items    = NULL;
+	pl->numitems = 0;
+	pl->marks    = NULL;
+	pl->nummarks = 0;
+}
+
+static void read_stream(struct reader *r, BLURAY_STREAM_INFO *stream, uint8_t *stream_type)
+{
+	memset(stream, 0, sizeof(*stream));
+
+	// stream entry
+	uint8_t len = read8(r);
+	size_t  end = r->pos + len;
+	*stream_type = read8(r);
+	switch(*stream_type)
+	{
+	case 1:
+		stream->pid = read16(r);
+		break;
+	case 2:
+	case 4:
+		stream->subpath_id = read8(r);
+		read8(r); // subclip_id
+		stream->pid = read16(r);
+		break;
+	case 3:
+		stream->subpath_id = read8(r);
+		stream->pid = read16(r);
+		break;
+	}
+	reader_seek(r, end);
+
+	// stream attributes
+	len = read8(r);
+	end = r->pos + len;
+	stream->coding_type = read8(r);
+	switch(stream->coding_type)
+	{
+	case 0x01:
+	case 0x02:
+	case 0x1b:
+	case 0x20:
+	case 0x24:
+	case 0xea:
+		{
+			uint8_t x = read8(r);
+			stream->format = x >> 4;
+			stream->rate   = x & 0xf;
+		}
+		break;
+	case 0x03:
+	case 0x04:
+	case 0x80:
+	case 0x81:
+	case 0x82:
+	case 0x83:
+	case 0x84:
+	case 0x85:
+	case 0x86:
+	case 0xa1:
+	case 0xa2:
+		{
+			uint8_t x = read8(r);
+			stream->format = x >> 4;
+			stream->rate   = x & 0xf;
+			read_string(r, (char *)stream->lang, 3);
+		}
+		break;
+	case 0x90:
+	case 0x91:
+		read_string(r, (char *)stream->lang, 3);
+		break;
+	case 0x92:
+		stream->char_code = read8(r);
+		read_string(r, (char *)stream->lang, 3);
+		break;
+	}
+	reader_seek(r, end);
+}
+
+static void skip_stream_refs(struct reader *r)
+{
+	uint8_t n = read8(r);
+	read8(r); // reserved
+	reader_skip(r, n + n % 2);
+}
+
+static void parse_stn(struct reader *r, struct mpls_item *item)
+{
+	uint16_t len = read16(r);
+	size_t   end = r->pos + len;
+	read16(r); // reserved
+	uint8_t numvideo    = read8(r);
+	uint8_t numaudio    = read8(r);
+	uint8_t numpg       = read8(r);
+	uint8_t numig       = read8(r);
+	uint8_t numsecaudio = read8(r);
+	uint8_t numsecvideo = read8(r);
+	uint8_t numpippg    = read8(r);
+	reader_skip(r, 5); // reserved
+
+	item->counts[0] = numvideo;
+	item->counts[1] = numaudio;
+	item->counts[2] = numpg + numpippg;
+	item->counts[3] = numig;
+	item->counts[4] = numsecaudio;
+	item->counts[5] = numsecvideo;
+	size_t total = (size_t)numvideo + numaudio + numpg + numpippg + numig
+			+ numsecaudio + numsecvideo;
+	if(r->err)
+		return;
+	if(!(item->streams = malloc(total * sizeof(*item->streams) + 1)))
+	{
+		r->err = -1;
+		return;
+	}
+
+	BLURAY_STREAM_INFO *stream = item->streams;
+	for(int kind = 0; kind < 6; kind++)
+		for(uint8_t i = 0; i < item->counts[kind] && !r->err; i++, stream++)
+		{
+			uint8_t stream_type;
+			read_stream(r, stream, &stream_type);
+			if(i == 0)
+				item->first_types[kind] = stream_type;
+			if(kind == 4)
+				skip_stream_refs(r); // primary audio
+			else if(kind == 5)
+			{
+				skip_stream_refs(r); // secondary audio
+				skip_stream_refs(r); // PiP PG
+			}
+		}
+	reader_seek(r, end);
+}
+
+static void parse_play_item(struct reader *r, struct mpls_item *item)
+{
+	uint16_t len = read16(r);
+	size_t   end = r->pos + len;
+	read_string(r, item->clip_ids[0], 5);
+	reader_skip(r, 4); // codec identifier
+	uint8_t is_multi_angle = read16(r) >> 4 & 1;
+	read8(r); // ref_to_STC_id
+	item->in_time  = read32(r);
+	item->out_time = read32(r);
+	reader_skip(r, 8); // UO_mask_table
+	read8(r); // random access flag
+	item->still_mode = read8(r);
+	item->still_time = read16(r);
+	if(item->still_mode != 0x01)
+		item->still_time = 0;
+
+	item->angle_count = 1;
+	if(is_multi_angle)
+	{
+		item->angle_count = read8(r);
+		if(item->angle_count < 1)
+			item->angle_count = 1;
+		else if(item->angle_count > MAX_ANGLES)
+			r->err = 1;
+		read8(r); // is_different_audios and is_seamless_angle_change
+		for(uint8_t i = 1; i < item->angle_count && !r->err; i++)
+		{
+			read_string(r, item->clip_ids[i], 5);
+			reader_skip(r, 4); // codec identifier
+			read8(r); // ref_to_STC_id
+		}
+	}
+	parse_stn(r, item);
+	reader_seek(r, end);
+}
+
+static int parse_mpls(struct reader *r, void *data)
+{
+	struct mpls *pl = data;
+	free_mpls(pl);
+
+	if(r->size < 40 || memcmp(r->buf, "MPLS", 4) != 0)
+		return -2;
+	reader_seek(r, 8);
+	uint32_t list_start = read32(r);
+	uint32_t mark_start = read32(r);
+
+	// AppInfoPlayList
+	reader_seek(r, 40);
+	read32(r); // length
+	reader_skip(r, 12); // reserved, playback type and count, UO_mask_table
+	pl->mvc_base_view_r_flag = read8(r) >> 4 & 1;
+
+	reader_seek(r, list_start);
+	read32(r); // length
+	read16(r); // reserved
+	pl->numitems    = read16(r);
+	pl->numsubpaths = read16(r);
+	if(r->err)
+		return -2;
+	if(!(pl->items = calloc(pl->numitems + 1, sizeof(*pl->items))))
+		return -1;
+	for(uint16_t i = 0; i < pl->numitems && !r->err; i++)
+		parse_play_item(r, pl->items + i);
+
+	reader_seek(r, mark_start);
+	read32(r); // length
+	pl->nummarks = read16(r);
+	if(r->err)
+		goto error;
+	if(!(pl->marks = malloc(pl->nummarks * sizeof(*pl->marks) + 1)))
+	{
+		r->err = -1;
+		goto error;
+	}
+	for(uint16_t i = 0; i < pl->nummarks; i++)
+	{
+		struct mpls_mark *mark = pl->marks + i;
+		read8(r); // reserved
+		mark->type     = read8(r);
+		mark->item     = read16(r);
+		mark->time     = read32(r);
+		mark->pid      = read16(r);
+		mark->duration = read32(r);
+	}
+	if(r->err)
+		goto error;
+	return 0;
+
+error:
+	free_mpls(pl);
+	return r->err < 0 ? -1 : -2;
+}
+
+/**
+ * Parsed playlists and the clips they reference.
+ */
+struct bdmv {
+	const char   *root;
+	struct mpls  *playlists;
+	size_t        numplaylists;
+	struct clpi  *clips;
+	size_t        numclips;
+};
+
+static void parse_playlist_job(size_t i, void *data)
+{
+	struct bdmv *bdmv = data;
+	struct mpls *pl   = bdmv->playlists + i;
+	char name[16];
+	snprintf(name, sizeof(name), "%05"PRIu32".mpls", pl->playlist);
+	pl->err = parse_bdmv_file(bdmv->root, "PLAYLIST", name, parse_mpls, pl);
+	if(pl->err == -1)
+		pl->err = errno;
+	else if(pl->err == -2)
+		pl->err = -1;
+}
+
+static void parse_clip_job(size_t i, void *data)
+{
+	struct bdmv *bdmv = data;
+	struct clpi *clpi = bdmv->clips + i;
+	char name[16];
+	snprintf(name, sizeof(name), "%s.clpi", clpi->clip_id);
+	clpi->err = parse_bdmv_file(bdmv->root, "CLIPINF", name, parse_clpi, clpi);
+	if(clpi->err == -1)
+		clpi->err = errno;
+	else if(clpi->err == -2)
+		clpi->err = -1;
+}
+
+static int cmp_clpi(const void *a, const void *b)
+{
+	return strcmp(((const struct clpi *)a)->clip_id, ((const struct clpi *)b)->clip_id);
+}
+
+static const struct clpi *find_clip(const struct bdmv *bdmv, const char *clip_id)
+{
+	struct clpi key;
+	memcpy(key.clip_id, clip_id, sizeof(key.clip_id));
+	const struct clpi *clpi = bsearch(&key, bdmv->clips, bdmv->numclips,
+			sizeof(*bdmv->clips), cmp_clpi);
+	return clpi && clpi->err == 0 ? clpi : NULL;
+}
+
+/**
+ * Parse the clip information files of all successfully parsed playlists.
+ *
+ * Returns 0 on success or -1 on error with errno set.
+ */
+static int parse_clips(struct bdmv *bdmv, size_t numthreads)
+{
+	size_t n = 0;
+	for(size_t i = 0; i < bdmv->numplaylists; i++)
+		if(bdmv->playlists[i].err == 0)
+			for(uint16_t j = 0; j < bdmv->playlists[i].numitems; j++)
+				n += bdmv->playlists[i].items[j].angle_count;
+	if(!(bdmv->clips = calloc(n + 1, sizeof(*bdmv->clips))))
+		return -1;
+	for(size_t i = 0; i < bdmv->numplaylists; i++)
+		if(bdmv->playlists[i].err == 0)
+			for(uint16_t j = 0; j < bdmv->playlists[i].numitems; j++)
+			{
+				const struct mpls_item *item = bdmv->playlists[i].items + j;
+				for(uint8_t k = 0; k < item->angle_count; k++)
+					memcpy(bdmv->clips[bdmv->numclips++].clip_id, item->clip_ids[k],
+							sizeof(item->clip_ids[k]));
+			}
+
+	// deduplicate clips
+	qsort(bdmv->clips, bdmv->numclips, sizeof(*bdmv->clips), cmp_clpi);
+	n = 0;
+	for(size_t i = 0; i < bdmv->numclips; i++)
+		if(n == 0 || cmp_clpi(bdmv->clips + n - 1, bdmv->clips + i) != 0)
+			bdmv->clips[n++] = bdmv->clips[i];
+	bdmv->numclips = n;
+
+	if((errno = parallel_for(bdmv->numclips, numthreads, parse_clip_job, bdmv)))
+		return -1;
+	for(size_t i = 0; i < bdmv->numclips; i++)
+		if(bdmv->clips[i].err > 0)
+		{
+			errno = bdmv->clips[i].err;
+			return -1;
+		}
+	return 0;
+}
+
+static void free_bdmv(struct bdmv *bdmv)
+{
+	for(size_t i = 0; i < bdmv->numplaylists; i++)
+		free_mpls(bdmv->playlists + i);
+	free(bdmv->playlists);
+	for(size_t i = 0; i < bdmv->numclips; i++)
+		free_clpi(bdmv->clips + i);
+	free(bdmv->clips);
+}
+
+static void fill_streams(BLURAY_STREAM_INFO *dst, const BLURAY_STREAM_INFO *src,
+		size_t n, uint8_t first_type, const struct clpi *clpi)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		dst[i] = src[i];
+		dst[i].aspect = clpi_lookup_aspect(clpi, src[i].pid);
+		// libbluray decides by the first stream of the kind
+		if(first_type != 2 && first_type != 3)
+			dst[i].subpath_id = -1;
+		else
+			dst[i].subpath_id = src[0].subpath_id;
+	}
+}
+
+/**
+ * Compute chapter or mark starts and offsets like _extrapolate_title does.
+ * A mark lasts until the next one or the end of the title.
+ */
+#define FILL_MARKS(list, count, filter) \
+	do \
+	{ \
+		count = 0; \
+		for(uint16_t i = 0; i < pl->nummarks; i++) \
+		{ \
+			const struct mpls_mark *m = pl->marks + i; \
+			if(!(filter)) \
+				continue; \
+			__typeof__(*list) *mark = list + count; \
+			mark->idx      = count; \
+			mark->clip_ref = m->item; \
+			mark->duration = 0; \
+			if(m->item < pl->numitems) \
+			{ \
+				const BLURAY_CLIP_INFO *clip = title.clips + m->item; \
+				uint32_t spn = clip_lookup(bdmv, pl, m->item, angle, m->time, 1); \
+				uint32_t start = clip->start_time / 2 + m->time - pl->items[m->item].in_time; \
+				mark->start  = 2 * (uint64_t)start; \
+				mark->offset = (uint64_t)(title_pkts[m->item] + spn - start_pkts[m->item]) * 192; \
+			} \
+			else \
+			{ \
+				mark->start  = 0; \
+				mark->offset = 0; \
+			} \
+			if(count > 0) \
+				list[count - 1].duration = mark->start - list[count - 1].start; \
+			count++; \
+		} \
+		if(count > 0) \
+			list[count - 1].duration = title.duration - list[count - 1].start; \
+	} \
+	while(0)
+
+static uint32_t clip_lookup(const struct bdmv *bdmv, const struct mpls *pl,
+		uint16_t item, unsigned angle, uint32_t timestamp, int before)
+{
+	const struct mpls_item *pi = pl->items + item;
+	const struct clpi *clpi = find_clip(bdmv, pi->clip_ids[angle < pi->angle_count ? angle : 0]);
+	return clpi ? clpi_lookup_spn(clpi, timestamp, before) : 0;
+}
+
+/**
+ * Build the title of the parsed playlist *pl* for *angle*.
+ */
+static BLURAY_TITLE_INFO *build_title(const struct bdmv *bdmv, const struct mpls *pl,
+		unsigned angle, uint32_t idx)
+{
+	BLURAY_TITLE_INFO title;
+	memset(&title, 0, sizeof(title));
+	title.idx                  = idx;
+	title.playlist             = pl->playlist;
+	title.clip_count           = pl->numitems;
+	title.angle_count          = 1;
+	title.mvc_base_view_r_flag = pl->mvc_base_view_r_flag;
+
+	BLURAY_TITLE_INFO *result = NULL;
+	BLURAY_STREAM_INFO *streams = NULL;
+	uint32_t *title_pkts = malloc(2 * (size_t)pl->numitems * sizeof(*title_pkts) + 1);
+	uint32_t *start_pkts = title_pkts + pl->numitems;
+	title.clips    = calloc(pl->numitems + 1, sizeof(*title.clips));
+	title.chapters = malloc(pl->nummarks * sizeof(*title.chapters) + 1);
+	title.marks    = malloc(pl->nummarks * sizeof(*title.marks) + 1);
+	size_t numstreams = 0;
+	for(uint16_t i = 0; i < pl->numitems; i++)
+		for(int kind = 0; kind < 6; kind++)
+			numstreams += pl->items[i].counts[kind];
+	streams = malloc(numstreams * sizeof(*streams) + 1);
+	if(!title_pkts || !title.clips || !title.chapters || !title.marks || !streams)
+		goto cleanup;
+
+	uint64_t duration = 0;
+	uint32_t pkts     = 0;
+	BLURAY_STREAM_INFO *dst = streams;
+	for(uint16_t i = 0; i < pl->numitems; i++)
+	{
+		const struct mpls_item *pi = pl->items + i;
+		BLURAY_CLIP_INFO *clip = title.clips + i;
+		const char *clip_id = pi->clip_ids[angle < pi->angle_count ? angle : 0];
+		const struct clpi *clpi = find_clip(bdmv, clip_id);
+		if(pi->angle_count > title.angle_count)
+			title.angle_count = pi->angle_count;
+
+		memcpy(clip->clip_id, clip_id, sizeof(clip->clip_id));
+		start_pkts[i] = clpi ? clpi_lookup_spn(clpi, pi->in_time, 1) : 0;
+		uint32_t end_pkt = clpi ? clpi_lookup_spn(clpi, pi->out_time, 0) : 0;
+		title_pkts[i] = pkts;
+		pkts += end_pkt - start_pkts[i];
+
+		clip->pkt_count  = end_pkt - start_pkts[i];
+		clip->still_mode = pi->still_mode;
+		clip->still_time = pi->still_time;
+		clip->start_time = 2 * duration;
+		clip->in_time    = 2 * (uint64_t)pi->in_time;
+		clip->out_time   = 2 * (uint64_t)pi->out_time;
+		duration += (uint32_t)(pi->out_time - pi->in_time);
+
+		const BLURAY_STREAM_INFO *src = pi->streams;
+#define FILL_STREAMS(streams, count, kind) \
+		do \
+		{ \
+			clip->count   = pi->counts[kind]; \
+			clip->streams = dst; \
+			fill_streams(dst, src, clip->count, pi->first_types[kind], clpi); \
+			dst += clip->count; \
+			src += clip->count; \
+		} \
+		while(0)
+		FILL_STREAMS(video_streams,     video_stream_count,     0);
+		FILL_STREAMS(audio_streams,     audio_stream_count,     1);
+		FILL_STREAMS(pg_streams,        pg_stream_count,        2);
+		FILL_STREAMS(ig_streams,        ig_stream_count,        3);
+		FILL_STREAMS(sec_audio_streams, sec_audio_stream_count, 4);
+		FILL_STREAMS(sec_video_streams, sec_video_stream_count, 5);
+#undef FILL_STREAMS
+	}
+	title.duration = 2 * duration;
+
+	FILL_MARKS(title.chapters, title.chapter_count, m->type == BLURAY_MARK_ENTRY);
+	FILL_MARKS(title.marks, title.mark_count, 1);
+	for(uint32_t i = 0; i < title.mark_count; i++)
+		title.marks[i].type = pl->marks[i].type;
+
+	result = title_dup(&title);
+
+cleanup:
+	free(title_pkts);
+	free(title.clips);
+	free(title.chapters);
+	free(title.marks);
+	free(streams);
+	return result;
+}
+
+#undef FILL_MARKS
+
+/**
+ * Test if a play item of *pl* is repeated more than *repeats* times, see
+ * _filter_repeats.
+ */
+static int has_repeats(const struct mpls *pl, unsigned repeats)
+{
+	for(uint16_t i = 0; i < pl->numitems; i++)
+	{
+		const struct mpls_item *a = pl->items + i;
+		unsigned count = 0;
+		for(uint16_t j = i; j < pl->numitems; j++)
+		{
+			const struct mpls_item *b = pl->items + j;
+			if(strcmp(a->clip_ids[0], b->clip_ids[0]) == 0
+					&& a->in_time == b->in_time && a->out_time == b->out_time)
+				count++;
+		}
+		if(count > repeats)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Test if two playlists play the same items with the same marks, see _pl_cmp.
+ */
+static int same_playlist(const struct mpls *a, const struct mpls *b)
+{
+	if(a->numitems != b->numitems || a->nummarks != b->nummarks
+			|| a->numsubpaths != b->numsubpaths)
+		return 0;
+	for(uint16_t i = 0; i < a->numitems; i++)
+		if(strcmp(a->items[i].clip_ids[0], b->items[i].clip_ids[0]) != 0
+				|| a->items[i].in_time != b->items[i].in_time
+				|| a->items[i].out_time != b->items[i].out_time)
+			return 0;
+	for(uint16_t i = 0; i < a->nummarks; i++)
+		if(a->marks[i].type != b->marks[i].type || a->marks[i].item != b->marks[i].item
+				|| a->marks[i].time != b->marks[i].time
+				|| a->marks[i].pid != b->marks[i].pid
+				|| a->marks[i].duration != b->marks[i].duration)
+			return 0;
+	return 1;
+}
+
+static int is_playlist_name(const struct dirent *entry)
+{
+	const char *name = entry->d_name;
+	for(int i = 0; i < 5; i++)
+		if(name[i] < '0' || name[i] > '9')
+			return 0;
+	return strcmp(name + 5, ".mpls") == 0;
+}
+
+struct build_titles {
+	const struct bdmv  *bdmv;
+	const size_t       *selected;
+	BLURAY_TITLE_INFO **titles;
+};
+
+static void build_title_job(size_t i, void *data)
+{
+	struct build_titles *build = data;
+	build->titles[i] = build_title(build->bdmv,
+			build->bdmv->playlists + build->selected[i], 0, i);
+}
+
+int bdmv_get_titles(const char *root, int filter_flags, size_t numthreads,
+		BLURAY_TITLE_INFO ***titles_, size_t *numtitles_)
+{
+	struct bdmv bdmv = {root, NULL, 0, NULL, 0};
+	struct dirent **entries = NULL;
+	size_t *selected = NULL;
+	BLURAY_TITLE_INFO **titles = NULL;
+	size_t numtitles = 0;
+	int err = -1;
+
+	char *dir;
+	if(asprintf(&dir, "%s/BDMV/PLAYLIST", root) < 0)
+		return -1;
+	int n = scandir(dir, &entries, is_playlist_name, alphasort);
+	free(dir);
+	if(n < 0)
+		return errno == ENOMEM ? -1 : -2;
+
+	if(!(bdmv.playlists = calloc(n + 1, sizeof(*bdmv.playlists))))
+		goto error;
+	for(; bdmv.numplaylists < (size_t)n; bdmv.numplaylists++)
+		bdmv.playlists[bdmv.numplaylists].playlist = strtoul(entries[bdmv.numplaylists]->d_name, NULL, 10);
+
+	if((errno = parallel_for(bdmv.numplaylists, numthreads, parse_playlist_job, &bdmv)))
+		goto error;
+	for(size_t i = 0; i < bdmv.numplaylists; i++)
+		if(bdmv.playlists[i].err > 0)
+		{
+			errno = bdmv.playlists[i].err;
+			goto error;
+		}
+	if(parse_clips(&bdmv, numthreads) < 0)
+		goto error;
+
+	// filter the playlists in order like nav_get_title_list
+	if(!(selected = malloc(bdmv.numplaylists * sizeof(*selected) + 1)))
+		goto error;
+	size_t numselected = 0;
+	for(size_t i = 0; i < bdmv.numplaylists; i++)
+	{
+		const struct mpls *pl = bdmv.playlists + i;
+		if(pl->err != 0)
+			continue;
+		if(filter_flags & TITLES_FILTER_DUP_TITLE)
+		{
+			size_t j = 0;
+			while(j < numselected && !same_playlist(pl, bdmv.playlists + selected[j]))
+				j++;
+			if(j < numselected)
+				continue;
+		}
+		if((filter_flags & TITLES_FILTER_DUP_CLIP) && has_repeats(pl, 2))
+			continue;
+		selected[numselected++] = i;
+	}
+
+	if(!(titles = array_reserve(NULL, 0, numselected > 0 ? numselected : 1, sizeof(*titles))))
+		goto error;
+	struct build_titles build = {&bdmv, selected, titles};
+	if((errno = parallel_for(numselected, numthreads, build_title_job, &build)))
+		goto error;
+	for(; numtitles < numselected; numtitles++)
+		if(!titles[numtitles])
+		{
+			for(size_t i = numtitles + 1; i < numselected; i++)
+				free(titles[i]);
+			errno = ENOMEM;
+			goto error;
+		}
+
+	*titles_    = titles;
+	*numtitles_ = numtitles;
+	err = 0;
+
+	if(0)
+	{
+	error:
+		{
+			int errnum = errno;
+			for(size_t i = 0; i < numtitles; i++)
+				free(titles[i]);
+			free(titles);
+			errno = errnum;
+		}
+	}
+	{
+		int errnum = errno;
+		for(int i = 0; i < n; i++)
+			free(entries[i]);
+		free(entries);
+		free(selected);
+		free_bdmv(&bdmv);
+		errno = errnum;
+	}
+	return err;
+}
+
+int bdmv_get_playlist(const char *root, uint32_t playlist, unsigned angle,
+		BLURAY_TITLE_INFO **title)
+{
+	struct bdmv bdmv = {root, NULL, 0, NULL, 0};
+	int err = -1;
+	if(!(bdmv.playlists = calloc(1, sizeof(*bdmv.playlists))))
+		return -1;
+	bdmv.playlists->playlist = playlist;
+	bdmv.numplaylists = 1;
+	parse_playlist_job(0, &bdmv);
+	if(bdmv.playlists->err != 0)
+	{
+		if(bdmv.playlists->err > 0)
+			errno = bdmv.playlists->err;
+		else
+			err = -2;
+		goto cleanup;
+	}
+	if(parse_clips(&bdmv, 1) < 0)
+		goto cleanup;
+	if((*title = build_title(&bdmv, bdmv.playlists, angle, 0)))
+		err = 0;
+
+cleanup:
+	{
+		int errnum = errno;
+		free_bdmv(&bdmv);
+		errno = errnum;
+	}
+	return err;
+}
+
+int bdmv_clip_packets(const char *root, const char *clip_id, uint64_t in_time,
+		uint64_t out_time, uint32_t *start, uint32_t *end)
+{
+	struct clpi clpi;
+	memset(&clpi, 0, sizeof(clpi));
+	char name[16];
+	snprintf(name, sizeof(name), "%.5s.clpi", clip_id);
+	int err = parse_bdmv_file(root, "CLIPINF", name, parse_clpi, &clpi);
+	if(err == 0)
+	{
+		*start = clpi_lookup_spn(&clpi, in_time / 2, 1);
+		*end   = clpi_lookup_spn(&clpi, out_time / 2, 0);
+	}
+	free_clpi(&clpi);
+	return err;
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BDMV_H_INCLUDED
+#define BDMV_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+/**
+ * Read the titles of the Blu-ray directory *root* by parsing its playlists and
+ * clip information files directly, like bd_get_titles with *filter_flags* and
+ * bd_get_title_info for every title would. The files are parsed by up to
+ * *numthreads* threads.
+ *
+ * The titles are stored in *\*titles* in the order of their playlist numbers
+ * and are allocated as by title_dup. *\*titles* can be extended with
+ * array_reserve.
+ *
+ * Returns 0 on success, -1 on error with errno set or -2 if *root* is not a
+ * Blu-ray directory that can be parsed.
+ */
+int bdmv_get_titles(const char *root, int filter_flags, size_t numthreads,
+		BLURAY_TITLE_INFO ***titles, size_t *numtitles);
+
+/**
+ * Read the title of *playlist* with angle *angle* from the Blu-ray directory
+ * *root*, like bd_get_playlist_info would. The title has to be freed with
+ * free.
+ *
+ * Returns 0 on success, -1 on error with errno set or -2 if the playlist could
+ * not be parsed.
+ */
+int bdmv_get_playlist(const char *root, uint32_t playlist, unsigned angle,
+		BLURAY_TITLE_INFO **title);
+
+/**
+ * Look up the source packets of the clip *clip_id* of the Blu-ray directory
+ * *root* that are played from *in_time* to *out_time*, in 90 kHz ticks. The
+ * packets from *\*start* up to *\*end* span the entry points around both
+ * times, like the packet counts of the clips of a title.
+ *
+ * Returns 0 on success, -1 on error with errno set or -2 if the clip
+ * information file could not be parsed.
+ */
+int bdmv_clip_packets(const char *root, const char *clip_id, uint64_t in_time,
+		uint64_t out_time, uint32_t *start, uint32_t *end);
+
+#endif
@@ -0,0 +1,531 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "title.h"
+#include "util.h"
+
+#define CACHE_MAGIC   "BDICACHE"
+#define CACHE_VERSION 1
+#define CACHE_MAX_AGE (90 * 24 * 60 * 60)
+
+struct cache_list {
+	int32_t   filter_flags;
+	uint32_t *playlists;
+	size_t    numplaylists;
+};
+
+struct title_cache {
+	char               *path;
+	uint64_t            id;
+	BLURAY_TITLE_INFO **titles;
+	size_t              numtitles;
+	struct cache_list  *lists;
+	size_t              numlists;
+	int                 dirty;
+};
+
+/**
+ * Hash the contents of the file at *path*.
+ */
+static int hash_file(uint64_t *h, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if(!f)
+		return -1;
+	char buf[4096];
+	size_t n;
+	while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		*h = fnv1a64(*h, buf, n);
+	int err = ferror(f) ? -1 : 0;
+	fclose(f);
+	return err;
+}
+
+/**
+ * Hash names, sizes, and modification times of the files in *path*.
+ */
+static int hash_dir(uint64_t *h, const char *path)
+{
+	struct dirent **entries;
+	int n = scandir(path, &entries, NULL, alphasort);
+	if(n < 0)
+		return -1;
+	int err = 0;
+	for(int i = 0; i < n; i++)
+	{
+		const char *name = entries[i]->d_name;
+		struct stat st;
+		char sub[PATH_MAX];
+		if(!err && name[0] != '.')
+		{
+			if(snprintf(sub, sizeof(sub), "%s/%s", path, name) >= (int)sizeof(sub)
+					|| stat(sub, &st) < 0)
+				err = -1;
+			else
+			{
+				uint64_t meta[3] = {st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+				*h = fnv1a64(*h, name, strlen(name) + 1);
+				*h = fnv1a64(*h, meta, sizeof(meta));
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return err;
+}
+
+int cache_disc_id(const char *src, uint64_t *id)
+{
+	static const char *const subpaths[] = {
+		"/BDMV/index.bdmv",
+		"/BDMV/PLAYLIST",
+		"/BDMV/CLIPINF"
+	};
+	static const uint32_t sizes[] = {
+		CACHE_VERSION,
+		sizeof(BLURAY_TITLE_INFO),
+		sizeof(BLURAY_CLIP_INFO),
+		sizeof(BLURAY_STREAM_INFO),
+		sizeof(BLURAY_TITLE_CHAPTER),
+		sizeof(BLURAY_TITLE_MARK)
+	};
+
+	uint64_t h = fnv1a64(FNV1A64_INIT, sizes, sizeof(sizes));
+	struct stat st;
+	if(stat(src, &st) < 0)
+		return -1;
+	if(S_ISDIR(st.st_mode))
+	{
+		for(size_t i = 0; i < sizeof(subpaths) / sizeof(subpaths[0]); i++)
+		{
+			char path[PATH_MAX];
+			if(snprintf(path, sizeof(path), "%s%s", src, subpaths[i]) >= (int)sizeof(path))
+			{
+				errno = ENAMETOOLONG;
+				return -1;
+			}
+			if((i == 0 ? hash_file : hash_dir)(&h, path) < 0)
+				return -1;
+		}
+	}
+	else if(S_ISREG(st.st_mode))
+	{
+		char *path = realpath(src, NULL);
+		if(!path)
+			return -1;
+		uint64_t meta[4] = {st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+		h = fnv1a64(h, path, strlen(path) + 1);
+		h = fnv1a64(h, meta, sizeof(meta));
+		free(path);
+	}
+	else
+	{
+		errno = ENOTSUP;
+		return -1;
+	}
+	*id = h;
+	return 0;
+}
+
+/**
+ * Get the cache directory and create it if *create* is set.
+ */
+static char *cache_dir(int create)
+{
+	const char *base = getenv("XDG_CACHE_HOME");
+	const char *sub  = "/bdinfo";
+	if(!base || base[0] != '/')
+	{
+		base = getenv("HOME");
+		sub  = "/.cache/bdinfo";
+		if(!base || !*base)
+		{
+			errno = ENOENT;
+			return NULL;
+		}
+	}
+
+	char *dir = malloc(strlen(base) + strlen(sub) + 1);
+	if(!dir)
+		return NULL;
+	strcat(strcpy(dir, base), sub);
+	if(create)
+	{
+		// create all missing parents
+		for(char *c = dir + 1; (c = strchr(c, '/')); c++)
+		{
+			*c = '\0';
+			int err = mkdir(dir, 0755) < 0 && errno != EEXIST;
+			*c = '/';
+			if(err)
+				goto error;
+		}
+		if(mkdir(dir, 0755) < 0 && errno != EEXIST)
+			goto error;
+	}
+	return dir;
+
+error:
+	free(dir);
+	return NULL;
+}
+
+static int cmp_cached_title(const void *a_, const void *b_)
+{
+	const BLURAY_TITLE_INFO *a = *(const void    **)a_;
+	uint32_t                 b = *(const uint32_t *)b_;
+	return (a->playlist > b) - (a->playlist < b);
+}
+
+static int read_all(FILE *f, void *buf, size_t n)
+{
+	return fread(buf, 1, n, f) == n ? 0 : -1;
+}
+
+/**
+ * Load the entry at *cache->path*. An invalid or unreadable entry is treated
+ * as empty.
+ */
+static void cache_load(struct title_cache *cache)
+{
+	FILE *f = fopen(cache->path, "rb");
+	if(!f)
+		return;
+
+	char     magic[8];
+	uint32_t version;
+	uint64_t id;
+	uint32_t n;
+	if(read_all(f, magic, sizeof(magic)) < 0 || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0
+			|| read_all(f, &version, sizeof(version)) < 0 || version != CACHE_VERSION
+			|| read_all(f, &id, sizeof(id)) < 0 || id != cache->id
+			|| read_all(f, &n, sizeof(n)) < 0)
+		goto invalid;
+
+	for(uint32_t i = 0; i < n; i++)
+	{
+		int32_t  filter_flags;
+		uint32_t numplaylists;
+		if(read_all(f, &filter_flags, sizeof(filter_flags)) < 0
+				|| read_all(f, &numplaylists, sizeof(numplaylists)) < 0
+				|| numplaylists > 100000)
+			goto invalid;
+		uint32_t *playlists = malloc(numplaylists * sizeof(*playlists) + 1);
+		if(!playlists || read_all(f, playlists, numplaylists * sizeof(*playlists)) < 0
+				|| cache_put_titles(cache, filter_flags, playlists, numplaylists) < 0)
+		{
+			free(playlists);
+			goto invalid;
+		}
+		free(playlists);
+	}
+
+	if(read_all(f, &n, sizeof(n)) < 0)
+		goto invalid;
+	for(uint32_t i = 0; i < n; i++)
+	{
+		uint64_t size;
+		if(read_all(f, &size, sizeof(size)) < 0 || size > 64 * 1024 * 1024)
+			goto invalid;
+		BLURAY_TITLE_INFO *title = malloc(size);
+		if(!title || read_all(f, title, size) < 0 || title_relocate(title, size) < 0)
+		{
+			free(title);
+			goto invalid;
+		}
+		BLURAY_TITLE_INFO **grown = array_reserve(cache->titles, cache->numtitles, 1,
+				sizeof(*cache->titles));
+		if(!grown)
+		{
+			free(title);
+			goto invalid;
+		}
+		cache->titles = grown;
+		cache->titles[cache->numtitles++] = title;
+	}
+	qsort(cache->titles, cache->numtitles, sizeof(*cache->titles), cmp_cached_title);
+
+	// mark the entry as used, so it is not pruned
+	utimensat(AT_FDCWD, cache->path, NULL, 0);
+
+	if(0)
+	{
+	invalid:
+		for(size_t i = 0; i < cache->numtitles; i++)
+			free(cache->titles[i]);
+		free(cache->titles);
+		cache->titles    = NULL;
+		cache->numtitles = 0;
+		for(size_t i = 0; i < cache->numlists; i++)
+			free(cache->lists[i].playlists);
+		free(cache->lists);
+		cache->lists    = NULL;
+		cache->numlists = 0;
+	}
+	cache->dirty = 0;
+	fclose(f);
+}
+
+struct title_cache *cache_open(const char *src, int refresh)
+{
+	struct title_cache *cache = calloc(1, sizeof(*cache));
+	if(!cache)
+		return NULL;
+	if(cache_disc_id(src, &cache->id) < 0)
+		goto error;
+
+	char *dir = cache_dir(0);
+	if(!dir)
+		goto error;
+	cache->path = malloc(strlen(dir) + 18);
+	if(cache->path)
+		sprintf(cache->path, "%s/%016"PRIx64, dir, cache->id);
+	free(dir);
+	if(!cache->path)
+		goto error;
+
+	if(!refresh)
+		cache_load(cache);
+	return cache;
+
+error:
+	cache_close(cache);
+	return NULL;
+}
+
+struct title_cache *cache_new(void)
+{
+	return calloc(1, sizeof(struct title_cache));
+}
+
+/**
+ * Remove entries from *dir* that were not used for CACHE_MAX_AGE seconds.
+ * Entries of changed Blu-rays are never hit again and would pile up otherwise.
+ */
+static void cache_prune(const char *dir)
+{
+	struct dirent **entries;
+	int n = scandir(dir, &entries, NULL, NULL);
+	if(n < 0)
+		return;
+	time_t now = time(NULL);
+	for(int i = 0; i < n; i++)
+	{
+		const char *name = entries[i]->d_name;
+		char path[PATH_MAX];
+		struct stat st;
+		if(name[0] != '.' && strspn(name, "0123456789abcdef") == 16 && name[16] == '\0'
+				&& snprintf(path, sizeof(path), "%s/%s", dir, name) < (int)sizeof(path)
+				&& stat(path, &st) == 0 && S_ISREG(st.st_mode)
+				&& now - st.st_mtime > CACHE_MAX_AGE)
+			unlink(path);
+		free(entries[i]);
+	}
+	free(entries);
+}
+
+static int write_all(FILE *f, const void *buf, size_t n)
+{
+	return fwrite(buf, 1, n, f) == n ? 0 : -1;
+}
+
+int cache_save(struct title_cache *cache)
+{
+	if(!cache->dirty || !cache->path)
+		return 0;
+
+	char *dir = cache_dir(1);
+	if(!dir)
+		return -1;
+	cache_prune(dir);
+	free(dir);
+
+	// threads of one process may save the same cache at once
+	char *tmp = malloc(strlen(cache->path) + 8);
+	if(!tmp)
+		return -1;
+	sprintf(tmp, "%s.XXXXXX", cache->path);
+	int fd = mkstemp(tmp);
+	FILE *f = fd < 0 ? NULL : fdopen(fd, "wb");
+	if(!f)
+	{
+		int errnum = errno;
+		if(fd >= 0)
+		{
+			close(fd);
+			unlink(tmp);
+		}
+		free(tmp);
+		errno = errnum;
+		return -1;
+	}
+
+	uint32_t version  = CACHE_VERSION;
+	uint32_t numlists = cache->numlists;
+	int err = write_all(f, CACHE_MAGIC, 8) < 0
+			|| write_all(f, &version, sizeof(version)) < 0
+			|| write_all(f, &cache->id, sizeof(cache->id)) < 0
+			|| write_all(f, &numlists, sizeof(numlists)) < 0;
+	for(size_t i = 0; !err && i < cache->numlists; i++)
+	{
+		const struct cache_list *list = cache->lists + i;
+		uint32_t numplaylists = list->numplaylists;
+		err = write_all(f, &list->filter_flags, sizeof(list->filter_flags)) < 0
+				|| write_all(f, &numplaylists, sizeof(numplaylists)) < 0
+				|| write_all(f, list->playlists, numplaylists * sizeof(*list->playlists)) < 0;
+	}
+	uint32_t numtitles = cache->numtitles;
+	if(!err)
+		err = write_all(f, &numtitles, sizeof(numtitles)) < 0;
+	for(size_t i = 0; !err && i < cache->numtitles; i++)
+	{
+		uint64_t size = title_size(cache->titles[i]);
+		err = write_all(f, &size, sizeof(size)) < 0
+				|| write_all(f, cache->titles[i], size) < 0;
+	}
+
+	if(fclose(f) == EOF)
+		err = 1;
+	if(!err && rename(tmp, cache->path) < 0)
+		err = 1;
+	if(err)
+	{
+		int errnum = errno;
+		unlink(tmp);
+		errno = errnum;
+	}
+	else
+		cache->dirty = 0;
+	free(tmp);
+	return err ? -1 : 0;
+}
+
+void cache_close(struct title_cache *cache)
+{
+	if(!cache)
+		return;
+	for(size_t i = 0; i < cache->numtitles; i++)
+		free(cache->titles[i]);
+	free(cache->titles);
+	for(size_t i = 0; i < cache->numlists; i++)
+		free(cache->lists[i].playlists);
+	free(cache->lists);
+	free(cache->path);
+	free(cache);
+}
+
+BLURAY_TITLE_INFO *cache_get_playlist(struct title_cache *cache, uint32_t playlist)
+{
+	size_t i = bisect_left(cache->titles, &playlist, cache->numtitles,
+			sizeof(*cache->titles), cmp_cached_title);
+	if(i < cache->numtitles && cache->titles[i]->playlist == playlist)
+		return title_dup(cache->titles[i]);
+	return NULL;
+}
+
+int cache_put_playlist(struct title_cache *cache, const BLURAY_TITLE_INFO *title)
+{
+	BLURAY_TITLE_INFO *copy = title_dup(title);
+	if(!copy)
+		return -1;
+
+	size_t i = bisect_left(cache->titles, &title->playlist, cache->numtitles,
+			sizeof(*cache->titles), cmp_cached_title);
+	if(i < cache->numtitles && cache->titles[i]->playlist == title->playlist)
+		free(cache->titles[i]);
+	else
+	{
+		BLURAY_TITLE_INFO **grown = array_reserve(cache->titles, cache->numtitles, 1,
+				sizeof(*cache->titles));
+		if(!grown)
+		{
+			free(copy);
+			return -1;
+		}
+		cache->titles = grown;
+		memmove(cache->titles + i + 1, cache->titles + i,
+				(cache->numtitles++ - i) * sizeof(*cache->titles));
+	}
+	cache->titles[i] = copy;
+	cache->dirty = 1;
+	return 0;
+}
+
+int cache_get_titles(struct title_cache *cache, int filter_flags,
+		const uint32_t **playlists, size_t *numplaylists)
+{
+	for(size_t i = 0; i < cache->numlists; i++)
+		if(cache->lists[i].filter_flags == filter_flags)
+		{
+			*playlists    = cache->lists[i].playlists;
+			*numplaylists = cache->lists[i].numplaylists;
+			return 0;
+		}
+	return -1;
+}
+
+int cache_put_titles(struct title_cache *cache, int filter_flags,
+		const uint32_t *playlists, size_t numplaylists)
+{
+	uint32_t *copy = malloc(numplaylists * sizeof(*copy) + 1);
+	if(!copy)
+		return -1;
+	if(numplaylists > 0)
+		memcpy(copy, playlists, numplaylists * sizeof(*copy));
+
+	struct cache_list *list = NULL;
+	for(size_t i = 0; i < cache->numlists; i++)
+		if(cache->lists[i].filter_flags == filter_flags)
+		{
+			list = cache->lists + i;
+			free(list->playlists);
+			break;
+		}
+	if(!list)
+	{
+		struct cache_list *grown = array_reserve(cache->lists, cache->numlists, 1,
+				sizeof(*cache->lists));
+		if(!grown)
+		{
+			free(copy);
+			return -1;
+		}
+		cache->lists = grown;
+		list = cache->lists + cache->numlists++;
+		list->filter_flags = filter_flags;
+	}
+	list->playlists    = copy;
+	list->numplaylists = numplaylists;
+	cache->dirty = 1;
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CACHE_H_INCLUDED
+#define CACHE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+/**
+ * Titles of a Blu-ray cached in $XDG_CACHE_HOME/bdinfo.
+ *
+ * Entries are keyed by an identity of the Blu-ray: a hash over
+ * BDMV/index.bdmv and the names, sizes, and modification times of all files
+ * in BDMV/PLAYLIST and BDMV/CLIPINF, or, for images, over the path, size, and
+ * modification time of the image. A changed Blu-ray therefore never hits a
+ * stale entry.
+ */
+struct title_cache;
+
+/**
+ * Compute the identity of the Blu-ray at *src*. Devices have no stable
+ * identity and fail with ENOTSUP.
+ */
+int cache_disc_id(const char *src, uint64_t *id);
+
+/**
+ * Open the cache entry of the Blu-ray at *src*. If *refresh* is set the
+ * existing entry is ignored and will be overwritten by cache_save.
+ *
+ * Returns NULL with errno set if the Blu-ray cannot be cached.
+ */
+struct title_cache *cache_open(const char *src, int refresh);
+
+/**
+ * Create a cache that only lives in memory and is never written.
+ */
+struct title_cache *cache_new(void);
+
+/**
+ * Write the entry if it was modified since it was opened and is not only kept
+ * in memory.
+ */
+int cache_save(struct title_cache *cache);
+
+void cache_close(struct title_cache *cache);
+
+/**
+ * Get a copy of the cached title of *playlist* or NULL if it is not cached.
+ * The copy has to be freed with free.
+ */
+BLURAY_TITLE_INFO *cache_get_playlist(struct title_cache *cache, uint32_t playlist);
+
+/**
+ * Add a copy of *title* to the cache.
+ */
+int cache_put_playlist(struct title_cache *cache, const BLURAY_TITLE_INFO *title);
+
+/**
+ * Get the playlists bd_get_titles returns for *filter_flags* and a minimum
+ * duration of 0. *\*playlists* is owned by the cache.
+ *
+ * Returns -1 if they are not cached.
+ */
+int cache_get_titles(struct title_cache *cache, int filter_flags,
+		const uint32_t **playlists, size_t *numplaylists);
+
+int cache_put_titles(struct title_cache *cache, int filter_flags,
+		const uint32_t *playlists, size_t numplaylists);
+
+#endif
@@ -0,0 +1,561 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calls.h"
+#include "util.h"
+
+#define FATALPUTS(s) \
+		do \
+		{ \
+			if(fputs(s, f) == EOF) \
+				return -1; \
+		} \
+		while(0)
+#define FATALPRINTF(...) \
+		do \
+		{ \
+			if(fprintf(f, __VA_ARGS__) < 0) \
+				return -1; \
+		} \
+		while(0)
+
+int print_xml_chapters(FILE *f, const BLURAY_TITLE_INFO *title)
+{
+	static const char head[] =
+			"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+			"<Chapters>\n"
+			"\t<EditionEntry>\n"
+			"\t\t<EditionFlagHidden>0</EditionFlagHidden>\n"
+			"\t\t<EditionFlagDefault>0</EditionFlagDefault>\n";
+	static const char tail[] =
+			"\t</EditionEntry>\n"
+			"</Chapters>\n";
+
+	const BLURAY_TITLE_CHAPTER *chapters = title->chapters;
+	FATALPUTS(head);
+	for(uint32_t i = 0; i < title->chapter_count; i++)
+	{
+		char timebuf[22];
+		FATALPRINTF("\t\t<ChapterAtom>\n"
+				"\t\t\t<ChapterTimeStart>%s</ChapterTimeStart>\n"
+				"\t\t\t<ChapterFlagHidden>0</ChapterFlagHidden>\n"
+				"\t\t\t<ChapterFlagEnabled>1</ChapterFlagEnabled>\n"
+				"\t\t</ChapterAtom>\n",
+				ticks2time(timebuf, chapters[i].start));
+	}
+	FATALPUTS(tail);
+	return 0;
+}
+
+int print_ff_chapters(FILE *f, const BLURAY_TITLE_INFO *title)
+{
+	const BLURAY_TITLE_CHAPTER *chapters = title->chapters;
+	if(fputs(";FFMETADATA1\n", f) == EOF)
+		return -1;
+	for(uint32_t i = 0; i < title->chapter_count; i++)
+		if(fprintf(f, "[CHAPTER]\n"
+				"TIMEBASE=1/90000\n"
+				"START=%"PRIu64"\n"
+				"END=%"PRIu64"\n",
+				chapters[i].start,
+				chapters[i].start + chapters[i].duration) < 0)
+			return -1;
+	return 0;
+}
+
+#undef FATALPUTS
+#undef FATALPRINTF
+
+/**
+ * An argv being built in *arena*. *argv* has room for *size* pointers and is
+ * kept terminated by a NULL pointer after its *argc* arguments.
+ */
+struct argv_builder {
+	struct arena *arena;
+	char        **argv;
+	size_t        argc;
+	size_t        size;
+};
+
+/**
+ * Append a format string and its arguments to the argv builder.
+ */
+static char *argv_pushf(struct argv_builder *b, const char *fmt, ...)
+{
+	if(b->argc + 1 >= b->size)
+	{
+		size_t size = b->size > 0 ? 2 * b->size : 16;
+		char **argv = arena_grow(b->arena, b->argv, b->size * sizeof(*argv), size * sizeof(*argv));
+		if(!argv)
+			return NULL;
+		b->argv = argv;
+		b->size = size;
+	}
+	va_list ap;
+	va_start(ap, fmt);
+	char *arg = arena_vprintf(b->arena, fmt, ap);
+	va_end(ap);
+	if(!arg)
+		return NULL;
+	b->argv[b->argc++] = arg;
+	b->argv[b->argc]   = NULL;
+	return arg;
+}
+
+/**
+ * Push the input of *title* to *b*: the Blu-ray *src* read with ffmpeg's bluray
+ * protocol, starting at the chapter of *segment* if given, or the transport
+ * stream fed to the file descriptor *feedfd* by feed_title, unless it is -1.
+ */
+static int push_title_input(struct argv_builder *b, const BLURAY_TITLE_INFO *title,
+		const char *src, int feedfd, const struct segment *segment)
+{
+	if(feedfd >= 0)
+		return argv_pushf(b, "-f") && argv_pushf(b, "mpegts")
+				&& argv_pushf(b, "-i") && argv_pushf(b, "pipe:%d", feedfd) ? 0 : -1;
+	if(!argv_pushf(b, "-playlist") || !argv_pushf(b, "%"PRIu32,   title->playlist))
+//			|| !argv_pushf(b, "-angle")    || !argv_pushf(b, "%"PRIu8,    title->angle)
+		return -1;
+	// ffmpeg's bluray protocol counts chapters from 1
+	if(segment && segment->chapter > 0)
+		if(!argv_pushf(b, "-chapter") || !argv_pushf(b, "%"PRIu32, segment->chapter + 1))
+			return -1;
+	return argv_pushf(b, "-i") && argv_pushf(b, "bluray:%s", src) ? 0 : -1;
+}
+
+/**
+ * Push to *b* the options that set the language of every stream of *plan*
+ * whose language is known. Late streams are left out, their output index is
+ * only known if ffmpeg finds all late streams before them.
+ */
+static int push_languages(struct argv_builder *b, const struct remux_plan *plan)
+{
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(plan->streams[i].language[0] && !plan->tracks[i].late)
+			if(!argv_pushf(b, "-metadata:s:%zu", i)
+					|| !argv_pushf(b, "language=%s", plan->streams[i].language))
+				return -1;
+	return 0;
+}
+
+/**
+ * Push to *b* the ffmpeg stream specifier of stream *i* of *plan*, its PID in
+ * the title. Streams missing from the first clip are mapped optionally, since
+ * ffmpeg only finds the streams it probes at the start of the title. They are
+ * planned last, so a missing one does not shift the output index of any stream
+ * of the first clip.
+ */
+static char *push_stream_map(struct argv_builder *b, const struct remux_plan *plan, size_t i)
+{
+	return argv_pushf(b, "0:i:0x%04"PRIx16"%s", plan->streams[i].info->pid,
+			plan->tracks[i].late ? "?" : "");
+}
+
+char **generate_ffargv(struct arena *arena, const struct remux_plan *plan, const char *src,
+		int feedfd, const char *dst, int chapterfd, int progressfd, const struct segment *segment)
+{
+	struct argv_builder b = {
+		.arena = arena,
+		.argv  = NULL,
+		.argc  = 0,
+		.size  = 0
+	};
+
+	if(!argv_pushf(&b, "ffmpeg"))
+		goto error;
+	if(progressfd >= 0)
+		if(!argv_pushf(&b, "-nostats") || !argv_pushf(&b, "-progress")
+				|| !argv_pushf(&b, "pipe:%d", progressfd))
+			goto error;
+	if(push_title_input(&b, plan->title, src, feedfd, segment) < 0)
+		goto error;
+	int chapters = plan->chapters && !segment;
+	if(chapters)
+	{
+		const char *fmt = chapterfd == STDIN_FILENO ? "-" : "/dev/fd/%u";
+		if(!argv_pushf(&b, "-i") || !argv_pushf(&b, fmt, chapterfd))
+			goto error;
+	}
+
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(!argv_pushf(&b, "-map") || !push_stream_map(&b, plan, i))
+			goto error;
+	if(!argv_pushf(&b, "-c") || !argv_pushf(&b, "copy"))
+		goto error;
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(plan->tracks[i].codec == PLAN_FLAC && !plan->tracks[i].late)
+			if(!argv_pushf(&b, "-c:%zu", i) || !argv_pushf(&b, "flac"))
+				goto error;
+	if(plan->numflac > 0)
+		if(!argv_pushf(&b, "-compression_level") || !argv_pushf(&b, "12"))
+			goto error;
+	if(push_languages(&b, plan) < 0)
+		goto error;
+
+	if(chapters)
+		if(!argv_pushf(&b, "-map_chapters") || !argv_pushf(&b, "1"))
+			goto error;
+	if(segment)
+		if(!argv_pushf(&b, "-t") || !argv_pushf(&b, "%.6f", segment->duration / 90000.0))
+			goto error;
+
+	if(!argv_pushf(&b, "%s", dst))
+		goto error;
+
+	return b.argv;
+
+error:
+	// TODO errno
+	return NULL;
+}
+
+char **generate_concat_ffargv(struct arena *arena, const struct remux_plan *plan, int listfd,
+		int chapterfd, int progressfd, const char *dst)
+{
+	struct argv_builder b = {
+		.arena = arena,
+		.argv  = NULL,
+		.argc  = 0,
+		.size  = 0
+	};
+
+	if(!argv_pushf(&b, "ffmpeg"))
+		goto error;
+	if(progressfd >= 0)
+		if(!argv_pushf(&b, "-nostats") || !argv_pushf(&b, "-progress")
+				|| !argv_pushf(&b, "pipe:%d", progressfd))
+			goto error;
+	if(!argv_pushf(&b, "-f") || !argv_pushf(&b, "concat") || !argv_pushf(&b, "-safe")
+			|| !argv_pushf(&b, "0") || !argv_pushf(&b, "-i") || !argv_pushf(&b, "/dev/fd/%d", listfd))
+		goto error;
+	if(plan->chapters)
+		if(!argv_pushf(&b, "-i") || !argv_pushf(&b, "/dev/fd/%d", chapterfd))
+			goto error;
+	if(!argv_pushf(&b, "-map") || !argv_pushf(&b, "0") || !argv_pushf(&b, "-c")
+			|| !argv_pushf(&b, "copy"))
+		goto error;
+	if(push_languages(&b, plan) < 0)
+		goto error;
+	if(plan->chapters)
+		if(!argv_pushf(&b, "-map_chapters") || !argv_pushf(&b, "1"))
+			goto error;
+	if(!argv_pushf(&b, "%s", dst))
+		goto error;
+
+	return b.argv;
+
+error:
+	return NULL;
+}
+
+char *split_output(const char *dst, ssize_t stream, int encoded)
+{
+	char *name;
+	int n = stream < 0
+			? asprintf(&name, "%s.copy.mkv", dst)
+			: asprintf(&name, "%s.a%02zd%s.mka", dst, stream, encoded ? ".flac" : "");
+	return n < 0 ? NULL : name;
+}
+
+char **generate_demux_ffargv(struct arena *arena, const struct remux_plan *plan,
+		const char *src, int feedfd, const char *dst, int progressfd)
+{
+	struct argv_builder b = {
+		.arena = arena,
+		.argv  = NULL,
+		.argc  = 0,
+		.size  = 0
+	};
+	char *name = NULL;
+
+	if(!argv_pushf(&b, "ffmpeg"))
+		goto error;
+	if(progressfd >= 0)
+		if(!argv_pushf(&b, "-nostats") || !argv_pushf(&b, "-progress")
+				|| !argv_pushf(&b, "pipe:%d", progressfd))
+			goto error;
+	if(push_title_input(&b, plan->title, src, feedfd, NULL) < 0)
+		goto error;
+
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(plan->tracks[i].codec == PLAN_COPY)
+			if(!argv_pushf(&b, "-map") || !push_stream_map(&b, plan, i))
+				goto error;
+	if(plan->numflac < plan->numstreams)
+		if(!argv_pushf(&b, "-c") || !argv_pushf(&b, "copy") || !(name = split_output(dst, -1, 0))
+				|| !argv_pushf(&b, "%s", name))
+			goto error;
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(plan->tracks[i].codec == PLAN_FLAC)
+		{
+			free(name);
+			if(!argv_pushf(&b, "-map") || !push_stream_map(&b, plan, i)
+					|| !argv_pushf(&b, "-c") || !argv_pushf(&b, "flac")
+					|| !argv_pushf(&b, "-compression_level") || !argv_pushf(&b, "0")
+					|| !(name = split_output(dst, i, 0)) || !argv_pushf(&b, "%s", name))
+				goto error;
+		}
+
+	free(name);
+	return b.argv;
+
+error:
+	free(name);
+	return NULL;
+}
+
+char **generate_encode_ffargv(struct arena *arena, const char *dst, size_t stream,
+		int progressfd)
+{
+	struct argv_builder b = {
+		.arena = arena,
+		.argv  = NULL,
+		.argc  = 0,
+		.size  = 0
+	};
+	char *input  = split_output(dst, stream, 0);
+	char *output = split_output(dst, stream, 1);
+	if(!input || !output || !argv_pushf(&b, "ffmpeg"))
+		goto error;
+	if(progressfd >= 0)
+		if(!argv_pushf(&b, "-nostats") || !argv_pushf(&b, "-progress")
+				|| !argv_pushf(&b, "pipe:%d", progressfd))
+			goto error;
+	if(!argv_pushf(&b, "-i") || !argv_pushf(&b, "%s", input)
+			|| !argv_pushf(&b, "-map") || !argv_pushf(&b, "0")
+			|| !argv_pushf(&b, "-c") || !argv_pushf(&b, "flac")
+			|| !argv_pushf(&b, "-compression_level") || !argv_pushf(&b, "12")
+			|| !argv_pushf(&b, "%s", output))
+		goto error;
+
+	free(input);
+	free(output);
+	return b.argv;
+
+error:
+	free(input);
+	free(output);
+	return NULL;
+}
+
+char **generate_mux_ffargv(struct arena *arena, const struct remux_plan *plan,
+		const char *dst, int chapterfd, int progressfd)
+{
+	struct argv_builder b = {
+		.arena = arena,
+		.argv  = NULL,
+		.argc  = 0,
+		.size  = 0
+	};
+	char *name = NULL;
+
+	if(!argv_pushf(&b, "ffmpeg"))
+		goto error;
+	if(progressfd >= 0)
+		if(!argv_pushf(&b, "-nostats") || !argv_pushf(&b, "-progress")
+				|| !argv_pushf(&b, "pipe:%d", progressfd))
+			goto error;
+
+	// the copied streams are the first input, if there are any
+	size_t numinputs = plan->numflac < plan->numstreams;
+	if(numinputs > 0)
+		if(!(name = split_output(dst, -1, 0)) || !argv_pushf(&b, "-i")
+				|| !argv_pushf(&b, "%s", name))
+			goto error;
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(plan->tracks[i].codec == PLAN_FLAC)
+		{
+			free(name);
+			if(!(name = split_output(dst, i, 1)) || !argv_pushf(&b, "-i")
+					|| !argv_pushf(&b, "%s", name))
+				goto error;
+		}
+	if(plan->chapters)
+		if(!argv_pushf(&b, "-i") || !argv_pushf(&b, "/dev/fd/%d", chapterfd))
+			goto error;
+
+	size_t copied = 0;
+	size_t encoded = numinputs;
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(!(plan->tracks[i].codec == PLAN_FLAC
+				? argv_pushf(&b, "-map") && argv_pushf(&b, "%zu:0", encoded++)
+				: argv_pushf(&b, "-map") && argv_pushf(&b, "0:%zu%s", copied++,
+						plan->tracks[i].late ? "?" : "")))
+			goto error;
+	if(!argv_pushf(&b, "-c") || !argv_pushf(&b, "copy"))
+		goto error;
+	if(push_languages(&b, plan) < 0)
+		goto error;
+	if(plan->chapters)
+		if(!argv_pushf(&b, "-map_chapters") || !argv_pushf(&b, "%zu", encoded))
+			goto error;
+	if(!argv_pushf(&b, "%s", dst))
+		goto error;
+
+	free(name);
+	return b.argv;
+
+error:
+	free(name);
+	return NULL;
+}
+
+/**
+ * Number mkvmerge gives the track *pid* of *title*. It numbers the streams of
+ * the transport stream it can mux, which Blu-rays multiplex ordered by PID,
+ * so interactive graphic streams are left out.
+ */
+static size_t mkvmerge_track_id(const BLURAY_TITLE_INFO *title, uint16_t pid)
+{
+	struct plan_stream_iter it;
+	plan_stream_iter_init(&it, title->clips, 1);
+	size_t id = 0;
+	for(const BLURAY_STREAM_INFO *stream; (stream = plan_stream_next(&it, NULL));)
+		id += stream->pid < pid;
+	return id;
+}
+
+/**
+ * Join the mkvmerge_track_ids of the streams of *plan* of *kind*, or of all
+ * streams mkvmerge can mux if *kind* is -1, each prefixed with *prefix*, with
+ * commas, into *arena*.
+ */
+static char *join_mkvmerge_tracks(struct arena *arena, const struct remux_plan *plan, int kind,
+		const char *prefix)
+{
+	// the IDs are below the at most 5 * 255 streams of a clip
+	char *ids = arena_alloc(arena, plan->numstreams * (strlen(prefix) + 5) + 1);
+	if(!ids)
+		return NULL;
+	char *end = ids;
+	*end = '\0';
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(!plan->tracks[i].late && (kind < 0 ? plan->tracks[i].kind != PLAN_INTERACTIVE
+				: (int)plan->tracks[i].kind == kind))
+			end += sprintf(end, "%s%s%zu", end == ids ? "" : ",", prefix,
+					mkvmerge_track_id(plan->title, plan->streams[i].info->pid));
+	return ids;
+}
+
+/**
+ * Push the mkvmerge option *opt* that selects the tracks of *plan* of *kind*,
+ * or *none* if there are none.
+ */
+static int push_mkvmerge_tracks(struct argv_builder *b, const struct remux_plan *plan,
+		enum plan_kind kind, const char *opt, const char *none)
+{
+	char *ids = join_mkvmerge_tracks(b->arena, plan, kind, "");
+	if(!ids)
+		return -1;
+	int ok = ids[0] ? argv_pushf(b, "%s", opt) && argv_pushf(b, "%s", ids)
+			: argv_pushf(b, "%s", none) != NULL;
+	return ok ? 0 : -1;
+}
+
+char **generate_mkvmerge_argv(struct arena *arena, const struct remux_plan *plan,
+		const char *src, const char *dst)
+{
+	struct argv_builder b = {
+		.arena = arena,
+		.argv  = NULL,
+		.argc  = 0,
+		.size  = 0
+	};
+	if(!argv_pushf(&b, "mkvmerge") || !argv_pushf(&b, "-o") || !argv_pushf(&b, "%s", dst))
+		goto error;
+	if(push_mkvmerge_tracks(&b, plan, PLAN_VIDEO, "--video-tracks", "--no-video") < 0
+			|| push_mkvmerge_tracks(&b, plan, PLAN_AUDIO, "--audio-tracks", "--no-audio") < 0
+			|| push_mkvmerge_tracks(&b, plan, PLAN_SUBTITLE, "--subtitle-tracks", "--no-subtitles") < 0)
+		goto error;
+	if(!plan->chapters)
+		if(!argv_pushf(&b, "--no-chapters"))
+			goto error;
+	for(size_t i = 0; i < plan->numstreams; i++)
+		if(plan->tracks[i].kind != PLAN_INTERACTIVE && !plan->tracks[i].late
+				&& plan->streams[i].language[0])
+			if(!argv_pushf(&b, "--language") || !argv_pushf(&b, "%zu:%s",
+					mkvmerge_track_id(plan->title, plan->streams[i].info->pid),
+					plan->streams[i].language))
+				goto error;
+	char *order = join_mkvmerge_tracks(arena, plan, -1, "0:");
+	if(!order)
+		goto error;
+	if(order[0])
+		if(!argv_pushf(&b, "--track-order") || !argv_pushf(&b, "%s", order))
+			goto error;
+	if(!argv_pushf(&b, "%s/BDMV/PLAYLIST/%05"PRIu32".mpls", src, plan->title->playlist))
+		goto error;
+
+	return b.argv;
+
+error:
+	return NULL;
+}
+
+int print_argv(FILE *f, char **argv)
+{
+	for(char **arg = argv; *arg;)
+	{
+		if(shell_escape(f, *arg) < 0)
+			return -1;
+		if(*++arg && fputc(' ', f) == EOF)
+			return -1;
+	}
+	return 0;
+}
+
+int output_template_has_playlist(const char *tmpl)
+{
+	for(const char *c = tmpl; (c = strchr(c, '%')); c += 2)
+		if(c[1] == 'p')
+			return 1;
+		else if(c[1] == '\0')
+			break;
+	return 0;
+}
+
+char *format_output(const char *tmpl, const BLURAY_TITLE_INFO *title)
+{
+	char playlist[11];
+	snprintf(playlist, sizeof(playlist), "%05"PRIu32, title->playlist);
+
+	char *dst = malloc(strlen(tmpl) + strcnt(tmpl, '%') * (sizeof(playlist) - 3) + 1);
+	if(!dst)
+		return NULL;
+	char *d = dst;
+	for(const char *c = tmpl; *c; c++)
+	{
+		if(c[0] == '%' && c[1] == 'p')
+			d = stpcpy(d, playlist), c++;
+		else if(c[0] == '%' && c[1] == '%')
+			*d++ = '%', c++;
+		else
+			*d++ = *c;
+	}
+	*d = '\0';
+	return dst;
+}
+
@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALLS_H_INCLUDED
+#define CALLS_H_INCLUDED
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <libbluray/bluray.h>
+
+#include "arena.h"
+#include "plan.h"
+#include "segment.h"
+
+/*
+ * The command lines of ffmpeg and mkvmerge that render remux plans. Every argv
+ * is terminated by a NULL pointer and allocated from *arena*, so it is freed
+ * with it. On error NULL is returned with errno set.
+ */
+
+/**
+ * Print *title* chapters as XML to *f*, consumable by mkvmerge.
+ */
+int print_xml_chapters(FILE *f, const BLURAY_TITLE_INFO *title);
+
+/**
+ * Print *title*'s as FFMETADATA1 to *f*, consumable by ffmpeg.
+ */
+int print_ff_chapters(FILE *f, const BLURAY_TITLE_INFO *title);
+
+/**
+ * Generate argv for ffmpeg that remuxes the title of *plan* from *src* to
+ * *dst*.
+ *
+ * If *chapterfd* is given, chapter data is read from this file descriptor. If
+ * *progressfd* is not -1, ffmpeg writes its progress to it instead of printing
+ * statistics.
+ *
+ * If *segment* is given, only it is remuxed, starting at its chapter, and
+ * chapters are left to the call joining the segments. If *feedfd* is not -1,
+ * the title is read from the transport stream feed_title feeds to it instead
+ * of *src*.
+ */
+char **generate_ffargv(struct arena *arena, const struct remux_plan *plan, const char *src,
+		int feedfd, const char *dst, int chapterfd, int progressfd, const struct segment *segment);
+
+/**
+ * Generate argv for ffmpeg that joins the segments of the title of *plan*
+ * listed for the concat demuxer in *listfd* to *dst* without reencoding. The
+ * languages of the streams are set again. Chapters are read from *chapterfd*
+ * and progress is written to *progressfd* as in generate_ffargv.
+ */
+char **generate_concat_ffargv(struct arena *arena, const struct remux_plan *plan, int listfd,
+		int chapterfd, int progressfd, const char *dst);
+
+/**
+ * Name of a file the streams of the output *dst* are split into: the copied
+ * streams if *stream* is -1, or otherwise the stream with that number before
+ * or, if *encoded* is set, after it was encoded to FLAC. The name has to be
+ * freed.
+ */
+char *split_output(const char *dst, ssize_t stream, int encoded);
+
+/**
+ * Generate argv for ffmpeg that reads the title of *plan* from *src* once and
+ * splits its streams for the output *dst*. Streams that are converted to FLAC
+ * are each written to their own split_output with the fastest FLAC
+ * compression, all others are copied to another split_output. If *feedfd* is
+ * not -1, the title is read from it instead of *src*.
+ */
+char **generate_demux_ffargv(struct arena *arena, const struct remux_plan *plan,
+		const char *src, int feedfd, const char *dst, int progressfd);
+
+/**
+ * Generate argv for ffmpeg that encodes the split_output of stream *stream* of
+ * the output *dst* to FLAC with the highest compression.
+ */
+char **generate_encode_ffargv(struct arena *arena, const char *dst, size_t stream,
+		int progressfd);
+
+/**
+ * Generate argv for ffmpeg that merges the split_outputs of the title of *plan*
+ * for the output *dst* to *dst* without reencoding, restoring the order of the
+ * streams and setting their languages and, from *chapterfd*, the chapters.
+ */
+char **generate_mux_ffargv(struct arena *arena, const struct remux_plan *plan,
+		const char *dst, int chapterfd, int progressfd);
+
+/**
+ * Generate argv for mkvmerge that remuxes the title of *plan* from the Blu-ray
+ * directory *src* to *dst*. mkvmerge reads the playlist and its chapters
+ * itself and copies every stream, LPCM streams are stored as PCM. Interactive
+ * graphic streams cannot be muxed by mkvmerge and are left out, as are streams
+ * missing from the first clip, which mkvmerge takes the tracks from.
+ */
+char **generate_mkvmerge_argv(struct arena *arena, const struct remux_plan *plan,
+		const char *src, const char *dst);
+
+/**
+ * Print *argv* to *f* as a command line for a shell.
+ */
+int print_argv(FILE *f, char **argv);
+
+/**
+ * Test if the output template *tmpl* contains the %p placeholder.
+ */
+int output_template_has_playlist(const char *tmpl);
+
+/**
+ * Expand the output template *tmpl* for *title*. %p is replaced with the
+ * zero-padded playlist number and %% with a literal %. All other characters
+ * are copied unchanged.
+ */
+char *format_output(const char *tmpl, const BLURAY_TITLE_INFO *title);
+
+#endif
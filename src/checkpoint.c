@@ -0,0 +1,205 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "checkpoint.h"
+
+#define CHECKPOINT_VERSION 2
+
+/**
+ * Render the header of the state file of the title of *plan* of the Blu-ray
+ * *src* remuxed in *numsegments* segments to *\*len* bytes, which have to be
+ * freed. Segments are only resumed if the disc, the title, and the selected
+ * streams did not change. The disc is named by its cache_disc_id or, if it has
+ * none, by *src*.
+ */
+static char *render_header(const struct remux_plan *plan, const char *src,
+		size_t numsegments, size_t *len)
+{
+	char *header = NULL;
+	FILE *f = open_memstream(&header, len);
+	if(!f)
+		return NULL;
+	uint64_t id;
+	fprintf(f, "bdinfo-resume %d\n", CHECKPOINT_VERSION);
+	if(cache_disc_id(src, &id) == 0)
+		fprintf(f, "disc %016"PRIx64"\n", id);
+	else
+		fprintf(f, "input %s\n", src);
+	fprintf(f, "playlist %05"PRIu32" duration %"PRIu64" segments %zu\n",
+			plan->title->playlist, plan->title->duration, numsegments);
+	for(size_t i = 0; i < plan->numstreams; i++)
+		fprintf(f, "stream 0x%04"PRIx16" %s %s\n", plan->streams[i].info->pid,
+				plan_codec_name(plan->tracks[i].codec),
+				plan->streams[i].language[0] ? plan->streams[i].language : "und");
+	int err = ferror(f);
+	if(fclose(f) == EOF || err)
+	{
+		free(header);
+		errno = ENOMEM;
+		return NULL;
+	}
+	return header;
+}
+
+/**
+ * Mark the segments of *c* done that the records following the header of the
+ * state file *f* name, if their output of *output* is still complete.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+static int load_records(struct checkpoint *c, FILE *f, const char *output,
+		const struct segment *segments)
+{
+	char  *line = NULL;
+	size_t size = 0;
+	int    err  = 0;
+	while(!err && getline(&line, &size, f) > 0)
+	{
+		size_t   i;
+		uint64_t start;
+		uint64_t duration;
+		intmax_t length;
+		if(sscanf(line, "done %zu %"SCNu64" %"SCNu64" %jd", &i, &start, &duration, &length) != 4
+				|| i >= c->numsegments || start != segments[i].start
+				|| duration != segments[i].duration)
+			continue;
+		// a segment rewritten since it was recorded has a later record
+		char *name = segment_output(output, i);
+		struct stat st;
+		if(!name)
+			err = 1;
+		else if(stat(name, &st) == 0 && st.st_size == length)
+			c->done[i] = 1;
+		free(name);
+	}
+	free(line);
+	return err ? -1 : 0;
+}
+
+ssize_t checkpoint_open(struct checkpoint *c, const struct remux_plan *plan,
+		const char *src, const char *output, const struct segment *segments, size_t numsegments)
+{
+	*c = (struct checkpoint){
+		.path        = NULL,
+		.done        = calloc(numsegments + 1, sizeof(*c->done)),
+		.numsegments = numsegments,
+		.numdone     = 0
+	};
+	size_t len;
+	char *header = render_header(plan, src, numsegments, &len);
+	char *buf    = header ? malloc(len + 1) : NULL;
+	if(!c->done || !buf || asprintf(&c->path, "%s.resume", output) < 0)
+	{
+		c->path = NULL;
+		goto error;
+	}
+
+	int valid = 0;
+	FILE *f = fopen(c->path, "r");
+	if(f)
+	{
+		valid = fread(buf, 1, len, f) == len && memcmp(buf, header, len) == 0;
+		int err = valid && load_records(c, f, output, segments) < 0;
+		int errnum = errno;
+		fclose(f);
+		if(err)
+		{
+			errno = errnum;
+			goto error;
+		}
+	}
+	else if(errno != ENOENT)
+		goto error;
+
+	if(!valid)
+	{
+		if(!(f = fopen(c->path, "w")))
+			goto error;
+		int err = fwrite(header, 1, len, f) != len;
+		if(fclose(f) == EOF || err)
+			goto error;
+	}
+	free(header);
+	free(buf);
+	for(size_t i = 0; i < numsegments; i++)
+		c->numdone += c->done[i];
+	return c->numdone;
+
+error:
+	{
+		int errnum = errno;
+		free(header);
+		free(buf);
+		checkpoint_free(c);
+		errno = errnum;
+	}
+	return -1;
+}
+
+int checkpoint_record(const struct checkpoint *c, size_t i, const struct segment *segment,
+		const char *output)
+{
+	// the segment has to be on disk before it is recorded
+	int fd = open(output, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return -1;
+	struct stat st;
+	int err = fstat(fd, &st) < 0 || fsync(fd) < 0;
+	int errnum = errno;
+	close(fd);
+	if(err)
+	{
+		errno = errnum;
+		return -1;
+	}
+
+	char line[128];
+	int n = snprintf(line, sizeof(line), "done %zu %"PRIu64" %"PRIu64" %jd\n", i,
+			segment->start, segment->duration, (intmax_t)st.st_size);
+	// a single write appends the whole line, even if others append at once
+	if((fd = open(c->path, O_WRONLY | O_APPEND | O_CLOEXEC)) < 0)
+		return -1;
+	ssize_t written = write(fd, line, n);
+	if(written >= 0 && written < n)
+		errno = EIO;
+	err = written != n || fsync(fd) < 0;
+	errnum = errno;
+	close(fd);
+	errno = errnum;
+	return err ? -1 : 0;
+}
+
+void checkpoint_free(struct checkpoint *c)
+{
+	free(c->path);
+	free(c->done);
+	c->path = NULL;
+	c->done = NULL;
+}
@@ -0,0 +1,72 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "plan.h"
+#include "segment.h"
+
+/**
+ * The checkpoints of a title remuxed in *numsegments* segments, kept in the
+ * state file *path* next to its output. *done* marks the segments an earlier
+ * run remuxed completely, *numdone* counts them.
+ */
+struct checkpoint {
+	char   *path;
+	char   *done;
+	size_t  numsegments;
+	size_t  numdone;
+};
+
+/**
+ * Load the checkpoints of the title of *plan* of the Blu-ray *src*, which is
+ * remuxed to *output* in the *numsegments* *segments*, into *c*. The state
+ * file holds a header naming the disc, the title, its streams, and the number
+ * of segments, followed by a line
+ *
+ *     done SEGMENT START DURATION SIZE
+ *
+ * for every segment remuxed completely, with its start and duration in ticks
+ * and the size of its output in bytes. A segment is only taken as done if its
+ * start and duration match and its output, see segment_output, still has that
+ * size. A state file with a different header is started anew.
+ *
+ * Returns the number of segments done or -1 with errno set. *c* has to be
+ * freed with checkpoint_free.
+ */
+ssize_t checkpoint_open(struct checkpoint *c, const struct remux_plan *plan,
+		const char *src, const char *output, const struct segment *segments, size_t numsegments);
+
+/**
+ * Record in *c* that the *i*-th segment *segment* was remuxed completely to
+ * *output*, after flushing *output* to disk. Segments of the same title may be
+ * recorded by several processes at once.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int checkpoint_record(const struct checkpoint *c, size_t i, const struct segment *segment,
+		const char *output);
+
+void checkpoint_free(struct checkpoint *c);
+
+#endif
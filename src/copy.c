@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "copy.h"
+
+/** bytes read and written at once if the kernel cannot copy */
+#define COPY_BUFFER_SIZE (8 << 20)
+
+/**
+ * Copy *length* bytes at *offset* of *in* to *out* with copy_file_range.
+ *
+ * Returns 0, 1 if copy_file_range cannot copy between the files and nothing
+ * was copied, or -1 with errno set.
+ */
+static int copy_in_kernel(int in, int out, off_t offset, off_t length)
+{
+	off_t copied = 0;
+	while(copied < length)
+	{
+		ssize_t n = copy_file_range(in, &offset, out, NULL, length - copied, 0);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(copied == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL
+					|| errno == EOPNOTSUPP))
+				return 1;
+			return -1;
+		}
+		// the source was truncated
+		if(n == 0)
+			break;
+		copied += n;
+	}
+	return 0;
+}
+
+static int copy_read_write(int in, int out, off_t offset, off_t length)
+{
+	uint8_t *buf = malloc(COPY_BUFFER_SIZE);
+	if(!buf)
+		return -1;
+	posix_fadvise(in, offset, length, POSIX_FADV_SEQUENTIAL);
+	int err = -1;
+	while(length > 0)
+	{
+		ssize_t n = pread(in, buf, length < COPY_BUFFER_SIZE ? length : COPY_BUFFER_SIZE,
+				offset);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+			goto out;
+		if(n == 0)
+			break;
+		offset += n;
+		length -= n;
+		for(ssize_t off = 0; off < n;)
+		{
+			ssize_t written = write(out, buf + off, n - off);
+			if(written < 0 && errno == EINTR)
+				continue;
+			if(written < 0)
+				goto out;
+			off += written;
+		}
+	}
+	err = 0;
+
+out:
+	free(buf);
+	return err;
+}
+
+int copy_file(const char *src, const char *dst, off_t offset, off_t length)
+{
+	int in = open(src, O_RDONLY | O_CLOEXEC);
+	if(in < 0)
+		return -1;
+	int out = -1;
+	int method = -1;
+	struct stat st;
+	if(fstat(in, &st) < 0)
+		goto cleanup;
+	if(offset > st.st_size)
+		offset = st.st_size;
+	if(length < 0 || length > st.st_size - offset)
+		length = st.st_size - offset;
+	if((out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0)
+		goto cleanup;
+
+	if(offset == 0 && length == st.st_size && ioctl(out, FICLONE, in) == 0)
+		method = COPY_CLONED;
+	else
+		switch(copy_in_kernel(in, out, offset, length))
+		{
+		case 0:
+			method = COPY_IN_KERNEL;
+			break;
+		case 1:
+			if(copy_read_write(in, out, offset, length) == 0)
+				method = COPY_READ_WRITE;
+			break;
+		}
+	if(close(out) < 0)
+		method = -1;
+	out = -1;
+	if(method < 0)
+	{
+		int errnum = errno;
+		unlink(dst);
+		errno = errnum;
+	}
+
+cleanup:
+	{
+		int errnum = errno;
+		if(out >= 0)
+			close(out);
+		close(in);
+		errno = errnum;
+	}
+	return method;
+}
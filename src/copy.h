@@ -0,0 +1,48 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COPY_H_INCLUDED
+#define COPY_H_INCLUDED
+
+#include <sys/types.h>
+
+/**
+ * How copy_file copied the data.
+ */
+enum copy_method {
+	/** the destination shares the extents of the source */
+	COPY_CLONED,
+	/** the kernel copied the data, possibly sharing extents as well */
+	COPY_IN_KERNEL,
+	/** the data was read and written in large sequential blocks */
+	COPY_READ_WRITE
+};
+
+/**
+ * Copy *length* bytes at *offset* of the file *src* to the new file *dst*, or
+ * the whole rest of *src* if *length* is -1. A whole file is cloned with a
+ * reflink if the filesystem supports it, otherwise the data is copied with
+ * copy_file_range, or read and written if the files are on different
+ * filesystems that do not support it. *dst* is removed if copying failed.
+ *
+ * Returns the copy_method used or -1 with errno set.
+ */
+int copy_file(const char *src, const char *dst, off_t offset, off_t length);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "demux.h"
+#include "progress.h"
+#include "ts.h"
+
+/** bd_read reads this many aligned units of 32 source packets at once */
+#define READ_UNITS 32
+#define READ_SIZE  (READ_UNITS * 32 * TS_PACKET_SIZE)
+
+/** buffered per output file */
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+#define PTS_MASK ((INT64_C(1) << 33) - 1)
+
+/** milliseconds between progress reports */
+#define PROGRESS_INTERVAL 500
+
+struct track {
+	const BLURAY_STREAM_INFO *info;
+	FILE                     *f;
+	char                     *buf;
+};
+
+struct demux {
+	const BLURAY_TITLE_INFO *title;
+	struct track            *tracks;
+	size_t                   numtracks;
+	/** index into *tracks* + 1 for every PID, 0 if not demultiplexed */
+	uint16_t                 track_of_pid[0x2000];
+	uint32_t                 clip;
+	/** latest timestamp in the title so far */
+	uint64_t                 position;
+	uint64_t                 written;
+};
+
+const char *demux_extension(const BLURAY_STREAM_INFO *stream)
+{
+	switch(stream->coding_type)
+	{
+	case BLURAY_STREAM_TYPE_VIDEO_MPEG1:
+	case BLURAY_STREAM_TYPE_VIDEO_MPEG2:
+		return "m2v";
+	case BLURAY_STREAM_TYPE_VIDEO_VC1:
+		return "vc1";
+	case BLURAY_STREAM_TYPE_VIDEO_H264:
+		return "h264";
+	case 0x24: // BLURAY_STREAM_TYPE_VIDEO_HEVC, missing in older libbluray
+		return "hevc";
+	case BLURAY_STREAM_TYPE_AUDIO_MPEG1:
+	case BLURAY_STREAM_TYPE_AUDIO_MPEG2:
+		return "mpa";
+	case BLURAY_STREAM_TYPE_AUDIO_LPCM:
+		return "pcm";
+	case BLURAY_STREAM_TYPE_AUDIO_AC3:
+		return "ac3";
+	case BLURAY_STREAM_TYPE_AUDIO_AC3PLUS:
+	case BLURAY_STREAM_TYPE_AUDIO_AC3PLUS_SECONDARY:
+		return "eac3";
+	case BLURAY_STREAM_TYPE_AUDIO_DTS:
+		return "dts";
+	case BLURAY_STREAM_TYPE_AUDIO_DTSHD:
+	case BLURAY_STREAM_TYPE_AUDIO_DTSHD_MASTER:
+	case BLURAY_STREAM_TYPE_AUDIO_DTSHD_SECONDARY:
+		return "dtshd";
+	case BLURAY_STREAM_TYPE_AUDIO_TRUHD:
+		return "thd";
+	case BLURAY_STREAM_TYPE_SUB_PG:
+		return "sup";
+	default:
+		return NULL;
+	}
+}
+
+char *demux_output(const char *dst, const BLURAY_STREAM_INFO *stream)
+{
+	char *name;
+	if(asprintf(&name, "%s.0x%04"PRIx16".%s", dst, stream->pid, demux_extension(stream)) < 0)
+		return NULL;
+	return name;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/**
+ * Map the timestamp *ts* of the current clip of *d* to the title, or return -1
+ * if it lies before the title.
+ */
+static int64_t title_timestamp(const struct demux *d, int64_t ts)
+{
+	const BLURAY_CLIP_INFO *clip = d->title->clips + d->clip;
+	ts = (ts - (int64_t)clip->in_time) & PTS_MASK;
+	if(ts >= INT64_C(1) << 32)
+		ts -= INT64_C(1) << 33;
+	ts += clip->start_time;
+	return ts < 0 ? -1 : ts;
+}
+
+/**
+ * Write the segments of the PGS packet *pes* to *f*, each preceded by the SUP
+ * header with its timestamps *pts* and *dts*. Returns the bytes written or -1.
+ */
+static ssize_t write_sup(FILE *f, const struct ts_pes *pes, int64_t pts, int64_t dts)
+{
+	uint8_t header[10] = {'P', 'G'};
+	put_be32(header + 2, pts);
+	put_be32(header + 6, dts < 0 ? 0 : dts);
+	size_t written = 0;
+	for(size_t off = 0; off + 3 <= pes->size;)
+	{
+		size_t len = 3 + ((size_t)pes->data[off + 1] << 8 | pes->data[off + 2]);
+		if(off + len > pes->size)
+			break;
+		if(fwrite(header, sizeof(header), 1, f) != 1 || fwrite(pes->data + off, len, 1, f) != 1)
+			return -1;
+		written += sizeof(header) + len;
+		off     += len;
+	}
+	return written;
+}
+
+static int on_pes(const struct ts_pes *pes, void *data)
+{
+	struct demux *d = data;
+	struct track *track = d->tracks + d->track_of_pid[pes->pid] - 1;
+	if(pes->size == 0)
+		return 0;
+	int64_t pts = pes->pts == TS_NO_TIMESTAMP ? -1 : title_timestamp(d, pes->pts);
+	if(pts >= 0 && (uint64_t)pts > d->position)
+		d->position = pts;
+
+	const uint8_t *payload = pes->data;
+	size_t         size    = pes->size;
+	switch(track->info->coding_type)
+	{
+	case BLURAY_STREAM_TYPE_SUB_PG:
+		if(pts < 0)
+			return 0;
+		{
+			ssize_t n = write_sup(track->f, pes, pts, pes->dts == TS_NO_TIMESTAMP
+					? -1 : title_timestamp(d, pes->dts));
+			if(n < 0)
+				return -1;
+			d->written += n;
+		}
+		return 0;
+	case BLURAY_STREAM_TYPE_AUDIO_TRUHD:
+		// the AC3 frames of the embedded core are in their own PES packets
+		if(size >= 2 && payload[0] == 0x0b && payload[1] == 0x77)
+			return 0;
+		break;
+	case BLURAY_STREAM_TYPE_AUDIO_LPCM:
+		if(size < 4)
+			return 0;
+		payload += 4;
+		size    -= 4;
+		break;
+	}
+	if(fwrite(payload, size, 1, track->f) != 1)
+		return -1;
+	d->written += size;
+	return 0;
+}
+
+/**
+ * Report the progress of *d* to *fd* if it is not -1 and at least
+ * PROGRESS_INTERVAL milliseconds passed since *\*last* or *done* is set.
+ */
+static int report_progress(const struct demux *d, int fd, struct timespec *last, int done)
+{
+	if(fd < 0)
+		return 0;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(!done && (now.tv_sec - last->tv_sec) * 1000
+			+ (now.tv_nsec - last->tv_nsec) / 1000000 < PROGRESS_INTERVAL)
+		return 0;
+	*last = now;
+	return progress_write(fd, d->written, d->position, 0, done);
+}
+
+int demux_title(const char *src, const BLURAY_TITLE_INFO *title,
+		const struct remux_stream *streams, size_t numstreams, const char *dst,
+		int progressfd)
+{
+	struct demux d;
+	memset(&d, 0, sizeof(d));
+	d.title = title;
+
+	BLURAY          *bd = NULL;
+	struct ts_demux *ts = NULL;
+	uint8_t *buf = malloc(READ_SIZE);
+	int err = -1;
+	if(!buf || !(d.tracks = calloc(numstreams + 1, sizeof(*d.tracks)))
+			|| !(ts = ts_demux_new(on_pes, &d)))
+		goto cleanup;
+	for(size_t i = 0; i < numstreams; i++)
+	{
+		uint16_t pid = streams[i].info->pid & 0x1fff;
+		// a PID is only demultiplexed once
+		if(d.track_of_pid[pid])
+			continue;
+		struct track *track = d.tracks + d.numtracks++;
+		track->info = streams[i].info;
+		d.track_of_pid[pid] = d.numtracks;
+		char *name = demux_output(dst, track->info);
+		if(!name)
+			goto cleanup;
+		track->f = fopen(name, "wb");
+		free(name);
+		if(!track->f || !(track->buf = malloc(WRITE_BUFFER_SIZE))
+				|| setvbuf(track->f, track->buf, _IOFBF, WRITE_BUFFER_SIZE) != 0
+				|| ts_demux_add_pid(ts, pid) < 0)
+			goto cleanup;
+	}
+
+	err = -2;
+	if(!(bd = bd_open(src, NULL)) || !bd_select_playlist(bd, title->playlist))
+		goto cleanup;
+	// clip changes are reported as events
+	bd_get_event(bd, NULL);
+
+	err = -1;
+	struct timespec last;
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	while(1)
+	{
+		int n = bd_read(bd, buf, READ_SIZE);
+		if(n < 0)
+		{
+			err = -2;
+			goto cleanup;
+		}
+		if(n == 0)
+			break;
+
+		// a read may end in the next clip, whose timestamps then apply to all of it
+		BD_EVENT event;
+		while(bd_get_event(bd, &event))
+			if(event.event == BD_EVENT_PLAYITEM && event.param != d.clip
+					&& event.param < title->clip_count)
+			{
+				if(ts_demux_flush(ts) < 0)
+					goto cleanup;
+				d.clip = event.param;
+			}
+		if(ts_demux_feed(ts, buf, n) < 0 || report_progress(&d, progressfd, &last, 0) < 0)
+			goto cleanup;
+	}
+	if(ts_demux_flush(ts) < 0)
+		goto cleanup;
+	for(size_t i = 0; i < d.numtracks; i++)
+	{
+		FILE *f = d.tracks[i].f;
+		d.tracks[i].f = NULL;
+		if(fclose(f) == EOF)
+			goto cleanup;
+	}
+	if(report_progress(&d, progressfd, &last, 1) < 0)
+		goto cleanup;
+	err = 0;
+
+cleanup:
+	{
+		int errnum = errno;
+		if(bd)
+			bd_close(bd);
+		ts_demux_free(ts);
+		if(d.tracks)
+			for(size_t i = 0; i < d.numtracks; i++)
+			{
+				if(d.tracks[i].f)
+					fclose(d.tracks[i].f);
+				free(d.tracks[i].buf);
+			}
+		free(d.tracks);
+		free(buf);
+		errno = errnum;
+	}
+	return err;
+}
@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DEMUX_H_INCLUDED
+#define DEMUX_H_INCLUDED
+
+#include <stddef.h>
+
+#include <libbluray/bluray.h>
+
+#include "remux.h"
+
+/**
+ * The file name extension of the elementary stream of *stream*, or NULL if it
+ * cannot be written as one.
+ */
+const char *demux_extension(const BLURAY_STREAM_INFO *stream);
+
+/**
+ * Name of the file the elementary stream of *stream* is demultiplexed to for
+ * the output *dst*, DST.PID.EXTENSION. The name has to be freed.
+ */
+char *demux_output(const char *dst, const BLURAY_STREAM_INFO *stream);
+
+/**
+ * Demultiplex *streams* of *title* from the Blu-ray *src* to raw elementary
+ * streams named by demux_output for *dst*, without ffmpeg. The title is read
+ * with bd_read in large blocks and only the packets of *streams* are parsed.
+ * Audio and video streams are written as they are, except that the AC-3 core
+ * of Dolby TrueHD streams and the header of LPCM frames are dropped. PGS
+ * streams are written as SUP files with timestamps relative to the title. All
+ * *streams* must have a demux_extension. If *progressfd* is not -1, the
+ * progress is written to it as by remux_title.
+ *
+ * Returns 0, -1 on error with errno set or -2 if libbluray failed.
+ */
+int demux_title(const char *src, const BLURAY_TITLE_INFO *title,
+		const struct remux_stream *streams, size_t numstreams, const char *dst,
+		int progressfd);
+
+#endif
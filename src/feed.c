@@ -0,0 +1,246 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "feed.h"
+#include "progress.h"
+
+/** milliseconds between progress reports */
+#define PROGRESS_INTERVAL 500
+
+/**
+ * A ring buffer of *depth* blocks, of which *count* starting at *head* are
+ * filled. The reader sets *result* when it stops, the writer sets *stop* when
+ * it no longer drains the buffer.
+ */
+struct feed {
+	BLURAY         *bd;
+	uint8_t        *buf;
+	size_t         *lengths;
+	size_t          blocksize;
+	size_t          depth;
+	size_t          head;
+	size_t          count;
+	int             done;
+	int             result;
+	int             stop;
+	uint64_t        bytes;
+	uint64_t        read_ns;
+	pthread_mutex_t lock;
+	pthread_cond_t  filled;
+	pthread_cond_t  drained;
+};
+
+static uint64_t elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * UINT64_C(1000000000)
+			+ end->tv_nsec - start->tv_nsec;
+}
+
+/**
+ * Fill the free blocks of the feed *data* until the title ended or the writer
+ * stopped.
+ */
+static void *read_blocks(void *data)
+{
+	struct feed *f = data;
+	int result = 0;
+	while(!f->done)
+	{
+		pthread_mutex_lock(&f->lock);
+		while(f->count == f->depth && !f->stop)
+			pthread_cond_wait(&f->drained, &f->lock);
+		int stop = f->stop;
+		size_t slot = (f->head + f->count) % f->depth;
+		pthread_mutex_unlock(&f->lock);
+		if(stop)
+			break;
+
+		// the free block is only touched by the reader
+		uint8_t *block = f->buf + slot * f->blocksize;
+		size_t len = 0;
+		uint64_t ns = 0;
+		int eof = 0;
+		while(len < f->blocksize)
+		{
+			struct timespec start, end;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			int n = bd_read(f->bd, block + len, f->blocksize - len);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			ns += elapsed_ns(&start, &end);
+			if(n <= 0)
+			{
+				result = n < 0 ? -2 : 0;
+				eof = 1;
+				break;
+			}
+			len += n;
+		}
+
+		pthread_mutex_lock(&f->lock);
+		f->lengths[slot] = len;
+		if(len > 0)
+			f->count++;
+		f->bytes   += len;
+		f->read_ns += ns;
+		if(eof)
+		{
+			f->done   = 1;
+			f->result = result;
+		}
+		pthread_cond_signal(&f->filled);
+		pthread_mutex_unlock(&f->lock);
+	}
+	return NULL;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len)
+{
+	while(len > 0)
+	{
+		ssize_t n = write(fd, buf, len);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int report_progress(struct feed *f, int fd, struct timespec *last, int done)
+{
+	if(fd < 0)
+		return 0;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(!done && elapsed_ns(last, &now) < PROGRESS_INTERVAL * UINT64_C(1000000))
+		return 0;
+	*last = now;
+	pthread_mutex_lock(&f->lock);
+	uint64_t bytes = f->bytes;
+	uint64_t us    = f->read_ns / 1000;
+	pthread_mutex_unlock(&f->lock);
+	return progress_write_read(fd, bytes, us);
+}
+
+/**
+ * Write the blocks of *f* to *fd* until the reader is done. Returns 0, or -1
+ * with errno set if writing failed for another reason than *fd* being closed.
+ */
+static int write_blocks(struct feed *f, int fd, int progressfd)
+{
+	struct timespec last = {0, 0};
+	while(1)
+	{
+		pthread_mutex_lock(&f->lock);
+		while(f->count == 0 && !f->done)
+			pthread_cond_wait(&f->filled, &f->lock);
+		size_t slot = f->head;
+		size_t len  = f->count > 0 ? f->lengths[slot] : 0;
+		pthread_mutex_unlock(&f->lock);
+		if(len == 0)
+			return report_progress(f, progressfd, &last, 1);
+
+		if(write_all(fd, f->buf + slot * f->blocksize, len) < 0)
+			return errno == EPIPE ? 0 : -1;
+
+		pthread_mutex_lock(&f->lock);
+		f->head = (f->head + 1) % f->depth;
+		f->count--;
+		pthread_cond_signal(&f->drained);
+		pthread_mutex_unlock(&f->lock);
+		if(report_progress(f, progressfd, &last, 0) < 0)
+			return -1;
+	}
+}
+
+int feed_title(const char *src, const BLURAY_TITLE_INFO *title, uint32_t chapter,
+		int fd, size_t blocksize, size_t depth, int progressfd)
+{
+	struct feed f = {
+		.bd        = NULL,
+		.buf       = NULL,
+		.lengths   = NULL,
+		.blocksize = blocksize - blocksize % FEED_UNIT_SIZE,
+		.depth     = depth,
+		.head      = 0,
+		.count     = 0,
+		.done      = 0,
+		.result    = 0,
+		.stop      = 0,
+		.bytes     = 0,
+		.read_ns   = 0,
+		.lock      = PTHREAD_MUTEX_INITIALIZER,
+		.filled    = PTHREAD_COND_INITIALIZER,
+		.drained   = PTHREAD_COND_INITIALIZER
+	};
+	if(f.blocksize == 0 || f.depth == 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(!(f.buf = malloc(f.depth * f.blocksize))
+			|| !(f.lengths = calloc(f.depth, sizeof(*f.lengths))))
+	{
+		free(f.buf);
+		return -1;
+	}
+
+	int err = -2;
+	if(!(f.bd = bd_open(src, NULL)) || !bd_select_playlist(f.bd, title->playlist))
+		goto cleanup;
+	if(chapter > 0 && bd_seek_chapter(f.bd, chapter) < 0)
+		goto cleanup;
+
+	err = -1;
+	pthread_t reader;
+	if((errno = pthread_create(&reader, NULL, read_blocks, &f)))
+		goto cleanup;
+	int written = write_blocks(&f, fd, progressfd);
+
+	// the reader may still wait for a block to be drained
+	pthread_mutex_lock(&f.lock);
+	f.stop = 1;
+	pthread_cond_signal(&f.drained);
+	pthread_mutex_unlock(&f.lock);
+	pthread_join(reader, NULL);
+	if(written == 0)
+		err = f.result;
+
+cleanup:
+	{
+		int errnum = errno;
+		if(f.bd)
+			bd_close(f.bd);
+		free(f.lengths);
+		free(f.buf);
+		errno = errnum;
+	}
+	return err;
+}
@@ -0,0 +1,48 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEED_H_INCLUDED
+#define FEED_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+/** bytes in an aligned unit of 32 source packets, the granularity of reads */
+#define FEED_UNIT_SIZE 6144
+
+/**
+ * Read *title* from the Blu-ray *src*, starting at its chapter *chapter*, and
+ * write the transport stream to *fd*, e.g. a pipe to ffmpeg. A reader thread
+ * fills a ring buffer of *depth* blocks of *blocksize* bytes with bd_read,
+ * while the calling thread drains it, so reading from the disc and writing to
+ * *fd* overlap. *blocksize* is rounded down to a multiple of FEED_UNIT_SIZE.
+ *
+ * If *progressfd* is not -1, the bytes read and the microseconds spent in
+ * bd_read are written to it as the keys read_size and read_time_us.
+ *
+ * Feeding ends early without error if the reader of *fd* closes it.
+ *
+ * Returns 0, -1 on error with errno set or -2 if libbluray failed.
+ */
+int feed_title(const char *src, const BLURAY_TITLE_INFO *title, uint32_t chapter,
+		int fd, size_t blocksize, size_t depth, int progressfd);
+
+#endif
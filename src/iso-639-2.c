@@ -0,0 +1,388 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "iso-639-2.h"
+#include "util.h"
+
+#define C(a, b, c) ISO639_CODE(a, b, c)
+#define B(a, b, c) [C(a, b, c)] = C(a, b, c)
+
+/**
+ * The bibliographic code of every known code, indexed by the code itself, so
+ * the packed codes are their own perfect hash. The compiler lays the table out
+ * from the designated initializers, where a code listed twice is a warning.
+ */
+static const iso639_code bcodes[ISO639_MAX + 1] = {
+	/* ISO 639-2/B */
+	B('a','a','r'), B('a','b','k'), B('a','c','e'), B('a','c','h'), B('a','d','a'),
+	B('a','d','y'), B('a','f','h'), B('a','f','r'), B('a','i','n'), B('a','k','a'),
+	B('a','k','k'), B('a','l','b'), B('a','l','e'), B('a','l','t'), B('a','m','h'),
+	B('a','n','g'), B('a','n','p'), B('a','r','a'), B('a','r','c'), B('a','r','g'),
+	B('a','r','m'), B('a','r','n'), B('a','r','p'), B('a','r','w'), B('a','s','m'),
+	B('a','s','t'), B('a','v','a'), B('a','v','e'), B('a','w','a'), B('a','y','m'),
+	B('a','z','e'), B('b','a','k'), B('b','a','m'), B('b','a','n'), B('b','a','q'),
+	B('b','a','s'), B('b','e','j'), B('b','e','l'), B('b','e','m'), B('b','e','n'),
+	B('b','h','o'), B('b','i','h'), B('b','i','n'), B('b','i','s'), B('b','l','a'),
+	B('b','o','s'), B('b','r','a'), B('b','r','e'), B('b','u','g'), B('b','u','l'),
+	B('b','u','r'), B('b','y','n'), B('c','a','d'), B('c','a','r'), B('c','a','t'),
+	B('c','e','b'), B('c','h','a'), B('c','h','b'), B('c','h','e'), B('c','h','g'),
+	B('c','h','i'), B('c','h','k'), B('c','h','n'), B('c','h','o'), B('c','h','p'),
+	B('c','h','r'), B('c','h','u'), B('c','h','v'), B('c','h','y'), B('c','o','p'),
+	B('c','o','r'), B('c','o','s'), B('c','r','e'), B('c','r','h'), B('c','s','b'),
+	B('c','z','e'), B('d','a','k'), B('d','a','n'), B('d','a','r'), B('d','g','r'),
+	B('d','i','v'), B('d','s','b'), B('d','u','a'), B('d','u','m'), B('d','u','t'),
+	B('d','y','u'), B('d','z','o'), B('e','f','i'), B('e','g','y'), B('e','k','a'),
+	B('e','l','x'), B('e','n','g'), B('e','n','m'), B('e','p','o'), B('e','s','t'),
+	B('e','w','e'), B('e','w','o'), B('f','a','n'), B('f','a','o'), B('f','a','t'),
+	B('f','i','j'), B('f','i','l'), B('f','i','n'), B('f','o','n'), B('f','r','e'),
+	B('f','r','m'), B('f','r','o'), B('f','r','r'), B('f','r','s'), B('f','r','y'),
+	B('f','u','l'), B('f','u','r'), B('g','a','a'), B('g','a','y'), B('g','e','o'),
+	B('g','e','r'), B('g','e','z'), B('g','i','l'), B('g','l','a'), B('g','l','e'),
+	B('g','l','g'), B('g','l','v'), B('g','m','h'), B('g','o','h'), B('g','o','r'),
+	B('g','o','t'), B('g','r','c'), B('g','r','e'), B('g','r','n'), B('g','s','w'),
+	B('g','u','j'), B('g','w','i'), B('h','a','t'), B('h','a','u'), B('h','a','w'),
+	B('h','e','b'), B('h','e','r'), B('h','i','l'), B('h','i','n'), B('h','i','t'),
+	B('h','m','o'), B('h','r','v'), B('h','s','b'), B('h','u','n'), B('h','u','p'),
+	B('i','b','a'), B('i','b','o'), B('i','c','e'), B('i','d','o'), B('i','i','i'),
+	B('i','k','u'), B('i','l','e'), B('i','l','o'), B('i','n','a'), B('i','n','d'),
+	B('i','n','h'), B('i','p','k'), B('i','t','a'), B('j','a','v'), B('j','b','o'),
+	B('j','p','n'), B('j','p','r'), B('k','a','a'), B('k','a','b'), B('k','a','c'),
+	B('k','a','l'), B('k','a','m'), B('k','a','n'), B('k','a','s'), B('k','a','u'),
+	B('k','a','w'), B('k','a','z'), B('k','b','d'), B('k','h','a'), B('k','h','m'),
+	B('k','h','o'), B('k','i','k'), B('k','i','n'), B('k','i','r'), B('k','m','b'),
+	B('k','o','m'), B('k','o','n'), B('k','o','r'), B('k','o','s'), B('k','r','c'),
+	B('k','r','l'), B('k','r','u'), B('k','u','a'), B('k','u','m'), B('k','u','r'),
+	B('k','u','t'), B('l','a','d'), B('l','a','m'), B('l','a','o'), B('l','a','t'),
+	B('l','a','v'), B('l','e','z'), B('l','i','m'), B('l','i','n'), B('l','i','t'),
+	B('l','o','l'), B('l','o','z'), B('l','t','z'), B('l','u','a'), B('l','u','b'),
+	B('l','u','g'), B('l','u','i'), B('l','u','n'), B('l','u','o'), B('l','u','s'),
+	B('m','a','c'), B('m','a','d'), B('m','a','g'), B('m','a','h'), B('m','a','i'),
+	B('m','a','k'), B('m','a','l'), B('m','a','o'), B('m','a','r'), B('m','a','s'),
+	B('m','a','y'), B('m','d','f'), B('m','d','r'), B('m','e','n'), B('m','g','a'),
+	B('m','i','c'), B('m','i','n'), B('m','l','g'), B('m','l','t'), B('m','n','c'),
+	B('m','n','i'), B('m','o','h'), B('m','o','n'), B('m','o','s'), B('m','u','s'),
+	B('m','w','l'), B('m','y','v'), B('n','a','p'), B('n','a','u'), B('n','a','v'),
+	B('n','b','l'), B('n','d','e'), B('n','d','o'), B('n','d','s'), B('n','e','p'),
+	B('n','e','w'), B('n','i','a'), B('n','i','u'), B('n','n','o'), B('n','o','b'),
+	B('n','o','g'), B('n','o','n'), B('n','o','r'), B('n','q','o'), B('n','s','o'),
+	B('n','w','c'), B('n','y','a'), B('n','y','m'), B('n','y','n'), B('n','y','o'),
+	B('n','z','i'), B('o','c','i'), B('o','j','i'), B('o','r','i'), B('o','r','m'),
+	B('o','s','a'), B('o','s','s'), B('o','t','a'), B('p','a','g'), B('p','a','l'),
+	B('p','a','m'), B('p','a','n'), B('p','a','p'), B('p','a','u'), B('p','e','o'),
+	B('p','e','r'), B('p','h','n'), B('p','l','i'), B('p','o','l'), B('p','o','n'),
+	B('p','o','r'), B('p','r','o'), B('p','u','s'), B('q','u','e'), B('r','o','h'),
+	B('r','u','m'), B('r','u','n'), B('r','u','s'), B('s','a','d'), B('s','a','g'),
+	B('s','a','h'), B('s','a','m'), B('s','a','n'), B('s','a','s'), B('s','a','t'),
+	B('s','c','n'), B('s','c','o'), B('s','e','l'), B('s','g','a'), B('s','h','n'),
+	B('s','i','d'), B('s','i','n'), B('s','l','o'), B('s','l','v'), B('s','m','a'),
+	B('s','m','e'), B('s','m','j'), B('s','m','n'), B('s','m','o'), B('s','m','s'),
+	B('s','n','a'), B('s','n','d'), B('s','n','k'), B('s','o','g'), B('s','o','m'),
+	B('s','o','t'), B('s','p','a'), B('s','r','d'), B('s','r','n'), B('s','r','p'),
+	B('s','r','r'), B('s','s','w'), B('s','u','k'), B('s','u','n'), B('s','u','s'),
+	B('s','u','x'), B('s','w','a'), B('s','w','e'), B('s','y','c'), B('t','a','h'),
+	B('t','a','m'), B('t','a','t'), B('t','e','l'), B('t','e','m'), B('t','e','r'),
+	B('t','e','t'), B('t','g','k'), B('t','g','l'), B('t','h','a'), B('t','i','b'),
+	B('t','i','g'), B('t','i','r'), B('t','i','v'), B('t','k','l'), B('t','l','h'),
+	B('t','l','i'), B('t','o','g'), B('t','o','n'), B('t','p','i'), B('t','s','i'),
+	B('t','s','n'), B('t','s','o'), B('t','u','k'), B('t','u','m'), B('t','u','r'),
+	B('t','v','l'), B('t','w','i'), B('t','y','v'), B('u','d','m'), B('u','g','a'),
+	B('u','i','g'), B('u','k','r'), B('u','m','b'), B('u','n','d'), B('u','r','d'),
+	B('u','z','b'), B('v','a','i'), B('v','e','n'), B('v','i','e'), B('v','o','l'),
+	B('v','o','t'), B('w','a','l'), B('w','a','r'), B('w','a','s'), B('w','e','l'),
+	B('w','l','n'), B('w','o','l'), B('x','a','l'), B('x','h','o'), B('y','a','o'),
+	B('y','a','p'), B('y','i','d'), B('y','o','r'), B('z','b','l'), B('z','e','n'),
+	B('z','g','h'), B('z','h','a'), B('z','u','l'), B('z','u','n'),
+
+	/* ISO 639-2/T, which differ from the bibliographic codes */
+	[C('b','o','d')] = C('t','i','b'),
+	[C('c','e','s')] = C('c','z','e'),
+	[C('c','y','m')] = C('w','e','l'),
+	[C('d','e','u')] = C('g','e','r'),
+	[C('e','l','l')] = C('g','r','e'),
+	[C('e','u','s')] = C('b','a','q'),
+	[C('f','a','s')] = C('p','e','r'),
+	[C('f','r','a')] = C('f','r','e'),
+	[C('h','y','e')] = C('a','r','m'),
+	[C('i','s','l')] = C('i','c','e'),
+	[C('k','a','t')] = C('g','e','o'),
+	[C('m','k','d')] = C('m','a','c'),
+	[C('m','r','i')] = C('m','a','o'),
+	[C('m','s','a')] = C('m','a','y'),
+	[C('m','y','a')] = C('b','u','r'),
+	[C('n','l','d')] = C('d','u','t'),
+	[C('r','o','n')] = C('r','u','m'),
+	[C('s','l','k')] = C('s','l','o'),
+	[C('s','q','i')] = C('a','l','b'),
+	[C('z','h','o')] = C('c','h','i'),
+
+	/* ISO 639-1 */
+	[C('a','a',0)] = C('a','a','r'),
+	[C('a','b',0)] = C('a','b','k'),
+	[C('a','e',0)] = C('a','v','e'),
+	[C('a','f',0)] = C('a','f','r'),
+	[C('a','k',0)] = C('a','k','a'),
+	[C('a','m',0)] = C('a','m','h'),
+	[C('a','n',0)] = C('a','r','g'),
+	[C('a','r',0)] = C('a','r','a'),
+	[C('a','s',0)] = C('a','s','m'),
+	[C('a','v',0)] = C('a','v','a'),
+	[C('a','y',0)] = C('a','y','m'),
+	[C('a','z',0)] = C('a','z','e'),
+	[C('b','a',0)] = C('b','a','k'),
+	[C('b','e',0)] = C('b','e','l'),
+	[C('b','g',0)] = C('b','u','l'),
+	[C('b','h',0)] = C('b','i','h'),
+	[C('b','i',0)] = C('b','i','s'),
+	[C('b','m',0)] = C('b','a','m'),
+	[C('b','n',0)] = C('b','e','n'),
+	[C('b','o',0)] = C('t','i','b'),
+	[C('b','r',0)] = C('b','r','e'),
+	[C('b','s',0)] = C('b','o','s'),
+	[C('c','a',0)] = C('c','a','t'),
+	[C('c','e',0)] = C('c','h','e'),
+	[C('c','h',0)] = C('c','h','a'),
+	[C('c','o',0)] = C('c','o','s'),
+	[C('c','r',0)] = C('c','r','e'),
+	[C('c','s',0)] = C('c','z','e'),
+	[C('c','u',0)] = C('c','h','u'),
+	[C('c','v',0)] = C('c','h','v'),
+	[C('c','y',0)] = C('w','e','l'),
+	[C('d','a',0)] = C('d','a','n'),
+	[C('d','e',0)] = C('g','e','r'),
+	[C('d','v',0)] = C('d','i','v'),
+	[C('d','z',0)] = C('d','z','o'),
+	[C('e','e',0)] = C('e','w','e'),
+	[C('e','l',0)] = C('g','r','e'),
+	[C('e','n',0)] = C('e','n','g'),
+	[C('e','o',0)] = C('e','p','o'),
+	[C('e','s',0)] = C('s','p','a'),
+	[C('e','t',0)] = C('e','s','t'),
+	[C('e','u',0)] = C('b','a','q'),
+	[C('f','a',0)] = C('p','e','r'),
+	[C('f','f',0)] = C('f','u','l'),
+	[C('f','i',0)] = C('f','i','n'),
+	[C('f','j',0)] = C('f','i','j'),
+	[C('f','o',0)] = C('f','a','o'),
+	[C('f','r',0)] = C('f','r','e'),
+	[C('f','y',0)] = C('f','r','y'),
+	[C('g','a',0)] = C('g','l','e'),
+	[C('g','d',0)] = C('g','l','a'),
+	[C('g','l',0)] = C('g','l','g'),
+	[C('g','n',0)] = C('g','r','n'),
+	[C('g','u',0)] = C('g','u','j'),
+	[C('g','v',0)] = C('g','l','v'),
+	[C('h','a',0)] = C('h','a','u'),
+	[C('h','e',0)] = C('h','e','b'),
+	[C('h','i',0)] = C('h','i','n'),
+	[C('h','o',0)] = C('h','m','o'),
+	[C('h','r',0)] = C('h','r','v'),
+	[C('h','t',0)] = C('h','a','t'),
+	[C('h','u',0)] = C('h','u','n'),
+	[C('h','y',0)] = C('a','r','m'),
+	[C('h','z',0)] = C('h','e','r'),
+	[C('i','a',0)] = C('i','n','a'),
+	[C('i','d',0)] = C('i','n','d'),
+	[C('i','e',0)] = C('i','l','e'),
+	[C('i','g',0)] = C('i','b','o'),
+	[C('i','i',0)] = C('i','i','i'),
+	[C('i','k',0)] = C('i','p','k'),
+	[C('i','o',0)] = C('i','d','o'),
+	[C('i','s',0)] = C('i','c','e'),
+	[C('i','t',0)] = C('i','t','a'),
+	[C('i','u',0)] = C('i','k','u'),
+	[C('j','a',0)] = C('j','p','n'),
+	[C('j','v',0)] = C('j','a','v'),
+	[C('k','a',0)] = C('g','e','o'),
+	[C('k','g',0)] = C('k','o','n'),
+	[C('k','i',0)] = C('k','i','k'),
+	[C('k','j',0)] = C('k','u','a'),
+	[C('k','k',0)] = C('k','a','z'),
+	[C('k','l',0)] = C('k','a','l'),
+	[C('k','m',0)] = C('k','h','m'),
+	[C('k','n',0)] = C('k','a','n'),
+	[C('k','o',0)] = C('k','o','r'),
+	[C('k','r',0)] = C('k','a','u'),
+	[C('k','s',0)] = C('k','a','s'),
+	[C('k','u',0)] = C('k','u','r'),
+	[C('k','v',0)] = C('k','o','m'),
+	[C('k','w',0)] = C('c','o','r'),
+	[C('k','y',0)] = C('k','i','r'),
+	[C('l','a',0)] = C('l','a','t'),
+	[C('l','b',0)] = C('l','t','z'),
+	[C('l','g',0)] = C('l','u','g'),
+	[C('l','i',0)] = C('l','i','m'),
+	[C('l','n',0)] = C('l','i','n'),
+	[C('l','o',0)] = C('l','a','o'),
+	[C('l','t',0)] = C('l','i','t'),
+	[C('l','u',0)] = C('l','u','b'),
+	[C('l','v',0)] = C('l','a','v'),
+	[C('m','g',0)] = C('m','l','g'),
+	[C('m','h',0)] = C('m','a','h'),
+	[C('m','i',0)] = C('m','a','o'),
+	[C('m','k',0)] = C('m','a','c'),
+	[C('m','l',0)] = C('m','a','l'),
+	[C('m','n',0)] = C('m','o','n'),
+	[C('m','r',0)] = C('m','a','r'),
+	[C('m','s',0)] = C('m','a','y'),
+	[C('m','t',0)] = C('m','l','t'),
+	[C('m','y',0)] = C('b','u','r'),
+	[C('n','a',0)] = C('n','a','u'),
+	[C('n','b',0)] = C('n','o','b'),
+	[C('n','d',0)] = C('n','d','e'),
+	[C('n','e',0)] = C('n','e','p'),
+	[C('n','g',0)] = C('n','d','o'),
+	[C('n','l',0)] = C('d','u','t'),
+	[C('n','n',0)] = C('n','n','o'),
+	[C('n','o',0)] = C('n','o','r'),
+	[C('n','r',0)] = C('n','b','l'),
+	[C('n','v',0)] = C('n','a','v'),
+	[C('n','y',0)] = C('n','y','a'),
+	[C('o','c',0)] = C('o','c','i'),
+	[C('o','j',0)] = C('o','j','i'),
+	[C('o','m',0)] = C('o','r','m'),
+	[C('o','r',0)] = C('o','r','i'),
+	[C('o','s',0)] = C('o','s','s'),
+	[C('p','a',0)] = C('p','a','n'),
+	[C('p','i',0)] = C('p','l','i'),
+	[C('p','l',0)] = C('p','o','l'),
+	[C('p','s',0)] = C('p','u','s'),
+	[C('p','t',0)] = C('p','o','r'),
+	[C('q','u',0)] = C('q','u','e'),
+	[C('r','m',0)] = C('r','o','h'),
+	[C('r','n',0)] = C('r','u','n'),
+	[C('r','o',0)] = C('r','u','m'),
+	[C('r','u',0)] = C('r','u','s'),
+	[C('r','w',0)] = C('k','i','n'),
+	[C('s','a',0)] = C('s','a','n'),
+	[C('s','c',0)] = C('s','r','d'),
+	[C('s','d',0)] = C('s','n','d'),
+	[C('s','e',0)] = C('s','m','e'),
+	[C('s','g',0)] = C('s','a','g'),
+	[C('s','i',0)] = C('s','i','n'),
+	[C('s','k',0)] = C('s','l','o'),
+	[C('s','l',0)] = C('s','l','v'),
+	[C('s','m',0)] = C('s','m','o'),
+	[C('s','n',0)] = C('s','n','a'),
+	[C('s','o',0)] = C('s','o','m'),
+	[C('s','q',0)] = C('a','l','b'),
+	[C('s','r',0)] = C('s','r','p'),
+	[C('s','s',0)] = C('s','s','w'),
+	[C('s','t',0)] = C('s','o','t'),
+	[C('s','u',0)] = C('s','u','n'),
+	[C('s','v',0)] = C('s','w','e'),
+	[C('s','w',0)] = C('s','w','a'),
+	[C('t','a',0)] = C('t','a','m'),
+	[C('t','e',0)] = C('t','e','l'),
+	[C('t','g',0)] = C('t','g','k'),
+	[C('t','h',0)] = C('t','h','a'),
+	[C('t','i',0)] = C('t','i','r'),
+	[C('t','k',0)] = C('t','u','k'),
+	[C('t','l',0)] = C('t','g','l'),
+	[C('t','n',0)] = C('t','s','n'),
+	[C('t','o',0)] = C('t','o','n'),
+	[C('t','r',0)] = C('t','u','r'),
+	[C('t','s',0)] = C('t','s','o'),
+	[C('t','t',0)] = C('t','a','t'),
+	[C('t','w',0)] = C('t','w','i'),
+	[C('t','y',0)] = C('t','a','h'),
+	[C('u','g',0)] = C('u','i','g'),
+	[C('u','k',0)] = C('u','k','r'),
+	[C('u','r',0)] = C('u','r','d'),
+	[C('u','z',0)] = C('u','z','b'),
+	[C('v','e',0)] = C('v','e','n'),
+	[C('v','i',0)] = C('v','i','e'),
+	[C('v','o',0)] = C('v','o','l'),
+	[C('w','a',0)] = C('w','l','n'),
+	[C('w','o',0)] = C('w','o','l'),
+	[C('x','h',0)] = C('x','h','o'),
+	[C('y','i',0)] = C('y','i','d'),
+	[C('y','o',0)] = C('y','o','r'),
+	[C('z','a',0)] = C('z','h','a'),
+	[C('z','h',0)] = C('c','h','i'),
+	[C('z','u',0)] = C('z','u','l'),
+};
+
+iso639_code iso639_pack(const char *lang)
+{
+	iso639_code code = 0;
+	size_t n = 0;
+	for(; n < 3 && lang[n]; n++)
+	{
+		int c = tolower((unsigned char)lang[n]);
+		if(c < 'a' || c > 'z')
+			return 0;
+		code = code << 5 | (c - 'a' + 1);
+	}
+	if(lang[n] || n < 2)
+		return 0;
+	// ISO 639-1 codes are packed with an empty third letter
+	return n == 2 ? code << 5 : code;
+}
+
+char *iso639_unpack(char buf[4], iso639_code code)
+{
+	size_t n = 0;
+	for(int shift = 10; shift >= 0; shift -= 5)
+		if(code >> shift & 0x1f)
+			buf[n++] = 'a' - 1 + (code >> shift & 0x1f);
+	buf[n] = '\0';
+	return buf;
+}
+
+iso639_code iso6392_bcode(iso639_code code)
+{
+	return code <= ISO639_MAX ? bcodes[code] : 0;
+}
+
+const char *iso6392_to_bcode(char buf[4], const char *lang)
+{
+	iso639_code code = iso6392_bcode(iso639_pack(lang));
+	return code ? iso639_unpack(buf, code) : lang;
+}
+
+size_t iso639_set_parse(struct iso639_set *set, const char *list,
+		void (*unknown)(const char *lang, size_t len, void *data), void *data)
+{
+	size_t n = 0;
+	for(const char *lang, *next = list; (lang = iter_comma_list(&next, ','));)
+	{
+		// null-terminate lang
+		char buf[4] = "";
+		if(next - lang < 4)
+		{
+			memcpy(buf, lang, next - lang);
+			buf[next - lang] = '\0';
+		}
+
+		iso639_code code = iso6392_bcode(iso639_pack(buf));
+		if(!code)
+		{
+			if(unknown)
+				unknown(lang, next - lang, data);
+			continue;
+		}
+		iso639_set_add(set, code);
+		n++;
+	}
+	return n;
+}
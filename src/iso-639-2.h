@@ -20,94 +20,71 @@ with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef ISO_639_2_H_INCLUDED
 #define ISO_639_2_H_INCLUDED
 
-#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#include "util.h"
+/**
+ * An ISO 639 language code packed into 15 bits, 5 bits for each letter from
+ * 1 for a to 26 for z. ISO 639-1 codes have an empty third letter. 0 is no
+ * language.
+ */
+typedef uint16_t iso639_code;
+
+#define ISO639_LETTER(c) ((c) ? (c) - 'a' + 1 : 0)
+#define ISO639_CODE(a, b, c) \
+		((iso639_code)(ISO639_LETTER(a) << 10 | ISO639_LETTER(b) << 5 | ISO639_LETTER(c)))
+#define ISO639_MAX ISO639_CODE('z', 'z', 'z')
 
 /**
- * Convert ISO-639-2 terminology codes to bibliographic codes. (Convert localized
- * codes to international codes.) If *lang* is already a bibliographic code it
- * is returned unchanged.
+ * Pack the two- or three-letter code *lang*, in any case. Returns 0 if *lang*
+ * is not a code.
  */
-const char *iso6392_to_bcode(const char *lang)
-{
-	static const struct {
-		char tcode[4];
-		char bcode[4];
-	} tcodes[] = {
-		{"bod", "tib"},
-		{"ces", "cze"},
-		{"cym", "wel"},
-		{"deu", "ger"},
-		{"ell", "gre"},
-		{"eus", "baq"},
-		{"fra", "fre"},
-		{"hye", "arm"},
-		{"isl", "ice"},
-		{"kat", "geo"},
-		{"mkd", "mac"},
-		{"mri", "mao"},
-		{"mya", "bur"},
-		{"nld", "dut"},
-		{"slk", "slo"}
-	};
-	static const size_t numtcodes = sizeof(tcodes) / sizeof(tcodes[0]);
-
-	size_t i = bisect_left(tcodes, lang, numtcodes, sizeof(tcodes[0]), (compar_fn)strcmp);
-	if(i < numtcodes && strcmp(tcodes[i].tcode, lang) == 0)
-		return tcodes[i].bcode;
-	else
-		return lang;
-}
+iso639_code iso639_pack(const char *lang);
+
+/**
+ * Unpack *code* to lowercase letters in *buf*. Returns *buf*.
+ */
+char *iso639_unpack(char buf[4], iso639_code code);
+
+/**
+ * Look up the ISO 639-2 bibliographic code of *code*, which may be a
+ * bibliographic, a terminology, or an ISO 639-1 code. Returns 0 if the language
+ * is unknown.
+ */
+iso639_code iso6392_bcode(iso639_code code);
 
 /**
- * Test if *lang* is a known ISO 639-2 language code.
+ * Convert a known code *lang* to its bibliographic code in *buf*, as by
+ * iso6392_bcode. Unknown codes are returned unchanged.
  */
-int iso6392_is_known(const char *lang)
+const char *iso6392_to_bcode(char buf[4], const char *lang);
+
+/**
+ * A set of languages with one bit for every packed code.
+ */
+struct iso639_set {
+	uint64_t bits[(ISO639_MAX >> 6) + 1];
+};
+
+static inline void iso639_set_add(struct iso639_set *set, iso639_code code)
+{
+	set->bits[code >> 6] |= UINT64_C(1) << (code & 63);
+}
+
+static inline int iso639_set_contains(const struct iso639_set *set, iso639_code code)
 {
-	static const char bcodes[][4] = {
-		"aar", "abk", "ace", "ach", "ada", "ady", "afh", "afr", "ain", "akk",
-		"ale", "alt", "amh", "ang", "anp", "arc", "arg", "arm", "arn", "arp",
-		"arw", "asm", "ast", "ava", "ave", "awa", "bak", "bam", "ban", "baq",
-		"bas", "bej", "bel", "bem", "ben", "bho", "bin", "bis", "bla", "bos",
-		"bra", "bre", "bug", "bul", "bur", "byn", "cad", "car", "cat", "ceb",
-		"cha", "chb", "che", "chg", "chk", "chn", "cho", "chp", "chr", "chu",
-		"chv", "chy", "cop", "cor", "cos", "crh", "csb", "cze", "dak", "dan",
-		"dar", "dgr", "div", "dsb", "dua", "dum", "dut", "dyu", "dzo", "efi",
-		"egy", "eka", "elx", "eng", "enm", "epo", "ewe", "ewo", "fan", "fao",
-		"fat", "fij", "fil", "fin", "fon", "fre", "frm", "fro", "frr", "frs",
-		"fry", "fur", "gaa", "gay", "geo", "ger", "gez", "gil", "gla", "gle",
-		"glg", "glv", "gmh", "goh", "gor", "got", "grc", "gre", "gsw", "guj",
-		"gwi", "hat", "hau", "haw", "heb", "her", "hil", "hin", "hit", "hmo",
-		"hrv", "hsb", "hun", "hup", "iba", "ibo", "ice", "ido", "iii", "ile",
-		"ilo", "ina", "ind", "inh", "ita", "jav", "jbo", "jpn", "jpr", "kaa",
-		"kab", "kac", "kal", "kam", "kan", "kas", "kaw", "kaz", "kbd", "kha",
-		"khm", "kho", "kik", "kin", "kir", "kmb", "kor", "kos", "krc", "krl",
-		"kru", "kua", "kum", "kut", "lad", "lam", "lao", "lat", "lez", "lim",
-		"lin", "lit", "lol", "loz", "ltz", "lua", "lub", "lug", "lui", "lun",
-		"luo", "lus", "mac", "mad", "mag", "mah", "mai", "mak", "mal", "mao",
-		"mar", "mas", "mdf", "mdr", "men", "mga", "mic", "min", "mlt", "mnc",
-		"mni", "moh", "mos", "mus", "mwl", "myv", "nap", "nau", "nav", "nbl",
-		"nde", "ndo", "nds", "new", "nia", "niu", "nno", "nob", "nog", "non",
-		"nqo", "nso", "nwc", "nya", "nym", "nyn", "nyo", "nzi", "oci", "osa",
-		"oss", "ota", "pag", "pal", "pam", "pan", "pap", "pau", "peo", "phn",
-		"pli", "pol", "pon", "por", "pro", "sad", "sag", "sah", "sam", "san",
-		"sas", "sat", "scn", "sco", "sel", "sga", "shn", "sid", "sin", "slo",
-		"slv", "sma", "sme", "smj", "smn", "smo", "sms", "sna", "snd", "snk",
-		"sog", "som", "sot", "spa", "srn", "srp", "srr", "ssw", "suk", "sun",
-		"sus", "sux", "swe", "syc", "tah", "tam", "tat", "tel", "tem", "ter",
-		"tet", "tgk", "tgl", "tha", "tib", "tig", "tir", "tiv", "tkl", "tlh",
-		"tli", "tog", "ton", "tpi", "tsi", "tsn", "tso", "tuk", "tum", "tur",
-		"tvl", "twi", "tyv", "udm", "uga", "uig", "ukr", "umb", "und", "urd",
-		"vai", "ven", "vie", "vol", "vot", "wal", "war", "was", "wel", "wln",
-		"wol", "xal", "xho", "yao", "yap", "yor", "zbl", "zen", "zgh", "zul",
-		"zun"
-	};
-	static const size_t numbcodes = sizeof(bcodes) / sizeof(bcodes[0]);
-
-	lang = iso6392_to_bcode(lang);
-	size_t i = bisect_left(bcodes, lang, numbcodes, sizeof(bcodes[0]), (compar_fn)strcmp);
-	return i < numbcodes && strcmp(bcodes[i], lang) == 0;
+	return set->bits[code >> 6] >> (code & 63) & 1;
 }
 
+/**
+ * Add the known languages of the comma-separated list *list* to *set* as ISO
+ * 639-2/B codes, see iso6392_bcode. Unknown languages are skipped, *unknown*
+ * is called with each of them and its length first, unless it is NULL. bdinfo
+ * and libbdinfo select all streams if no language is known.
+ *
+ * Returns the number of known languages in *list*.
+ */
+size_t iso639_set_parse(struct iso639_set *set, const char *list,
+		void (*unknown)(const char *lang, size_t len, void *data), void *data);
+
 #endif
@@ -0,0 +1,204 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "jobs.h"
+
+static int64_t msecs_between(const struct timespec *a, const struct timespec *b)
+{
+	return (int64_t)(b->tv_sec - a->tv_sec) * 1000 + (b->tv_nsec - a->tv_nsec) / 1000000;
+}
+
+/**
+ * Pass everything left in the progress file descriptor of the reaped *job*
+ * to *watch* and close it.
+ */
+static void drain_job(struct job *job, size_t i, const struct job_watch *watch, void *data)
+{
+	if(job->fd < 0)
+		return;
+	// descendants of the child may still hold the pipe, so only what is
+	// available is read
+	struct pollfd fd = {
+		.fd     = job->fd,
+		.events = POLLIN
+	};
+	if(watch)
+		while(poll(&fd, 1, 0) > 0 && watch->input(i, job->fd, data) == 0)
+			;
+	close(job->fd);
+	job->fd = -1;
+}
+
+/**
+ * Store *status* and *usage* in the job of *pid* among the *running* jobs in
+ * *slots* and remove it from them. Returns 1 if it did not succeed, 0
+ * otherwise.
+ */
+static int finish_job(struct job *jobs, size_t *slots, size_t *running, pid_t pid,
+		int status, const struct rusage *usage, const struct job_watch *watch, void *data)
+{
+	for(size_t i = 0; i < *running; i++)
+		if(jobs[slots[i]].pid == pid)
+		{
+			struct job *job = jobs + slots[i];
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			job->status  = status;
+			job->usage   = *usage;
+			job->seconds = (now.tv_sec - job->started.tv_sec)
+					+ (now.tv_nsec - job->started.tv_nsec) / 1e9;
+			job->running = 0;
+			drain_job(job, slots[i], watch, data);
+			slots[i] = slots[--(*running)];
+			return !job_succeeded(job);
+		}
+	return 0;
+}
+
+int run_jobs(struct job *jobs, size_t numjobs, size_t maxjobs,
+		job_spawn_fn spawn, const struct job_watch *watch, void *data)
+{
+	if(maxjobs == 0)
+		maxjobs = 1;
+	if(maxjobs > numjobs)
+		maxjobs = numjobs;
+
+	// indices of the running jobs and their progress file descriptors
+	size_t        *slots = malloc(maxjobs * sizeof(*slots));
+	struct pollfd *fds   = malloc(maxjobs * sizeof(*fds));
+	size_t        *fdjob = malloc(maxjobs * sizeof(*fdjob));
+	if((!slots || !fds || !fdjob) && maxjobs > 0)
+	{
+		free(slots);
+		free(fds);
+		free(fdjob);
+		return -1;
+	}
+
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	size_t next    = 0;
+	size_t running = 0;
+	int    failed  = 0;
+	while(next < numjobs || running > 0)
+	{
+		// fill up free slots
+		while(running < maxjobs && next < numjobs)
+		{
+			struct job *job = jobs + next;
+			memset(job, 0, sizeof(*job));
+			job->fd = -1;
+			clock_gettime(CLOCK_MONOTONIC, &job->started);
+			job->pid = spawn(next++, &job->fd, data);
+			if(job->pid < 0)
+			{
+				job->error = errno;
+				failed++;
+			}
+			else if(job->pid > 0)
+			{
+				job->running = 1;
+				slots[running++] = next - 1;
+			}
+		}
+		if(running == 0)
+			break;
+
+		int status;
+		struct rusage usage;
+		pid_t pid;
+		if(!watch)
+		{
+			if((pid = wait4(-1, &status, 0, &usage)) < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				failed = -1;
+				break;
+			}
+			if(WIFEXITED(status) || WIFSIGNALED(status))
+				failed += finish_job(jobs, slots, &running, pid, status, &usage, watch, data);
+			continue;
+		}
+
+		// children are reaped after poll, which wakes up when a progress pipe closes
+		nfds_t numfds = 0;
+		for(size_t i = 0; i < running; i++)
+			if(jobs[slots[i]].fd >= 0)
+			{
+				fds[numfds].fd     = jobs[slots[i]].fd;
+				fds[numfds].events = POLLIN;
+				fdjob[numfds++]    = slots[i];
+			}
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int64_t timeout = watch->interval - msecs_between(&tick, &now);
+		int n = poll(fds, numfds, timeout > 0 ? timeout : 0);
+		if(n < 0 && errno != EINTR)
+		{
+			failed = -1;
+			break;
+		}
+		for(nfds_t i = 0; i < numfds && n > 0; i++)
+			if(fds[i].revents)
+			{
+				struct job *job = jobs + fdjob[i];
+				if(watch->input(fdjob[i], job->fd, data))
+				{
+					close(job->fd);
+					job->fd = -1;
+				}
+			}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(msecs_between(&tick, &now) >= watch->interval)
+		{
+			watch->tick(data);
+			tick = now;
+		}
+
+		while((pid = wait4(-1, &status, WNOHANG, &usage)) > 0)
+			if(WIFEXITED(status) || WIFSIGNALED(status))
+				failed += finish_job(jobs, slots, &running, pid, status, &usage, watch, data);
+		if(pid < 0 && errno != EINTR && errno != ECHILD)
+		{
+			failed = -1;
+			break;
+		}
+	}
+	for(size_t i = 0; i < running; i++)
+		drain_job(jobs + slots[i], slots[i], NULL, NULL);
+	free(slots);
+	free(fds);
+	free(fdjob);
+	return failed;
+}
+
+int job_succeeded(const struct job *job)
+{
+	return job->pid >= 0 && WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0;
+}
@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JOBS_H_INCLUDED
+#define JOBS_H_INCLUDED
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * State of a job run by run_jobs. If the job could not be started *pid* is -1
+ * and *error* holds the errno, if it had nothing left to do *pid* is 0,
+ * otherwise *status* and *usage* hold the status and resource usage returned
+ * by wait4 and *seconds* the wall time the job ran.
+ * *running* is set from the start of the job until it was reaped and *fd* is
+ * its progress file descriptor or -1.
+ */
+struct job {
+	pid_t           pid;
+	int             status;
+	int             error;
+	struct rusage   usage;
+	double          seconds;
+	struct timespec started;
+	int             running;
+	int             fd;
+};
+
+/**
+ * Start job *i*. Returns the pid of the forked child, 0 if the job has nothing
+ * left to do and succeeded without a child, or -1 and sets errno. If the job
+ * reports its progress, *\*fd* is set to the read end of a pipe, which is then
+ * watched and closed by run_jobs, otherwise it is left at -1.
+ */
+typedef pid_t (*job_spawn_fn)(size_t i, int *fd, void *data);
+
+/**
+ * Callbacks of run_jobs while jobs are running. *input* is called when the
+ * progress file descriptor *fd* of job *i* is readable and returns 0 if it
+ * should be watched further, or 1 on end of file or an error. *tick* is called
+ * every *interval* milliseconds.
+ */
+struct job_watch {
+	int  (*input)(size_t i, int fd, void *data);
+	void (*tick)(void *data);
+	int    interval;
+};
+
+/**
+ * Run *numjobs* jobs with at most *maxjobs* of them running simultaneously.
+ * Every job is started with *spawn* and its result is stored in *jobs*. If
+ * *watch* is given, its callbacks are called with *data* while jobs are
+ * running.
+ *
+ * Returns the number of jobs that could not be started or did not exit
+ * successfully, or -1 if waiting for the children failed.
+ */
+int run_jobs(struct job *jobs, size_t numjobs, size_t maxjobs,
+		job_spawn_fn spawn, const struct job_watch *watch, void *data);
+
+/**
+ * Test if *job* was started and exited with status 0.
+ */
+int job_succeeded(const struct job *job);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "calls.h"
+#include "libbdinfo.h"
+#include "plan.h"
+#include "source.h"
+#include "title.h"
+#include "util.h"
+
+/**
+ * A result and the arena everything it points to is allocated from, itself
+ * included.
+ */
+struct result {
+	struct bdinfo_result result;
+	struct arena         arena;
+};
+
+/**
+ * Render the chapters of *title* as FFMETADATA1 into *arena*.
+ */
+static char *arena_ff_chapters(struct arena *arena, const BLURAY_TITLE_INFO *title)
+{
+	char  *buf = NULL;
+	size_t len;
+	FILE *f = open_memstream(&buf, &len);
+	if(!f)
+		return NULL;
+	int err = print_ff_chapters(f, title) < 0;
+	if(fclose(f) == EOF || err)
+	{
+		free(buf);
+		errno = ENOMEM;
+		return NULL;
+	}
+	char *chapters = arena_memdup(arena, buf, len + 1);
+	free(buf);
+	return chapters;
+}
+
+/**
+ * Copy *src* into *arena* as *title* and plan its remux by *query*.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+static int plan_result_title(struct arena *arena, struct bdinfo_title *title,
+		const BLURAY_TITLE_INFO *src, const char *input, const struct bdinfo_query *query,
+		const struct iso639_set *langs, enum plan_layout layout)
+{
+	// streams of the plan point into the copy, which outlives it
+	BLURAY_TITLE_INFO *info = arena_alloc(arena, title_size(src));
+	if(!info)
+		return -1;
+	title_copy(info, src);
+	*title = (struct bdinfo_title){
+		.info       = info,
+		.streams    = NULL,
+		.numstreams = 0,
+		.output     = NULL,
+		.argv       = NULL,
+		.chapters   = NULL
+	};
+
+	struct remux_plan plan;
+	if(plan_title(&plan, info, langs, query->lossless, query->skip_ig, layout) < 0)
+		return -1;
+	if(plan.numstreams > 0 && !(title->streams = arena_alloc(arena,
+			plan.numstreams * sizeof(*title->streams))))
+		goto error;
+	for(size_t i = 0; i < plan.numstreams; i++)
+	{
+		struct bdinfo_stream *stream = title->streams + i;
+		stream->info = plan.streams[i].info;
+		memcpy(stream->language, plan.streams[i].language, sizeof(stream->language));
+		stream->flac = plan.tracks[i].codec == PLAN_FLAC;
+		stream->late = plan.tracks[i].late;
+	}
+	title->numstreams = plan.numstreams;
+
+	if(query->output)
+	{
+		char *output = format_output(query->output, info);
+		title->output = output ? arena_strdup(arena, output) : NULL;
+		free(output);
+		if(!title->output)
+			goto error;
+		title->argv = query->mkvmerge
+				? generate_mkvmerge_argv(arena, &plan, input, title->output)
+				: generate_ffargv(arena, &plan, input, -1, title->output, 0, -1, NULL);
+		if(!title->argv)
+			goto error;
+		if(plan.chapters && !query->mkvmerge
+				&& !(title->chapters = arena_ff_chapters(arena, info)))
+			goto error;
+	}
+	plan_free(&plan);
+	return 0;
+
+error:
+	{
+		int errnum = errno;
+		plan_free(&plan);
+		errno = errnum;
+	}
+	return -1;
+}
+
+/**
+ * Get the titles of *src* selected by *query* and *playlists*, which are
+ * cleaned, see get_titles. The titles are read into the scratch arrays that
+ * get_titles shares with bdinfo and are freed once they are copied into the
+ * arena of the result. The titles that tie with the main feature are counted
+ * in *numties*.
+ */
+static int select_titles(const char *src, const struct bdinfo_query *query,
+		struct playlist_selector *playlists, size_t numplaylists,
+		BLURAY_TITLE_INFO ***titles, size_t *numtitles, size_t *numties)
+{
+	uint32_t min_duration = numplaylists > 0 ? (uint32_t)-1
+			: query->main_feature ? 0 : query->min_duration;
+	struct title_source source;
+	source_open(&source, src, query->use_cache, 0, query->numthreads, NULL);
+	int status = get_titles(&source, query->all ? 0 : TITLES_RELEVANT, min_duration,
+			playlists, numplaylists, titles, numtitles, NULL, NULL);
+	struct title_score score;
+	if(status == 0 && query->main_feature && select_main_feature(*titles, numtitles,
+			query->numthreads > 0 ? query->numthreads : 1, &score, numties, NULL, NULL) < 0)
+		status = -1;
+	int errnum = errno;
+	source_close(&source);
+	errno = errnum;
+	return status;
+}
+
+int bdinfo_query(const char *src, const struct bdinfo_query *query,
+		struct bdinfo_result **result)
+{
+	int layout = query->layout ? plan_parse_layout(query->layout) : PLAN_FIRST_CLIP;
+	if(layout < 0 || (query->main_feature && query->numplaylists > 0))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct arena arena;
+	arena_init(&arena);
+	struct iso639_set *langs = NULL;
+	if(query->languages)
+	{
+		if(!(langs = arena_alloc(&arena, sizeof(*langs))))
+			goto error;
+		memset(langs, 0, sizeof(*langs));
+		// as with bdinfo, unknown languages are skipped and none selects all streams
+		if(iso639_set_parse(langs, query->languages, NULL, NULL) == 0)
+			langs = NULL;
+	}
+
+	struct playlist_selector *playlists = NULL;
+	size_t numplaylists = query->numplaylists;
+	if(numplaylists > 0)
+	{
+		if(!(playlists = arena_alloc(&arena, numplaylists * sizeof(*playlists))))
+			goto error;
+		for(size_t i = 0; i < numplaylists; i++)
+			playlists[i] = (struct playlist_selector){
+				.playlist = query->playlists[i].playlist,
+				.angle    = query->playlists[i].angle
+			};
+		clean_playlist_selectors(playlists, &numplaylists);
+	}
+
+	BLURAY_TITLE_INFO **titles = NULL;
+	size_t numtitles = 0;
+	size_t numties   = 0;
+	int status = select_titles(src, query, playlists, numplaylists, &titles, &numtitles,
+			&numties);
+	if(status < 0)
+	{
+		int errnum = errno;
+		arena_free(&arena);
+		errno = errnum;
+		return status;
+	}
+	if(numtitles > 1 && query->output && !output_template_has_playlist(query->output))
+	{
+		errno = EINVAL;
+		goto error_titles;
+	}
+
+	struct result *r = arena_alloc(&arena, sizeof(*r));
+	struct bdinfo_title *planned = numtitles == 0 ? NULL
+			: arena_alloc(&arena, numtitles * sizeof(*planned));
+	if(!r || (numtitles > 0 && !planned))
+		goto error_titles;
+	for(size_t i = 0; i < numtitles; i++)
+		if(plan_result_title(&arena, planned + i, titles[i], src, query, langs, layout) < 0)
+			goto error_titles;
+	free_titles(titles, numtitles);
+
+	// nothing is allocated from the arena after it is stored in the result
+	r->result = (struct bdinfo_result){
+		.titles    = planned,
+		.numtitles = numtitles,
+		.numties   = numties
+	};
+	r->arena = arena;
+	*result = &r->result;
+	return 0;
+
+error_titles:
+	{
+		int errnum = errno;
+		free_titles(titles, numtitles);
+		errno = errnum;
+	}
+error:
+	{
+		int errnum = errno;
+		arena_free(&arena);
+		errno = errnum;
+	}
+	return -1;
+}
+
+void bdinfo_free(struct bdinfo_result *result)
+{
+	if(!result)
+		return;
+	// the arena is copied out of the memory it frees
+	struct arena arena = ((struct result *)result)->arena;
+	arena_free(&arena);
+}
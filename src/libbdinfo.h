@@ -0,0 +1,154 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBBDINFO_H_INCLUDED
+#define LIBBDINFO_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * libbdinfo selects the titles of a Blu-ray and plans their remux, like
+ * `bdinfo -f` does. Its functions may be called from several threads at once,
+ * every query opens the Blu-ray on its own. Titles are shared between queries
+ * and processes through the title cache.
+ */
+
+#define BDINFO_API __attribute__((visibility("default")))
+
+/** the angle of a bdinfo_playlist that selects all angles */
+#define BDINFO_ALL_ANGLES ((uint8_t)-1)
+
+/**
+ * A playlist and its *angle*, counted from 0, or BDINFO_ALL_ANGLES.
+ */
+struct bdinfo_playlist {
+	uint32_t playlist;
+	uint8_t  angle;
+};
+
+/**
+ * Which titles are selected and how they are remuxed, see the options of the
+ * same names of bdinfo(1). A query initialized to zero selects all titles but
+ * duplicates and plans no calls.
+ *
+ * If *numplaylists* is 0, all titles at least *min_duration* seconds long are
+ * selected, otherwise only the *playlists*. If *main_feature* is set, only the
+ * title most likely to be the main feature is kept of all titles, which
+ * cannot be combined with *playlists*. Titles that duplicate others are
+ * omitted unless *all* is set.
+ *
+ * *languages* is a comma-separated list of ISO 639-1 or 639-2 codes; if it
+ * names a known language, only streams of the known languages and of undefined
+ * language are selected, unknown codes are skipped like by bdinfo(1). LPCM
+ * audio streams are converted to FLAC and, if *lossless* is set, DTS-HD MA and
+ * Dolby True HD streams as well. Interactive graphic streams are skipped if
+ * *skip_ig* is set. *layout* is `first`, `union`, or `intersection`, the first
+ * if it is NULL.
+ *
+ * If *output* is not NULL, the call that remuxes each title to the output
+ * template *output* is generated, with ffmpeg or, if *mkvmerge* is set, with
+ * mkvmerge. If several titles are selected *output* has to contain %p.
+ *
+ * Titles are looked up in and added to the title cache if *use_cache* is set.
+ * If *numthreads* is not 0, Blu-ray directories are parsed natively with up
+ * to *numthreads* threads instead of with libbluray.
+ */
+struct bdinfo_query {
+	uint32_t                      min_duration;
+	const struct bdinfo_playlist *playlists;
+	size_t                        numplaylists;
+	int                           main_feature;
+	int                           all;
+	const char                   *languages;
+	int                           lossless;
+	int                           skip_ig;
+	const char                   *layout;
+	const char                   *output;
+	int                           mkvmerge;
+	int                           use_cache;
+	size_t                        numthreads;
+};
+
+/**
+ * A stream of the output of a title, *language* is its ISO 639-2/B code or
+ * empty if it is unknown. A *flac* stream is converted to FLAC, a *late*
+ * stream is missing from the first clip of the title.
+ */
+struct bdinfo_stream {
+	const BLURAY_STREAM_INFO *info;
+	char                      language[4];
+	int                       flac;
+	int                       late;
+};
+
+/**
+ * A selected title and the *numstreams* *streams* of its output, in output
+ * order. If the query has an output template, *output* is the output file of
+ * the title and *argv* the NULL-terminated call that remuxes it. An ffmpeg
+ * call reads the *chapters* of the title as FFMETADATA1 from its standard
+ * input unless they are NULL.
+ */
+struct bdinfo_title {
+	const BLURAY_TITLE_INFO *info;
+	struct bdinfo_stream    *streams;
+	size_t                   numstreams;
+	const char              *output;
+	char                   **argv;
+	const char              *chapters;
+};
+
+/**
+ * The *numtitles* *titles* selected by a query, sorted by playlist number. If
+ * the main feature was queried, *numties* other titles scored as high as the
+ * one that was kept because its playlist number is the lowest.
+ */
+struct bdinfo_result {
+	struct bdinfo_title *titles;
+	size_t               numtitles;
+	size_t               numties;
+};
+
+/**
+ * Select the titles of the Blu-ray *src*, a directory, an image, or a device,
+ * by *query* and plan their remux. The result is stored in *\*result*, which
+ * has to be freed with bdinfo_free. Nothing is printed.
+ *
+ * Returns 0 or -1 with errno set, to EINVAL if *query* is invalid, or -2 if
+ * libbluray failed.
+ */
+BDINFO_API int bdinfo_query(const char *src, const struct bdinfo_query *query,
+		struct bdinfo_result **result);
+
+/**
+ * Free *result* and everything it points to at once.
+ */
+BDINFO_API void bdinfo_free(struct bdinfo_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,579 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mkv.h"
+#include "util.h"
+
+#define BDINFO_APP "bdinfo"
+
+enum {
+	ID_EBML                = 0x1a45dfa3,
+	ID_EBML_VERSION        = 0x4286,
+	ID_EBML_READ_VERSION   = 0x42f7,
+	ID_EBML_MAX_ID_LENGTH  = 0x42f2,
+	ID_EBML_MAX_SIZE_LENGTH = 0x42f3,
+	ID_DOC_TYPE            = 0x4282,
+	ID_DOC_TYPE_VERSION    = 0x4287,
+	ID_DOC_TYPE_READ_VERSION = 0x4285,
+	ID_VOID                = 0xec,
+	ID_SEGMENT             = 0x18538067,
+	ID_SEEK_HEAD           = 0x114d9b74,
+	ID_SEEK                = 0x4dbb,
+	ID_SEEK_ID             = 0x53ab,
+	ID_SEEK_POSITION       = 0x53ac,
+	ID_INFO                = 0x1549a966,
+	ID_TIMECODE_SCALE      = 0x2ad7b1,
+	ID_DURATION            = 0x4489,
+	ID_MUXING_APP          = 0x4d80,
+	ID_WRITING_APP         = 0x5741,
+	ID_TRACKS              = 0x1654ae6b,
+	ID_TRACK_ENTRY         = 0xae,
+	ID_TRACK_NUMBER        = 0xd7,
+	ID_TRACK_UID           = 0x73c5,
+	ID_TRACK_TYPE          = 0x83,
+	ID_FLAG_LACING         = 0x9c,
+	ID_LANGUAGE            = 0x22b59c,
+	ID_CODEC_ID            = 0x86,
+	ID_CODEC_PRIVATE       = 0x63a2,
+	ID_DEFAULT_DURATION    = 0x23e383,
+	ID_VIDEO               = 0xe0,
+	ID_FLAG_INTERLACED     = 0x9a,
+	ID_PIXEL_WIDTH         = 0xb0,
+	ID_PIXEL_HEIGHT        = 0xba,
+	ID_DISPLAY_WIDTH       = 0x54b0,
+	ID_DISPLAY_HEIGHT      = 0x54ba,
+	ID_AUDIO               = 0xe1,
+	ID_SAMPLING_FREQUENCY  = 0xb5,
+	ID_CHANNELS            = 0x9f,
+	ID_BIT_DEPTH           = 0x6264,
+	ID_CHAPTERS            = 0x1043a770,
+	ID_EDITION_ENTRY       = 0x45b9,
+	ID_EDITION_UID         = 0x45bc,
+	ID_EDITION_FLAG_HIDDEN = 0x45bd,
+	ID_EDITION_FLAG_DEFAULT = 0x45db,
+	ID_CHAPTER_ATOM        = 0xb6,
+	ID_CHAPTER_UID         = 0x73c4,
+	ID_CHAPTER_TIME_START  = 0x91,
+	ID_CHAPTER_TIME_END    = 0x92,
+	ID_CHAPTER_FLAG_HIDDEN = 0x98,
+	ID_CHAPTER_FLAG_ENABLED = 0x4598,
+	ID_CLUSTER             = 0x1f43b675,
+	ID_TIMECODE            = 0xe7,
+	ID_SIMPLE_BLOCK        = 0xa3,
+	ID_CUES                = 0x1c53bb6b,
+	ID_CUE_POINT           = 0xbb,
+	ID_CUE_TIME            = 0xb3,
+	ID_CUE_TRACK_POSITIONS = 0xb7,
+	ID_CUE_TRACK           = 0xf7,
+	ID_CUE_CLUSTER_POSITION = 0xf1
+};
+
+/** nanoseconds per timecode tick */
+#define TIMECODE_SCALE 1000000
+
+/** space reserved for the seek head */
+#define SEEK_HEAD_SIZE 128
+
+/** clusters are closed at the next keyframe after this many ticks */
+#define CLUSTER_DURATION 1000
+/** clusters are closed after this many ticks if there is no video */
+#define CLUSTER_MAX_DURATION 5000
+/** clusters are closed after this many bytes */
+#define CLUSTER_MAX_SIZE (8 << 20)
+
+struct mkv_cue {
+	uint64_t time;
+	uint64_t track;
+	uint64_t position;
+};
+
+struct mkv {
+	int             fd;
+	/** removed unless the file is finished */
+	char           *path;
+	/** file offset of the segment's payload */
+	uint64_t        segment;
+	/** offset of the segment info, tracks, and chapters in the segment */
+	uint64_t        info;
+	uint64_t        tracks;
+	uint64_t        chapters;
+	/** end of the file */
+	uint64_t        pos;
+
+	struct buffer   cluster;
+	int64_t         cluster_time;
+	uint64_t       *video_tracks;
+	size_t          numvideotracks;
+
+	struct mkv_cue *cues;
+	size_t          numcues;
+};
+
+static int write_all(int fd, const void *data, size_t size)
+{
+	for(const char *p = data; size > 0;)
+	{
+		ssize_t n = write(fd, p, size);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		p    += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int pwrite_all(int fd, const void *data, size_t size, uint64_t offset)
+{
+	for(const char *p = data; size > 0;)
+	{
+		ssize_t n = pwrite(fd, p, size, offset);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		p      += n;
+		size   -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+static int put_bytes(struct buffer *buf, const void *data, size_t size)
+{
+	return buffer_append(buf, data, size);
+}
+
+static int put_be(struct buffer *buf, uint64_t v, size_t n)
+{
+	uint8_t bytes[8];
+	for(size_t i = n; i-- > 0; v >>= 8)
+		bytes[i] = v;
+	return put_bytes(buf, bytes, n);
+}
+
+static int put_id(struct buffer *buf, uint32_t id)
+{
+	size_t n = id > 0xffffff ? 4 : id > 0xffff ? 3 : id > 0xff ? 2 : 1;
+	return put_be(buf, id, n);
+}
+
+static int put_size(struct buffer *buf, uint64_t size)
+{
+	size_t n = 1;
+	while(n < 8 && size >= ((uint64_t)1 << (7 * n)) - 1)
+		n++;
+	return put_be(buf, size | (uint64_t)1 << (7 * n), n);
+}
+
+static int put_uint(struct buffer *buf, uint32_t id, uint64_t v)
+{
+	size_t n = 1;
+	while(n < 8 && v >> (8 * n))
+		n++;
+	return put_id(buf, id) < 0 || put_size(buf, n) < 0 || put_be(buf, v, n) < 0 ? -1 : 0;
+}
+
+static int put_float(struct buffer *buf, uint32_t id, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return put_id(buf, id) < 0 || put_size(buf, 8) < 0 || put_be(buf, bits, 8) < 0 ? -1 : 0;
+}
+
+static int put_binary(struct buffer *buf, uint32_t id, const void *data, size_t size)
+{
+	return put_id(buf, id) < 0 || put_size(buf, size) < 0 || put_bytes(buf, data, size) < 0
+			? -1 : 0;
+}
+
+static int put_string(struct buffer *buf, uint32_t id, const char *s)
+{
+	return put_binary(buf, id, s, strlen(s));
+}
+
+/**
+ * Start a master element with an 8-byte size to be filled in by end_master.
+ * Returns the offset of the size in *buf* or -1.
+ */
+static ssize_t start_master(struct buffer *buf, uint32_t id)
+{
+	if(put_id(buf, id) < 0 || put_be(buf, 0, 8) < 0)
+		return -1;
+	return buf->size - 8;
+}
+
+static void end_master(struct buffer *buf, ssize_t start)
+{
+	uint64_t size = buf->size - start - 8;
+	size |= (uint64_t)1 << 56;
+	for(int i = 8; i-- > 0; size >>= 8)
+		buf->data[start + i] = size;
+}
+
+struct mkv *mkv_create(const char *path)
+{
+	struct mkv *mkv = calloc(1, sizeof(*mkv));
+	if(!mkv)
+		return NULL;
+	if(!(mkv->path = strdup(path))
+			|| (mkv->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0)
+	{
+		int errnum = errno;
+		free(mkv->path);
+		free(mkv);
+		errno = errnum;
+		return NULL;
+	}
+	mkv->cluster_time = -1;
+	return mkv;
+}
+
+static int put_track(struct buffer *buf, const struct mkv_track *track)
+{
+	ssize_t entry = start_master(buf, ID_TRACK_ENTRY);
+	if(entry < 0
+			|| put_uint(buf, ID_TRACK_NUMBER, track->number) < 0
+			|| put_uint(buf, ID_TRACK_UID, track->number) < 0
+			|| put_uint(buf, ID_TRACK_TYPE, track->type) < 0
+			|| put_uint(buf, ID_FLAG_LACING, 0) < 0
+			|| put_string(buf, ID_LANGUAGE, track->language && *track->language
+					? track->language : "und") < 0
+			|| put_string(buf, ID_CODEC_ID, track->codec_id) < 0)
+		return -1;
+	if(track->codec_private_size > 0 && put_binary(buf, ID_CODEC_PRIVATE,
+			track->codec_private, track->codec_private_size) < 0)
+		return -1;
+	if(track->default_duration > 0
+			&& put_uint(buf, ID_DEFAULT_DURATION, track->default_duration) < 0)
+		return -1;
+
+	if(track->type == MKV_TRACK_VIDEO)
+	{
+		ssize_t video = start_master(buf, ID_VIDEO);
+		if(video < 0
+				|| put_uint(buf, ID_FLAG_INTERLACED, track->interlaced ? 1 : 2) < 0
+				|| put_uint(buf, ID_PIXEL_WIDTH, track->width) < 0
+				|| put_uint(buf, ID_PIXEL_HEIGHT, track->height) < 0)
+			return -1;
+		if(track->display_width > 0 && track->display_height > 0
+				&& (put_uint(buf, ID_DISPLAY_WIDTH, track->display_width) < 0
+						|| put_uint(buf, ID_DISPLAY_HEIGHT, track->display_height) < 0))
+			return -1;
+		end_master(buf, video);
+	}
+	else if(track->type == MKV_TRACK_AUDIO)
+	{
+		ssize_t audio = start_master(buf, ID_AUDIO);
+		if(audio < 0
+				|| put_float(buf, ID_SAMPLING_FREQUENCY, track->sampling_frequency) < 0
+				|| put_uint(buf, ID_CHANNELS, track->channels) < 0)
+			return -1;
+		if(track->bit_depth > 0 && put_uint(buf, ID_BIT_DEPTH, track->bit_depth) < 0)
+			return -1;
+		end_master(buf, audio);
+	}
+	end_master(buf, entry);
+	return 0;
+}
+
+int mkv_write_header(struct mkv *mkv, const struct mkv_track *tracks, size_t numtracks,
+		const struct mkv_chapter *chapters, size_t numchapters, uint64_t duration)
+{
+	struct buffer buf = {NULL, 0, 0};
+
+	ssize_t ebml = start_master(&buf, ID_EBML);
+	if(ebml < 0
+			|| put_uint(&buf, ID_EBML_VERSION, 1) < 0
+			|| put_uint(&buf, ID_EBML_READ_VERSION, 1) < 0
+			|| put_uint(&buf, ID_EBML_MAX_ID_LENGTH, 4) < 0
+			|| put_uint(&buf, ID_EBML_MAX_SIZE_LENGTH, 8) < 0
+			|| put_string(&buf, ID_DOC_TYPE, "matroska") < 0
+			|| put_uint(&buf, ID_DOC_TYPE_VERSION, 4) < 0
+			|| put_uint(&buf, ID_DOC_TYPE_READ_VERSION, 2) < 0)
+		goto error;
+	end_master(&buf, ebml);
+
+	// the segment's size is written by mkv_close
+	if(put_id(&buf, ID_SEGMENT) < 0 || put_be(&buf, 0x01ffffffffffffff, 8) < 0)
+		goto error;
+	mkv->segment = buf.size;
+
+	// reserve space for the seek head
+	if(put_id(&buf, ID_VOID) < 0 || put_size(&buf, SEEK_HEAD_SIZE - 2) < 0
+			|| buffer_reserve(&buf, SEEK_HEAD_SIZE - 2) < 0)
+		goto error;
+	memset(buf.data + buf.size, 0, SEEK_HEAD_SIZE - 2);
+	buf.size += SEEK_HEAD_SIZE - 2;
+
+	mkv->info = buf.size - mkv->segment;
+	ssize_t info = start_master(&buf, ID_INFO);
+	if(info < 0
+			|| put_uint(&buf, ID_TIMECODE_SCALE, TIMECODE_SCALE) < 0
+			|| put_string(&buf, ID_MUXING_APP, BDINFO_APP) < 0
+			|| put_string(&buf, ID_WRITING_APP, BDINFO_APP) < 0
+			|| put_float(&buf, ID_DURATION, (double)duration / TIMECODE_SCALE) < 0)
+		goto error;
+	end_master(&buf, info);
+
+	mkv->tracks = buf.size - mkv->segment;
+	ssize_t tracks_ = start_master(&buf, ID_TRACKS);
+	if(tracks_ < 0)
+		goto error;
+	for(size_t i = 0; i < numtracks; i++)
+	{
+		if(put_track(&buf, tracks + i) < 0)
+			goto error;
+		if(tracks[i].type == MKV_TRACK_VIDEO)
+		{
+			uint64_t *grown = array_reserve(mkv->video_tracks, mkv->numvideotracks, 1,
+					sizeof(*mkv->video_tracks));
+			if(!grown)
+				goto error;
+			mkv->video_tracks = grown;
+			mkv->video_tracks[mkv->numvideotracks++] = tracks[i].number;
+		}
+	}
+	end_master(&buf, tracks_);
+
+	if(numchapters > 0)
+	{
+		mkv->chapters = buf.size - mkv->segment;
+		ssize_t chapters_ = start_master(&buf, ID_CHAPTERS);
+		ssize_t edition   = start_master(&buf, ID_EDITION_ENTRY);
+		if(chapters_ < 0 || edition < 0
+				|| put_uint(&buf, ID_EDITION_UID, 1) < 0
+				|| put_uint(&buf, ID_EDITION_FLAG_HIDDEN, 0) < 0
+				|| put_uint(&buf, ID_EDITION_FLAG_DEFAULT, 0) < 0)
+			goto error;
+		for(size_t i = 0; i < numchapters; i++)
+		{
+			ssize_t atom = start_master(&buf, ID_CHAPTER_ATOM);
+			if(atom < 0
+					|| put_uint(&buf, ID_CHAPTER_UID, i + 1) < 0
+					|| put_uint(&buf, ID_CHAPTER_TIME_START, chapters[i].start) < 0
+					|| put_uint(&buf, ID_CHAPTER_TIME_END, chapters[i].end) < 0
+					|| put_uint(&buf, ID_CHAPTER_FLAG_HIDDEN, 0) < 0
+					|| put_uint(&buf, ID_CHAPTER_FLAG_ENABLED, 1) < 0)
+				goto error;
+			end_master(&buf, atom);
+		}
+		end_master(&buf, edition);
+		end_master(&buf, chapters_);
+	}
+
+	if(write_all(mkv->fd, buf.data, buf.size) < 0)
+		goto error;
+	mkv->pos = buf.size;
+	free(buf.data);
+	return 0;
+
+error:
+	{
+		int errnum = errno;
+		free(buf.data);
+		errno = errnum;
+	}
+	return -1;
+}
+
+static int flush_cluster(struct mkv *mkv)
+{
+	if(mkv->cluster_time < 0)
+		return 0;
+	end_master(&mkv->cluster, 4);
+	if(write_all(mkv->fd, mkv->cluster.data, mkv->cluster.size) < 0)
+		return -1;
+	mkv->pos += mkv->cluster.size;
+	mkv->cluster.size = 0;
+	mkv->cluster_time = -1;
+	return 0;
+}
+
+static int is_video_track(const struct mkv *mkv, uint64_t track)
+{
+	for(size_t i = 0; i < mkv->numvideotracks; i++)
+		if(mkv->video_tracks[i] == track)
+			return 1;
+	return 0;
+}
+
+int mkv_write_block(struct mkv *mkv, uint64_t track, uint64_t timestamp, int keyframe,
+		const void *data, size_t size)
+{
+	int64_t time  = timestamp / TIMECODE_SCALE;
+	int     video = is_video_track(mkv, track);
+
+	// start a new cluster if needed
+	if(mkv->cluster_time >= 0)
+	{
+		int64_t duration = time - mkv->cluster_time;
+		if(duration < INT16_MIN || duration > INT16_MAX
+				|| mkv->cluster.size > CLUSTER_MAX_SIZE
+				|| (video && keyframe && duration >= CLUSTER_DURATION)
+				|| (mkv->numvideotracks == 0 && duration >= CLUSTER_MAX_DURATION))
+			if(flush_cluster(mkv) < 0)
+				return -1;
+	}
+	if(mkv->cluster_time < 0)
+	{
+		if(start_master(&mkv->cluster, ID_CLUSTER) < 0
+				|| put_uint(&mkv->cluster, ID_TIMECODE, time) < 0)
+			return -1;
+		mkv->cluster_time = time;
+		if(mkv->numvideotracks == 0)
+			keyframe = 1;
+	}
+
+	if((video || mkv->numvideotracks == 0) && keyframe)
+	{
+		struct mkv_cue *grown = array_reserve(mkv->cues, mkv->numcues, 1, sizeof(*mkv->cues));
+		if(!grown)
+			return -1;
+		mkv->cues = grown;
+		mkv->cues[mkv->numcues].time     = time;
+		mkv->cues[mkv->numcues].track    = track;
+		mkv->cues[mkv->numcues].position = mkv->pos - mkv->segment;
+		mkv->numcues++;
+	}
+
+	int16_t relative = time - mkv->cluster_time;
+	uint8_t header[4] = {
+		0x80 | track, // track numbers are below 127
+		(uint16_t)relative >> 8,
+		(uint16_t)relative & 0xff,
+		keyframe ? 0x80 : 0x00
+	};
+	if(put_id(&mkv->cluster, ID_SIMPLE_BLOCK) < 0
+			|| put_size(&mkv->cluster, sizeof(header) + size) < 0
+			|| put_bytes(&mkv->cluster, header, sizeof(header)) < 0
+			|| put_bytes(&mkv->cluster, data, size) < 0)
+		return -1;
+	return 0;
+}
+
+static int put_seek(struct buffer *buf, uint32_t id, uint64_t position)
+{
+	uint8_t seekid[4] = {id >> 24, id >> 16, id >> 8, id};
+	ssize_t seek = start_master(buf, ID_SEEK);
+	if(seek < 0 || put_binary(buf, ID_SEEK_ID, seekid, sizeof(seekid)) < 0
+			|| put_uint(buf, ID_SEEK_POSITION, position) < 0)
+		return -1;
+	end_master(buf, seek);
+	return 0;
+}
+
+int mkv_close(struct mkv *mkv)
+{
+	struct buffer buf = {NULL, 0, 0};
+	int err = -1;
+	if(flush_cluster(mkv) < 0)
+		goto cleanup;
+
+	uint64_t cues = mkv->pos - mkv->segment;
+	ssize_t cues_ = start_master(&buf, ID_CUES);
+	if(cues_ < 0)
+		goto cleanup;
+	for(size_t i = 0; i < mkv->numcues; i++)
+	{
+		ssize_t point     = start_master(&buf, ID_CUE_POINT);
+		if(point < 0 || put_uint(&buf, ID_CUE_TIME, mkv->cues[i].time) < 0)
+			goto cleanup;
+		ssize_t positions = start_master(&buf, ID_CUE_TRACK_POSITIONS);
+		if(positions < 0
+				|| put_uint(&buf, ID_CUE_TRACK, mkv->cues[i].track) < 0
+				|| put_uint(&buf, ID_CUE_CLUSTER_POSITION, mkv->cues[i].position) < 0)
+			goto cleanup;
+		end_master(&buf, positions);
+		end_master(&buf, point);
+	}
+	end_master(&buf, cues_);
+	if(write_all(mkv->fd, buf.data, buf.size) < 0)
+		goto cleanup;
+	mkv->pos += buf.size;
+
+	// the seek head replaces the reserved void element
+	buf.size = 0;
+	ssize_t seekhead = start_master(&buf, ID_SEEK_HEAD);
+	if(seekhead < 0
+			|| put_seek(&buf, ID_INFO,   mkv->info) < 0
+			|| put_seek(&buf, ID_TRACKS, mkv->tracks) < 0
+			|| (mkv->chapters > 0 && put_seek(&buf, ID_CHAPTERS, mkv->chapters) < 0)
+			|| put_seek(&buf, ID_CUES,   cues) < 0)
+		goto cleanup;
+	end_master(&buf, seekhead);
+	size_t padding = SEEK_HEAD_SIZE - buf.size - 2;
+	if(put_id(&buf, ID_VOID) < 0 || put_size(&buf, padding) < 0
+			|| buffer_reserve(&buf, SEEK_HEAD_SIZE - buf.size) < 0)
+		goto cleanup;
+	memset(buf.data + buf.size, 0, SEEK_HEAD_SIZE - buf.size);
+	if(pwrite_all(mkv->fd, buf.data, SEEK_HEAD_SIZE, mkv->segment) < 0)
+		goto cleanup;
+
+	// segment size
+	uint8_t bytes[8];
+	uint64_t size = (mkv->pos - mkv->segment) | (uint64_t)1 << 56;
+	for(int i = 8; i-- > 0; size >>= 8)
+		bytes[i] = size;
+	if(pwrite_all(mkv->fd, bytes, sizeof(bytes), mkv->segment - 8) < 0)
+		goto cleanup;
+	err = 0;
+
+cleanup:
+	{
+		int errnum = errno;
+		free(buf.data);
+		if(close(mkv->fd) < 0 && err == 0)
+			errnum = errno, err = -1;
+		mkv->fd = -1;
+		if(err < 0)
+			unlink(mkv->path);
+		mkv_abort(mkv);
+		errno = errnum;
+	}
+	return err;
+}
+
+void mkv_abort(struct mkv *mkv)
+{
+	if(!mkv)
+		return;
+	if(mkv->fd >= 0)
+	{
+		close(mkv->fd);
+		unlink(mkv->path);
+	}
+	free(mkv->path);
+	free(mkv->cluster.data);
+	free(mkv->video_tracks);
+	free(mkv->cues);
+	free(mkv);
+}
@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MKV_H_INCLUDED
+#define MKV_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+	MKV_TRACK_VIDEO    = 0x01,
+	MKV_TRACK_AUDIO    = 0x02,
+	MKV_TRACK_SUBTITLE = 0x11
+};
+
+/**
+ * A Matroska track. Track numbers start at 1. *default_duration* is in
+ * nanoseconds, 0 omits it.
+ */
+struct mkv_track {
+	uint64_t       number;
+	int            type;
+	const char    *codec_id;
+	const uint8_t *codec_private;
+	size_t         codec_private_size;
+	const char    *language;
+	uint64_t       default_duration;
+
+	unsigned       width;
+	unsigned       height;
+	unsigned       display_width;
+	unsigned       display_height;
+	int            interlaced;
+
+	double         sampling_frequency;
+	unsigned       channels;
+	unsigned       bit_depth;
+};
+
+/**
+ * A chapter from *start* to *end* nanoseconds.
+ */
+struct mkv_chapter {
+	uint64_t start;
+	uint64_t end;
+};
+
+struct mkv;
+
+/**
+ * Create the Matroska file *path*. The file has to be seekable, because the
+ * seek head and element sizes are written last.
+ */
+struct mkv *mkv_create(const char *path);
+
+/**
+ * Write the segment info, *tracks*, and *chapters*. *duration* is in
+ * nanoseconds. Must be called once before mkv_write_block.
+ */
+int mkv_write_header(struct mkv *mkv, const struct mkv_track *tracks, size_t numtracks,
+		const struct mkv_chapter *chapters, size_t numchapters, uint64_t duration);
+
+/**
+ * Write a frame of *track* at *timestamp* nanoseconds as a SimpleBlock.
+ * Keyframes of video tracks are added to the cues.
+ */
+int mkv_write_block(struct mkv *mkv, uint64_t track, uint64_t timestamp, int keyframe,
+		const void *data, size_t size);
+
+/**
+ * Write the cues and seek head, fix up the element sizes, and close the file.
+ * *mkv* is freed even on error, and the file is removed then.
+ */
+int mkv_close(struct mkv *mkv);
+
+/**
+ * Close and free *mkv* without finishing the file, which is removed.
+ */
+void mkv_abort(struct mkv *mkv);
+
+#endif
@@ -0,0 +1,871 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "iso-639-2.h"
+#include "output.h"
+#include "util.h"
+
+/** buffered output is written once it exceeds this size */
+#define OUTPUT_FLUSH_SIZE (256 << 10)
+
+struct output {
+	int                fd;
+	enum output_format format;
+	struct buffer      buf;
+	size_t             numtitles;
+};
+
+struct enum_map {
+	int value;
+	const char *name;
+};
+
+static const char *enum_map_search(const struct enum_map *map, int value)
+{
+	for(; map->name != NULL; map++)
+		if(map->value == value)
+			return map->name;
+	return NULL;
+}
+
+static const char *get_stream_type(uint8_t type)
+{
+	static const struct enum_map types[] = {
+		{BLURAY_STREAM_TYPE_VIDEO_MPEG1,             "MPEG-1"},
+		{BLURAY_STREAM_TYPE_VIDEO_MPEG2,             "MPEG-2"},
+		{BLURAY_STREAM_TYPE_VIDEO_H264,              "H.264/MPEG-4 AVC"},
+		{BLURAY_STREAM_TYPE_VIDEO_VC1,               "VC-1/SMPTE 421M"},
+		{BLURAY_STREAM_TYPE_AUDIO_MPEG1,             "MPEG-1"},
+		{BLURAY_STREAM_TYPE_AUDIO_MPEG2,             "MPEG-2"},
+		{BLURAY_STREAM_TYPE_AUDIO_LPCM,              "PCM"},
+		{BLURAY_STREAM_TYPE_AUDIO_AC3,               "AC3"},
+		{BLURAY_STREAM_TYPE_AUDIO_DTS,               "DTS"},
+		{BLURAY_STREAM_TYPE_AUDIO_TRUHD,             "TrueHD"},
+		{BLURAY_STREAM_TYPE_AUDIO_AC3PLUS,           "AC3+"},
+		{BLURAY_STREAM_TYPE_AUDIO_AC3PLUS_SECONDARY, "AC3+"},
+		{BLURAY_STREAM_TYPE_AUDIO_DTSHD,             "DTS-HD"},
+		{BLURAY_STREAM_TYPE_AUDIO_DTSHD_SECONDARY,   "DTS-HD"},
+		{BLURAY_STREAM_TYPE_AUDIO_DTSHD_MASTER,      "DTS-HD MA"},
+		{BLURAY_STREAM_TYPE_SUB_PG,                  "HDMV/PGS"},
+		{BLURAY_STREAM_TYPE_SUB_IG,                  "HDMV/IGS"},
+		{BLURAY_STREAM_TYPE_SUB_TEXT,                "HDMV/TEXT"},
+		{0, NULL}
+	};
+	return enum_map_search(types, type);
+}
+
+static const char *get_video_format(uint8_t format)
+{
+	static const struct enum_map formats[] = {
+		{BLURAY_VIDEO_FORMAT_480I,  "480i"},
+		{BLURAY_VIDEO_FORMAT_576I,  "576i"},
+		{BLURAY_VIDEO_FORMAT_480P,  "480p"},
+		{BLURAY_VIDEO_FORMAT_1080I, "1080i"},
+		{BLURAY_VIDEO_FORMAT_720P,  "720p"},
+		{BLURAY_VIDEO_FORMAT_1080P, "1080p"},
+		{BLURAY_VIDEO_FORMAT_576P,  "576p"},
+		{0, NULL}
+	};
+	return enum_map_search(formats, format);
+}
+
+static const char *get_video_rate(uint8_t rate)
+{
+	static const struct enum_map rates[] = {
+		{BLURAY_VIDEO_RATE_24000_1001, "23.976 fps"},
+		{BLURAY_VIDEO_RATE_24,         "24 fps"},
+		{BLURAY_VIDEO_RATE_25,         "25 fps"},
+		{BLURAY_VIDEO_RATE_30000_1001, "29.97 fps"},
+		{BLURAY_VIDEO_RATE_50,         "50 fps"},
+		{BLURAY_VIDEO_RATE_60000_1001, "59.94 fps"},
+		{0, NULL}
+	};
+	return enum_map_search(rates, rate);
+}
+
+static const char *get_aspect_ratio(uint8_t ratio)
+{
+	static const struct enum_map ratios[] = {
+		{BLURAY_ASPECT_RATIO_4_3,  "4:3"},
+		{BLURAY_ASPECT_RATIO_16_9, "16:9"},
+		{0, NULL}
+	};
+	return enum_map_search(ratios, ratio);
+}
+
+static const char *get_audio_format(uint8_t format)
+{
+	static const struct enum_map formats[] = {
+		{BLURAY_AUDIO_FORMAT_MONO,       "Mono"},
+		{BLURAY_AUDIO_FORMAT_STEREO,     "Stereo"},
+		{BLURAY_AUDIO_FORMAT_MULTI_CHAN, "Multi channel"},
+		{BLURAY_AUDIO_FORMAT_COMBO,      "Combo"},
+		{0, NULL}
+	};
+	return enum_map_search(formats, format);
+}
+
+static const char *get_audio_rate(uint8_t rate)
+{
+	static const struct enum_map rates[] = {
+		{BLURAY_AUDIO_RATE_48,        "48 kHz"},
+		{BLURAY_AUDIO_RATE_96,        "96 kHz"},
+		{BLURAY_AUDIO_RATE_96_COMBO,  "96 kHz"},
+		{BLURAY_AUDIO_RATE_192,       "192 kHz"},
+		{BLURAY_AUDIO_RATE_192_COMBO, "192 kHz"},
+		{0, NULL}
+	};
+	return enum_map_search(rates, rate);
+}
+
+static const char *get_language(const BLURAY_STREAM_INFO *stream, char buf[4])
+{
+	return stream->lang[0] ? iso6392_to_bcode(buf, (const char *)stream->lang) : NULL;
+}
+
+/**
+ * Append the formatted string to the buffer of *out*.
+ */
+static int out_printf(struct output *out, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf((char *)out->buf.data + out->buf.size,
+			out->buf.capacity - out->buf.size, fmt, ap);
+	va_end(ap);
+	if(n < 0)
+		return -1;
+	if((size_t)n >= out->buf.capacity - out->buf.size)
+	{
+		if(buffer_reserve(&out->buf, n + 1) < 0)
+			return -1;
+		va_start(ap, fmt);
+		n = vsnprintf((char *)out->buf.data + out->buf.size, n + 1, fmt, ap);
+		va_end(ap);
+		if(n < 0)
+			return -1;
+	}
+	out->buf.size += n;
+	return 0;
+}
+
+static int out_puts(struct output *out, const char *s)
+{
+	return buffer_append(&out->buf, s, strlen(s));
+}
+
+#define FATALPUTS(s) \
+		do \
+		{ \
+			if(out_puts(out, s) < 0) \
+				return -1; \
+		} \
+		while(0)
+#define FATALPRINTF(...) \
+		do \
+		{ \
+			if(out_printf(out, __VA_ARGS__) < 0) \
+				return -1; \
+		} \
+		while(0)
+
+/** the key the streams of each plan_kind are listed under, primary and secondary together */
+static const char *const stream_keys[] = {
+	[PLAN_VIDEO]       = "video",
+	[PLAN_AUDIO]       = "audio",
+	[PLAN_SUBTITLE]    = "subtitles",
+	[PLAN_INTERACTIVE] = "other"
+};
+
+/**
+ * Get the next stream of *it* of *kind*, see plan_stream_next.
+ */
+static const BLURAY_STREAM_INFO *next_stream_of_kind(struct plan_stream_iter *it,
+		enum plan_kind kind)
+{
+	const BLURAY_STREAM_INFO *stream;
+	enum plan_kind k;
+	while((stream = plan_stream_next(it, &k)) && k != kind)
+		;
+	return stream;
+}
+
+static size_t count_streams_of_kind(const BLURAY_CLIP_INFO *clip, enum plan_kind kind)
+{
+	struct plan_stream_iter it;
+	plan_stream_iter_init(&it, clip, 0);
+	size_t n = 0;
+	while(next_stream_of_kind(&it, kind))
+		n++;
+	return n;
+}
+
+static const struct clip_scan *get_clip_scan(const struct title_extra *extra, uint32_t i)
+{
+	if(!extra || !extra->scan || i >= extra->scan->numclips || extra->scan->clips[i].err)
+		return NULL;
+	return extra->scan->clips + i;
+}
+
+static const struct stream_scan *get_stream_scan(const struct clip_scan *scan,
+		const BLURAY_STREAM_INFO *stream)
+{
+	return scan ? scan_find_stream(scan, stream->pid & 0x1fff) : NULL;
+}
+
+static int yaml_stream(struct output *out, const BLURAY_STREAM_INFO *stream, enum plan_kind kind,
+		const struct stream_scan *scan)
+{
+	FATALPRINTF("          - pid:          0x%04"PRIx16"\n", stream->pid);
+	if(scan)
+		FATALPRINTF("            size:         %.1f MB\n"
+				"            bitrate:      %"PRIu64" kbit/s\n"
+				"            peak:         %"PRIu64" kbit/s\n",
+				scan->bytes / 1e6, scan->bitrate / 1000, scan->peak / 1000);
+	const char *s;
+	char langbuf[4];
+	if((s = get_language(stream, langbuf)))
+		FATALPRINTF("            language:     %s\n", s);
+	if((s = get_stream_type(stream->coding_type)))
+		FATALPRINTF("            codec:        %s\n", s);
+	if(kind == PLAN_VIDEO)
+	{
+		if((s = get_aspect_ratio(stream->aspect)))
+			FATALPRINTF("            aspect_ratio: %s\n", s);
+		if((s = get_video_format(stream->format)))
+			FATALPRINTF("            resolution:   %s\n", s);
+		if((s = get_video_rate(stream->rate)))
+			FATALPRINTF("            rate:         %s\n", s);
+	}
+	else if(kind == PLAN_AUDIO)
+	{
+		if((s = get_audio_format(stream->format)))
+			FATALPRINTF("            channels:     %s\n", s);
+		if((s = get_audio_rate(stream->rate)))
+			FATALPRINTF("            rate:         %s\n", s);
+	}
+	return 0;
+}
+
+/**
+ * Print the streams of *clip* of *kind* as a list of languages or, if
+ * *extended* is set and there are any streams, as a list of mappings.
+ */
+static int yaml_stream_group(struct output *out, const BLURAY_CLIP_INFO *clip,
+		enum plan_kind kind, int extended, const struct clip_scan *scan)
+{
+	const char *name = stream_keys[kind];
+	extended = extended && count_streams_of_kind(clip, kind) > 0;
+	FATALPRINTF("        %s:%*s", name, extended ? 0 : (int)(11 - strlen(name)),
+			extended ? "\n" : "[");
+	struct plan_stream_iter it;
+	plan_stream_iter_init(&it, clip, 0);
+	size_t n = 0;
+	for(const BLURAY_STREAM_INFO *stream; (stream = next_stream_of_kind(&it, kind)); n++)
+	{
+		if(extended)
+		{
+			if(yaml_stream(out, stream, kind, get_stream_scan(scan, stream)) < 0)
+				return -1;
+		}
+		else
+		{
+			char langbuf[4];
+			const char *lang = get_language(stream, langbuf);
+			FATALPRINTF("%s%s", n == 0 ? "" : ", ", lang ? lang : "und");
+		}
+	}
+	if(!extended)
+		FATALPUTS("]\n");
+	return 0;
+}
+
+/**
+ * Print the streams of *clip* that differ from those of the first clip of its
+ * title, *first*, as lists of PIDs and languages.
+ */
+static int yaml_clip_diff(struct output *out, const BLURAY_CLIP_INFO *clip,
+		const BLURAY_CLIP_INFO *first)
+{
+	struct clip_diff diff;
+	if(plan_diff_clip(clip, first, 0, &diff) < 0)
+		return -1;
+	const struct {
+		const char                *name;
+		const BLURAY_STREAM_INFO **streams;
+		size_t                     numstreams;
+	} lists[] = {
+		{"added:   ", diff.added,   diff.numadded},
+		{"missing: ", diff.missing, diff.nummissing}
+	};
+	int err = 0;
+	for(size_t i = 0; i < 2 && err == 0; i++)
+	{
+		if(lists[i].numstreams == 0)
+			continue;
+		err = out_printf(out, "    %s [", lists[i].name);
+		for(size_t j = 0; j < lists[i].numstreams && err == 0; j++)
+		{
+			char langbuf[4];
+			const char *lang = get_language(lists[i].streams[j], langbuf);
+			err = out_printf(out, "%s0x%04"PRIx16" %s", j == 0 ? "" : ", ",
+					lists[i].streams[j]->pid, lang ? lang : "und");
+		}
+		if(err == 0)
+			err = out_puts(out, "]\n");
+	}
+	plan_free_diff(&diff);
+	return err;
+}
+
+static int yaml_clip(struct output *out, const BLURAY_CLIP_INFO *clip, int extended,
+		const struct clip_scan *scan, const BLURAY_CLIP_INFO *first)
+{
+	FATALPRINTF("  - name: %s%s.m2ts\n", extended ? "    " : "", clip->clip_id);
+	if(extended)
+	{
+		char timebuf[22];
+		FATALPRINTF("    start:    %s\n", ticks2time(timebuf, clip->start_time));
+		FATALPRINTF("    duration: %s\n", ticks2time(timebuf, clip->out_time - clip->in_time));
+		FATALPRINTF("    skip:     %s\n", ticks2time(timebuf, clip->in_time));
+		if(scan)
+			FATALPRINTF("    size:     %.1f MB\n"
+					"    bitrate:  %"PRIu64" kbit/s\n"
+					"    peak:     %"PRIu64" kbit/s\n",
+					scan->bytes / 1e6, scan->bitrate / 1000, scan->peak / 1000);
+		if(first && yaml_clip_diff(out, clip, first) < 0)
+			return -1;
+	}
+	FATALPUTS("    streams:\n");
+	for(enum plan_kind kind = PLAN_VIDEO; kind <= PLAN_INTERACTIVE; kind++)
+		if(yaml_stream_group(out, clip, kind, extended, scan) < 0)
+			return -1;
+	return 0;
+}
+
+/**
+ * Print *s* as a double-quoted YAML scalar.
+ */
+static int yaml_quoted(struct output *out, const char *s)
+{
+	FATALPUTS("\"");
+	for(const char *end; *s; s = end)
+	{
+		end = s + strcspn(s, "\"\\");
+		if(buffer_append(&out->buf, s, end - s) < 0)
+			return -1;
+		if(*end)
+		{
+			FATALPRINTF("\\%c", *end);
+			end++;
+		}
+	}
+	FATALPUTS("\"");
+	return 0;
+}
+
+static int yaml_title(struct output *out, const BLURAY_TITLE_INFO *title, const char *input,
+		const struct title_extra *extra, int extended)
+{
+	char timebuf[22];
+	FATALPUTS("---\n");
+	if(input)
+	{
+		FATALPUTS("input:    ");
+		if(yaml_quoted(out, input) < 0)
+			return -1;
+		FATALPUTS("\n");
+	}
+	FATALPRINTF("playlist: %05"PRIu32".mpls\n"
+			"angles:   %"PRIu8"\n"
+			"duration: %s\n"
+			"chapters: %"PRIu32"\n",
+			title->playlist, title->angle_count,
+			ticks2time(timebuf, title->duration), title->chapter_count);
+	if(extra && extra->numduplicates > 0)
+	{
+		FATALPUTS("duplicates: [");
+		for(size_t i = 0; i < extra->numduplicates; i++)
+			FATALPRINTF("%s%05"PRIu32".mpls", i == 0 ? "" : ", ", extra->duplicates[i]);
+		FATALPUTS("]\n");
+	}
+	if(extra && extra->score)
+	{
+		const struct title_score *score = extra->score;
+		FATALPRINTF("score:\n"
+				"    total:    %.3f\n"
+				"    duration: %.3f\n"
+				"    reuse:    %.3f\n"
+				"    order:    %.3f\n"
+				"    segments: %.3f\n"
+				"    chapters: %.3f\n"
+				"    streams:  %.3f\n",
+				score->total, score->duration, score->reuse, score->order,
+				score->segments, score->chapters, score->streams);
+	}
+	if(extra && extra->numties > 0)
+	{
+		FATALPUTS("ties: [");
+		for(size_t i = 0; i < extra->numties; i++)
+			FATALPRINTF("%s%05"PRIu32".mpls", i == 0 ? "" : ", ", extra->runners_up[i].playlist);
+		FATALPUTS("]\n");
+	}
+	if(extra && extra->numrunnersup > 0)
+	{
+		FATALPUTS("runners_up:\n");
+		for(size_t i = 0; i < extra->numrunnersup; i++)
+		{
+			const struct playlist_score *r = extra->runners_up + i;
+			FATALPRINTF("  - {playlist: %05"PRIu32".mpls, total: %.3f, duration: %.3f,"
+					" reuse: %.3f, order: %.3f, segments: %.3f, chapters: %.3f,"
+					" streams: %.3f}\n", r->playlist, r->score.total, r->score.duration,
+					r->score.reuse, r->score.order, r->score.segments, r->score.chapters,
+					r->score.streams);
+		}
+	}
+
+	if(title->clip_count == 0)
+		FATALPUTS("clips:    []\n");
+	else if(title->clip_count == 1)
+		FATALPUTS("clips:\n");
+	else
+		FATALPRINTF("clips:    # %"PRIu32"\n", title->clip_count);
+	for(uint32_t i = 0; i < title->clip_count; i++)
+		if(yaml_clip(out, title->clips + i, extended, get_clip_scan(extra, i),
+				i > 0 ? title->clips : NULL) < 0)
+			return -1;
+	return 0;
+}
+
+/**
+ * Print *s* as a JSON string.
+ */
+static int json_string(struct output *out, const char *s)
+{
+	FATALPUTS("\"");
+	for(const char *end; *s; s = end)
+	{
+		for(end = s; *end && *end != '"' && *end != '\\' && (unsigned char)*end >= 0x20; end++) {}
+		if(buffer_append(&out->buf, s, end - s) < 0)
+			return -1;
+		if(*end == '"' || *end == '\\')
+			FATALPRINTF("\\%c", *end++);
+		else if(*end)
+			FATALPRINTF("\\u%04x", (unsigned char)*end++);
+	}
+	FATALPUTS("\"");
+	return 0;
+}
+
+/**
+ * Print the key *key* and the string *value*, if it is not NULL.
+ */
+static int json_string_member(struct output *out, const char *key, const char *value)
+{
+	if(value)
+	{
+		FATALPRINTF(",\"%s\":", key);
+		if(json_string(out, value) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Print a size in bytes and an average and peak bitrate in bit/s.
+ */
+static int json_scan_members(struct output *out, uint64_t bytes, uint64_t bitrate, uint64_t peak)
+{
+	FATALPRINTF(",\"size\":%"PRIu64",\"bitrate\":%"PRIu64",\"peak\":%"PRIu64,
+			bytes, bitrate, peak);
+	return 0;
+}
+
+static int json_stream(struct output *out, const BLURAY_STREAM_INFO *stream, enum plan_kind kind,
+		const struct stream_scan *scan)
+{
+	char langbuf[4];
+	FATALPRINTF("{\"pid\":%"PRIu16, stream->pid);
+	if(scan && json_scan_members(out, scan->bytes, scan->bitrate, scan->peak) < 0)
+		return -1;
+	if(json_string_member(out, "language", get_language(stream, langbuf)) < 0
+			|| json_string_member(out, "codec", get_stream_type(stream->coding_type)) < 0)
+		return -1;
+	if(kind == PLAN_VIDEO)
+	{
+		if(json_string_member(out, "aspect_ratio", get_aspect_ratio(stream->aspect)) < 0
+				|| json_string_member(out, "resolution", get_video_format(stream->format)) < 0
+				|| json_string_member(out, "rate", get_video_rate(stream->rate)) < 0)
+			return -1;
+	}
+	else if(kind == PLAN_AUDIO)
+	{
+		if(json_string_member(out, "channels", get_audio_format(stream->format)) < 0
+				|| json_string_member(out, "rate", get_audio_rate(stream->rate)) < 0)
+			return -1;
+	}
+	FATALPUTS("}");
+	return 0;
+}
+
+/**
+ * Print the streams of *clip* that differ from those of the first clip of its
+ * title, *first*, as "added" and "missing" arrays of PIDs and languages.
+ */
+static int json_clip_diff(struct output *out, const BLURAY_CLIP_INFO *clip,
+		const BLURAY_CLIP_INFO *first)
+{
+	struct clip_diff diff;
+	if(plan_diff_clip(clip, first, 0, &diff) < 0)
+		return -1;
+	const struct {
+		const char                *name;
+		const BLURAY_STREAM_INFO **streams;
+		size_t                     numstreams;
+	} lists[] = {
+		{"added",   diff.added,   diff.numadded},
+		{"missing", diff.missing, diff.nummissing}
+	};
+	int err = 0;
+	for(size_t i = 0; i < 2 && err == 0; i++)
+	{
+		if(lists[i].numstreams == 0)
+			continue;
+		err = out_printf(out, ",\"%s\":[", lists[i].name);
+		for(size_t j = 0; j < lists[i].numstreams && err == 0; j++)
+		{
+			char langbuf[4];
+			const char *lang = get_language(lists[i].streams[j], langbuf);
+			err = out_printf(out, "%s{\"pid\":%"PRIu16",\"language\":\"%s\"}", j == 0 ? "" : ",",
+					lists[i].streams[j]->pid, lang ? lang : "und");
+		}
+		if(err == 0)
+			err = out_puts(out, "]");
+	}
+	plan_free_diff(&diff);
+	return err;
+}
+
+static int json_clip(struct output *out, const BLURAY_CLIP_INFO *clip, int extended,
+		const struct clip_scan *scan, const BLURAY_CLIP_INFO *first)
+{
+	FATALPRINTF("{\"name\":\"%s.m2ts\"", clip->clip_id);
+	if(extended)
+	{
+		char timebuf[22];
+		FATALPRINTF(",\"start\":\"%s\"", ticks2time(timebuf, clip->start_time));
+		FATALPRINTF(",\"duration\":\"%s\"", ticks2time(timebuf, clip->out_time - clip->in_time));
+		FATALPRINTF(",\"skip\":\"%s\"", ticks2time(timebuf, clip->in_time));
+		if(scan && json_scan_members(out, scan->bytes, scan->bitrate, scan->peak) < 0)
+			return -1;
+		if(first && json_clip_diff(out, clip, first) < 0)
+			return -1;
+	}
+	FATALPUTS(",\"streams\":{");
+	for(enum plan_kind kind = PLAN_VIDEO; kind <= PLAN_INTERACTIVE; kind++)
+	{
+		FATALPRINTF("%s\"%s\":[", kind == PLAN_VIDEO ? "" : ",", stream_keys[kind]);
+		struct plan_stream_iter it;
+		plan_stream_iter_init(&it, clip, 0);
+		size_t n = 0;
+		for(const BLURAY_STREAM_INFO *stream; (stream = next_stream_of_kind(&it, kind)); n++)
+		{
+			if(n > 0)
+				FATALPUTS(",");
+			if(extended)
+			{
+				if(json_stream(out, stream, kind, get_stream_scan(scan, stream)) < 0)
+					return -1;
+			}
+			else
+			{
+				char langbuf[4];
+				const char *lang = get_language(stream, langbuf);
+				FATALPRINTF("\"%s\"", lang ? lang : "und");
+			}
+		}
+		FATALPUTS("]");
+	}
+	FATALPUTS("}}");
+	return 0;
+}
+
+/**
+ * Print *title* as a single-line JSON object.
+ */
+static int json_title(struct output *out, const BLURAY_TITLE_INFO *title, const char *input,
+		const struct title_extra *extra, int extended)
+{
+	char timebuf[22];
+	FATALPUTS("{");
+	if(input)
+	{
+		FATALPUTS("\"input\":");
+		if(json_string(out, input) < 0)
+			return -1;
+		FATALPUTS(",");
+	}
+	FATALPRINTF("\"playlist\":\"%05"PRIu32".mpls\","
+			"\"angles\":%"PRIu8","
+			"\"duration\":\"%s\","
+			"\"chapters\":%"PRIu32",",
+			title->playlist, title->angle_count,
+			ticks2time(timebuf, title->duration), title->chapter_count);
+	if(extra && extra->numduplicates > 0)
+	{
+		FATALPUTS("\"duplicates\":[");
+		for(size_t i = 0; i < extra->numduplicates; i++)
+			FATALPRINTF("%s\"%05"PRIu32".mpls\"", i == 0 ? "" : ",", extra->duplicates[i]);
+		FATALPUTS("],");
+	}
+	if(extra && extra->score)
+	{
+		const struct title_score *score = extra->score;
+		FATALPRINTF("\"score\":{\"total\":%.3f,\"duration\":%.3f,\"reuse\":%.3f,"
+				"\"order\":%.3f,\"segments\":%.3f,\"chapters\":%.3f,\"streams\":%.3f},",
+				score->total, score->duration, score->reuse, score->order,
+				score->segments, score->chapters, score->streams);
+	}
+	if(extra && extra->numties > 0)
+	{
+		FATALPUTS("\"ties\":[");
+		for(size_t i = 0; i < extra->numties; i++)
+			FATALPRINTF("%s\"%05"PRIu32".mpls\"", i == 0 ? "" : ",", extra->runners_up[i].playlist);
+		FATALPUTS("],");
+	}
+	if(extra && extra->numrunnersup > 0)
+	{
+		FATALPUTS("\"runners_up\":[");
+		for(size_t i = 0; i < extra->numrunnersup; i++)
+		{
+			const struct playlist_score *r = extra->runners_up + i;
+			FATALPRINTF("%s{\"playlist\":\"%05"PRIu32".mpls\",\"total\":%.3f,"
+					"\"duration\":%.3f,\"reuse\":%.3f,\"order\":%.3f,\"segments\":%.3f,"
+					"\"chapters\":%.3f,\"streams\":%.3f}", i == 0 ? "" : ",", r->playlist,
+					r->score.total, r->score.duration, r->score.reuse, r->score.order,
+					r->score.segments, r->score.chapters, r->score.streams);
+		}
+		FATALPUTS("],");
+	}
+	FATALPUTS("\"clips\":[");
+	for(uint32_t i = 0; i < title->clip_count; i++)
+	{
+		if(i > 0)
+			FATALPUTS(",");
+		if(json_clip(out, title->clips + i, extended, get_clip_scan(extra, i),
+				i > 0 ? title->clips : NULL) < 0)
+			return -1;
+	}
+	FATALPUTS("]}");
+	return 0;
+}
+
+static int yaml_plan(struct output *out, const struct remux_plan *plan, const char *input,
+		const char *output)
+{
+	FATALPUTS("---\ninput:    ");
+	if(yaml_quoted(out, input) < 0)
+		return -1;
+	FATALPUTS("\noutput:   ");
+	if(yaml_quoted(out, output) < 0)
+		return -1;
+	FATALPRINTF("\nplaylist: %05"PRIu32".mpls\n"
+			"chapters: %"PRIu32"\n",
+			plan->title->playlist, plan->chapters ? plan->title->chapter_count : 0);
+	FATALPUTS(plan->numstreams == 0 ? "streams:  []\n" : "streams:\n");
+	for(size_t i = 0; i < plan->numstreams; i++)
+	{
+		FATALPRINTF("    - pid:      0x%04"PRIx16"\n"
+				"      kind:     %s\n"
+				"      codec:    %s\n",
+				plan->streams[i].info->pid, plan_kind_name(plan->tracks[i].kind),
+				plan_codec_name(plan->tracks[i].codec));
+		if(plan->streams[i].language[0])
+			FATALPRINTF("      language: %s\n", plan->streams[i].language);
+		if(plan->tracks[i].late)
+			FATALPUTS("      late:     true\n");
+	}
+	return 0;
+}
+
+/**
+ * Print *plan* as a single-line JSON object. The output index of a stream is
+ * its index in "streams", streams missing from the first clip are "late".
+ */
+static int json_plan(struct output *out, const struct remux_plan *plan, const char *input,
+		const char *output)
+{
+	FATALPUTS("{\"input\":");
+	if(json_string(out, input) < 0)
+		return -1;
+	FATALPUTS(",\"output\":");
+	if(json_string(out, output) < 0)
+		return -1;
+	FATALPRINTF(",\"playlist\":\"%05"PRIu32".mpls\",\"chapters\":%"PRIu32",\"streams\":[",
+			plan->title->playlist, plan->chapters ? plan->title->chapter_count : 0);
+	for(size_t i = 0; i < plan->numstreams; i++)
+	{
+		FATALPRINTF("%s{\"pid\":%"PRIu16",\"kind\":\"%s\",\"codec\":\"%s\"",
+				i == 0 ? "" : ",", plan->streams[i].info->pid,
+				plan_kind_name(plan->tracks[i].kind), plan_codec_name(plan->tracks[i].codec));
+		if(plan->streams[i].language[0]
+				&& json_string_member(out, "language", plan->streams[i].language) < 0)
+			return -1;
+		if(plan->tracks[i].late)
+			FATALPUTS(",\"late\":true");
+		FATALPUTS("}");
+	}
+	FATALPUTS("]}");
+	return 0;
+}
+
+int output_parse_format(const char *name)
+{
+	static const struct enum_map formats[] = {
+		{OUTPUT_YAML,   "yaml"},
+		{OUTPUT_JSON,   "json"},
+		{OUTPUT_NDJSON, "ndjson"},
+		{0, NULL}
+	};
+	for(const struct enum_map *format = formats; format->name; format++)
+		if(strcmp(format->name, name) == 0)
+			return format->value;
+	return -1;
+}
+
+struct output *output_new(int fd, enum output_format format)
+{
+	struct output *out = malloc(sizeof(*out));
+	if(!out)
+		return NULL;
+	out->fd        = fd;
+	out->format    = format;
+	out->buf       = (struct buffer){NULL, 0, 0};
+	out->numtitles = 0;
+	if(buffer_reserve(&out->buf, OUTPUT_FLUSH_SIZE) < 0)
+	{
+		free(out);
+		return NULL;
+	}
+	return out;
+}
+
+int output_title(struct output *out, const BLURAY_TITLE_INFO *title, const char *input,
+		const struct title_extra *extra, int extended)
+{
+	switch(out->format)
+	{
+	case OUTPUT_YAML:
+		if(yaml_title(out, title, input, extra, extended) < 0)
+			return -1;
+		break;
+	case OUTPUT_JSON:
+		FATALPUTS(out->numtitles == 0 ? "[\n" : ",\n");
+		if(json_title(out, title, input, extra, extended) < 0)
+			return -1;
+		break;
+	case OUTPUT_NDJSON:
+		if(json_title(out, title, input, extra, extended) < 0)
+			return -1;
+		FATALPUTS("\n");
+		break;
+	}
+	out->numtitles++;
+
+	// every NDJSON line can be consumed on its own
+	if(out->format == OUTPUT_NDJSON || out->buf.size >= OUTPUT_FLUSH_SIZE)
+		return output_flush(out);
+	return 0;
+}
+
+int output_plan(struct output *out, const struct remux_plan *plan, const char *input,
+		const char *output)
+{
+	switch(out->format)
+	{
+	case OUTPUT_YAML:
+		if(yaml_plan(out, plan, input, output) < 0)
+			return -1;
+		break;
+	case OUTPUT_JSON:
+		FATALPUTS(out->numtitles == 0 ? "[\n" : ",\n");
+		if(json_plan(out, plan, input, output) < 0)
+			return -1;
+		break;
+	case OUTPUT_NDJSON:
+		if(json_plan(out, plan, input, output) < 0)
+			return -1;
+		FATALPUTS("\n");
+		break;
+	}
+	out->numtitles++;
+
+	if(out->format == OUTPUT_NDJSON || out->buf.size >= OUTPUT_FLUSH_SIZE)
+		return output_flush(out);
+	return 0;
+}
+
+int output_flush(struct output *out)
+{
+	for(const uint8_t *p = out->buf.data, *end = p + out->buf.size; p < end;)
+	{
+		ssize_t n = write(out->fd, p, end - p);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+	}
+	out->buf.size = 0;
+	return 0;
+}
+
+int output_finish(struct output *out)
+{
+	switch(out->format)
+	{
+	case OUTPUT_YAML:
+		FATALPUTS("...\n");
+		break;
+	case OUTPUT_JSON:
+		FATALPUTS(out->numtitles == 0 ? "[]\n" : "\n]\n");
+		break;
+	case OUTPUT_NDJSON:
+		break;
+	}
+	return output_flush(out);
+}
+
+void output_free(struct output *out)
+{
+	if(out)
+		free(out->buf.data);
+	free(out);
+}
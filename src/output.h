@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OUTPUT_H_INCLUDED
+#define OUTPUT_H_INCLUDED
+
+#include <libbluray/bluray.h>
+
+#include "plan.h"
+#include "scan.h"
+#include "score.h"
+
+enum output_format {
+	OUTPUT_YAML,
+	OUTPUT_JSON,
+	OUTPUT_NDJSON
+};
+
+struct output;
+
+/**
+ * Parse the output format *name*. Returns the format or -1 if it is unknown.
+ */
+int output_parse_format(const char *name);
+
+/**
+ * Create a buffered writer that prints titles in *format* to *fd*. Output is
+ * collected in a large buffer and written in big chunks, NDJSON is flushed
+ * after every title.
+ */
+struct output *output_new(int fd, enum output_format format);
+
+/**
+ * Additional information about a title, which is printed if it is set.
+ * *duplicates* are the playlists that were folded into the title, *scan* holds
+ * the sizes and bitrates of its clips and streams. *runners_up* are the scores
+ * of the titles that lost against the title selected as main feature, the
+ * first *numties* of them only by having a higher playlist number.
+ */
+struct title_extra {
+	const uint32_t              *duplicates;
+	size_t                       numduplicates;
+	const struct title_score    *score;
+	size_t                       numties;
+	const struct playlist_score *runners_up;
+	size_t                       numrunnersup;
+	const struct title_scan     *scan;
+};
+
+/**
+ * Print *title*. If *input* is given the Blu-ray it was read from is included,
+ * if *extra* is given its information is included. Returns 0 or -1 with errno
+ * set.
+ */
+int output_title(struct output *out, const BLURAY_TITLE_INFO *title, const char *input,
+		const struct title_extra *extra, int extended);
+
+/**
+ * Print *plan*, which remuxes its title from *input* to *output*. Returns 0 or
+ * -1 with errno set.
+ */
+int output_plan(struct output *out, const struct remux_plan *plan, const char *input,
+		const char *output);
+
+/**
+ * Write all buffered output. Returns 0 or -1 with errno set.
+ */
+int output_flush(struct output *out);
+
+/**
+ * Terminate the document and flush it. Returns 0 or -1 with errno set.
+ */
+int output_finish(struct output *out);
+
+void output_free(struct output *out);
+
+#endif
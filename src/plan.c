@@ -0,0 +1,304 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan.h"
+
+/**
+ * Test if *stream* is converted to FLAC on extraction, which LPCM streams
+ * always are and DTS-HD MA and Dolby True HD streams if *transcode* is set.
+ */
+static int flac_stream(const BLURAY_STREAM_INFO *stream, int transcode)
+{
+	return stream->coding_type == BLURAY_STREAM_TYPE_AUDIO_LPCM || (transcode
+			&& (stream->coding_type == BLURAY_STREAM_TYPE_AUDIO_TRUHD
+					|| stream->coding_type == BLURAY_STREAM_TYPE_AUDIO_DTSHD_MASTER));
+}
+
+#define NUM_GROUPS 6
+
+/**
+ * The streams of a clip of one kind, in the order they are planned.
+ */
+struct stream_group {
+	const BLURAY_STREAM_INFO *streams;
+	size_t                    numstreams;
+	enum plan_kind            kind;
+};
+
+static void get_stream_groups(const BLURAY_CLIP_INFO *clip, int skip_ig,
+		struct stream_group groups[NUM_GROUPS])
+{
+	groups[0] = (struct stream_group){clip->video_streams,     clip->video_stream_count,     PLAN_VIDEO};
+	groups[1] = (struct stream_group){clip->sec_video_streams, clip->sec_video_stream_count, PLAN_VIDEO};
+	groups[2] = (struct stream_group){clip->audio_streams,     clip->audio_stream_count,     PLAN_AUDIO};
+	groups[3] = (struct stream_group){clip->sec_audio_streams, clip->sec_audio_stream_count, PLAN_AUDIO};
+	groups[4] = (struct stream_group){clip->pg_streams,        clip->pg_stream_count,        PLAN_SUBTITLE};
+	groups[5] = (struct stream_group){clip->ig_streams,        skip_ig ? 0 : clip->ig_stream_count,
+			PLAN_INTERACTIVE};
+}
+
+static int same_stream(const BLURAY_STREAM_INFO *a, const BLURAY_STREAM_INFO *b)
+{
+	return a->pid == b->pid && memcmp(a->lang, b->lang, sizeof(a->lang)) == 0;
+}
+
+/**
+ * Test if one of the *n* *streams* is the same as *stream*.
+ */
+static int find_stream(const BLURAY_STREAM_INFO *const *streams, size_t n,
+		const BLURAY_STREAM_INFO *stream)
+{
+	for(size_t i = 0; i < n; i++)
+		if(same_stream(streams[i], stream))
+			return 1;
+	return 0;
+}
+
+void plan_stream_iter_init(struct plan_stream_iter *it, const BLURAY_CLIP_INFO *clip,
+		int skip_ig)
+{
+	*it = (struct plan_stream_iter){
+		.clip    = clip,
+		.skip_ig = skip_ig,
+		.group   = 0,
+		.index   = 0
+	};
+}
+
+const BLURAY_STREAM_INFO *plan_stream_next(struct plan_stream_iter *it, enum plan_kind *kind)
+{
+	struct stream_group groups[NUM_GROUPS];
+	get_stream_groups(it->clip, it->skip_ig, groups);
+	for(; it->group < NUM_GROUPS; it->group++, it->index = 0)
+		if(it->index < groups[it->group].numstreams)
+		{
+			if(kind)
+				*kind = groups[it->group].kind;
+			return groups[it->group].streams + it->index++;
+		}
+	return NULL;
+}
+
+/**
+ * Test if *clip* has a stream that is the same as *stream*.
+ */
+static int clip_has_stream(const BLURAY_CLIP_INFO *clip, int skip_ig,
+		const BLURAY_STREAM_INFO *stream)
+{
+	struct plan_stream_iter it;
+	plan_stream_iter_init(&it, clip, skip_ig);
+	for(const BLURAY_STREAM_INFO *other; (other = plan_stream_next(&it, NULL));)
+		if(same_stream(other, stream))
+			return 1;
+	return 0;
+}
+
+/**
+ * Test if every clip of *title* has a stream that is the same as *stream*.
+ */
+static int title_has_stream(const BLURAY_TITLE_INFO *title, int skip_ig,
+		const BLURAY_STREAM_INFO *stream)
+{
+	for(uint32_t i = 0; i < title->clip_count; i++)
+		if(!clip_has_stream(title->clips + i, skip_ig, stream))
+			return 0;
+	return 1;
+}
+
+int plan_title(struct remux_plan *plan, const BLURAY_TITLE_INFO *title,
+		const struct iso639_set *langs, int transcode, int skip_ig,
+		enum plan_layout layout)
+{
+	uint32_t numclips = layout == PLAN_UNION ? title->clip_count : 1;
+	struct stream_group groups[NUM_GROUPS];
+	size_t total = 0;
+	for(uint32_t i = 0; i < numclips; i++)
+	{
+		get_stream_groups(title->clips + i, skip_ig, groups);
+		for(size_t j = 0; j < NUM_GROUPS; j++)
+			total += groups[j].numstreams;
+	}
+	if(total == 0)
+		total = 1;
+
+	// the distinct streams of the clips of a union, whether they are selected or not
+	const BLURAY_STREAM_INFO **seen = NULL;
+	size_t numseen = 0;
+	*plan = (struct remux_plan){
+		.title      = title,
+		.streams    = malloc(total * sizeof(*plan->streams)),
+		.tracks     = malloc(total * sizeof(*plan->tracks)),
+		.numstreams = 0,
+		.numflac    = 0,
+		.numlate    = 0,
+		.chapters   = title->chapter_count > 0
+	};
+	if(!plan->streams || !plan->tracks
+			|| (layout == PLAN_UNION && !(seen = malloc(total * sizeof(*seen)))))
+	{
+		plan_free(plan);
+		return -1;
+	}
+
+	// late streams follow all streams of the first clip, so that a late stream
+	// dropped by the remux does not shift the index of any other stream
+	for(uint32_t late = 0; late < 2; late++)
+		for(size_t i = 0; i < NUM_GROUPS; i++)
+			for(uint32_t j = late; j < (late ? numclips : 1); j++)
+			{
+				get_stream_groups(title->clips + j, skip_ig, groups);
+				for(size_t k = 0; k < groups[i].numstreams; k++)
+				{
+					const BLURAY_STREAM_INFO *stream = groups[i].streams + k;
+					if(layout == PLAN_UNION)
+					{
+						if(find_stream(seen, numseen, stream))
+							continue;
+						seen[numseen++] = stream;
+					}
+					else if(layout == PLAN_INTERSECTION && !title_has_stream(title, skip_ig, stream))
+						continue;
+
+					iso639_code code = iso6392_bcode(iso639_pack((const char *)stream->lang));
+					if(langs && stream->lang[0] && !(code && iso639_set_contains(langs, code)))
+						continue;
+
+					struct remux_stream *selected = plan->streams + plan->numstreams;
+					selected->info = stream;
+					// unknown languages are kept as they are
+					if(code)
+						iso639_unpack(selected->language, code);
+					else
+						memcpy(selected->language, stream->lang, sizeof(selected->language));
+					selected->language[3] = '\0';
+
+					int flac = flac_stream(stream, transcode);
+					plan->tracks[plan->numstreams++] = (struct plan_track){
+						.kind  = groups[i].kind,
+						.codec = flac ? PLAN_FLAC : PLAN_COPY,
+						.late  = j > 0
+					};
+					plan->numflac += flac;
+					plan->numlate += j > 0;
+				}
+			}
+	free(seen);
+	return 0;
+}
+
+int plan_parse_layout(const char *name)
+{
+	static const char *const layouts[] = {
+		[PLAN_FIRST_CLIP]   = "first",
+		[PLAN_UNION]        = "union",
+		[PLAN_INTERSECTION] = "intersection"
+	};
+	for(size_t i = 0; i < sizeof(layouts) / sizeof(*layouts); i++)
+		if(strcmp(layouts[i], name) == 0)
+			return i;
+	return -1;
+}
+
+/**
+ * Store the streams of *clip* that *other* does not have in *diff*, which has
+ * room for all streams of *clip*. Returns their number.
+ */
+static size_t diff_streams(const BLURAY_CLIP_INFO *clip, const BLURAY_CLIP_INFO *other,
+		int skip_ig, const BLURAY_STREAM_INFO **diff)
+{
+	struct plan_stream_iter it;
+	plan_stream_iter_init(&it, clip, skip_ig);
+	size_t n = 0;
+	for(const BLURAY_STREAM_INFO *stream; (stream = plan_stream_next(&it, NULL));)
+		if(!clip_has_stream(other, skip_ig, stream))
+			diff[n++] = stream;
+	return n;
+}
+
+static size_t count_streams(const BLURAY_CLIP_INFO *clip, int skip_ig)
+{
+	struct plan_stream_iter it;
+	plan_stream_iter_init(&it, clip, skip_ig);
+	size_t n = 0;
+	while(plan_stream_next(&it, NULL))
+		n++;
+	return n;
+}
+
+int plan_diff_clip(const BLURAY_CLIP_INFO *clip, const BLURAY_CLIP_INFO *ref, int skip_ig,
+		struct clip_diff *diff)
+{
+	size_t numclip = count_streams(clip, skip_ig);
+	size_t numref  = count_streams(ref, skip_ig);
+	*diff = (struct clip_diff){
+		.added      = malloc((numclip > 0 ? numclip : 1) * sizeof(*diff->added)),
+		.numadded   = 0,
+		.missing    = malloc((numref > 0 ? numref : 1) * sizeof(*diff->missing)),
+		.nummissing = 0
+	};
+	if(!diff->added || !diff->missing)
+	{
+		plan_free_diff(diff);
+		return -1;
+	}
+	diff->numadded   = diff_streams(clip, ref, skip_ig, diff->added);
+	diff->nummissing = diff_streams(ref, clip, skip_ig, diff->missing);
+	return 0;
+}
+
+void plan_free_diff(struct clip_diff *diff)
+{
+	free(diff->added);
+	free(diff->missing);
+	diff->added   = NULL;
+	diff->missing = NULL;
+}
+
+const char *plan_kind_name(enum plan_kind kind)
+{
+	switch(kind)
+	{
+	case PLAN_VIDEO:
+		return "video";
+	case PLAN_AUDIO:
+		return "audio";
+	case PLAN_SUBTITLE:
+		return "subtitle";
+	default:
+		return "interactive";
+	}
+}
+
+const char *plan_codec_name(enum plan_codec codec)
+{
+	return codec == PLAN_FLAC ? "flac" : "copy";
+}
+
+void plan_free(struct remux_plan *plan)
+{
+	free(plan->streams);
+	free(plan->tracks);
+	plan->streams    = NULL;
+	plan->tracks     = NULL;
+	plan->numstreams = 0;
+}
@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLAN_H_INCLUDED
+#define PLAN_H_INCLUDED
+
+#include <stddef.h>
+
+#include <libbluray/bluray.h>
+
+#include "iso-639-2.h"
+#include "remux.h"
+
+enum plan_kind {
+	PLAN_VIDEO,
+	PLAN_AUDIO,
+	PLAN_SUBTITLE,
+	PLAN_INTERACTIVE
+};
+
+enum plan_codec {
+	PLAN_COPY,
+	/** converted to FLAC, which only ffmpeg does */
+	PLAN_FLAC
+};
+
+/**
+ * Which streams of a title are planned if its clips have different streams:
+ * those of its first clip, those of any clip, or those of every clip.
+ */
+enum plan_layout {
+	PLAN_FIRST_CLIP,
+	PLAN_UNION,
+	PLAN_INTERSECTION
+};
+
+/**
+ * How a stream of a remux plan is written. A *late* stream is missing from
+ * the first clip, so it is not found by probing the start of the title.
+ */
+struct plan_track {
+	enum plan_kind  kind;
+	enum plan_codec codec;
+	int             late;
+};
+
+/**
+ * How a title is remuxed, computed once and rendered by every backend. The
+ * output index of a stream is its index in *streams*, *tracks* holds how each
+ * is written. The output gets the chapters of *title* if *chapters* is set.
+ */
+struct remux_plan {
+	const BLURAY_TITLE_INFO *title;
+	struct remux_stream     *streams;
+	struct plan_track       *tracks;
+	size_t                   numstreams;
+	size_t                   numflac;
+	size_t                   numlate;
+	int                      chapters;
+};
+
+/**
+ * The streams of a clip that differ from those of another clip. Streams are
+ * told apart by PID and language.
+ */
+struct clip_diff {
+	const BLURAY_STREAM_INFO **added;
+	size_t                     numadded;
+	const BLURAY_STREAM_INFO **missing;
+	size_t                     nummissing;
+};
+
+/**
+ * Iterator over the streams of a clip in the order they are planned: video,
+ * secondary video, audio, secondary audio, presentation graphic, and, unless
+ * *skip_ig* is set, interactive graphic streams. Every walk over the streams
+ * of a clip uses it, so listings, plans, and calls agree on their order.
+ */
+struct plan_stream_iter {
+	const BLURAY_CLIP_INFO *clip;
+	int                     skip_ig;
+	size_t                  group;
+	size_t                  index;
+};
+
+void plan_stream_iter_init(struct plan_stream_iter *it, const BLURAY_CLIP_INFO *clip,
+		int skip_ig);
+
+/**
+ * Get the next stream of *it* and store its kind in *\*kind* unless *kind* is
+ * NULL. Returns NULL after the last stream.
+ */
+const BLURAY_STREAM_INFO *plan_stream_next(struct plan_stream_iter *it, enum plan_kind *kind);
+
+/**
+ * Plan the remux of *title*. The streams of its clips are chosen by *layout*,
+ * streams missing from the first clip follow all of its streams. Only
+ * streams of unknown language and of languages in *langs* are selected, if
+ * *langs* is given, and interactive graphic streams are skipped if *skip_ig*
+ * is set. LPCM audio streams are converted to FLAC and, if *transcode* is set,
+ * DTS-HD MA and Dolby True HD audio streams as well. *plan* has to be freed
+ * with plan_free.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int plan_title(struct remux_plan *plan, const BLURAY_TITLE_INFO *title,
+		const struct iso639_set *langs, int transcode, int skip_ig,
+		enum plan_layout layout);
+
+/**
+ * Parse the layout *name*. Returns the layout or -1 if it is unknown.
+ */
+int plan_parse_layout(const char *name);
+
+/**
+ * Compare the streams of *clip* with those of *ref*, skipping interactive
+ * graphic streams if *skip_ig* is set. *diff* has to be freed with
+ * plan_free_diff.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int plan_diff_clip(const BLURAY_CLIP_INFO *clip, const BLURAY_CLIP_INFO *ref, int skip_ig,
+		struct clip_diff *diff);
+
+void plan_free_diff(struct clip_diff *diff);
+
+const char *plan_kind_name(enum plan_kind kind);
+
+const char *plan_codec_name(enum plan_codec codec);
+
+void plan_free(struct remux_plan *plan);
+
+#endif
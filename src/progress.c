@@ -0,0 +1,187 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "progress.h"
+#include "util.h"
+
+static double seconds_since(const struct timespec *t)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) + (now.tv_nsec - t->tv_nsec) / 1e9;
+}
+
+void progress_init(struct progress *p, uint64_t duration)
+{
+	memset(p, 0, sizeof(*p));
+	p->duration = duration;
+	clock_gettime(CLOCK_MONOTONIC, &p->started);
+	p->advanced = p->started;
+}
+
+static void parse_line(struct progress *p, const char *line)
+{
+	const char *value = strchr(line, '=');
+	if(!value)
+		return;
+	size_t keylen = value++ - line;
+#define IS_KEY(key) (keylen == sizeof(key) - 1 && memcmp(line, key, keylen) == 0)
+	if(IS_KEY("out_time_us"))
+	{
+		// N/A before the first packet
+		long long us = strtoll(value, NULL, 10);
+		p->next_position = us > 0 ? (uint64_t)us * 9 / 100 : 0;
+	}
+	else if(IS_KEY("total_size"))
+	{
+		long long size = strtoll(value, NULL, 10);
+		p->next_size = size > 0 ? (uint64_t)size : 0;
+	}
+	// read_* lines are not part of ffmpeg's blocks and apply at once
+	else if(IS_KEY("read_size"))
+		p->read_size = strtoull(value, NULL, 10);
+	else if(IS_KEY("read_time_us"))
+		p->read_us = strtoull(value, NULL, 10);
+	else if(IS_KEY("fps"))
+		p->next_fps = strtod(value, NULL);
+	else if(IS_KEY("progress"))
+	{
+		if(p->next_position > p->position || p->next_size > p->size)
+			clock_gettime(CLOCK_MONOTONIC, &p->advanced);
+		p->position = p->next_position;
+		p->size     = p->next_size;
+		p->fps      = p->next_fps;
+		p->done     = strcmp(value, "end") == 0;
+	}
+#undef IS_KEY
+}
+
+int progress_read(struct progress *p, int fd)
+{
+	char buf[4096];
+	ssize_t n = read(fd, buf, sizeof(buf));
+	if(n < 0)
+		return errno == EINTR || errno == EAGAIN ? 0 : -1;
+	if(n == 0)
+		return 1;
+	for(ssize_t i = 0; i < n; i++)
+	{
+		if(buf[i] != '\n')
+		{
+			// overlong lines are truncated, no known key is that long
+			if(p->linelen + 1 < sizeof(p->line))
+				p->line[p->linelen++] = buf[i];
+			continue;
+		}
+		p->line[p->linelen] = '\0';
+		parse_line(p, p->line);
+		p->linelen = 0;
+	}
+	return 0;
+}
+
+/**
+ * Write the *n* bytes of *buf* to *fd* in one write if possible, so they are not
+ * interleaved with the progress of other writers of a pipe.
+ */
+static int write_lines(int fd, const char *buf, int n)
+{
+	for(int off = 0; off < n;)
+	{
+		ssize_t written = write(fd, buf + off, n - off);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		off += written;
+	}
+	return 0;
+}
+
+int progress_write(int fd, uint64_t size, uint64_t position, double fps, int done)
+{
+	char buf[160];
+	int n = snprintf(buf, sizeof(buf), "fps=%.2f\ntotal_size=%"PRIu64"\nout_time_us=%"PRIu64"\n"
+			"progress=%s\n", fps, size, position * 100 / 9, done ? "end" : "continue");
+	return write_lines(fd, buf, n);
+}
+
+int progress_write_read(int fd, uint64_t size, uint64_t us)
+{
+	char buf[64];
+	int n = snprintf(buf, sizeof(buf), "read_size=%"PRIu64"\nread_time_us=%"PRIu64"\n",
+			size, us);
+	return write_lines(fd, buf, n);
+}
+
+double progress_stalled(const struct progress *p)
+{
+	return seconds_since(&p->advanced);
+}
+
+void progress_print(const struct progress *p, FILE *f, int human)
+{
+	double elapsed = seconds_since(&p->started);
+	double rate    = elapsed > 0 ? p->size / elapsed / 1e6 : 0;
+	double percent = p->duration > 0 ? 100.0 * p->position / p->duration : 0;
+	// the remaining duration is remuxed at the average speed so far
+	double eta = -1;
+	if(p->position > 0 && p->duration >= p->position)
+		eta = elapsed * (p->duration - p->position) / p->position;
+
+	char position[22];
+	char duration[22];
+	ticks2time(position, p->position);
+	ticks2time(duration, p->duration);
+	if(human)
+	{
+		fprintf(f, "%.8s/%.8s %5.1f%% %6.1f MB/s %6.1f fps", position, duration, percent,
+				rate, p->fps);
+		if(eta >= 0)
+		{
+			char remaining[22];
+			fprintf(f, " ETA %.8s", ticks2time(remaining, eta * 90000));
+		}
+		// bytes per microsecond are MB/s
+		if(p->read_us > 0)
+			fprintf(f, " read %6.1f MB/s", (double)p->read_size / p->read_us);
+	}
+	else
+	{
+		fprintf(f, "\"position\":%.3f,\"duration\":%.3f,\"percent\":%.2f,\"bytes\":%"PRIu64","
+				"\"mb_per_s\":%.3f,\"fps\":%.3f,\"eta\":", p->position / 90000.0,
+				p->duration / 90000.0, percent, p->size, rate, p->fps);
+		if(eta >= 0)
+			fprintf(f, "%.1f", eta);
+		else
+			fputs("null", f);
+		if(p->read_us > 0)
+			fprintf(f, ",\"read_bytes\":%"PRIu64",\"read_mb_per_s\":%.3f", p->read_size,
+					(double)p->read_size / p->read_us);
+	}
+}
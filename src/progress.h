@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROGRESS_H_INCLUDED
+#define PROGRESS_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Progress of a remux as reported by ffmpeg's -progress option, which the
+ * built-in engine imitates: blocks of key=value lines, each terminated by
+ * progress=continue or progress=end. Titles fed to ffmpeg by bdinfo add lines
+ * outside of the blocks with the bytes read from the disc.
+ */
+struct progress {
+	/** of the title in 90 kHz ticks */
+	uint64_t        duration;
+	/** written so far in 90 kHz ticks */
+	uint64_t        position;
+	/** bytes written so far */
+	uint64_t        size;
+	/** bytes read from the disc by bdinfo and microseconds it took, if fed */
+	uint64_t        read_size;
+	uint64_t        read_us;
+	double          fps;
+	int             done;
+	struct timespec started;
+	/** when *position* or *size* last advanced */
+	struct timespec advanced;
+	/** unterminated rest of the last read */
+	char            line[128];
+	size_t          linelen;
+	/** values of the current block */
+	uint64_t        next_position;
+	uint64_t        next_size;
+	double          next_fps;
+};
+
+/**
+ * Start tracking the progress of a title *duration* ticks long.
+ */
+void progress_init(struct progress *p, uint64_t duration);
+
+/**
+ * Read the available progress from *fd* into *p*.
+ *
+ * Returns 0, 1 on end of file, or -1 on error with errno set.
+ */
+int progress_read(struct progress *p, int fd);
+
+/**
+ * Write a progress block with *size* bytes and *position* ticks written at
+ * *fps* to *fd*, ending with progress=end if *done* is set.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int progress_write(int fd, uint64_t size, uint64_t position, double fps, int done);
+
+/**
+ * Write the *size* bytes read from the disc in *us* microseconds to *fd*.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int progress_write_read(int fd, uint64_t size, uint64_t us);
+
+/**
+ * Seconds since the progress of *p* last advanced.
+ */
+double progress_stalled(const struct progress *p);
+
+/**
+ * Print the progress of *p* to *f*, as a compact human-readable status if
+ * *human* is set or as the members of a JSON object otherwise.
+ */
+void progress_print(const struct progress *p, FILE *f, int human);
+
+#endif
@@ -0,0 +1,995 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bdmv.h"
+#include "mkv.h"
+#include "progress.h"
+#include "remux.h"
+#include "ts.h"
+#include "util.h"
+
+/** bd_read returns aligned units of 32 source packets */
+#define ALIGNED_UNIT_SIZE (32 * TS_PACKET_SIZE)
+
+/** bytes read at once, from a title or the M2TS files of angles */
+#define READ_SIZE (32 * ALIGNED_UNIT_SIZE)
+
+/** frames queued while waiting for codec configurations */
+#define MAX_QUEUED_SIZE (64 << 20)
+
+#define PTS_MASK ((INT64_C(1) << 33) - 1)
+
+/** milliseconds between progress reports */
+#define PROGRESS_INTERVAL 500
+
+enum codec {
+	CODEC_H264,
+	CODEC_HEVC,
+	CODEC_MPEG2,
+	CODEC_AC3,
+	CODEC_EAC3,
+	CODEC_DTS,
+	CODEC_TRUEHD,
+	CODEC_LPCM,
+	CODEC_PGS,
+	CODEC_UNSUPPORTED
+};
+
+static enum codec get_codec(const BLURAY_STREAM_INFO *stream)
+{
+	switch(stream->coding_type)
+	{
+	case BLURAY_STREAM_TYPE_VIDEO_H264:
+		return CODEC_H264;
+	case 0x24: // BLURAY_STREAM_TYPE_VIDEO_HEVC, missing in older libbluray
+		return CODEC_HEVC;
+	case BLURAY_STREAM_TYPE_VIDEO_MPEG2:
+		return CODEC_MPEG2;
+	case BLURAY_STREAM_TYPE_AUDIO_AC3:
+		return CODEC_AC3;
+	case BLURAY_STREAM_TYPE_AUDIO_AC3PLUS:
+		return CODEC_EAC3;
+	case BLURAY_STREAM_TYPE_AUDIO_DTS:
+	case BLURAY_STREAM_TYPE_AUDIO_DTSHD:
+	case BLURAY_STREAM_TYPE_AUDIO_DTSHD_MASTER:
+		return CODEC_DTS;
+	case BLURAY_STREAM_TYPE_AUDIO_TRUHD:
+		return CODEC_TRUEHD;
+	case BLURAY_STREAM_TYPE_AUDIO_LPCM:
+		// other layouts are padded and ordered differently than in Matroska
+		return stream->format == BLURAY_AUDIO_FORMAT_STEREO ? CODEC_LPCM : CODEC_UNSUPPORTED;
+	case BLURAY_STREAM_TYPE_SUB_PG:
+		return CODEC_PGS;
+	default:
+		return CODEC_UNSUPPORTED;
+	}
+}
+
+int remux_stream_supported(const BLURAY_STREAM_INFO *stream)
+{
+	return get_codec(stream) != CODEC_UNSUPPORTED;
+}
+
+struct track {
+	const struct remux_stream *stream;
+	enum codec                 codec;
+	/** set once the codec private data is known */
+	int                        configured;
+	/** set once a keyframe was seen */
+	int                        started;
+	struct buffer              codec_private;
+	unsigned                   bit_depth;
+	/** Matroska track number, 0 if dropped */
+	uint64_t                   number;
+};
+
+struct queued_frame {
+	size_t   track;
+	uint64_t timestamp;
+	int      keyframe;
+	size_t   offset;
+	size_t   size;
+};
+
+struct remux {
+	const BLURAY_TITLE_INFO *title;
+	struct track            *tracks;
+	size_t                   numtracks;
+	/** index into *tracks* + 1 for every PID */
+	uint16_t                 track_of_pid[0x2000];
+	uint32_t                 clip;
+	struct ts_demux         *ts;
+	struct mkv              *mkv;
+	int                      header_written;
+	int                      dropped;
+	struct queued_frame     *queue;
+	size_t                   numqueued;
+	struct buffer            queued_data;
+	/** converted frame data */
+	struct buffer            frame;
+	/** latest timestamp in 90 kHz ticks and number of video frames written */
+	uint64_t                 position;
+	uint64_t                 numframes;
+};
+
+/** Bit reader for codec headers with emulation prevention bytes removed. */
+struct bits {
+	const uint8_t *data;
+	size_t         size;
+	size_t         pos;
+};
+
+static unsigned read_bits(struct bits *b, unsigned n)
+{
+	unsigned v = 0;
+	for(; n > 0; n--, b->pos++)
+		v = v << 1 | (b->pos / 8 < b->size ? b->data[b->pos / 8] >> (7 - b->pos % 8) & 1 : 0);
+	return v;
+}
+
+static unsigned read_ue(struct bits *b)
+{
+	unsigned zeros = 0;
+	while(read_bits(b, 1) == 0 && zeros < 32)
+		zeros++;
+	return (1u << zeros) - 1 + read_bits(b, zeros);
+}
+
+/**
+ * Copy the NAL unit *src* to *dst* without emulation prevention bytes.
+ */
+static size_t unescape_nal(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t n = 0;
+	for(size_t i = 0; i < size; i++)
+	{
+		if(i >= 2 && src[i] == 3 && src[i - 1] == 0 && src[i - 2] == 0)
+			continue;
+		dst[n++] = src[i];
+	}
+	return n;
+}
+
+/**
+ * Find the next Annex B NAL unit in [*\*p*, *end*). Its start is stored in
+ * *\*nal* and its size, without trailing zero bytes, is returned. *\*p* is
+ * moved behind it. Returns 0 if there is none.
+ */
+static size_t next_nal(const uint8_t **p, const uint8_t *end, const uint8_t **nal)
+{
+	const uint8_t *s = *p;
+	while(s + 3 <= end && !(s[0] == 0 && s[1] == 0 && s[2] == 1))
+		s++;
+	if(s + 3 > end)
+	{
+		*p = end;
+		return 0;
+	}
+	s += 3;
+	const uint8_t *e = s;
+	while(e + 3 <= end && !(e[0] == 0 && e[1] == 0 && (e[2] == 1 || e[2] == 0)))
+		e++;
+	if(e + 3 > end)
+		e = end;
+	*p = e;
+	*nal = s;
+	while(e > s && e[-1] == 0)
+		e--;
+	return e - s;
+}
+
+static int put_be16(struct buffer *buf, unsigned v)
+{
+	uint8_t bytes[2] = {v >> 8, v};
+	return buffer_append(buf, bytes, sizeof(bytes));
+}
+
+/**
+ * Build an AVCDecoderConfigurationRecord from the parameter sets of a frame.
+ */
+static int build_avcc(struct buffer *avcc, const uint8_t **sps, const size_t *spssizes,
+		size_t numsps, const uint8_t **pps, const size_t *ppssizes, size_t numpps)
+{
+	if(spssizes[0] < 4)
+		return 0;
+	uint8_t header[6] = {1, sps[0][1], sps[0][2], sps[0][3], 0xff, 0xe0 | numsps};
+	if(buffer_append(avcc, header, sizeof(header)) < 0)
+		return -1;
+	for(size_t i = 0; i < numsps; i++)
+		if(put_be16(avcc, spssizes[i]) < 0 || buffer_append(avcc, sps[i], spssizes[i]) < 0)
+			return -1;
+	uint8_t n = numpps;
+	if(buffer_append(avcc, &n, 1) < 0)
+		return -1;
+	for(size_t i = 0; i < numpps; i++)
+		if(put_be16(avcc, ppssizes[i]) < 0 || buffer_append(avcc, pps[i], ppssizes[i]) < 0)
+			return -1;
+
+	// high profiles carry the chroma format and bit depths
+	uint8_t profile = sps[0][1];
+	if(profile == 100 || profile == 110 || profile == 122 || profile == 144)
+	{
+		uint8_t rbsp[64];
+		size_t size = unescape_nal(rbsp, sps[0], spssizes[0] < sizeof(rbsp) ? spssizes[0] : sizeof(rbsp));
+		struct bits b = {rbsp, size, 32};
+		read_ue(&b); // seq_parameter_set_id
+		unsigned chroma = read_ue(&b);
+		if(chroma == 3)
+			read_bits(&b, 1); // separate_colour_plane_flag
+		unsigned luma   = read_ue(&b);
+		unsigned chroma_depth = read_ue(&b);
+		uint8_t ext[4] = {0xfc | (chroma & 3), 0xf8 | (luma & 7), 0xf8 | (chroma_depth & 7), 0};
+		if(buffer_append(avcc, ext, sizeof(ext)) < 0)
+			return -1;
+	}
+	return 1;
+}
+
+/**
+ * Build an HEVCDecoderConfigurationRecord from the parameter sets of a frame.
+ */
+static int build_hvcc(struct buffer *hvcc, const uint8_t **nals, const size_t *sizes,
+		const uint8_t *types, size_t numnals)
+{
+	const uint8_t *sps = NULL;
+	size_t spssize = 0;
+	for(size_t i = 0; i < numnals; i++)
+		if(types[i] == 33)
+		{
+			sps     = nals[i];
+			spssize = sizes[i];
+			break;
+		}
+	if(!sps)
+		return 0;
+
+	uint8_t rbsp[128];
+	size_t size = unescape_nal(rbsp, sps, spssize < sizeof(rbsp) ? spssize : sizeof(rbsp));
+	if(size < 15)
+		return 0;
+	struct bits b = {rbsp, size, 16};
+	read_bits(&b, 4); // sps_video_parameter_set_id
+	unsigned sublayers = read_bits(&b, 3);
+	unsigned nested    = read_bits(&b, 1);
+	b.pos += 96; // general profile_tier_level
+	unsigned profile_present[8];
+	unsigned level_present[8];
+	for(unsigned i = 0; i < sublayers; i++)
+	{
+		profile_present[i] = read_bits(&b, 1);
+		level_present[i]   = read_bits(&b, 1);
+	}
+	if(sublayers > 0)
+		b.pos += 2 * (8 - sublayers);
+	for(unsigned i = 0; i < sublayers; i++)
+		b.pos += (profile_present[i] ? 88 : 0) + (level_present[i] ? 8 : 0);
+	read_ue(&b); // sps_seq_parameter_set_id
+	unsigned chroma = read_ue(&b);
+	if(chroma == 3)
+		read_bits(&b, 1); // separate_colour_plane_flag
+	read_ue(&b); // pic_width_in_luma_samples
+	read_ue(&b); // pic_height_in_luma_samples
+	if(read_bits(&b, 1)) // conformance_window_flag
+		for(int i = 0; i < 4; i++)
+			read_ue(&b);
+	unsigned luma         = read_ue(&b);
+	unsigned chroma_depth = read_ue(&b);
+
+	uint8_t header[23];
+	header[0] = 1;
+	memcpy(header + 1, rbsp + 3, 12); // general profile, compatibility, constraints, level
+	header[13] = 0xf0;
+	header[14] = 0x00;
+	header[15] = 0xfc;
+	header[16] = 0xfc | (chroma & 3);
+	header[17] = 0xf8 | (luma & 7);
+	header[18] = 0xf8 | (chroma_depth & 7);
+	header[19] = 0;
+	header[20] = 0;
+	header[21] = (sublayers + 1) << 3 | nested << 2 | 3;
+	header[22] = 0;
+	if(buffer_append(hvcc, header, sizeof(header)) < 0)
+		return -1;
+
+	// arrays of VPS, SPS, and PPS
+	static const uint8_t array_types[] = {32, 33, 34};
+	for(size_t t = 0; t < sizeof(array_types); t++)
+	{
+		unsigned count = 0;
+		for(size_t i = 0; i < numnals; i++)
+			count += types[i] == array_types[t];
+		if(count == 0)
+			continue;
+		uint8_t type = 0x80 | array_types[t];
+		if(buffer_append(hvcc, &type, 1) < 0 || put_be16(hvcc, count) < 0)
+			return -1;
+		for(size_t i = 0; i < numnals; i++)
+			if(types[i] == array_types[t]
+					&& (put_be16(hvcc, sizes[i]) < 0 || buffer_append(hvcc, nals[i], sizes[i]) < 0))
+				return -1;
+		hvcc->data[22]++;
+	}
+	return 1;
+}
+
+#define MAX_PARAMETER_SETS 16
+
+/**
+ * Convert the Annex B access unit *data* to length-prefixed NAL units in
+ * *r->frame* and configure *track* from its parameter sets.
+ *
+ * Returns 1 if the access unit is a keyframe, 0 if not, or -1 on error.
+ */
+static int convert_nals(struct remux *r, struct track *track, const uint8_t *data, size_t size)
+{
+	int hevc = track->codec == CODEC_HEVC;
+	const uint8_t *params[MAX_PARAMETER_SETS];
+	size_t         paramsizes[MAX_PARAMETER_SETS];
+	uint8_t        paramtypes[MAX_PARAMETER_SETS];
+	size_t         numparams = 0;
+	int keyframe = 0;
+
+	r->frame.size = 0;
+	const uint8_t *p = data;
+	const uint8_t *end = data + size;
+	const uint8_t *nal;
+	for(size_t n; p < end;)
+	{
+		if((n = next_nal(&p, end, &nal)) == 0)
+			continue;
+		uint8_t type = hevc ? nal[0] >> 1 & 0x3f : nal[0] & 0x1f;
+		// access unit delimiters and filler data
+		if(hevc ? type == 35 || type == 38 : type == 9 || type == 12)
+			continue;
+		if(hevc ? type >= 16 && type <= 23 : type == 5 || type == 7)
+			keyframe = 1;
+		if((hevc ? type >= 32 && type <= 34 : type == 7 || type == 8)
+				&& numparams < MAX_PARAMETER_SETS)
+		{
+			params[numparams]     = nal;
+			paramsizes[numparams] = n;
+			paramtypes[numparams] = type;
+			numparams++;
+		}
+		uint8_t length[4] = {n >> 24, n >> 16, n >> 8, n};
+		if(buffer_append(&r->frame, length, sizeof(length)) < 0
+				|| buffer_append(&r->frame, nal, n) < 0)
+			return -1;
+	}
+
+	if(!track->configured && keyframe && numparams > 0)
+	{
+		int err;
+		if(hevc)
+			err = build_hvcc(&track->codec_private, params, paramsizes, paramtypes, numparams);
+		else
+		{
+			const uint8_t *sps[MAX_PARAMETER_SETS];
+			const uint8_t *pps[MAX_PARAMETER_SETS];
+			size_t spssizes[MAX_PARAMETER_SETS];
+			size_t ppssizes[MAX_PARAMETER_SETS];
+			size_t numsps = 0;
+			size_t numpps = 0;
+			for(size_t i = 0; i < numparams; i++)
+				if(paramtypes[i] == 7)
+					sps[numsps] = params[i], spssizes[numsps++] = paramsizes[i];
+				else
+					pps[numpps] = params[i], ppssizes[numpps++] = paramsizes[i];
+			err = numsps > 0 && numpps > 0
+					? build_avcc(&track->codec_private, sps, spssizes, numsps, pps, ppssizes, numpps)
+					: 0;
+		}
+		if(err < 0)
+			return -1;
+		if(err == 0)
+			track->codec_private.size = 0;
+		track->configured = err > 0;
+	}
+	return keyframe;
+}
+
+/**
+ * Configure an MPEG-2 video *track* from the sequence header in *data*.
+ * Returns 1 if *data* contains a sequence header, 0 if not, or -1 on error.
+ */
+static int configure_mpeg2(struct track *track, const uint8_t *data, size_t size)
+{
+	const uint8_t *start = NULL;
+	for(size_t i = 0; i + 4 <= size; i++)
+		if(data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+		{
+			if(start && data[i + 3] != 0xb5) // sequence extension
+			{
+				if(!track->configured)
+				{
+					if(buffer_append(&track->codec_private, start, data + i - start) < 0)
+						return -1;
+					track->configured = 1;
+				}
+				return 1;
+			}
+			else if(data[i + 3] == 0xb3)
+				start = data + i;
+		}
+	return 0;
+}
+
+static uint64_t ticks2ns(uint64_t ticks)
+{
+	return ticks * 100000 / 9;
+}
+
+static int write_header(struct remux *r)
+{
+	static const struct {
+		unsigned width;
+		unsigned height;
+		int      interlaced;
+	} formats[] = {
+		[BLURAY_VIDEO_FORMAT_480I]  = { 720,  480, 1},
+		[BLURAY_VIDEO_FORMAT_576I]  = { 720,  576, 1},
+		[BLURAY_VIDEO_FORMAT_480P]  = { 720,  480, 0},
+		[BLURAY_VIDEO_FORMAT_1080I] = {1920, 1080, 1},
+		[BLURAY_VIDEO_FORMAT_720P]  = {1280,  720, 0},
+		[BLURAY_VIDEO_FORMAT_1080P] = {1920, 1080, 0},
+		[BLURAY_VIDEO_FORMAT_576P]  = { 720,  576, 0},
+		[8]                         = {3840, 2160, 0}  // BLURAY_VIDEO_FORMAT_2160P
+	};
+	static const uint64_t frame_durations[] = {
+		[BLURAY_VIDEO_RATE_24000_1001] = 41708333,
+		[BLURAY_VIDEO_RATE_24]         = 41666667,
+		[BLURAY_VIDEO_RATE_25]         = 40000000,
+		[BLURAY_VIDEO_RATE_30000_1001] = 33366667,
+		[BLURAY_VIDEO_RATE_50]         = 20000000,
+		[BLURAY_VIDEO_RATE_60000_1001] = 16683333
+	};
+	static const char *const codec_ids[] = {
+		[CODEC_H264]   = "V_MPEG4/ISO/AVC",
+		[CODEC_HEVC]   = "V_MPEGH/ISO/HEVC",
+		[CODEC_MPEG2]  = "V_MPEG2",
+		[CODEC_AC3]    = "A_AC3",
+		[CODEC_EAC3]   = "A_EAC3",
+		[CODEC_DTS]    = "A_DTS",
+		[CODEC_TRUEHD] = "A_TRUEHD",
+		[CODEC_LPCM]   = "A_PCM/INT/BIG",
+		[CODEC_PGS]    = "S_HDMV/PGS"
+	};
+
+	struct mkv_track   *tracks   = calloc(r->numtracks + 1, sizeof(*tracks));
+	struct mkv_chapter *chapters = calloc(r->title->chapter_count + 1, sizeof(*chapters));
+	int err = -1;
+	if(!tracks || !chapters)
+		goto cleanup;
+
+	size_t numtracks = 0;
+	for(size_t i = 0; i < r->numtracks; i++)
+	{
+		struct track *track = r->tracks + i;
+		const BLURAY_STREAM_INFO *info = track->stream->info;
+		int video = track->codec == CODEC_H264 || track->codec == CODEC_HEVC
+				|| track->codec == CODEC_MPEG2;
+		if(!track->configured)
+		{
+			r->dropped++;
+			continue;
+		}
+
+		struct mkv_track *t = tracks + numtracks++;
+		track->number         = numtracks;
+		t->number             = numtracks;
+		t->codec_id           = codec_ids[track->codec];
+		t->codec_private      = track->codec_private.data;
+		t->codec_private_size = track->codec_private.size;
+		t->language           = track->stream->language;
+		if(video)
+		{
+			t->type = MKV_TRACK_VIDEO;
+			if(info->format < sizeof(formats) / sizeof(*formats) && formats[info->format].width)
+			{
+				t->width      = formats[info->format].width;
+				t->height     = formats[info->format].height;
+				t->interlaced = formats[info->format].interlaced;
+			}
+			else
+			{
+				t->width  = 1920;
+				t->height = 1080;
+			}
+			if(info->rate < sizeof(frame_durations) / sizeof(*frame_durations))
+				t->default_duration = frame_durations[info->rate];
+			// only standard definition is anamorphic
+			if(t->width == 720 && (info->aspect == BLURAY_ASPECT_RATIO_4_3
+					|| info->aspect == BLURAY_ASPECT_RATIO_16_9))
+			{
+				t->display_height = t->height;
+				t->display_width  = info->aspect == BLURAY_ASPECT_RATIO_4_3
+						? t->height * 4 / 3 : t->height * 16 / 9;
+			}
+		}
+		else if(track->codec == CODEC_PGS)
+			t->type = MKV_TRACK_SUBTITLE;
+		else
+		{
+			t->type = MKV_TRACK_AUDIO;
+			switch(info->rate)
+			{
+			case BLURAY_AUDIO_RATE_96:
+			case BLURAY_AUDIO_RATE_96_COMBO:
+				t->sampling_frequency = 96000;
+				break;
+			case BLURAY_AUDIO_RATE_192:
+			case BLURAY_AUDIO_RATE_192_COMBO:
+				t->sampling_frequency = 192000;
+				break;
+			default:
+				t->sampling_frequency = 48000;
+			}
+			// the exact layout of multi-channel streams is in their bitstream
+			t->channels  = info->format == BLURAY_AUDIO_FORMAT_MONO ? 1
+					: info->format == BLURAY_AUDIO_FORMAT_STEREO ? 2 : 6;
+			t->bit_depth = track->bit_depth;
+		}
+	}
+
+	for(uint32_t i = 0; i < r->title->chapter_count; i++)
+	{
+		const BLURAY_TITLE_CHAPTER *chapter = r->title->chapters + i;
+		chapters[i].start = ticks2ns(chapter->start);
+		chapters[i].end   = ticks2ns(chapter->start + chapter->duration);
+	}
+
+	if(mkv_write_header(r->mkv, tracks, numtracks, chapters, r->title->chapter_count,
+			ticks2ns(r->title->duration)) < 0)
+		goto cleanup;
+	r->header_written = 1;
+
+	// write the frames queued so far
+	for(size_t i = 0; i < r->numqueued; i++)
+	{
+		const struct queued_frame *frame = r->queue + i;
+		uint64_t number = r->tracks[frame->track].number;
+		if(number > 0 && mkv_write_block(r->mkv, number, frame->timestamp, frame->keyframe,
+				r->queued_data.data + frame->offset, frame->size) < 0)
+			goto cleanup;
+	}
+	free(r->queue);
+	free(r->queued_data.data);
+	r->queue       = NULL;
+	r->numqueued   = 0;
+	r->queued_data = (struct buffer){NULL, 0, 0};
+	err = 0;
+
+cleanup:
+	{
+		int errnum = errno;
+		free(tracks);
+		free(chapters);
+		errno = errnum;
+	}
+	return err;
+}
+
+static int all_configured(const struct remux *r)
+{
+	for(size_t i = 0; i < r->numtracks; i++)
+		if(!r->tracks[i].configured)
+			return 0;
+	return 1;
+}
+
+static int write_frame(struct remux *r, size_t track, uint64_t timestamp, int keyframe,
+		const uint8_t *data, size_t size)
+{
+	if(!r->header_written && (all_configured(r) || r->queued_data.size > MAX_QUEUED_SIZE))
+		if(write_header(r) < 0)
+			return -1;
+	if(r->header_written)
+	{
+		uint64_t number = r->tracks[track].number;
+		return number > 0 ? mkv_write_block(r->mkv, number, timestamp, keyframe, data, size) : 0;
+	}
+
+	struct queued_frame *grown = array_reserve(r->queue, r->numqueued, 1, sizeof(*r->queue));
+	if(!grown)
+		return -1;
+	r->queue = grown;
+	struct queued_frame *frame = r->queue + r->numqueued;
+	frame->track     = track;
+	frame->timestamp = timestamp;
+	frame->keyframe  = keyframe;
+	frame->offset    = r->queued_data.size;
+	frame->size      = size;
+	if(buffer_append(&r->queued_data, data, size) < 0)
+		return -1;
+	r->numqueued++;
+	return 0;
+}
+
+static int on_pes(const struct ts_pes *pes, void *data)
+{
+	struct remux *r = data;
+	size_t i = r->track_of_pid[pes->pid] - 1;
+	struct track *track = r->tracks + i;
+	if(pes->pts == TS_NO_TIMESTAMP || pes->size == 0)
+		return 0;
+
+	// map the clip's timestamps to the title's
+	const BLURAY_CLIP_INFO *clip = r->title->clips + r->clip;
+	int64_t ts = (pes->pts - (int64_t)clip->in_time) & PTS_MASK;
+	if(ts >= INT64_C(1) << 32)
+		ts -= INT64_C(1) << 33;
+	ts += clip->start_time;
+	if(ts < 0)
+		return 0;
+	uint64_t timestamp = ticks2ns(ts);
+	if((uint64_t)ts > r->position)
+		r->position = ts;
+
+	const uint8_t *payload = pes->data;
+	size_t         size    = pes->size;
+	int keyframe = 1;
+	switch(track->codec)
+	{
+	case CODEC_H264:
+	case CODEC_HEVC:
+		if((keyframe = convert_nals(r, track, payload, size)) < 0)
+			return -1;
+		payload = r->frame.data;
+		size    = r->frame.size;
+		break;
+	case CODEC_MPEG2:
+		if((keyframe = configure_mpeg2(track, payload, size)) < 0)
+			return -1;
+		break;
+	case CODEC_TRUEHD:
+		// the AC3 frames of the embedded core are in their own PES packets
+		if(size >= 2 && payload[0] == 0x0b && payload[1] == 0x77)
+			return 0;
+		break;
+	case CODEC_LPCM:
+		if(size < 4)
+			return 0;
+		if(!track->configured)
+		{
+			// 20-bit samples are stored in 24 bits
+			track->bit_depth  = payload[3] >> 6 == 1 ? 16 : 24;
+			track->configured = 1;
+		}
+		payload += 4;
+		size    -= 4;
+		break;
+	default:
+		break;
+	}
+
+	// decoding can only start at a keyframe
+	if(!track->started && !(keyframe && track->configured))
+		return 0;
+	track->started = 1;
+	if(track->codec == CODEC_H264 || track->codec == CODEC_HEVC || track->codec == CODEC_MPEG2)
+		r->numframes++;
+	return write_frame(r, i, timestamp, keyframe, payload, size);
+}
+
+static void set_clip(struct remux *r, uint32_t clip)
+{
+	if(clip < r->title->clip_count)
+		r->clip = clip;
+}
+
+/**
+ * Report the progress of *r* to *fd* if it is not -1 and at least
+ * PROGRESS_INTERVAL milliseconds passed since *\*last* or *done* is set.
+ */
+static int report_progress(const struct remux *r, int fd, uint64_t bytes,
+		const struct timespec *start, struct timespec *last, int done)
+{
+	if(fd < 0)
+		return 0;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(!done && (now.tv_sec - last->tv_sec) * 1000
+			+ (now.tv_nsec - last->tv_nsec) / 1000000 < PROGRESS_INTERVAL)
+		return 0;
+	*last = now;
+	double elapsed = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+	return progress_write(fd, bytes, r->position, elapsed > 0 ? r->numframes / elapsed : 0,
+			done);
+}
+
+/**
+ * Set up *r* to remux *streams* of *title* to the Matroska file *dst* with its
+ * own demultiplexer. *r* has to be freed with remux_free, even on error.
+ */
+static int remux_open(struct remux *r, const BLURAY_TITLE_INFO *title,
+		const struct remux_stream *streams, size_t numstreams, const char *dst)
+{
+	memset(r, 0, sizeof(*r));
+	r->title = title;
+	if(!(r->tracks = calloc(numstreams + 1, sizeof(*r->tracks)))
+			|| !(r->ts = ts_demux_new(on_pes, r)))
+		return -1;
+	for(size_t i = 0; i < numstreams; i++)
+	{
+		struct track *track = r->tracks + r->numtracks;
+		uint16_t pid = streams[i].info->pid & 0x1fff;
+		// a PID is only demultiplexed once
+		if(r->track_of_pid[pid])
+			continue;
+		track->stream = streams + i;
+		track->codec  = get_codec(streams[i].info);
+		track->configured = track->codec != CODEC_H264 && track->codec != CODEC_HEVC
+				&& track->codec != CODEC_MPEG2 && track->codec != CODEC_LPCM;
+		if(ts_demux_add_pid(r->ts, pid) < 0)
+			return -1;
+		r->track_of_pid[pid] = ++r->numtracks;
+	}
+	return (r->mkv = mkv_create(dst)) ? 0 : -1;
+}
+
+/**
+ * Write the pending frames of *r* and close its file. Returns the number of
+ * dropped streams or -1 with errno set. The file is removed if streams were
+ * dropped, since it lacks selected streams.
+ */
+static int remux_close(struct remux *r)
+{
+	if(ts_demux_flush(r->ts) < 0)
+		return -1;
+	if(!r->header_written && write_header(r) < 0)
+		return -1;
+	struct mkv *mkv = r->mkv;
+	r->mkv = NULL;
+	if(r->dropped > 0)
+	{
+		mkv_abort(mkv);
+		return r->dropped;
+	}
+	return mkv_close(mkv) < 0 ? -1 : 0;
+}
+
+/**
+ * Free *r*, its file is removed unless it was closed.
+ */
+static void remux_free(struct remux *r)
+{
+	if(r->mkv)
+		mkv_abort(r->mkv);
+	ts_demux_free(r->ts);
+	for(size_t i = 0; i < r->numtracks; i++)
+		free(r->tracks[i].codec_private.data);
+	free(r->tracks);
+	free(r->queue);
+	free(r->queued_data.data);
+	free(r->frame.data);
+}
+
+int remux_title(const char *src, const BLURAY_TITLE_INFO *title,
+		const struct remux_stream *streams, size_t numstreams, const char *dst,
+		int progressfd)
+{
+	struct remux r;
+	BLURAY  *bd  = NULL;
+	uint8_t *buf = malloc(READ_SIZE);
+	int err = -1;
+	if(remux_open(&r, title, streams, numstreams, dst) < 0 || !buf)
+		goto cleanup;
+
+	err = -2;
+	if(!(bd = bd_open(src, NULL)) || !bd_select_playlist(bd, title->playlist))
+		goto cleanup;
+	// clip changes are reported as events
+	bd_get_event(bd, NULL);
+
+	err = -1;
+	struct timespec start, last;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	last = start;
+	uint64_t bytes = 0;
+	// bytes read of the current clip
+	uint64_t clip_bytes = 0;
+	while(1)
+	{
+		// aligned units never span clips, but reads of several units might, so
+		// the end of a clip is read one unit at a time to catch its clip change
+		uint64_t clip_size = (uint64_t)title->clips[r.clip].pkt_count * TS_PACKET_SIZE;
+		int n = bd_read(bd, buf, clip_bytes + READ_SIZE + 2 * ALIGNED_UNIT_SIZE <= clip_size
+				? READ_SIZE : ALIGNED_UNIT_SIZE);
+		if(n < 0)
+		{
+			err = -2;
+			goto cleanup;
+		}
+		if(n == 0)
+			break;
+
+		clip_bytes += n;
+		BD_EVENT event;
+		while(bd_get_event(bd, &event))
+			if(event.event == BD_EVENT_PLAYITEM && event.param != r.clip)
+			{
+				if(ts_demux_flush(r.ts) < 0)
+					goto cleanup;
+				set_clip(&r, event.param);
+				clip_bytes = n;
+			}
+		if(ts_demux_feed(r.ts, buf, n) < 0)
+			goto cleanup;
+		bytes += n;
+		if(report_progress(&r, progressfd, bytes, &start, &last, 0) < 0)
+			goto cleanup;
+	}
+	int dropped = remux_close(&r);
+	if(dropped < 0 || report_progress(&r, progressfd, bytes, &start, &last, 1) < 0)
+		goto cleanup;
+	err = dropped;
+
+cleanup:
+	{
+		int errnum = errno;
+		if(bd)
+			bd_close(bd);
+		remux_free(&r);
+		free(buf);
+		errno = errnum;
+	}
+	return err;
+}
+
+/**
+ * Read the source packets the clip *j* of the angle *a* of *r* plays from the
+ * Blu-ray directory *root* and feed them to every angle that plays the same
+ * clip. *\*bytes* is advanced by the bytes read.
+ *
+ * Returns 0, -1 on error with errno set or -2 if the clip information file
+ * could not be parsed.
+ */
+static int feed_angle_clip(const char *root, struct remux *r, size_t numangles, size_t a,
+		uint32_t j, uint8_t *buf, uint64_t *bytes, int progressfd,
+		const struct timespec *start, struct timespec *last)
+{
+	const BLURAY_CLIP_INFO *clip = r[a].title->clips + j;
+	uint32_t first, end;
+	int err = bdmv_clip_packets(root, clip->clip_id, clip->in_time, clip->out_time, &first, &end);
+	if(err < 0)
+		return err;
+	char *path;
+	if(asprintf(&path, "%s/BDMV/STREAM/%s.m2ts", root, clip->clip_id) < 0)
+		return -1;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+	if(fd < 0)
+		return -1;
+
+	err = -1;
+	off_t offset = (off_t)first * TS_PACKET_SIZE;
+	off_t stop   = (off_t)end * TS_PACKET_SIZE;
+	posix_fadvise(fd, offset, stop - offset, POSIX_FADV_SEQUENTIAL);
+	while(offset < stop)
+	{
+		ssize_t n = pread(fd, buf, stop - offset < READ_SIZE ? stop - offset
+				: READ_SIZE, offset);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+			goto out;
+		n -= n % TS_PACKET_SIZE;
+		if(n == 0)
+			break;
+		offset += n;
+		for(size_t b = a; b < numangles; b++)
+			if(strcmp(r[b].title->clips[j].clip_id, clip->clip_id) == 0
+					&& ts_demux_feed(r[b].ts, buf, n) < 0)
+				goto out;
+		*bytes += n;
+		if(report_progress(r, progressfd, *bytes, start, last, 0) < 0)
+			goto out;
+	}
+	err = 0;
+
+out:
+	{
+		int errnum = errno;
+		close(fd);
+		errno = errnum;
+	}
+	return err;
+}
+
+int remux_angles(const char *root, BLURAY_TITLE_INFO *const *titles, size_t numangles,
+		const struct remux_stream *streams, size_t numstreams, char *const *dsts,
+		int progressfd)
+{
+	for(size_t a = 1; a < numangles; a++)
+		if(titles[a]->clip_count != titles[0]->clip_count)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+	struct remux *r = calloc(numangles + 1, sizeof(*r));
+	uint8_t *buf = malloc(READ_SIZE);
+	size_t numopen = 0;
+	int err = -1;
+	if(!r || !buf)
+		goto cleanup;
+	for(; numopen < numangles; numopen++)
+		if(remux_open(r + numopen, titles[numopen], streams, numstreams, dsts[numopen]) < 0)
+		{
+			numopen++;
+			goto cleanup;
+		}
+
+	struct timespec start, last;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	last = start;
+	uint64_t bytes = 0;
+	for(uint32_t j = 0; j < titles[0]->clip_count; j++)
+	{
+		for(size_t a = 0; a < numangles; a++)
+			set_clip(r + a, j);
+		for(size_t a = 0; a < numangles; a++)
+		{
+			// every clip is read once for all angles that play it
+			size_t b = 0;
+			while(b < a && strcmp(titles[b]->clips[j].clip_id, titles[a]->clips[j].clip_id) != 0)
+				b++;
+			if(b < a)
+				continue;
+			if((err = feed_angle_clip(root, r, numangles, a, j, buf, &bytes, progressfd,
+					&start, &last)) < 0)
+				goto cleanup;
+		}
+		err = -1;
+		for(size_t a = 0; a < numangles; a++)
+			if(ts_demux_flush(r[a].ts) < 0)
+				goto cleanup;
+	}
+
+	int dropped = 0;
+	for(size_t a = 0; a < numangles; a++)
+	{
+		int n = remux_close(r + a);
+		if(n < 0)
+			goto cleanup;
+		dropped += n;
+	}
+	if(report_progress(r, progressfd, bytes, &start, &last, 1) < 0)
+		goto cleanup;
+	err = dropped;
+
+cleanup:
+	{
+		int errnum = errno;
+		for(size_t a = 0; a < numopen; a++)
+			remux_free(r + a);
+		free(r);
+		free(buf);
+		errno = errnum;
+	}
+	return err;
+}
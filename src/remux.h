@@ -0,0 +1,71 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REMUX_H_INCLUDED
+#define REMUX_H_INCLUDED
+
+#include <stddef.h>
+
+#include <libbluray/bluray.h>
+
+/**
+ * A stream to remux and its ISO 639-2/B language or "".
+ */
+struct remux_stream {
+	const BLURAY_STREAM_INFO *info;
+	char                      language[4];
+};
+
+/**
+ * Test if the built-in remuxer can write *stream* to Matroska.
+ */
+int remux_stream_supported(const BLURAY_STREAM_INFO *stream);
+
+/**
+ * Remux *streams* of *title* from the Blu-ray *src* to the Matroska file *dst*
+ * without ffmpeg. The title is read with bd_read, demultiplexed by the PIDs
+ * of *streams*, and written with the chapters of *title*. All *streams* must
+ * be supported. If *progressfd* is not -1, the progress is written to it in the
+ * format of ffmpeg's -progress option, with the bytes read as total_size.
+ *
+ * Returns the number of video and LPCM streams that were dropped because no
+ * codec configuration was found, -1 on error with errno set or -2 if
+ * libbluray failed. *dst* is removed unless 0 is returned.
+ */
+int remux_title(const char *src, const BLURAY_TITLE_INFO *title,
+		const struct remux_stream *streams, size_t numstreams, const char *dst,
+		int progressfd);
+
+/**
+ * Remux *streams* of the *numangles* angles of a title from the Blu-ray
+ * directory *root* to the Matroska files *dsts* in one pass, like remux_title
+ * would for each angle. *titles* are the title for each angle, *streams* are
+ * selected from the first, which all angles must share. Every clip is read
+ * from its M2TS file once and fed to all angles that play it, so only the
+ * clips of different angles are read separately.
+ *
+ * Returns the number of streams that were dropped in all angles, -1 on error
+ * with errno set or -2 if a clip information file could not be parsed. The
+ * file of an angle is removed if it is not finished or lacks streams.
+ */
+int remux_angles(const char *root, BLURAY_TITLE_INFO *const *titles, size_t numangles,
+		const struct remux_stream *streams, size_t numstreams, char *const *dsts,
+		int progressfd);
+
+#endif
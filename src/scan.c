@@ -0,0 +1,332 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bdmv.h"
+#include "scan.h"
+#include "ts.h"
+#include "util.h"
+
+/** source packets read at once */
+#define SCAN_BLOCK_PACKETS 1024
+/** arrival timestamps count at 27 MHz and wrap after 30 bits */
+#define ATS_CLOCK 27000000
+#define ATS_MASK  UINT32_C(0x3fffffff)
+
+/**
+ * The counters of a clip. *slots* maps every PID to its stream index + 1 or 0,
+ * so a packet is accounted with two lookups into small flat arrays.
+ */
+struct clip_counter {
+	uint8_t   slots[0x2000];
+	size_t    numstreams;
+	uint16_t  pids[UINT8_MAX];
+	uint64_t  bytes[UINT8_MAX];
+	uint64_t  window[UINT8_MAX];
+	uint64_t  peak[UINT8_MAX];
+	uint64_t  total;
+	uint64_t  total_window;
+	uint64_t  total_peak;
+	int       started;
+	uint32_t  last_ats;
+	uint64_t  elapsed;
+	uint64_t  window_end;
+};
+
+static void counter_add_streams(struct clip_counter *c, const BLURAY_STREAM_INFO *streams,
+		size_t n)
+{
+	for(size_t i = 0; i < n && c->numstreams < UINT8_MAX; i++)
+	{
+		uint16_t pid = streams[i].pid & 0x1fff;
+		if(c->slots[pid] == 0)
+		{
+			c->pids[c->numstreams] = pid;
+			c->slots[pid] = ++c->numstreams;
+		}
+	}
+}
+
+/**
+ * Fold the current window into the peaks.
+ */
+static void counter_close_window(struct clip_counter *c)
+{
+	for(size_t i = 0; i < c->numstreams; i++)
+	{
+		if(c->window[i] > c->peak[i])
+			c->peak[i] = c->window[i];
+		c->window[i] = 0;
+	}
+	if(c->total_window > c->total_peak)
+		c->total_peak = c->total_window;
+	c->total_window = 0;
+}
+
+static void counter_feed(struct clip_counter *c, const uint8_t *buf, size_t size)
+{
+	for(const uint8_t *p = buf, *end = buf + size; p < end; p += TS_PACKET_SIZE)
+	{
+		if(p[4] != 0x47)
+			continue;
+		uint32_t ats = ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3])
+				& ATS_MASK;
+		if(!c->started)
+		{
+			c->started    = 1;
+			c->window_end = ATS_CLOCK;
+		}
+		else
+			c->elapsed += (ats - c->last_ats) & ATS_MASK;
+		c->last_ats = ats;
+		if(c->elapsed >= c->window_end)
+		{
+			counter_close_window(c);
+			c->window_end = (c->elapsed / ATS_CLOCK + 1) * ATS_CLOCK;
+		}
+
+		c->total        += TS_PACKET_SIZE;
+		c->total_window += TS_PACKET_SIZE;
+		uint8_t slot = c->slots[(p[5] & 0x1f) << 8 | p[6]];
+		if(slot == 0)
+			continue;
+		// payload after the header and the adaptation field
+		size_t payload = 0;
+		switch(p[7] >> 4 & 3)
+		{
+		case 1:
+			payload = 184;
+			break;
+		case 3:
+			payload = p[8] < 183 ? 183 - p[8] : 0;
+			break;
+		}
+		c->bytes[slot - 1]  += payload;
+		c->window[slot - 1] += payload;
+	}
+}
+
+static uint64_t bits_per_second(uint64_t bytes, uint64_t ats_ticks)
+{
+	return ats_ticks > 0 ? (uint64_t)((double)bytes * 8 * ATS_CLOCK / ats_ticks) : 0;
+}
+
+/**
+ * Read the source packets from *start* up to *end* of the file *path*, or all
+ * if *end* is 0.
+ */
+static int counter_read(struct clip_counter *c, const char *path, uint32_t start, uint32_t end)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return -1;
+	uint8_t *buf = malloc(SCAN_BLOCK_PACKETS * TS_PACKET_SIZE);
+	int err = -1;
+	if(!buf)
+		goto out;
+	off_t offset = (off_t)start * TS_PACKET_SIZE;
+	off_t stop   = end > 0 ? (off_t)end * TS_PACKET_SIZE : -1;
+	posix_fadvise(fd, offset, stop < 0 ? 0 : stop - offset, POSIX_FADV_SEQUENTIAL);
+	size_t have = 0;
+	for(;;)
+	{
+		size_t want = SCAN_BLOCK_PACKETS * TS_PACKET_SIZE - have;
+		if(stop >= 0 && (off_t)want > stop - offset)
+			want = stop - offset;
+		if(want == 0 && have == 0)
+			break;
+		ssize_t n = want > 0 ? pread(fd, buf + have, want, offset) : 0;
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+			goto out;
+		offset += n;
+		have   += n;
+		size_t whole = have - have % TS_PACKET_SIZE;
+		counter_feed(c, buf, whole);
+		if(n == 0)
+			break;
+		memmove(buf, buf + whole, have - whole);
+		have -= whole;
+	}
+	err = 0;
+
+out:
+	{
+		int errnum = errno;
+		free(buf);
+		close(fd);
+		errno = errnum;
+	}
+	return err;
+}
+
+static int cmp_stream_scans(const void *a_, const void *b_)
+{
+	const struct stream_scan *a = a_;
+	const struct stream_scan *b = b_;
+	return (a->pid > b->pid) - (a->pid < b->pid);
+}
+
+/**
+ * Count the payload of the streams of *clip* in the packets it plays.
+ */
+static int scan_clip(const char *root, const BLURAY_CLIP_INFO *clip, struct clip_scan *scan)
+{
+	struct clip_counter *c = calloc(1, sizeof(*c));
+	if(!c)
+		return -1;
+	counter_add_streams(c, clip->video_streams,     clip->video_stream_count);
+	counter_add_streams(c, clip->sec_video_streams, clip->sec_video_stream_count);
+	counter_add_streams(c, clip->audio_streams,     clip->audio_stream_count);
+	counter_add_streams(c, clip->sec_audio_streams, clip->sec_audio_stream_count);
+	counter_add_streams(c, clip->pg_streams,        clip->pg_stream_count);
+	counter_add_streams(c, clip->ig_streams,        clip->ig_stream_count);
+
+	// the whole file is read if its entry points are unknown
+	uint32_t start = 0;
+	uint32_t end   = 0;
+	char *path = NULL;
+	int err = -1;
+	if(bdmv_clip_packets(root, clip->clip_id, clip->in_time, clip->out_time, &start, &end) == -1
+			|| asprintf(&path, "%s/BDMV/STREAM/%s.m2ts", root, clip->clip_id) < 0)
+		goto out;
+	if(counter_read(c, path, start, end) < 0)
+		goto out;
+	counter_close_window(c);
+	// streams without arrival timestamps are rated by the duration they play
+	uint64_t ticks = c->elapsed > 0 ? c->elapsed : (clip->out_time - clip->in_time) * 300;
+
+	if(!(scan->streams = malloc(c->numstreams * sizeof(*scan->streams) + 1)))
+		goto out;
+	scan->numstreams = c->numstreams;
+	for(size_t i = 0; i < c->numstreams; i++)
+		scan->streams[i] = (struct stream_scan){
+			.pid     = c->pids[i],
+			.bytes   = c->bytes[i],
+			.bitrate = bits_per_second(c->bytes[i], ticks),
+			.peak    = c->peak[i] * 8
+		};
+	qsort(scan->streams, scan->numstreams, sizeof(*scan->streams), cmp_stream_scans);
+	scan->bytes   = c->total;
+	scan->bitrate = bits_per_second(c->total, ticks);
+	scan->peak    = c->total_peak * 8;
+	err = 0;
+
+out:
+	{
+		int errnum = errno;
+		free(path);
+		free(c);
+		errno = errnum;
+	}
+	return err;
+}
+
+struct clip_job {
+	const BLURAY_CLIP_INFO *clip;
+	struct clip_scan       *scan;
+};
+
+struct scan_jobs {
+	const char      *root;
+	struct clip_job *jobs;
+};
+
+static void scan_clip_job(size_t i, void *data)
+{
+	const struct scan_jobs *s = data;
+	if(scan_clip(s->root, s->jobs[i].clip, s->jobs[i].scan) < 0)
+		s->jobs[i].scan->err = errno;
+}
+
+static int cmp_clip_jobs(const void *a_, const void *b_)
+{
+	const BLURAY_CLIP_INFO *a = ((const struct clip_job *)a_)->clip;
+	const BLURAY_CLIP_INFO *b = ((const struct clip_job *)b_)->clip;
+	uint64_t da = a->out_time - a->in_time;
+	uint64_t db = b->out_time - b->in_time;
+	return (da < db) - (da > db);
+}
+
+int scan_titles(const char *root, BLURAY_TITLE_INFO *const *titles, size_t numtitles,
+		size_t numthreads, struct title_scan *scans)
+{
+	size_t numjobs = 0;
+	for(size_t i = 0; i < numtitles; i++)
+	{
+		scans[i].numclips = titles[i]->clip_count;
+		if(!(scans[i].clips = calloc(titles[i]->clip_count + 1, sizeof(*scans[i].clips))))
+		{
+			while(i-- > 0)
+				free(scans[i].clips);
+			return -1;
+		}
+		numjobs += titles[i]->clip_count;
+	}
+
+	struct scan_jobs s = {root, malloc(numjobs * sizeof(*s.jobs) + 1)};
+	if(!s.jobs)
+		goto error;
+	for(size_t i = 0, n = 0; i < numtitles; i++)
+		for(uint32_t j = 0; j < titles[i]->clip_count; j++, n++)
+			s.jobs[n] = (struct clip_job){titles[i]->clips + j, scans[i].clips + j};
+	// the longest clips are read first, so no thread is left with one at the end
+	qsort(s.jobs, numjobs, sizeof(*s.jobs), cmp_clip_jobs);
+	int err = parallel_for(numjobs, numthreads, scan_clip_job, &s);
+	free(s.jobs);
+	if(err == 0)
+		return 0;
+	errno = err;
+
+error:
+	{
+		int errnum = errno;
+		for(size_t i = 0; i < numtitles; i++)
+			scan_free(scans + i);
+		errno = errnum;
+	}
+	return -1;
+}
+
+const struct stream_scan *scan_find_stream(const struct clip_scan *clip, uint16_t pid)
+{
+	if(clip->err)
+		return NULL;
+	struct stream_scan key = {.pid = pid};
+	return bsearch(&key, clip->streams, clip->numstreams, sizeof(*clip->streams),
+			cmp_stream_scans);
+}
+
+void scan_free(struct title_scan *scan)
+{
+	if(scan->clips)
+		for(uint32_t i = 0; i < scan->numclips; i++)
+			free(scan->clips[i].streams);
+	free(scan->clips);
+	scan->clips    = NULL;
+	scan->numclips = 0;
+}
@@ -0,0 +1,77 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCAN_H_INCLUDED
+#define SCAN_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+/**
+ * The payload of one stream of a clip. Rates are in bit/s, *peak* is the
+ * highest rate in any second of the clip.
+ */
+struct stream_scan {
+	uint16_t pid;
+	uint64_t bytes;
+	uint64_t bitrate;
+	uint64_t peak;
+};
+
+/**
+ * The source packets a clip of a title plays and the payload of its streams,
+ * sorted by PID. *err* is the error number if the clip could not be read.
+ */
+struct clip_scan {
+	uint64_t            bytes;
+	uint64_t            bitrate;
+	uint64_t            peak;
+	struct stream_scan *streams;
+	size_t              numstreams;
+	int                 err;
+};
+
+struct title_scan {
+	struct clip_scan *clips;
+	uint32_t          numclips;
+};
+
+/**
+ * Read the source packets every clip of the *numtitles* *titles* plays from
+ * the M2TS files of the Blu-ray directory *root* and count the payload of their
+ * streams. The clips are read by up to *numthreads* threads. The results for
+ * *titles[i]* are stored in *scans[i]*, which has to be freed with scan_free,
+ * even if a clip could not be read.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int scan_titles(const char *root, BLURAY_TITLE_INFO *const *titles, size_t numtitles,
+		size_t numthreads, struct title_scan *scans);
+
+/**
+ * Look up the stream with *pid* in *clip*. Returns NULL if the clip could not
+ * be read or does not list the stream.
+ */
+const struct stream_scan *scan_find_stream(const struct clip_scan *clip, uint16_t pid);
+
+void scan_free(struct title_scan *scan);
+
+#endif
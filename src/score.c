@@ -0,0 +1,211 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "score.h"
+#include "title.h"
+#include "util.h"
+
+/** clips shorter than this many ticks are suspicious segments */
+#define MIN_SEGMENT_DURATION (10 * 90000)
+/** plausible range of chapter gaps in ticks */
+#define MIN_CHAPTER_GAP      (60 * 90000)
+#define MAX_CHAPTER_GAP      (30 * 60 * 90000)
+
+static const struct {
+	double duration;
+	double reuse;
+	double order;
+	double segments;
+	double chapters;
+	double streams;
+} weights = {
+	.duration = 3,
+	.reuse    = 2,
+	.order    = 2,
+	.segments = 1,
+	.chapters = 1,
+	.streams  = 1
+};
+
+/** how often a clip ID is played by all titles together */
+struct clip_count {
+	const char *clip_id;
+	size_t      count;
+};
+
+struct score_job {
+	BLURAY_TITLE_INFO      **titles;
+	struct title_score      *scores;
+	uint64_t                 maxduration;
+	/** every distinct clip ID, sorted */
+	const struct clip_count *counts;
+	size_t                   numcounts;
+};
+
+static int cmp_clip_ids(const void *a, const void *b)
+{
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static int cmp_clip_counts(const void *key, const void *count)
+{
+	return strcmp(key, ((const struct clip_count *)count)->clip_id);
+}
+
+/**
+ * Share of the clips of *title* that are played only once on the whole
+ * Blu-ray. Decoys that repeat clips of the feature, or of each other, lose
+ * against a title that plays its clips exclusively.
+ */
+static double score_reuse(const BLURAY_TITLE_INFO *title, const struct clip_count *counts,
+		size_t numcounts)
+{
+	uint32_t unique = 0;
+	for(uint32_t i = 0; i < title->clip_count; i++)
+	{
+		const struct clip_count *c = bsearch(title->clips[i].clip_id, counts, numcounts,
+				sizeof(*counts), cmp_clip_counts);
+		if(c && c->count == 1)
+			unique++;
+	}
+	return (double)unique / title->clip_count;
+}
+
+static void score_title_job(size_t i, void *data)
+{
+	struct score_job *job = data;
+	const BLURAY_TITLE_INFO *title = job->titles[i];
+	struct title_score *score = job->scores + i;
+	memset(score, 0, sizeof(*score));
+	if(title->clip_count == 0)
+		return;
+
+	score->duration = job->maxduration > 0 ? (double)title->duration / job->maxduration : 0;
+	score->reuse    = score_reuse(title, job->counts, job->numcounts);
+
+	uint32_t ascending = 0;
+	uint32_t long_clips = 0;
+	uint32_t same = 0;
+	for(uint32_t j = 0; j < title->clip_count; j++)
+	{
+		const BLURAY_CLIP_INFO *clip = title->clips + j;
+		if(j > 0 && strcmp(title->clips[j - 1].clip_id, clip->clip_id) < 0)
+			ascending++;
+		if(clip->out_time - clip->in_time >= MIN_SEGMENT_DURATION)
+			long_clips++;
+		if(clip_streams_equal(title->clips, clip))
+			same++;
+	}
+	score->order    = title->clip_count > 1 ? (double)ascending / (title->clip_count - 1) : 1;
+	score->segments = (double)long_clips / title->clip_count;
+	score->streams  = (double)same / title->clip_count;
+
+	// a feature without chapters is possible but unusual
+	if(title->chapter_count < 2)
+		score->chapters = 0.5;
+	else
+	{
+		uint32_t plausible = 0;
+		for(uint32_t j = 1; j < title->chapter_count; j++)
+		{
+			uint64_t gap = title->chapters[j].start - title->chapters[j - 1].start;
+			if(gap >= MIN_CHAPTER_GAP && gap <= MAX_CHAPTER_GAP)
+				plausible++;
+		}
+		score->chapters = (double)plausible / (title->chapter_count - 1);
+	}
+
+	score->total = (weights.duration * score->duration + weights.reuse * score->reuse
+			+ weights.order * score->order + weights.segments * score->segments
+			+ weights.chapters * score->chapters + weights.streams * score->streams)
+			/ (weights.duration + weights.reuse + weights.order + weights.segments
+					+ weights.chapters + weights.streams);
+}
+
+int score_titles(BLURAY_TITLE_INFO **titles, size_t numtitles, size_t numthreads,
+		struct title_score *scores)
+{
+	struct score_job job = {
+		.titles      = titles,
+		.scores      = scores,
+		.maxduration = 0,
+		.counts      = NULL,
+		.numcounts   = 0
+	};
+	size_t numids = 0;
+	for(size_t i = 0; i < numtitles; i++)
+	{
+		if(titles[i]->duration > job.maxduration)
+			job.maxduration = titles[i]->duration;
+		numids += titles[i]->clip_count;
+	}
+
+	int err = -1;
+	const char **ids = malloc(numids * sizeof(*ids) + 1);
+	struct clip_count *counts = malloc(numids * sizeof(*counts) + 1);
+	if(!ids || !counts)
+		goto cleanup;
+	// clips are counted over all titles before they are scored in parallel
+	size_t n = 0;
+	for(size_t i = 0; i < numtitles; i++)
+		for(uint32_t j = 0; j < titles[i]->clip_count; j++)
+			ids[n++] = titles[i]->clips[j].clip_id;
+	qsort(ids, numids, sizeof(*ids), cmp_clip_ids);
+	for(size_t i = 0; i < numids; i++)
+		if(job.numcounts > 0 && strcmp(counts[job.numcounts - 1].clip_id, ids[i]) == 0)
+			counts[job.numcounts - 1].count++;
+		else
+			counts[job.numcounts++] = (struct clip_count){
+				.clip_id = ids[i],
+				.count   = 1
+			};
+	job.counts = counts;
+	if((errno = parallel_for(numtitles, numthreads, score_title_job, &job)))
+		goto cleanup;
+	err = 0;
+
+cleanup:
+	{
+		int errnum = errno;
+		free(ids);
+		free(counts);
+		errno = errnum;
+	}
+	return err;
+}
+
+size_t score_best(const struct title_score *scores, size_t numscores, size_t *numties)
+{
+	size_t best = 0;
+	*numties = 0;
+	for(size_t i = 1; i < numscores; i++)
+		if(scores[i].total > scores[best].total)
+		{
+			best     = i;
+			*numties = 0;
+		}
+		else if(scores[i].total == scores[best].total)
+			(*numties)++;
+	return best;
+}
@@ -0,0 +1,72 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCORE_H_INCLUDED
+#define SCORE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+/**
+ * How likely a title is the main feature. Every signal is in [0, 1], higher is
+ * more plausible, and *total* is their weighted mean.
+ */
+struct title_score {
+	double total;
+	/** duration relative to the longest title */
+	double duration;
+	/** share of clips that no title, including this one, plays again */
+	double reuse;
+	/** share of consecutive clips in ascending clip ID order */
+	double order;
+	/** share of clips that are at least 10 seconds long */
+	double segments;
+	/** share of chapter gaps of plausible length */
+	double chapters;
+	/** share of clips with the stream table of the first clip */
+	double streams;
+};
+
+/**
+ * The score of the title of *playlist* that was not selected as the main
+ * feature.
+ */
+struct playlist_score {
+	uint32_t           playlist;
+	struct title_score score;
+};
+
+/**
+ * Score all *titles* with up to *numthreads* threads.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int score_titles(BLURAY_TITLE_INFO **titles, size_t numtitles, size_t numthreads,
+		struct title_score *scores);
+
+/**
+ * Index of the title with the highest total score in *scores*, the first one
+ * if several are equal. The number of other titles with the same score is
+ * stored in *numties*.
+ */
+size_t score_best(const struct title_score *scores, size_t numscores, size_t *numties);
+
+#endif
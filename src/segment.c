@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+
+#include "segment.h"
+#include "util.h"
+
+ssize_t segment_title(const BLURAY_TITLE_INFO *title, uint32_t every,
+		struct segment **segments)
+{
+	if(every == 0)
+		every = 1;
+	size_t n = title->chapter_count / every + (title->chapter_count % every != 0);
+	struct segment *s = malloc(n * sizeof(*s) + 1);
+	if(!s)
+		return -1;
+	for(size_t i = 0; i < n; i++)
+	{
+		const BLURAY_TITLE_CHAPTER *first = title->chapters + i * every;
+		s[i].chapter = i * every;
+		s[i].start   = first->start;
+		// the last segment extends to the end of the title
+		uint64_t end = i + 1 < n ? first[every].start : title->duration;
+		s[i].duration = end > first->start ? end - first->start : 0;
+	}
+	*segments = s;
+	return n;
+}
+
+char *segment_output(const char *output, size_t i)
+{
+	char *name;
+	if(asprintf(&name, "%s.seg%03zu.mkv", output, i) < 0)
+		return NULL;
+	return name;
+}
+
+/**
+ * Print *s* quoted for a concat list to *f*. Quotes cannot be escaped inside
+ * quotes, so they are escaped between two quoted parts.
+ */
+static int print_quoted(FILE *f, const char *s)
+{
+	if(fputc('\'', f) == EOF)
+		return -1;
+	for(; *s; s++)
+		if(*s == '\'' ? fputs("'\\''", f) == EOF : fputc(*s, f) == EOF)
+			return -1;
+	return fputc('\'', f) == EOF ? -1 : 0;
+}
+
+int segment_print_list(FILE *f, char **outputs, const struct segment *segments,
+		size_t numsegments)
+{
+	if(fputs("ffconcat version 1.0\n", f) == EOF)
+		return -1;
+	for(size_t i = 0; i < numsegments; i++)
+		if(fputs("file ", f) == EOF || print_quoted(f, outputs[i]) < 0
+				|| fprintf(f, "\nduration %.6f\n", segments[i].duration / 90000.0) < 0)
+			return -1;
+	return 0;
+}
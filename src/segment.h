@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEGMENT_H_INCLUDED
+#define SEGMENT_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <libbluray/bluray.h>
+
+/**
+ * A part of a title that is remuxed on its own. It starts at chapter *chapter*,
+ * *start* ticks into the title, and is *duration* ticks long.
+ */
+struct segment {
+	uint32_t chapter;
+	uint64_t start;
+	uint64_t duration;
+};
+
+/**
+ * Split *title* at every *every*-th chapter. The segments are stored in
+ * *\*segments*, which has to be freed.
+ *
+ * Returns the number of segments, which is 0 if *title* has no chapters, or -1
+ * with errno set.
+ */
+ssize_t segment_title(const BLURAY_TITLE_INFO *title, uint32_t every,
+		struct segment **segments);
+
+/**
+ * Name of the file the *i*-th segment of the output *output* is remuxed to.
+ * The name has to be freed.
+ */
+char *segment_output(const char *output, size_t i);
+
+/**
+ * Print a list for ffmpeg's concat demuxer to *f* that joins the *numsegments*
+ * files *outputs* of *segments*. Their durations are taken from *segments*, so
+ * the joined timestamps match those of the title.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int segment_print_list(FILE *f, char **outputs, const struct segment *segments,
+		size_t numsegments);
+
+#endif
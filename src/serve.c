@@ -0,0 +1,449 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serve.h"
+#include "util.h"
+
+/** longest request line that is accepted */
+#define SERVE_MAX_REQUEST (64 << 10)
+/** milliseconds between checks for idle Blu-rays and signals */
+#define SERVE_TICK 1000
+/** milliseconds a client may take to send its request line */
+#define SERVE_REQUEST_TIMEOUT 30000
+
+/**
+ * An opened Blu-ray. *lock* is held by the request using *state*, *users*
+ * counts the requests holding or waiting for it.
+ */
+struct served_disc {
+	char           *path;
+	void           *state;
+	pthread_mutex_t lock;
+	size_t          users;
+	time_t          used;
+};
+
+/**
+ * A connected client, linked into the clients of its server while its thread
+ * runs.
+ */
+struct serve_client {
+	struct server       *server;
+	int                  fd;
+	struct serve_client *prev;
+	struct serve_client *next;
+};
+
+/**
+ * *lock* protects *discs* and their *users* and *used*, and *clients*, the
+ * connected clients, and *numclients*, the number of running request threads,
+ * whose end is signaled with *done*.
+ */
+struct server {
+	const struct serve_ops *ops;
+	void                   *data;
+	pthread_mutex_t         lock;
+	pthread_cond_t          done;
+	struct served_disc    **discs;
+	size_t                  numdiscs;
+	struct serve_client    *clients;
+	size_t                  numclients;
+};
+
+static volatile sig_atomic_t stop_serving = 0;
+
+static void handle_stop(int sig)
+{
+	(void)sig;
+	stop_serving = 1;
+}
+
+static time_t monotonic_seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+static void free_disc(struct server *server, struct served_disc *disc)
+{
+	if(disc->state)
+		server->ops->close(disc->state, server->data);
+	pthread_mutex_destroy(&disc->lock);
+	free(disc->path);
+	free(disc);
+}
+
+/**
+ * Remove the *i*th disc of *server*, whose lock has to be held.
+ */
+static void remove_disc(struct server *server, size_t i)
+{
+	free_disc(server, server->discs[i]);
+	server->discs[i] = server->discs[--server->numdiscs];
+}
+
+void *serve_acquire(struct server *server, const char *path)
+{
+	pthread_mutex_lock(&server->lock);
+	struct served_disc *disc = NULL;
+	for(size_t i = 0; i < server->numdiscs; i++)
+		if(strcmp(server->discs[i]->path, path) == 0)
+		{
+			disc = server->discs[i];
+			break;
+		}
+	if(!disc)
+	{
+		// the open discs are kept if the list cannot grow
+		struct served_disc **grown = array_reserve(server->discs, server->numdiscs, 1,
+				sizeof(*server->discs));
+		if(!grown)
+			goto error;
+		server->discs = grown;
+		if(!(disc = calloc(1, sizeof(*disc))))
+			goto error;
+		if(!(disc->path = strdup(path)))
+		{
+			free(disc);
+			goto error;
+		}
+		pthread_mutex_init(&disc->lock, NULL);
+		server->discs[server->numdiscs++] = disc;
+	}
+	disc->users++;
+	pthread_mutex_unlock(&server->lock);
+
+	// Blu-rays are opened outside of the server lock, concurrent requests for
+	// the same one wait for it instead of opening it again
+	pthread_mutex_lock(&disc->lock);
+	if(!disc->state && !(disc->state = server->ops->open(disc->path, server->data)))
+	{
+		int errnum = errno;
+		pthread_mutex_unlock(&disc->lock);
+		pthread_mutex_lock(&server->lock);
+		disc->users--;
+		pthread_mutex_unlock(&server->lock);
+		errno = errnum;
+		return NULL;
+	}
+	return disc->state;
+
+error:
+	{
+		int errnum = errno;
+		pthread_mutex_unlock(&server->lock);
+		errno = errnum;
+	}
+	return NULL;
+}
+
+void serve_release(struct server *server, void *state)
+{
+	pthread_mutex_lock(&server->lock);
+	for(size_t i = 0; i < server->numdiscs; i++)
+		if(server->discs[i]->state == state)
+		{
+			struct served_disc *disc = server->discs[i];
+			disc->users--;
+			disc->used = monotonic_seconds();
+			pthread_mutex_unlock(&disc->lock);
+			break;
+		}
+	pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * Close the Blu-rays of *server* that were not used for *idle_timeout*
+ * seconds and those that could not be opened.
+ */
+static void evict_discs(struct server *server, unsigned long idle_timeout)
+{
+	time_t now = monotonic_seconds();
+	pthread_mutex_lock(&server->lock);
+	for(size_t i = server->numdiscs; i-- > 0;)
+	{
+		struct served_disc *disc = server->discs[i];
+		if(disc->users == 0 && (!disc->state || (unsigned long)(now - disc->used) >= idle_timeout))
+			remove_disc(server, i);
+	}
+	pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * Read the request line of the client *fd*, split it at tabs, and pass it to
+ * the handler of *server*. A client that does not send its request within
+ * SERVE_REQUEST_TIMEOUT is dropped, so it does not hold its thread forever.
+ */
+static void serve_client(struct server *server, int fd)
+{
+	struct buffer line = {NULL, 0, 0};
+	char *nl;
+	while(!(nl = line.size > 0 ? memchr(line.data, '\n', line.size) : NULL))
+	{
+		if(line.size >= SERVE_MAX_REQUEST)
+		{
+			dprintf(fd, "error: request too long\n");
+			goto out;
+		}
+		if(buffer_reserve(&line, 4096) < 0)
+		{
+			dprintf(fd, "error: %s\n", strerror(errno));
+			goto out;
+		}
+		struct pollfd pfd = {
+			.fd     = fd,
+			.events = POLLIN
+		};
+		int ready = poll(&pfd, 1, SERVE_REQUEST_TIMEOUT);
+		if(ready < 0 && errno == EINTR)
+			continue;
+		if(ready == 0)
+			dprintf(fd, "error: request timed out\n");
+		if(ready <= 0)
+			goto out;
+		// one byte is kept to terminate a request ended by end of file
+		ssize_t n = read(fd, line.data + line.size, line.capacity - line.size - 1);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0 || (n == 0 && line.size == 0))
+			goto out;
+		if(n == 0)
+			line.data[line.size++] = '\n';
+		else
+			line.size += n;
+	}
+	*nl = '\0';
+	if(nl > (char *)line.data && nl[-1] == '\r')
+		nl[-1] = '\0';
+
+	char **args = NULL;
+	size_t numargs = 0;
+	for(char *field = (char *)line.data, *end; field; field = end ? end + 1 : NULL)
+	{
+		if((end = strchr(field, '\t')))
+			*end = '\0';
+		char **grown = array_reserve(args, numargs, 2, sizeof(*args));
+		if(!grown)
+		{
+			dprintf(fd, "error: %s\n", strerror(errno));
+			free(args);
+			goto out;
+		}
+		args = grown;
+		args[numargs++] = field;
+	}
+	args[numargs] = NULL;
+	server->ops->handle(server, fd, args, numargs, server->data);
+	free(args);
+
+out:
+	free(line.data);
+}
+
+static void *client_thread(void *data)
+{
+	struct serve_client *client = data;
+	struct server *server = client->server;
+	serve_client(server, client->fd);
+
+	// the server must not shut down the descriptor once it is closed
+	pthread_mutex_lock(&server->lock);
+	if(client->prev)
+		client->prev->next = client->next;
+	else
+		server->clients = client->next;
+	if(client->next)
+		client->next->prev = client->prev;
+	server->numclients--;
+	pthread_cond_signal(&server->done);
+	pthread_mutex_unlock(&server->lock);
+	close(client->fd);
+	free(client);
+	return NULL;
+}
+
+/**
+ * Bind *sock* to *addr*. If another server is not listening on it anymore,
+ * its socket is replaced.
+ */
+static int bind_socket(int sock, const struct sockaddr_un *addr)
+{
+	if(bind(sock, (const struct sockaddr *)addr, sizeof(*addr)) == 0)
+		return 0;
+	if(errno != EADDRINUSE)
+		return -1;
+
+	int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(probe < 0)
+		return -1;
+	int live = connect(probe, (const struct sockaddr *)addr, sizeof(*addr)) == 0
+			|| errno != ECONNREFUSED;
+	close(probe);
+	if(live)
+	{
+		errno = EADDRINUSE;
+		return -1;
+	}
+	if(unlink(addr->sun_path) < 0)
+		return -1;
+	return bind(sock, (const struct sockaddr *)addr, sizeof(*addr));
+}
+
+int serve(const char *path, const struct serve_ops *ops, unsigned long idle_timeout,
+		void *data)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if(strlen(path) >= sizeof(addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(sock < 0)
+		return -1;
+	if(bind_socket(sock, &addr) < 0 || listen(sock, SOMAXCONN) < 0)
+	{
+		int errnum = errno;
+		close(sock);
+		errno = errnum;
+		return -1;
+	}
+
+	struct server server = {
+		.ops        = ops,
+		.data       = data,
+		.lock       = PTHREAD_MUTEX_INITIALIZER,
+		.done       = PTHREAD_COND_INITIALIZER,
+		.discs      = NULL,
+		.numdiscs   = 0,
+		.clients    = NULL,
+		.numclients = 0
+	};
+
+	// clients that disconnect early must not kill the server, signals are
+	// only received by this thread
+	struct sigaction act = {.sa_handler = handle_stop};
+	sigemptyset(&act.sa_mask);
+	struct sigaction oldint, oldterm, oldpipe;
+	sigaction(SIGINT, &act, &oldint);
+	sigaction(SIGTERM, &act, &oldterm);
+	act.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &act, &oldpipe);
+	sigset_t stopsigs, oldsigs;
+	sigemptyset(&stopsigs);
+	sigaddset(&stopsigs, SIGINT);
+	sigaddset(&stopsigs, SIGTERM);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	int err = 0;
+	while(!stop_serving)
+	{
+		struct pollfd fd = {
+			.fd     = sock,
+			.events = POLLIN
+		};
+		int n = poll(&fd, 1, SERVE_TICK);
+		evict_discs(&server, idle_timeout);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+		{
+			err = errno;
+			break;
+		}
+		if(n == 0)
+			continue;
+
+		struct serve_client *client = malloc(sizeof(*client));
+		int clientfd = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+		if(clientfd < 0 || !client)
+		{
+			if(clientfd >= 0)
+				close(clientfd);
+			free(client);
+			continue;
+		}
+		client->server = &server;
+		client->fd     = clientfd;
+		client->prev   = NULL;
+
+		pthread_t thread;
+		pthread_sigmask(SIG_BLOCK, &stopsigs, &oldsigs);
+		pthread_mutex_lock(&server.lock);
+		// linked before the thread starts, which unlinks it under the same lock
+		client->next = server.clients;
+		int errnum = pthread_create(&thread, &attr, client_thread, client);
+		if(errnum == 0)
+		{
+			if(server.clients)
+				server.clients->prev = client;
+			server.clients = client;
+			server.numclients++;
+		}
+		pthread_mutex_unlock(&server.lock);
+		pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+		if(errnum != 0)
+		{
+			dprintf(clientfd, "error: %s\n", strerror(errnum));
+			close(clientfd);
+			free(client);
+		}
+	}
+
+	close(sock);
+	unlink(path);
+	// clients blocked on reading their request or on receiving their answer
+	// are cut off instead of being waited for
+	pthread_mutex_lock(&server.lock);
+	for(struct serve_client *client = server.clients; client; client = client->next)
+		shutdown(client->fd, SHUT_RDWR);
+	while(server.numclients > 0)
+		pthread_cond_wait(&server.done, &server.lock);
+	pthread_mutex_unlock(&server.lock);
+	for(size_t i = 0; i < server.numdiscs; i++)
+		free_disc(&server, server.discs[i]);
+	free(server.discs);
+
+	pthread_attr_destroy(&attr);
+	sigaction(SIGINT, &oldint, NULL);
+	sigaction(SIGTERM, &oldterm, NULL);
+	sigaction(SIGPIPE, &oldpipe, NULL);
+	stop_serving = 0;
+	errno = err;
+	return err ? -1 : 0;
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERVE_H_INCLUDED
+#define SERVE_H_INCLUDED
+
+#include <stddef.h>
+
+struct server;
+
+/**
+ * Callbacks of serve. *open* opens the Blu-ray at *path* and returns its state
+ * or NULL with errno set, *close* frees that state again. *handle* answers
+ * the request *args*, the tab-separated fields of a line sent by a client, on
+ * the connected socket *fd*. Requests are handled concurrently, so *handle*
+ * must only access Blu-rays through serve_acquire.
+ */
+struct serve_ops {
+	void *(*open)(const char *path, void *data);
+	void  (*close)(void *state, void *data);
+	void  (*handle)(struct server *server, int fd, char **args, size_t numargs, void *data);
+};
+
+/**
+ * Listen on the UNIX socket *path* and answer every request in its own thread
+ * until SIGINT or SIGTERM is received. A stale socket left by a previous
+ * server is replaced. Opened Blu-rays are kept until they were not used for
+ * *idle_timeout* seconds.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int serve(const char *path, const struct serve_ops *ops, unsigned long idle_timeout,
+		void *data);
+
+/**
+ * Get the state of the Blu-ray at *path*, which is opened if necessary. The
+ * state is exclusively owned by the caller until it is passed to
+ * serve_release.
+ *
+ * Returns NULL with errno set if the Blu-ray cannot be opened.
+ */
+void *serve_acquire(struct server *server, const char *path);
+
+void serve_release(struct server *server, void *state);
+
+#endif
@@ -0,0 +1,480 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bdmv.h"
+#include "source.h"
+#include "title.h"
+#include "util.h"
+
+/**
+ * Compare playlist-angle tuples.
+ */
+static int cmp_playlist_selectors(const void *a_, const void *b_)
+{
+	const struct playlist_selector *a = a_;
+	const struct playlist_selector *b = b_;
+	int c = (a->playlist > b->playlist) - (a->playlist < b->playlist);
+	if(c == 0)
+	{
+		if(a->angle == ANGLE_WILDCARD)
+			c = -1;
+		else if(b->angle == ANGLE_WILDCARD)
+			c = 1;
+		else
+			c = (a->angle > b->angle) - (a->angle < b->angle);
+	}
+	return c;
+}
+
+void clean_playlist_selectors(struct playlist_selector *playlists, size_t *numplaylists)
+{
+	if(*numplaylists == 0)
+		return;
+	qsort(playlists, *numplaylists, sizeof(*playlists), cmp_playlist_selectors);
+	size_t off = 0;
+	int wildcard = playlists[0].angle == ANGLE_WILDCARD;
+	for(size_t src = 1; src < *numplaylists; src++)
+	{
+		if(playlists[src].playlist == playlists[src - 1].playlist)
+		{
+			if(wildcard || playlists[src].angle == playlists[src - 1].angle)
+			{
+				off++;
+				continue;
+			}
+		}
+		else
+			wildcard = playlists[src].angle == ANGLE_WILDCARD;
+		if(off > 0)
+			playlists[src - off] = playlists[src];
+	}
+	*numplaylists -= off;
+}
+
+/**
+ * Compare playlist-angle tuple with playlist number.
+ */
+static int cmp_title_playlist(const void *a_, const void *b_)
+{
+	const BLURAY_TITLE_INFO *a = *(const void    **)a_;
+	uint32_t                 b = *(const uint32_t *)b_;
+	return (a->playlist > b) - (a->playlist < b);
+}
+
+/**
+ * Compare playlist-angle tuple with BLURAY_TITLE_INFO.
+ */
+static int cmp_title_infos(const void *a, const void *b_)
+{
+	const BLURAY_TITLE_INFO *b = *(const void **)b_;
+	return cmp_title_playlist(a, &b->playlist);
+}
+
+void free_titles(BLURAY_TITLE_INFO **titles, size_t numtitles)
+{
+	for(size_t i = 0; i < numtitles; i++)
+		free(titles[i]);
+	free(titles);
+}
+
+void source_open(struct title_source *source, const char *src,
+		int use_cache, int refresh_cache, size_t numthreads, struct stats *stats)
+{
+	enum stats_phase prev = stats_switch(stats, STATS_OPEN);
+	source->src        = src;
+	source->bd         = NULL;
+	source->cache      = use_cache ? cache_open(src, refresh_cache) : NULL;
+	source->numthreads = numthreads;
+	source->stats      = stats;
+	stats_switch(stats, prev);
+}
+
+/**
+ * Open *source* with libbluray if it is not open yet. Returns 0 or -1 if
+ * libbluray failed.
+ */
+static int source_open_bd(struct title_source *source)
+{
+	if(source->bd)
+		return 0;
+	enum stats_phase prev = stats_switch(source->stats, STATS_OPEN);
+	source->bd = bd_open(source->src, NULL);
+	stats_switch(source->stats, prev);
+	return source->bd ? 0 : -1;
+}
+
+void source_close(struct title_source *source)
+{
+	if(source->bd)
+		bd_close(source->bd);
+	source->bd = NULL;
+	if(source->cache)
+	{
+		// the cache is only an optimization, failing to write it is fine
+		cache_save(source->cache);
+		cache_close(source->cache);
+	}
+	source->cache = NULL;
+}
+
+/**
+ * Get the title with index *i* of bd_get_titles or, if *i* is -1, of
+ * *playlist*. The title has to be freed with free.
+ *
+ * Returns 0 on success, -1 on error with errno set or -2 if libbluray failed.
+ */
+static int source_get_title(struct title_source *source, int64_t i, uint32_t playlist,
+		BLURAY_TITLE_INFO **title)
+{
+	enum stats_phase prev = stats_switch(source->stats, STATS_TITLE_INFO);
+	int err = 0;
+	if(i < 0 && source->cache && (*title = cache_get_playlist(source->cache, playlist)))
+		goto out;
+
+	err = -2;
+	if(i < 0 && source->numthreads > 0
+			&& (err = bdmv_get_playlist(source->src, playlist, 0, title)) == -1)
+		goto out;
+	if(err == -2)
+	{
+		if(source_open_bd(source) < 0)
+			goto out;
+		BLURAY_TITLE_INFO *info = i < 0
+				? bd_get_playlist_info(source->bd, playlist, 0)
+				: bd_get_title_info(source->bd, i, 0);
+		if(!info)
+			goto out;
+		*title = title_dup(info);
+		bd_free_title_info(info);
+		err = -1;
+		if(!*title)
+			goto out;
+	}
+	err = 0;
+	if(source->cache && cache_put_playlist(source->cache, *title) < 0)
+	{
+		int errnum = errno;
+		free(*title);
+		errno = errnum;
+		err = -1;
+	}
+
+out:
+	stats_switch(source->stats, prev);
+	return err;
+}
+
+/**
+ * Get all titles bd_get_titles returns for *filter_flags*. If the titles are
+ * neither cached nor parsed natively, titles shorter than *min_duration* are
+ * skipped by libbluray, otherwise all titles are fetched.
+ *
+ * The titles are stored in *\*titles_*, which has to be freed with
+ * free_titles.
+ *
+ * Returns 0 on success, -1 on error with errno set or -2 if libbluray failed.
+ */
+static int source_get_titles(struct title_source *source, int filter_flags,
+		uint32_t min_duration, BLURAY_TITLE_INFO ***titles_, size_t *numtitles_)
+{
+	BLURAY_TITLE_INFO **titles    = NULL;
+	uint32_t           *playlists = NULL;
+	size_t numtitles = 0;
+	int err = -1;
+
+	enum stats_phase prev = stats_switch(source->stats, STATS_TITLES);
+	const uint32_t *cached = NULL;
+	size_t          n      = 0;
+	int             native = 0;
+	if(!source->cache || cache_get_titles(source->cache, filter_flags, &cached, &n) < 0)
+	{
+		if(source->numthreads > 0)
+		{
+			if((err = bdmv_get_titles(source->src, filter_flags, source->numthreads,
+					&titles, &numtitles)) == -1)
+				goto error;
+			native = err == 0;
+			n = numtitles;
+		}
+		if(!native)
+		{
+			err = -2;
+			if(source_open_bd(source) < 0)
+				goto error;
+			n = bd_get_titles(source->bd, filter_flags, source->cache ? 0 : min_duration);
+		}
+	}
+
+	// the titles may be extended with array_reserve
+	err = -1;
+	if(!native && !(titles = array_reserve(NULL, 0, n > 0 ? n : 1, sizeof(*titles))))
+		goto error;
+	if(!(playlists = malloc(n * sizeof(*playlists) + 1)))
+		goto error;
+	for(size_t i = 0; i < n; i++)
+	{
+		if(native)
+		{
+			if(source->cache && cache_put_playlist(source->cache, titles[i]) < 0)
+				goto error;
+		}
+		else
+		{
+			if((err = cached
+					? source_get_title(source, -1, cached[i], titles + i)
+					: source_get_title(source, i, 0, titles + i)) < 0)
+				goto error;
+			numtitles++;
+		}
+		playlists[i] = titles[i]->playlist;
+	}
+	if(!cached && source->cache && cache_put_titles(source->cache, filter_flags, playlists, n) < 0)
+	{
+		err = -1;
+		goto error;
+	}
+	free(playlists);
+	stats_switch(source->stats, prev);
+
+	*titles_    = titles;
+	*numtitles_ = numtitles;
+	return 0;
+
+error:
+	{
+		int errnum = errno;
+		free(playlists);
+		free_titles(titles, numtitles);
+		stats_switch(source->stats, prev);
+		errno = errnum;
+	}
+	return err;
+}
+
+static int cmp_title_folds(const void *a_, const void *b_)
+{
+	const struct title_fold *a = a_;
+	const struct title_fold *b = b_;
+	if(a->into != b->into)
+		return a->into < b->into ? -1 : 1;
+	return a->playlist < b->playlist ? -1 : a->playlist > b->playlist;
+}
+
+/**
+ * Remove all but the first of the *\*numtitles* *titles* with the same
+ * fingerprint and content. The removed playlists are appended to *\*folds*,
+ * which is sorted by the playlist they were folded into.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+static int fold_duplicates(BLURAY_TITLE_INFO **titles, size_t *numtitles,
+		struct title_fold **folds, size_t *numfolds)
+{
+	size_t n = *numtitles;
+	size_t *original = malloc(n * sizeof(*original) + 1);
+	if(!original || title_dedup(titles, n, original) < 0)
+		goto error;
+
+	size_t numunique = 0;
+	for(size_t i = 0; i < n; i++)
+	{
+		if(original[i] == i)
+		{
+			// originals precede their duplicates, so their index stays valid
+			original[i] = numunique;
+			titles[numunique++] = titles[i];
+			continue;
+		}
+		if(folds)
+		{
+			// *folds is freed by the caller if it cannot grow
+			struct title_fold *grown = array_reserve(*folds, *numfolds, 1, sizeof(**folds));
+			if(!grown)
+				goto error;
+			*folds = grown;
+			(*folds)[(*numfolds)++] = (struct title_fold){
+				.into     = titles[original[original[i]]]->playlist,
+				.playlist = titles[i]->playlist
+			};
+		}
+		free(titles[i]);
+		titles[i] = NULL;
+	}
+	*numtitles = numunique;
+	free(original);
+	if(folds)
+		qsort(*folds, *numfolds, sizeof(**folds), cmp_title_folds);
+	return 0;
+
+error:
+	{
+		int errnum = errno;
+		free(original);
+		errno = errnum;
+	}
+	return -1;
+}
+
+int get_titles(struct title_source *source, int filter_flags, uint32_t min_duration,
+		const struct playlist_selector *playlists, size_t numplaylists,
+		BLURAY_TITLE_INFO ***titles_, size_t *numtitles_,
+		struct title_fold **folds_, size_t *numfolds_)
+{
+	BLURAY_TITLE_INFO **titles = NULL;
+	struct title_fold  *folds  = NULL;
+	size_t numtitles = 0;
+	size_t numfolds  = 0;
+	int err;
+
+	// get BLURAY_TITLE_INFOs by duration
+	if(min_duration != (uint32_t)-1)
+	{
+		if((err = source_get_titles(source, filter_flags & ~TITLES_FILTER_DUP_TITLE,
+				min_duration, &titles, &numtitles)) < 0)
+			return err;
+		// the first playlist of duplicates is kept
+		qsort(titles, numtitles, sizeof(*titles), cmp_title_infos);
+		if((filter_flags & TITLES_FILTER_DUP_TITLE)
+				&& fold_duplicates(titles, &numtitles, folds_ ? &folds : NULL, &numfolds) < 0)
+		{
+			err = -1;
+			goto error;
+		}
+
+		// cached and natively parsed titles are not filtered by duration yet
+		size_t n = numtitles;
+		numtitles = 0;
+		for(size_t i = 0; i < n; i++)
+			if(titles[i]->duration / 90000 < min_duration)
+				free(titles[i]);
+			else
+				titles[numtitles++] = titles[i];
+	}
+	qsort(titles, numtitles, sizeof(*titles), cmp_title_infos);
+	size_t numbytime = numtitles;
+
+	// get BLURAY_TITLE_INFOs by playlist selectors
+	for(size_t i = 0; i < numplaylists; i++)
+	{
+		uint32_t playlist = playlists[i].playlist;
+
+		// skip playlist if already selected by time or another angle
+		if(i > 0 && playlists[i - 1].playlist == playlist)
+			continue;
+		size_t j = bisect_left(titles, &playlist, numbytime, sizeof(*titles), cmp_title_playlist);
+		if(j < numbytime && titles[j]->playlist == playlist)
+			continue;
+
+		BLURAY_TITLE_INFO *title;
+		if((err = source_get_title(source, -1, playlist, &title)) < 0)
+			goto error;
+
+		BLURAY_TITLE_INFO **grown = array_reserve(titles, numtitles, 1, sizeof(*titles));
+		if(!grown)
+		{
+			int errnum = errno;
+			free(title);
+			errno = errnum;
+			err = -1;
+			goto error;
+		}
+		titles = grown;
+		titles[numtitles++] = title;
+	}
+	qsort(titles, numtitles, sizeof(*titles), cmp_title_infos);
+
+	*titles_    = titles;
+	*numtitles_ = numtitles;
+	if(folds_)
+	{
+		*folds_    = folds;
+		*numfolds_ = numfolds;
+	}
+	return 0;
+
+error:
+	{
+		int errnum = errno;
+		free_titles(titles, numtitles);
+		free(folds);
+		errno = errnum;
+	}
+	return err;
+}
+
+static int cmp_playlist_scores(const void *a_, const void *b_)
+{
+	const struct playlist_score *a = a_;
+	const struct playlist_score *b = b_;
+	if(a->score.total != b->score.total)
+		return a->score.total < b->score.total ? 1 : -1;
+	return a->playlist < b->playlist ? -1 : a->playlist > b->playlist;
+}
+
+int select_main_feature(BLURAY_TITLE_INFO **titles, size_t *numtitles,
+		size_t numthreads, struct title_score *score, size_t *numties,
+		struct playlist_score **runners_up_, size_t *numrunnersup_)
+{
+	*numties = 0;
+	if(runners_up_)
+	{
+		*runners_up_   = NULL;
+		*numrunnersup_ = 0;
+	}
+	if(*numtitles == 0)
+		return 0;
+	struct title_score *scores = malloc(*numtitles * sizeof(*scores));
+	struct playlist_score *runners_up = runners_up_ && *numtitles > 1
+			? malloc((*numtitles - 1) * sizeof(*runners_up)) : NULL;
+	if(!scores || (runners_up_ && *numtitles > 1 && !runners_up)
+			|| score_titles(titles, *numtitles, numthreads, scores) < 0)
+	{
+		int errnum = errno;
+		free(scores);
+		free(runners_up);
+		errno = errnum;
+		return -1;
+	}
+
+	size_t best = score_best(scores, *numtitles, numties);
+	*score = scores[best];
+	if(runners_up)
+	{
+		size_t n = 0;
+		for(size_t i = 0; i < *numtitles; i++)
+			if(i != best)
+				runners_up[n++] = (struct playlist_score){
+					.playlist = titles[i]->playlist,
+					.score    = scores[i]
+				};
+		qsort(runners_up, n, sizeof(*runners_up), cmp_playlist_scores);
+		*runners_up_   = runners_up;
+		*numrunnersup_ = n;
+	}
+	free(scores);
+	for(size_t i = 0; i < *numtitles; i++)
+		if(i != best)
+			free(titles[i]);
+	titles[0]  = titles[best];
+	*numtitles = 1;
+	return 0;
+}
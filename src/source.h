@@ -0,0 +1,119 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOURCE_H_INCLUDED
+#define SOURCE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+#include "cache.h"
+#include "score.h"
+#include "stats.h"
+
+/** the angle of a playlist_selector that selects all angles */
+#define ANGLE_WILDCARD ((uint8_t)-1)
+
+/**
+ * A playlist selected with -p PLAYLIST[:ANGLE].
+ */
+struct playlist_selector {
+	uint32_t playlist;
+	uint8_t  angle;
+};
+
+
+/**
+ * Where titles are read from. The Blu-ray is only opened with libbluray if a
+ * title is not found in *cache* and cannot be parsed natively with
+ * *numthreads* threads. If *stats* is set, the time spent reading titles is
+ * recorded in it.
+ */
+struct title_source {
+	const char         *src;
+	BLURAY             *bd;
+	struct title_cache *cache;
+	size_t              numthreads;
+	struct stats       *stats;
+};
+
+/**
+ * A playlist that was folded into the title of playlist *into*, because both
+ * have the same content.
+ */
+struct title_fold {
+	uint32_t into;
+	uint32_t playlist;
+};
+
+/**
+ * Remove duplicate or wildcard angles.
+ */
+void clean_playlist_selectors(struct playlist_selector *playlists, size_t *numplaylists);
+
+void free_titles(BLURAY_TITLE_INFO **titles, size_t numtitles);
+
+/**
+ * Open *source->src* for reading titles. If *use_cache* is set, titles are
+ * looked up in and added to the title cache. If *refresh_cache* is set, cached
+ * titles are ignored. If *numthreads* is not 0, Blu-ray directories are parsed
+ * natively with up to *numthreads* threads instead of with libbluray. *stats*
+ * may be NULL.
+ */
+void source_open(struct title_source *source, const char *src,
+		int use_cache, int refresh_cache, size_t numthreads, struct stats *stats);
+
+void source_close(struct title_source *source);
+
+/**
+ * Get all titles at least *min_duration* seconds long, unless *min_duration*
+ * is -1, and all titles selected by *playlists*. *playlists* have to be
+ * cleaned by clean_playlist_selectors.
+ *
+ * Instead of libbluray's TITLES_FILTER_DUP_TITLE duplicates are found by their
+ * fingerprints. If *folds_* is given the playlists that were omitted as
+ * duplicates are stored in it.
+ *
+ * The titles are sorted by playlist number and stored in *\*titles_*, which
+ * has to be freed with free_titles.
+ *
+ * Returns 0 on success, -1 on error with errno set or -2 if libbluray failed.
+ */
+int get_titles(struct title_source *source, int filter_flags, uint32_t min_duration,
+		const struct playlist_selector *playlists, size_t numplaylists,
+		BLURAY_TITLE_INFO ***titles_, size_t *numtitles_,
+		struct title_fold **folds_, size_t *numfolds_);
+
+/**
+ * Score all *\*numtitles* *titles* with up to *numthreads* threads and keep
+ * only the one that is most likely the main feature. Its score is stored in
+ * *score* and the number of other titles with the same score, whose playlists
+ * are all higher, in *numties*. If *runners_up_* is given, the scores
+ * of the other titles, highest first, are stored in it and have to be freed;
+ * the tied titles are the first *\*numties* of them.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int select_main_feature(BLURAY_TITLE_INFO **titles, size_t *numtitles,
+		size_t numthreads, struct title_score *score, size_t *numties,
+		struct playlist_score **runners_up_, size_t *numrunnersup_);
+
+#endif
@@ -0,0 +1,179 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "stats.h"
+#include "util.h"
+
+/** ru_inblock is counted in blocks of 512 bytes */
+#define BLOCK_SIZE 512
+
+static const char *const phase_names[STATS_NUMPHASES] = {
+	[STATS_OTHER]      = "other",
+	[STATS_OPEN]       = "open",
+	[STATS_TITLES]     = "titles",
+	[STATS_TITLE_INFO] = "title_info",
+	[STATS_SELECT]     = "select",
+	[STATS_OUTPUT]     = "output",
+	[STATS_REMUX]      = "remux",
+	[STATS_EXTRACT]    = "extract",
+	[STATS_SCAN]       = "scan"
+};
+
+static double seconds_between(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static double timeval_seconds(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+void stats_init(struct stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	clock_gettime(CLOCK_MONOTONIC, &stats->start);
+	stats->last  = stats->start;
+	stats->phase = STATS_OTHER;
+}
+
+enum stats_phase stats_switch(struct stats *stats, enum stats_phase phase)
+{
+	if(!stats)
+		return STATS_OTHER;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	enum stats_phase prev = stats->phase;
+	stats->seconds[prev] += seconds_between(&stats->last, &now);
+	stats->last  = now;
+	stats->phase = phase;
+	return prev;
+}
+
+int stats_add_child(struct stats *stats, uint32_t playlist, const char *engine,
+		const struct job *job)
+{
+	if(!stats)
+		return 0;
+	struct stats_child *grown = array_reserve(stats->children, stats->numchildren, 1,
+			sizeof(*stats->children));
+	if(!grown)
+		return -1;
+	stats->children = grown;
+	stats->children[stats->numchildren++] = (struct stats_child){
+		.playlist = playlist,
+		.engine   = engine,
+		.job      = *job
+	};
+	return 0;
+}
+
+static void print_child_json(FILE *f, const struct stats_child *child)
+{
+	const struct job *job = &child->job;
+	fprintf(f, "{\"playlist\":\"%05"PRIu32".mpls\",\"engine\":\"%s\",",
+			child->playlist, child->engine);
+	if(job->pid < 0)
+	{
+		fprintf(f, "\"error\":\"%s\"}", strerror(job->error));
+		return;
+	}
+	if(WIFSIGNALED(job->status))
+		fprintf(f, "\"signal\":%d,", WTERMSIG(job->status));
+	else
+		fprintf(f, "\"exit_status\":%d,", WEXITSTATUS(job->status));
+	fprintf(f, "\"seconds\":%.6f,\"user\":%.6f,\"system\":%.6f,\"peak_rss_kib\":%ld,"
+			"\"read_bytes\":%lld}", job->seconds, timeval_seconds(&job->usage.ru_utime),
+			timeval_seconds(&job->usage.ru_stime), job->usage.ru_maxrss,
+			(long long)job->usage.ru_inblock * BLOCK_SIZE);
+}
+
+static void print_child(FILE *f, const struct stats_child *child, const char *prefix)
+{
+	const struct job *job = &child->job;
+	fprintf(f, "%s: stats: %05"PRIu32".mpls: %s ", prefix, child->playlist, child->engine);
+	if(job->pid < 0)
+	{
+		fprintf(f, "not started: %s\n", strerror(job->error));
+		return;
+	}
+	if(WIFSIGNALED(job->status))
+		fprintf(f, "signal %d", WTERMSIG(job->status));
+	else
+		fprintf(f, "status %d", WEXITSTATUS(job->status));
+	fprintf(f, ", %.3f s, user %.3f s, system %.3f s, peak RSS %ld KiB, %lld bytes read\n",
+			job->seconds, timeval_seconds(&job->usage.ru_utime),
+			timeval_seconds(&job->usage.ru_stime), job->usage.ru_maxrss,
+			(long long)job->usage.ru_inblock * BLOCK_SIZE);
+}
+
+int stats_print(struct stats *stats, FILE *f, int json, const char *prefix)
+{
+	stats_switch(stats, stats->phase);
+	double total = seconds_between(&stats->start, &stats->last);
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) < 0)
+		return -1;
+
+	if(json)
+	{
+		fputs("{\"phases\":{", f);
+		for(int i = 0; i < STATS_NUMPHASES; i++)
+			fprintf(f, "%s\"%s\":%.6f", i > 0 ? "," : "", phase_names[i], stats->seconds[i]);
+		fprintf(f, "},\"total\":%.6f,\"user\":%.6f,\"system\":%.6f,\"peak_rss_kib\":%ld,"
+				"\"read_bytes\":%lld,\"children\":[", total,
+				timeval_seconds(&usage.ru_utime), timeval_seconds(&usage.ru_stime),
+				usage.ru_maxrss, (long long)usage.ru_inblock * BLOCK_SIZE);
+		for(size_t i = 0; i < stats->numchildren; i++)
+		{
+			if(i > 0)
+				fputc(',', f);
+			print_child_json(f, stats->children + i);
+		}
+		fputs("]}\n", f);
+	}
+	else
+	{
+		fprintf(f, "%s: stats:", prefix);
+		for(int i = STATS_OPEN; i < STATS_NUMPHASES; i++)
+			fprintf(f, " %s %.3f s,", phase_names[i], stats->seconds[i]);
+		fprintf(f, " other %.3f s, total %.3f s\n", stats->seconds[STATS_OTHER], total);
+		fprintf(f, "%s: stats: user %.3f s, system %.3f s, peak RSS %ld KiB, %lld bytes read\n",
+				prefix, timeval_seconds(&usage.ru_utime), timeval_seconds(&usage.ru_stime),
+				usage.ru_maxrss, (long long)usage.ru_inblock * BLOCK_SIZE);
+		for(size_t i = 0; i < stats->numchildren; i++)
+			print_child(f, stats->children + i, prefix);
+	}
+	return ferror(f) ? -1 : 0;
+}
+
+void stats_free(struct stats *stats)
+{
+	free(stats->children);
+	stats->children    = NULL;
+	stats->numchildren = 0;
+}
@@ -0,0 +1,109 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "jobs.h"
+
+/**
+ * Phases of a bdinfo run. The time spent in nested phases is only accounted
+ * to the innermost one.
+ */
+enum stats_phase {
+	STATS_OTHER,
+	/** opening the Blu-ray with libbluray and the title cache */
+	STATS_OPEN,
+	/** bd_get_titles, natively parsing all playlists, or looking them up in the cache */
+	STATS_TITLES,
+	/** reading single titles with bd_get_title_info or bd_get_playlist_info */
+	STATS_TITLE_INFO,
+	/** sorting, deduplicating, and selecting titles */
+	STATS_SELECT,
+	/** printing titles, chapters, or ffmpeg calls */
+	STATS_OUTPUT,
+	/** waiting for the remux children */
+	STATS_REMUX,
+	/** copying clips with --extract-clips */
+	STATS_EXTRACT,
+	/** reading the clips with --scan */
+	STATS_SCAN,
+	STATS_NUMPHASES
+};
+
+/**
+ * A remux child of *playlist* run with *engine*.
+ */
+struct stats_child {
+	uint32_t    playlist;
+	const char *engine;
+	struct job  job;
+};
+
+/**
+ * Monotonic time spent in each phase and the remux children of a run.
+ */
+struct stats {
+	struct timespec     start;
+	struct timespec     last;
+	enum stats_phase    phase;
+	double              seconds[STATS_NUMPHASES];
+	struct stats_child *children;
+	size_t              numchildren;
+};
+
+/**
+ * Start recording *stats* in phase STATS_OTHER.
+ */
+void stats_init(struct stats *stats);
+
+/**
+ * Account the time since the last switch to the current phase and enter
+ * *phase*. Nothing is recorded if *stats* is NULL.
+ *
+ * Returns the previous phase, to which the caller switches back when *phase*
+ * is done.
+ */
+enum stats_phase stats_switch(struct stats *stats, enum stats_phase phase);
+
+/**
+ * Record the finished *job* of *playlist* run with *engine*, which must
+ * outlive *stats*. Nothing is recorded if *stats* is NULL.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int stats_add_child(struct stats *stats, uint32_t playlist, const char *engine,
+		const struct job *job);
+
+/**
+ * Print *stats* together with the peak RSS and the bytes read from storage by
+ * this process to *f*, as JSON if *json* is set, or as a compact report with
+ * every line prefixed by *prefix* otherwise.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int stats_print(struct stats *stats, FILE *f, int json, const char *prefix);
+
+void stats_free(struct stats *stats);
+
+#endif
@@ -0,0 +1,291 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "title.h"
+#include "util.h"
+
+/*
+ * A title is laid out as follows, so that the pointers can be recomputed from
+ * the counts alone:
+ *
+ *     BLURAY_TITLE_INFO
+ *     BLURAY_CLIP_INFO[clip_count]
+ *     BLURAY_TITLE_CHAPTER[chapter_count]
+ *     BLURAY_TITLE_MARK[mark_count]
+ *     per clip: video, audio, pg, ig, sec_audio, and sec_video streams
+ */
+
+static size_t clip_stream_count(const BLURAY_CLIP_INFO *clip)
+{
+	return (size_t)clip->video_stream_count + clip->audio_stream_count
+			+ clip->pg_stream_count + clip->ig_stream_count
+			+ clip->sec_audio_stream_count + clip->sec_video_stream_count;
+}
+
+size_t title_size(const BLURAY_TITLE_INFO *title)
+{
+	size_t size = sizeof(*title)
+			+ title->clip_count    * sizeof(*title->clips)
+			+ title->chapter_count * sizeof(*title->chapters)
+			+ title->mark_count    * sizeof(*title->marks);
+	for(uint32_t i = 0; i < title->clip_count; i++)
+		size += clip_stream_count(title->clips + i) * sizeof(BLURAY_STREAM_INFO);
+	return size;
+}
+
+/**
+ * Point the arrays of *title* behind it. The clips must already have been
+ * copied. If *src* is given the streams are copied from it.
+ *
+ * Returns the end of the layout.
+ */
+static char *title_layout(BLURAY_TITLE_INFO *title, const BLURAY_TITLE_INFO *src)
+{
+	char *p = (char *)(title + 1);
+	title->clips    = (BLURAY_CLIP_INFO *)p;
+	p += title->clip_count    * sizeof(*title->clips);
+	title->chapters = (BLURAY_TITLE_CHAPTER *)p;
+	p += title->chapter_count * sizeof(*title->chapters);
+	title->marks    = (BLURAY_TITLE_MARK *)p;
+	p += title->mark_count    * sizeof(*title->marks);
+
+	for(uint32_t i = 0; i < title->clip_count; i++)
+	{
+		BLURAY_CLIP_INFO *clip = title->clips + i;
+#define LAYOUT_STREAMS(streams, count) \
+		do \
+		{ \
+			BLURAY_STREAM_INFO *dst = (BLURAY_STREAM_INFO *)p; \
+			if(src && clip->count > 0) \
+				memcpy(dst, src->clips[i].streams, clip->count * sizeof(*dst)); \
+			clip->streams = dst; \
+			p += clip->count * sizeof(*dst); \
+		} \
+		while(0)
+		LAYOUT_STREAMS(video_streams,     video_stream_count);
+		LAYOUT_STREAMS(audio_streams,     audio_stream_count);
+		LAYOUT_STREAMS(pg_streams,        pg_stream_count);
+		LAYOUT_STREAMS(ig_streams,        ig_stream_count);
+		LAYOUT_STREAMS(sec_audio_streams, sec_audio_stream_count);
+		LAYOUT_STREAMS(sec_video_streams, sec_video_stream_count);
+#undef LAYOUT_STREAMS
+	}
+	return p;
+}
+
+BLURAY_TITLE_INFO *title_dup(const BLURAY_TITLE_INFO *src)
+{
+	void *buf = malloc(title_size(src));
+	return buf ? title_copy(buf, src) : NULL;
+}
+
+BLURAY_TITLE_INFO *title_copy(void *buf, const BLURAY_TITLE_INFO *src)
+{
+	BLURAY_TITLE_INFO *title = buf;
+	*title = *src;
+	title->clips = (BLURAY_CLIP_INFO *)(title + 1);
+	if(src->clip_count > 0)
+		memcpy(title->clips, src->clips, src->clip_count * sizeof(*src->clips));
+	title_layout(title, src);
+	if(src->chapter_count > 0)
+		memcpy(title->chapters, src->chapters, src->chapter_count * sizeof(*src->chapters));
+	if(src->mark_count > 0)
+		memcpy(title->marks, src->marks, src->mark_count * sizeof(*src->marks));
+	return title;
+}
+
+int title_relocate(BLURAY_TITLE_INFO *title, size_t size)
+{
+	if(size < sizeof(*title))
+		return -1;
+	// check the fixed-size arrays before the clips are accessed
+	size_t fixed = sizeof(*title)
+			+ (size_t)title->clip_count    * sizeof(*title->clips)
+			+ (size_t)title->chapter_count * sizeof(*title->chapters)
+			+ (size_t)title->mark_count    * sizeof(*title->marks);
+	if(fixed > size || title->clip_count > size || title->chapter_count > size
+			|| title->mark_count > size)
+		return -1;
+	title->clips = (BLURAY_CLIP_INFO *)(title + 1);
+	if(title_size(title) != size)
+		return -1;
+	title_layout(title, NULL);
+	return 0;
+}
+
+static int streams_equal(const BLURAY_STREAM_INFO *a, const BLURAY_STREAM_INFO *b,
+		size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		if(a[i].coding_type != b[i].coding_type || a[i].format != b[i].format
+				|| a[i].rate != b[i].rate || a[i].char_code != b[i].char_code
+				|| memcmp(a[i].lang, b[i].lang, sizeof(a[i].lang)) != 0
+				|| a[i].pid != b[i].pid || a[i].aspect != b[i].aspect
+				|| a[i].subpath_id != b[i].subpath_id)
+			return 0;
+	return 1;
+}
+
+int clip_streams_equal(const BLURAY_CLIP_INFO *x, const BLURAY_CLIP_INFO *y)
+{
+#define STREAMS_EQUAL(streams, count) \
+		(x->count == y->count && streams_equal(x->streams, y->streams, x->count))
+	return STREAMS_EQUAL(video_streams,     video_stream_count)
+			&& STREAMS_EQUAL(audio_streams,     audio_stream_count)
+			&& STREAMS_EQUAL(pg_streams,        pg_stream_count)
+			&& STREAMS_EQUAL(ig_streams,        ig_stream_count)
+			&& STREAMS_EQUAL(sec_audio_streams, sec_audio_stream_count)
+			&& STREAMS_EQUAL(sec_video_streams, sec_video_stream_count);
+#undef STREAMS_EQUAL
+}
+
+int title_equal(const BLURAY_TITLE_INFO *a, const BLURAY_TITLE_INFO *b)
+{
+	if(a->playlist != b->playlist || a->duration != b->duration
+			|| a->clip_count != b->clip_count || a->angle_count != b->angle_count
+			|| a->chapter_count != b->chapter_count || a->mark_count != b->mark_count
+			|| a->mvc_base_view_r_flag != b->mvc_base_view_r_flag)
+		return 0;
+	for(uint32_t i = 0; i < a->clip_count; i++)
+	{
+		const BLURAY_CLIP_INFO *x = a->clips + i;
+		const BLURAY_CLIP_INFO *y = b->clips + i;
+		if(x->pkt_count != y->pkt_count || x->still_mode != y->still_mode
+				|| x->still_time != y->still_time || x->start_time != y->start_time
+				|| x->in_time != y->in_time || x->out_time != y->out_time
+				|| strcmp(x->clip_id, y->clip_id) != 0 || !clip_streams_equal(x, y))
+			return 0;
+	}
+	for(uint32_t i = 0; i < a->chapter_count; i++)
+	{
+		const BLURAY_TITLE_CHAPTER *x = a->chapters + i;
+		const BLURAY_TITLE_CHAPTER *y = b->chapters + i;
+		if(x->idx != y->idx || x->start != y->start || x->duration != y->duration
+				|| x->offset != y->offset || x->clip_ref != y->clip_ref)
+			return 0;
+	}
+	for(uint32_t i = 0; i < a->mark_count; i++)
+	{
+		const BLURAY_TITLE_MARK *x = a->marks + i;
+		const BLURAY_TITLE_MARK *y = b->marks + i;
+		if(x->idx != y->idx || x->type != y->type || x->start != y->start
+				|| x->duration != y->duration || x->offset != y->offset
+				|| x->clip_ref != y->clip_ref)
+			return 0;
+	}
+	return 1;
+}
+
+int title_same_content(const BLURAY_TITLE_INFO *a, const BLURAY_TITLE_INFO *b)
+{
+	if(a->clip_count != b->clip_count || a->chapter_count != b->chapter_count)
+		return 0;
+	for(uint32_t i = 0; i < a->clip_count; i++)
+	{
+		const BLURAY_CLIP_INFO *x = a->clips + i;
+		const BLURAY_CLIP_INFO *y = b->clips + i;
+		if(x->in_time != y->in_time || x->out_time != y->out_time
+				|| strcmp(x->clip_id, y->clip_id) != 0 || !clip_streams_equal(x, y))
+			return 0;
+	}
+	for(uint32_t i = 0; i < a->chapter_count; i++)
+		if(a->chapters[i].start != b->chapters[i].start)
+			return 0;
+	return 1;
+}
+
+static uint64_t hash_streams(uint64_t h, const BLURAY_STREAM_INFO *streams, size_t n)
+{
+	h = fnv1a64(h, &n, sizeof(n));
+	for(size_t i = 0; i < n; i++)
+	{
+		const BLURAY_STREAM_INFO *s = streams + i;
+		const uint8_t fields[] = {
+			s->coding_type, s->format, s->rate, s->char_code,
+			s->lang[0], s->lang[1], s->lang[2],
+			s->pid >> 8, s->pid, s->aspect, s->subpath_id
+		};
+		h = fnv1a64(h, fields, sizeof(fields));
+	}
+	return h;
+}
+
+uint64_t title_fingerprint(const BLURAY_TITLE_INFO *title)
+{
+	uint64_t h = FNV1A64_INIT;
+	for(uint32_t i = 0; i < title->clip_count; i++)
+	{
+		const BLURAY_CLIP_INFO *clip = title->clips + i;
+		const uint64_t times[] = {clip->in_time, clip->out_time};
+		h = fnv1a64(h, clip->clip_id, strlen(clip->clip_id) + 1);
+		h = fnv1a64(h, times, sizeof(times));
+		h = hash_streams(h, clip->video_streams,     clip->video_stream_count);
+		h = hash_streams(h, clip->audio_streams,     clip->audio_stream_count);
+		h = hash_streams(h, clip->pg_streams,        clip->pg_stream_count);
+		h = hash_streams(h, clip->ig_streams,        clip->ig_stream_count);
+		h = hash_streams(h, clip->sec_audio_streams, clip->sec_audio_stream_count);
+		h = hash_streams(h, clip->sec_video_streams, clip->sec_video_stream_count);
+	}
+	for(uint32_t i = 0; i < title->chapter_count; i++)
+		h = fnv1a64(h, &title->chapters[i].start, sizeof(title->chapters[i].start));
+	return h;
+}
+
+int title_dedup(BLURAY_TITLE_INFO **titles, size_t numtitles, size_t *original)
+{
+	// open addressing with at most half of the slots used
+	size_t size = 16;
+	while(size < 2 * numtitles)
+		size *= 2;
+	uint64_t *fingerprints = malloc(numtitles * sizeof(*fingerprints) + 1);
+	size_t   *slots        = calloc(size, sizeof(*slots));
+	if(!fingerprints || !slots)
+	{
+		free(fingerprints);
+		free(slots);
+		return -1;
+	}
+
+	for(size_t i = 0; i < numtitles; i++)
+	{
+		uint64_t h = fingerprints[i] = title_fingerprint(titles[i]);
+		original[i] = i;
+		// slots hold the index of a title + 1
+		for(size_t j = h & (size - 1);; j = (j + 1) & (size - 1))
+		{
+			size_t k = slots[j];
+			if(k == 0)
+			{
+				slots[j] = i + 1;
+				break;
+			}
+			if(fingerprints[k - 1] == h && title_same_content(titles[k - 1], titles[i]))
+			{
+				original[i] = k - 1;
+				break;
+			}
+		}
+	}
+	free(fingerprints);
+	free(slots);
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TITLE_H_INCLUDED
+#define TITLE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+/**
+ * Number of bytes needed to store *title* and all its clips, streams,
+ * chapters, and marks in a single allocation.
+ */
+size_t title_size(const BLURAY_TITLE_INFO *title);
+
+/**
+ * Copy *title* into a single allocation of title_size bytes. The copy has to be
+ * freed with free instead of bd_free_title_info.
+ */
+BLURAY_TITLE_INFO *title_dup(const BLURAY_TITLE_INFO *title);
+
+/**
+ * Copy *title* like title_dup into *buf*, which has room for title_size bytes
+ * and is aligned for BLURAY_TITLE_INFO.
+ */
+BLURAY_TITLE_INFO *title_copy(void *buf, const BLURAY_TITLE_INFO *title);
+
+/**
+ * Restore the pointers of a title created by title_dup after its *size* bytes
+ * were moved, e.g. read from a file.
+ *
+ * Returns -1 if the counts stored in *title* do not match *size*.
+ */
+int title_relocate(BLURAY_TITLE_INFO *title, size_t size);
+
+/**
+ * Compare two titles field by field, ignoring their indices and the addresses
+ * of their arrays.
+ */
+int title_equal(const BLURAY_TITLE_INFO *a, const BLURAY_TITLE_INFO *b);
+
+/**
+ * Compare the stream tables of two clips.
+ */
+int clip_streams_equal(const BLURAY_CLIP_INFO *a, const BLURAY_CLIP_INFO *b);
+
+/**
+ * Test if *a* and *b* play the same clips with the same in and out times,
+ * streams, and chapters, regardless of their playlists.
+ */
+int title_same_content(const BLURAY_TITLE_INFO *a, const BLURAY_TITLE_INFO *b);
+
+/**
+ * Hash the ordered clip IDs, in and out times, stream tables, and chapter
+ * starts of *title*. Titles with the same content have the same fingerprint.
+ */
+uint64_t title_fingerprint(const BLURAY_TITLE_INFO *title);
+
+/**
+ * Find duplicate *titles* by their fingerprints in O(n). For every title the
+ * index of the first title with the same content, or its own index, is stored
+ * in *original*.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int title_dedup(BLURAY_TITLE_INFO **titles, size_t numtitles, size_t *original);
+
+#endif
@@ -0,0 +1,316 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TS_X86 1
+#include <immintrin.h>
+#endif
+
+#include "ts.h"
+#include "util.h"
+
+#define NUM_PIDS 0x2000
+
+/** packets filtered at once */
+#define FILTER_BATCH 256
+
+/**
+ * PIDs up to which the vectorized filters compare every PID with every packet,
+ * more are looked up packet by packet
+ */
+#define MAX_VECTOR_PIDS 8
+
+/**
+ * Store the indices of the *numpackets* packets in *buf* that are in sync and
+ * carry a demultiplexed PID of *ts* in *found*. Returns their number.
+ */
+typedef size_t (*filter_fn)(const struct ts_demux *ts, const uint8_t *buf, size_t numpackets,
+		uint16_t *found);
+
+struct ts_stream {
+	uint16_t      pid;
+	int           started;
+	struct buffer pes;
+};
+
+struct ts_demux {
+	ts_pes_fn         fn;
+	void             *data;
+	struct ts_stream *streams;
+	size_t            numstreams;
+	filter_fn         filter;
+	/** index into *streams* + 1 for every PID, 0 if not demultiplexed */
+	uint16_t          index[NUM_PIDS];
+};
+
+static size_t filter_scalar(const struct ts_demux *ts, const uint8_t *buf, size_t numpackets,
+		uint16_t *found)
+{
+	size_t n = 0;
+	for(size_t i = 0; i < numpackets; i++)
+	{
+		// skip TP_extra_header
+		const uint8_t *p = buf + i * TS_PACKET_SIZE + 4;
+		if(p[0] == 0x47 && ts->index[(p[1] & 0x1f) << 8 | p[2]])
+			found[n++] = i;
+	}
+	return n;
+}
+
+#ifdef TS_X86
+/*
+ * The vectorized filters load the sync byte and PID of several packets, the
+ * 4 bytes after the TP_extra_header, as 32-bit lanes, so the sync byte is in
+ * the lowest and the PID in the two middle bytes of each lane.
+ */
+#define SYNC_MASK 0x000000ff
+#define PID_MASK  0x00ff1f00
+#define SYNC_WORD 0x00000047
+/** a PID in the byte order of a lane */
+#define PID_WORD(pid) ((uint32_t)((pid) >> 8 & 0x1f) << 8 | (uint32_t)((pid) & 0xff) << 16)
+
+static uint32_t load_header(const uint8_t *packet)
+{
+	uint32_t word;
+	memcpy(&word, packet + 4, sizeof(word));
+	return word;
+}
+
+__attribute__((target("sse2")))
+static size_t filter_sse2(const struct ts_demux *ts, const uint8_t *buf, size_t numpackets,
+		uint16_t *found)
+{
+	__m128i sync_mask = _mm_set1_epi32(SYNC_MASK);
+	__m128i pid_mask  = _mm_set1_epi32(PID_MASK);
+	__m128i sync      = _mm_set1_epi32(SYNC_WORD);
+	__m128i pids[MAX_VECTOR_PIDS];
+	for(size_t j = 0; j < ts->numstreams; j++)
+		pids[j] = _mm_set1_epi32(PID_WORD(ts->streams[j].pid));
+
+	size_t n = 0;
+	size_t i = 0;
+	for(; i + 4 <= numpackets; i += 4)
+	{
+		const uint8_t *p = buf + i * TS_PACKET_SIZE;
+		__m128i words = _mm_set_epi32(load_header(p + 3 * TS_PACKET_SIZE),
+				load_header(p + 2 * TS_PACKET_SIZE), load_header(p + TS_PACKET_SIZE),
+				load_header(p));
+		__m128i in_sync = _mm_cmpeq_epi32(_mm_and_si128(words, sync_mask), sync);
+		__m128i pid     = _mm_and_si128(words, pid_mask);
+		__m128i wanted  = _mm_setzero_si128();
+		for(size_t j = 0; j < ts->numstreams; j++)
+			wanted = _mm_or_si128(wanted, _mm_cmpeq_epi32(pid, pids[j]));
+		unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(in_sync, wanted)));
+		for(; mask; mask &= mask - 1)
+			found[n++] = i + __builtin_ctz(mask);
+	}
+	return n + filter_scalar(ts, buf + i * TS_PACKET_SIZE, numpackets - i, found + n);
+}
+
+__attribute__((target("avx2")))
+static size_t filter_avx2(const struct ts_demux *ts, const uint8_t *buf, size_t numpackets,
+		uint16_t *found)
+{
+	__m256i offsets   = _mm256_setr_epi32(0, TS_PACKET_SIZE, 2 * TS_PACKET_SIZE,
+			3 * TS_PACKET_SIZE, 4 * TS_PACKET_SIZE, 5 * TS_PACKET_SIZE,
+			6 * TS_PACKET_SIZE, 7 * TS_PACKET_SIZE);
+	__m256i sync_mask = _mm256_set1_epi32(SYNC_MASK);
+	__m256i pid_mask  = _mm256_set1_epi32(PID_MASK);
+	__m256i sync      = _mm256_set1_epi32(SYNC_WORD);
+	__m256i pids[MAX_VECTOR_PIDS];
+	for(size_t j = 0; j < ts->numstreams; j++)
+		pids[j] = _mm256_set1_epi32(PID_WORD(ts->streams[j].pid));
+
+	size_t n = 0;
+	size_t i = 0;
+	for(; i + 8 <= numpackets; i += 8)
+	{
+		const int *p = (const int *)(buf + i * TS_PACKET_SIZE + 4);
+		__m256i words   = _mm256_i32gather_epi32(p, offsets, 1);
+		__m256i in_sync = _mm256_cmpeq_epi32(_mm256_and_si256(words, sync_mask), sync);
+		__m256i pid     = _mm256_and_si256(words, pid_mask);
+		__m256i wanted  = _mm256_setzero_si256();
+		for(size_t j = 0; j < ts->numstreams; j++)
+			wanted = _mm256_or_si256(wanted, _mm256_cmpeq_epi32(pid, pids[j]));
+		unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+				_mm256_and_si256(in_sync, wanted)));
+		for(; mask; mask &= mask - 1)
+			found[n++] = i + __builtin_ctz(mask);
+	}
+	return n + filter_scalar(ts, buf + i * TS_PACKET_SIZE, numpackets - i, found + n);
+}
+#endif
+
+/**
+ * Choose the fastest filter for the PIDs of *ts* the CPU supports.
+ */
+static filter_fn choose_filter(const struct ts_demux *ts)
+{
+	if(getenv("BDINFO_NO_SIMD") || ts->numstreams > MAX_VECTOR_PIDS)
+		return filter_scalar;
+#ifdef TS_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return filter_avx2;
+	if(__builtin_cpu_supports("sse2"))
+		return filter_sse2;
+#endif
+	return filter_scalar;
+}
+
+struct ts_demux *ts_demux_new(ts_pes_fn fn, void *data)
+{
+	struct ts_demux *ts = calloc(1, sizeof(*ts));
+	if(!ts)
+		return NULL;
+	ts->fn     = fn;
+	ts->data   = data;
+	ts->filter = filter_scalar;
+	return ts;
+}
+
+void ts_demux_free(struct ts_demux *ts)
+{
+	if(!ts)
+		return;
+	for(size_t i = 0; i < ts->numstreams; i++)
+		free(ts->streams[i].pes.data);
+	free(ts->streams);
+	free(ts);
+}
+
+int ts_demux_add_pid(struct ts_demux *ts, uint16_t pid)
+{
+	pid &= NUM_PIDS - 1;
+	if(ts->index[pid])
+		return 0;
+	struct ts_stream *grown = array_reserve(ts->streams, ts->numstreams, 1, sizeof(*ts->streams));
+	if(!grown)
+		return -1;
+	ts->streams = grown;
+	struct ts_stream *stream = ts->streams + ts->numstreams++;
+	memset(stream, 0, sizeof(*stream));
+	stream->pid = pid;
+	ts->index[pid] = ts->numstreams;
+	ts->filter = choose_filter(ts);
+	return 0;
+}
+
+static int64_t read_timestamp(const uint8_t *p)
+{
+	return (int64_t)(p[0] >> 1 & 0x07) << 30 | (int64_t)p[1] << 22
+			| (int64_t)(p[2] >> 1) << 15 | (int64_t)p[3] << 7 | p[4] >> 1;
+}
+
+/**
+ * Parse the PES header of *stream* and pass its payload to the callback.
+ */
+static int emit_pes(struct ts_demux *ts, struct ts_stream *stream)
+{
+	const uint8_t *p = stream->pes.data;
+	size_t size = stream->pes.size;
+	stream->pes.size = 0;
+	if(!stream->started || size < 9 || p[0] != 0 || p[1] != 0 || p[2] != 1)
+		return 0;
+
+	struct ts_pes pes = {
+		.pid = stream->pid,
+		.pts = TS_NO_TIMESTAMP,
+		.dts = TS_NO_TIMESTAMP
+	};
+	size_t header = 9 + p[8];
+	if(header > size)
+		return 0;
+	if((p[7] & 0x80) && header >= 14)
+		pes.pts = read_timestamp(p + 9);
+	if((p[7] & 0x40) && header >= 19)
+		pes.dts = read_timestamp(p + 14);
+
+	// the payload ends early if the PES packet length is set
+	size_t length = (size_t)p[4] << 8 | p[5];
+	if(length > 0 && length + 6 < size)
+		size = length + 6;
+	pes.data = p + header;
+	pes.size = size - header;
+	return ts->fn(&pes, ts->data);
+}
+
+/**
+ * Append the payload of the source packet *buf*, which is in sync and carries
+ * a demultiplexed PID, to the PES packet of its stream.
+ */
+static int demux_packet(struct ts_demux *ts, const uint8_t *buf)
+{
+	// skip TP_extra_header
+	const uint8_t *p = buf + 4;
+	struct ts_stream *stream = ts->streams + ts->index[(p[1] & 0x1f) << 8 | p[2]] - 1;
+
+	int unit_start = p[1] & 0x40;
+	int adaptation = p[3] >> 4 & 0x3;
+	const uint8_t *payload = p + 4;
+	if(adaptation & 0x2)
+		payload += 1 + p[4];
+	if(!(adaptation & 0x1) || payload >= p + 188)
+		return 0;
+
+	if(unit_start)
+	{
+		int err = emit_pes(ts, stream);
+		if(err)
+			return err;
+		stream->started = 1;
+	}
+	if(stream->started && buffer_append(&stream->pes, payload, p + 188 - payload) < 0)
+		return -1;
+	return 0;
+}
+
+int ts_demux_feed(struct ts_demux *ts, const uint8_t *buf, size_t size)
+{
+	uint16_t found[FILTER_BATCH];
+	size_t numpackets = size / TS_PACKET_SIZE;
+	for(size_t first = 0; first < numpackets; first += FILTER_BATCH)
+	{
+		const uint8_t *batch = buf + first * TS_PACKET_SIZE;
+		size_t n = numpackets - first < FILTER_BATCH ? numpackets - first : FILTER_BATCH;
+		n = ts->filter(ts, batch, n, found);
+		for(size_t i = 0; i < n; i++)
+		{
+			int err = demux_packet(ts, batch + found[i] * TS_PACKET_SIZE);
+			if(err)
+				return err;
+		}
+	}
+	return 0;
+}
+
+int ts_demux_flush(struct ts_demux *ts)
+{
+	for(size_t i = 0; i < ts->numstreams; i++)
+	{
+		int err = emit_pes(ts, ts->streams + i);
+		ts->streams[i].started = 0;
+		if(err)
+			return err;
+	}
+	return 0;
+}
@@ -0,0 +1,75 @@
+/*
+Copyright (C) 2016, 2018 Schnusch
+
+This file is part of bdinfo.
+
+bdinfo is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+bdinfo is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TS_H_INCLUDED
+#define TS_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TS_PACKET_SIZE   192
+#define TS_NO_TIMESTAMP  INT64_C(-1)
+
+/**
+ * A reassembled PES packet. *pts* and *dts* are in 90 kHz ticks or
+ * TS_NO_TIMESTAMP.
+ */
+struct ts_pes {
+	uint16_t       pid;
+	int64_t        pts;
+	int64_t        dts;
+	const uint8_t *data;
+	size_t         size;
+};
+
+/**
+ * Called for every complete PES packet. A non-zero return value stops
+ * demultiplexing and is returned by ts_demux_feed or ts_demux_flush.
+ */
+typedef int (*ts_pes_fn)(const struct ts_pes *pes, void *data);
+
+struct ts_demux;
+
+/**
+ * Create a demultiplexer for the 192-byte source packets of an M2TS stream
+ * that passes the PES packets of all added PIDs to *fn*.
+ */
+struct ts_demux *ts_demux_new(ts_pes_fn fn, void *data);
+
+void ts_demux_free(struct ts_demux *ts);
+
+/**
+ * Reassemble the PES packets of *pid*. Returns 0 or -1 with errno set.
+ */
+int ts_demux_add_pid(struct ts_demux *ts, uint16_t pid);
+
+/**
+ * Demultiplex the *size* bytes in *buf*, which must be a multiple of
+ * TS_PACKET_SIZE. Packets that are not in sync are skipped. The packets of the
+ * added PIDs are found with SSE2 or AVX2 if the CPU supports it and at most 8
+ * PIDs are demultiplexed, unless BDINFO_NO_SIMD is set in the environment.
+ */
+int ts_demux_feed(struct ts_demux *ts, const uint8_t *buf, size_t size);
+
+/**
+ * Pass all pending PES packets to the callback, e.g. at the end of a clip.
+ */
+int ts_demux_flush(struct ts_demux *ts);
+
+#endif
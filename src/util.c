@@ -20,9 +20,11 @@ with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
 #define _GNU_SOURCE
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "util.h"
 
@@ -92,39 +94,138 @@ size_t strcnt(const char *s, int c)
 	return n;
 }
 
-const char *shell_escape(const char *src)
+int buffer_reserve(struct buffer *buf, size_t n)
 {
-	static char *shell = NULL;
-	free(shell);
-	shell = NULL;
+	if(buf->capacity - buf->size >= n)
+		return 0;
+	size_t capacity = buf->capacity > 0 ? buf->capacity : 4096;
+	while(capacity - buf->size < n)
+	{
+		if(capacity > SIZE_MAX / 2)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+		capacity *= 2;
+	}
+	uint8_t *data = realloc(buf->data, capacity);
+	if(!data)
+		return -1;
+	buf->data     = data;
+	buf->capacity = capacity;
+	return 0;
+}
+
+int buffer_append(struct buffer *buf, const void *data, size_t n)
+{
+	if(buffer_reserve(buf, n) < 0)
+		return -1;
+	memcpy(buf->data + buf->size, data, n);
+	buf->size += n;
+	return 0;
+}
+
+struct parallel_for {
+	void          (*fn)(size_t, void *);
+	void           *data;
+	size_t          n;
+	size_t          next;
+	pthread_mutex_t lock;
+};
+
+static void *parallel_for_worker(void *data)
+{
+	struct parallel_for *p = data;
+	while(1)
+	{
+		pthread_mutex_lock(&p->lock);
+		size_t i = p->next;
+		if(i < p->n)
+			p->next++;
+		pthread_mutex_unlock(&p->lock);
+		if(i >= p->n)
+			return NULL;
+		p->fn(i, p->data);
+	}
+}
+
+int parallel_for(size_t n, size_t numthreads, void (*fn)(size_t i, void *data),
+		void *data)
+{
+	struct parallel_for p = {
+		.fn   = fn,
+		.data = data,
+		.n    = n,
+		.next = 0,
+		.lock = PTHREAD_MUTEX_INITIALIZER
+	};
+	if(numthreads > n)
+		numthreads = n;
+	if(numthreads <= 1)
+	{
+		parallel_for_worker(&p);
+		return 0;
+	}
 
+	pthread_t *threads = malloc(numthreads * sizeof(*threads));
+	if(!threads)
+	{
+		// fall back to the calling thread
+		parallel_for_worker(&p);
+		return 0;
+	}
+	size_t started = 0;
+	int err = 0;
+	for(; started < numthreads; started++)
+		if((err = pthread_create(threads + started, NULL, parallel_for_worker, &p)))
+			break;
+	if(started == 0)
+	{
+		free(threads);
+		return err;
+	}
+	for(size_t i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	return 0;
+}
+
+size_t num_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+}
+
+uint64_t fnv1a64(uint64_t h, const void *data, size_t n)
+{
+	const unsigned char *p = data;
+	for(size_t i = 0; i < n; i++)
+	{
+		h ^= p[i];
+		h *= UINT64_C(0x100000001b3);
+	}
+	return h;
+}
+
+int shell_escape(FILE *f, const char *src)
+{
 	size_t n = strlen(src);
 	if(strspn(src, "+,-./0123456789:@ABCDEFGHIJKLMNOPQRSTUVWXYZ_"
 			"abcdefghijklmnopqrstuvwxyz") == n)
-		return src;
+		return fputs(src, f) == EOF ? -1 : 0;
 
-	n += strcnt(src, '\'') * 3 + 3;
-	shell = malloc(n);
-	if(shell)
+	if(fputc('\'', f) == EOF)
+		return -1;
+	for(const char *c; *src; src = c)
 	{
-		char *dst = shell;
-		*dst++ = '\'';
-		do
-		{
-			const char *c = src;
-			if(*src == '\'')
-			{
-				memcpy(dst, "'\\'", 3);
-				dst += 3;
-				c   += 3;
-			}
-			c = strchrnul(c, '\'');
-			dst = mempcpy(dst, src, c - src);
-			src = c;
-		}
-		while(*src != '\0');
-		*dst++ = '\'';
-		*dst   = '\0';
+		c = strchrnul(src, '\'');
+		if(fwrite(src, 1, c - src, f) != (size_t)(c - src))
+			return -1;
+		// a quote ends the quoted string, is escaped, and starts a new one
+		if(*c == '\'' && fputs("'\\''", f) == EOF)
+			return -1;
+		if(*c)
+			c++;
 	}
-	return shell;
+	return fputc('\'', f) == EOF ? -1 : 0;
 }
@@ -21,6 +21,8 @@ with bdinfo.  If not, see <http://www.gnu.org/licenses/>.
 #define UTIL_H_INCLUDED
 
 #include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <unistd.h>
 
 typedef int (*compar_fn)(const void *, const void *);
@@ -67,10 +69,54 @@ char *ticks2time(char buf[22], uint64_t ticks);
 size_t strcnt(const char *s, int c);
 
 /**
- * Escapes a string not solely consisting of [\w-+,./_] for use in an
- * interactive shell.
- * Every call frees the result of the previous call.
+ * Growable byte buffer. Unlike array_reserve its capacity is doubled, so it
+ * suits large buffers that are appended to in small pieces.
  */
-const char *shell_escape(const char *src);
+struct buffer {
+	uint8_t *data;
+	size_t   size;
+	size_t   capacity;
+};
+
+/**
+ * Make room for *n* more bytes in *buf*. Returns 0 or -1 with errno set.
+ */
+int buffer_reserve(struct buffer *buf, size_t n);
+
+/**
+ * Append *n* bytes of *data* to *buf*. Returns 0 or -1 with errno set.
+ */
+int buffer_append(struct buffer *buf, const void *data, size_t n);
+
+/**
+ * Call *fn* for every index in [0, *n*) from up to *numthreads* threads. The
+ * indices are handed out in ascending order.
+ *
+ * Returns 0 or the error number of pthread_create if no thread could be
+ * started, in which case nothing was done.
+ */
+int parallel_for(size_t n, size_t numthreads, void (*fn)(size_t i, void *data),
+		void *data);
+
+/**
+ * Number of online CPUs, at least 1.
+ */
+size_t num_cpus(void);
+
+#define FNV1A64_INIT UINT64_C(0xcbf29ce484222325)
+
+/**
+ * Continue the 64-bit FNV-1a hash *h* over *n* bytes at *data*. Start with
+ * FNV1A64_INIT.
+ */
+uint64_t fnv1a64(uint64_t h, const void *data, size_t n);
+
+/**
+ * Print *src* to *f*, quoted for an interactive shell unless it solely
+ * consists of [\w-+,./:@]. Nothing is allocated, so it is safe in any thread.
+ *
+ * Returns 0 or -1 with errno set.
+ */
+int shell_escape(FILE *f, const char *src);
 
 #endif